@@ -1,6 +1,9 @@
 #include "BVHBuilder.h"
+#include "MeshSimplifier.h"
 #include "timCore/Common.h"
 #include "timCore/flat_hash_map.h"
+#include "timCore/Profiler.h"
+#include "timCore/SimdMath.h"
 
 #include "TriBoxCollision.hpp"
 #include <thread>
@@ -8,13 +11,14 @@
 #include <map>
 #include <algorithm>
 #include <execution>
+#include <cfloat>
 #include "shaders/struct_cpp.glsl"
 
 #define INLINE_TRIANGLES 1
 #define INLINE_STRIPS    0
 
 template<>
-struct ::std::hash<tim::Edge>
+struct std::hash<tim::Edge>
 {
     std::size_t operator()(tim::Edge e) const noexcept
     {
@@ -29,6 +33,28 @@ namespace tim
         constexpr u32 g_MaxMaterialCount = 1u << 16;
         constexpr u32 g_MaxNodeCount = NID_MASK;
         constexpr u32 g_MaxPrimitiveCount = (1u << 16) - 1;
+        // Triangle count of a LOD relative to the previous level, a level not reaching g_LodMinReduction ends the chain
+        constexpr float g_LodTriangleRatio = 0.25f;
+        constexpr float g_LodMinReduction = 0.8f;
+        // A refit tree whose SAH cost grew past this ratio is rebuilt
+        constexpr float g_RefitRebuildCostRatio = 1.5f;
+        // Room left in the packed buffer for the incremental edits of the top level tree
+        constexpr u32 g_NodeReserve = 512;
+        constexpr u32 g_LeafDataReserve = 4096; // u32
+        constexpr u32 g_PrimitiveReserve = 64;
+        // Room left in the packed buffer of a top level tree for the blas inserted later, a bigger blas triggers a repack
+        constexpr u32 g_BlasInstanceReserve = 16;
+        constexpr u32 g_BlasTriangleReserve = 16384;
+        constexpr u32 g_BlasNodeReserve = 4096;
+        constexpr u32 g_BlasMaterialReserve = 256;
+        constexpr u32 g_BlasLeafDataReserve = 16384; // u32
+        // The bit stack of the traversal shaders holds one bit per level
+        constexpr u32 g_MaxTraversalDepth = 32;
+
+        u32 blasReserve(bool _isTlas, u32 _reserve)
+        {
+            return _isTlas ? _reserve : 0;
+        }
 
         CollisionType sphereBoxCollision(const Sphere& _sphere, const Box& _box)
         {
@@ -89,6 +115,17 @@ namespace tim
             return _box.minExtent.x <= _box.maxExtent.x && _box.minExtent.y <= _box.maxExtent.y && _box.minExtent.z <= _box.maxExtent.z;
         }
 
+        Box getEmptyBox()
+        {
+            return { vec3(std::numeric_limits<float>::max()), vec3(-std::numeric_limits<float>::max()) };
+        }
+
+        double getBoxArea(const Box& _box)
+        {
+            vec3 dim = _box.maxExtent - _box.minExtent;
+            return 2.0 * (double(dim.x) * dim.y + double(dim.y) * dim.z + double(dim.z) * dim.x);
+        }
+
         Sphere getBoundingSphere(const Light& _light)
         {
             switch (_light.type)
@@ -127,6 +164,36 @@ namespace tim
         }
     }
 
+    void BVHBuilder::queryPrimitives(const Box& _box, std::vector<u32>& _result) const
+    {
+        _result.clear();
+        if (m_nodes.empty())
+            return;
+
+        std::vector<const Node*> stack = { m_nodes[0].get() };
+        while (!stack.empty())
+        {
+            const Node* node = stack.back();
+            stack.pop_back();
+            if (boxBoxCollision(node->extent, _box) == CollisionType::Disjoint)
+                continue;
+
+            for (u32 prim : node->primitiveList)
+            {
+                if (!m_removedPrimitives.count(prim) && primitiveBoxCollision(m_objects[prim], _box) != CollisionType::Disjoint)
+                    _result.push_back(prim);
+            }
+
+            if (node->left)
+                stack.push_back(node->left);
+            if (node->right)
+                stack.push_back(node->right);
+        }
+
+        std::sort(_result.begin(), _result.end());
+        _result.erase(std::unique(_result.begin(), _result.end()), _result.end());
+    }
+
     CollisionType BVHBuilder::primitiveSphereCollision(const Primitive& _prim, const Sphere& _sphere) const
     {
         switch (_prim.type)
@@ -174,6 +241,9 @@ namespace tim
         }
     }
 
+    // BoxA loads the min and max extents as 6 contiguous floats
+    static_assert(offsetof(Box, maxExtent) == sizeof(vec3) && sizeof(Box) == 2 * sizeof(vec3));
+
     Box mergeBox(const Box& _b1, const Box& _b2)
     {
         Box box;
@@ -380,24 +450,36 @@ namespace tim
         m_params = _params;
     }
 
-    void BVHBuilder::buildBlas(const BVHBuildParameters& _params)
+    void BVHBuilder::buildBlas(const BVHBuildParameters& _params, BVHCache* _cache)
     {
+        TIM_PROFILE_SCOPE("BVH build blas");
 #ifdef _DEBUG
         std::for_each(std::execution::seq, m_blas.begin(), m_blas.end(),
 #else
         std::for_each(std::execution::par, m_blas.begin(), m_blas.end(),
             // std::for_each(std::execution::seq, m_blas.begin(), m_blas.end(),
 #endif
-            [&_params](auto& blas)
+            [&_params, _cache](auto& blas)
             {
-                blas->setParameters(_params);
-                blas->build(true);
+                buildBlasLevels(*blas, _params, _cache);
                 blas->dumpStats();
             });
 
         // std::for_each(std::execution::seq, m_blas.begin(), m_blas.end(), [](auto& blas) { blas->dumpStats(); });
     }
 
+    void BVHBuilder::buildBlasLevels(BVHBuilder& _blas, const BVHBuildParameters& _params, BVHCache* _cache)
+    {
+        _blas.setParameters(_params);
+        _blas.build(true, _cache);
+
+        for (auto& lod : _blas.m_lods)
+        {
+            lod->setParameters(_params);
+            lod->build(true, _cache);
+        }
+    }
+
     static Box adjustAABB(Box _box)
     {
         _box.maxExtent += vec3(float(1e-6));
@@ -405,9 +487,25 @@ namespace tim
         return _box;
     }
 
-    void BVHBuilder::build(bool _useMultipleThreads)
+    void BVHBuilder::build(bool _useMultipleThreads, BVHCache* _cache)
     {
+        TIM_PROFILE_SCOPE("BVH build tree");
         m_stats = {};
+        m_refit.reset();
+        m_freeNodePairs.clear();
+        m_packedNodeOffset = 0;
+        m_packedTriangleOffset = 0;
+
+        BVHCache::Key cacheKey;
+        if (_cache)
+        {
+            cacheKey = computeCacheKey();
+            if (loadFromCache(*_cache, cacheKey))
+            {
+                m_lodMeshes.clear();
+                return;
+            }
+        }
 
         m_nodes.clear();
         m_nodes.push_back(std::make_unique<Node>(0));
@@ -419,6 +517,9 @@ namespace tim
                          { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() } };
         for (u32 i = 0; i < m_objects.size(); ++i)
         {
+            if (m_removedPrimitives.count(i))
+                continue;
+
             Box box = getAABB(m_objects[i]);
             tightBox.minExtent = linalg::min_(tightBox.minExtent, box.minExtent);
             tightBox.maxExtent = linalg::max_(tightBox.maxExtent, box.maxExtent);
@@ -433,6 +534,9 @@ namespace tim
         for (u32 i = 0; i < m_blasInstances.size(); ++i)
         {
             m_blasInstances[i].aabb = m_blas[m_blasInstances[i].blasId]->getAABB();
+            if (m_removedBlasInstances.count(i))
+                continue;
+
             tightBox.minExtent = linalg::min_(tightBox.minExtent, m_blasInstances[i].aabb.minExtent);
             tightBox.maxExtent = linalg::max_(tightBox.maxExtent, m_blasInstances[i].aabb.maxExtent);
         }
@@ -442,22 +546,260 @@ namespace tim
         m_meanTriangleSize /= m_triangles.size();
         m_meanTriangleSize *= m_params.expandNodeDimensionFactor;
 
-        std::vector<u32> objectsIds(m_objects.size());
+        // Removed items keep their slot until an insertion reuses it
+        std::vector<u32> objectsIds;
         for (u32 i = 0; i < m_objects.size(); ++i)
-            objectsIds[i] = i;
+        {
+            if (!m_removedPrimitives.count(i))
+                objectsIds.push_back(i);
+        }
 
         std::vector<u32> triangleIds(m_triangles.size());
         for (u32 i = 0; i < m_triangles.size(); ++i)
             triangleIds[i] = i;
 
-        std::vector<u32> blasIds(m_blasInstances.size());
+        std::vector<u32> blasIds;
         for (u32 i = 0; i < m_blasInstances.size(); ++i)
-            blasIds[i] = i;
+        {
+            if (!m_removedBlasInstances.count(i))
+                blasIds.push_back(i);
+        }
 
-        const u32 numItems = u32(m_objects.size() + m_triangles.size() + m_blasInstances.size());
+        const u32 numItems = u32(objectsIds.size() + triangleIds.size() + blasIds.size());
         addObjectsRec(0, numItems, objectsIds.begin(), objectsIds.end(), triangleIds.begin(), triangleIds.end(), blasIds.begin(), blasIds.end(), m_nodes[0].get(), _useMultipleThreads);
 
         TIM_ASSERT(m_nodes.size() < g_MaxNodeCount);
+
+        if (_cache)
+            saveToCache(*_cache, cacheKey);
+        m_lodMeshes.clear();
+    }
+
+    // Cached triangles and strips are stored relative to the first vertex of the builder, so moving the mesh in the geometry buffer keeps its entry valid
+    u32 BVHBuilder::getBaseVertexOffset() const
+    {
+        u32 base = u32(-1);
+        for (const Triangle& tri : m_triangles)
+            base = std::min(base, tri.vertexOffset);
+        return m_triangles.empty() ? 0 : base;
+    }
+
+    BVHCache::Key BVHBuilder::computeCacheKey() const
+    {
+        BVHCache::Key key;
+        key.add(BVHCacheHeader::Version);
+        key.add(m_isTlas);
+        key.add(m_params);
+
+        const u32 baseVertexOffset = getBaseVertexOffset();
+        key.add(u32(m_triangles.size()));
+        for (const Triangle& tri : m_triangles)
+        {
+            key.add(tri.vertexOffset - baseVertexOffset);
+            key.add(tri.index01);
+            key.add(tri.index2_matId);
+            const vec3 positions[3] = { m_geometryBuffer.getVertexPosition(tri.vertexOffset, tri.index01 & 0xFFFF),
+                                        m_geometryBuffer.getVertexPosition(tri.vertexOffset, tri.index01 >> 16),
+                                        m_geometryBuffer.getVertexPosition(tri.vertexOffset, tri.index2_matId & 0xFFFF) };
+            key.add(positions);
+        }
+
+        key.add(u32(m_triangleMaterials.size()));
+        key.add(m_triangleMaterials.data(), m_triangleMaterials.size() * sizeof(Material));
+
+        key.add(u32(m_objects.size()));
+        for (const Primitive& prim : m_objects)
+        {
+            key.add(prim.type);
+            if (prim.type == Primitive_Sphere)
+                key.add(prim.m_sphere);
+            else
+                key.add(prim.m_aabb);
+        }
+
+        key.add(u32(m_lights.size()));
+        for (const Light& light : m_lights)
+        {
+            key.add(light.type);
+            if (light.type == Light_Sphere)
+                key.add(light.m_sphere);
+            else
+                key.add(light.m_area);
+        }
+
+        key.add(u32(m_blasInstances.size()));
+        for (const BlasInstance& instance : m_blasInstances)
+        {
+            key.add(instance.blasId);
+            key.add(m_blas[instance.blasId]->getAABB());
+        }
+
+        return key;
+    }
+
+    static u64 getCacheEntrySize(const BVHCacheHeader& _header)
+    {
+        return sizeof(BVHCacheHeader) + u64(_header.numNodes) * sizeof(BVHCacheNode) + u64(_header.numListItems) * sizeof(u32) + u64(_header.numStrips) * sizeof(TriangleStrip) +
+               u64(_header.numLodMeshes) * sizeof(BVHCacheLodMesh) + u64(_header.numLodItems) * sizeof(u32);
+    }
+
+    bool BVHBuilder::loadFromCache(BVHCache& _cache, const BVHCache::Key& _key)
+    {
+        MappedFile file;
+        if (!_cache.load(_key, file))
+            return false;
+
+        // An entry without the LOD meshes generateLods is waiting to store is rebuilt
+        const BVHCacheHeader& header = *reinterpret_cast<const BVHCacheHeader*>(file.data());
+        if (header.numNodes == 0 || file.size() != getCacheEntrySize(header) || header.numTriangles != m_triangles.size() || header.numObjects != m_objects.size() ||
+            header.numLights != m_lights.size() || header.numBlasInstances != m_blasInstances.size() || (!m_lodMeshes.empty() && header.numLodMeshes != m_lodMeshes.size()))
+            return false;
+
+        const BVHCacheNode* cachedNodes = reinterpret_cast<const BVHCacheNode*>(file.data() + sizeof(BVHCacheHeader));
+        const u32* listItems = reinterpret_cast<const u32*>(cachedNodes + header.numNodes);
+        const TriangleStrip* strips = reinterpret_cast<const TriangleStrip*>(listItems + header.numListItems);
+
+        m_nodes.clear();
+        m_nodes.reserve(header.numNodes);
+        for (u32 i = 0; i < header.numNodes; ++i)
+            m_nodes.push_back(std::make_unique<Node>(i));
+
+        const u32 baseVertexOffset = getBaseVertexOffset();
+        auto getNode = [this](u32 _index) { return _index == u32(-1) ? nullptr : m_nodes[_index].get(); };
+        auto readList = [&listItems](LeafList& _list, u32 _count)
+        {
+            _list.assign(listItems, listItems + _count);
+            listItems += _count;
+        };
+
+        for (u32 i = 0; i < header.numNodes; ++i)
+        {
+            const BVHCacheNode& cachedNode = cachedNodes[i];
+            Node& node = *m_nodes[i];
+            node.extent = cachedNode.extent;
+            node.parent = getNode(cachedNode.parent);
+            node.sibling = getNode(cachedNode.sibling);
+            node.left = getNode(cachedNode.left);
+            node.right = getNode(cachedNode.right);
+
+            readList(node.primitiveList, cachedNode.numPrimitives);
+            readList(node.triangleList, cachedNode.numTriangles);
+            readList(node.lightList, cachedNode.numLights);
+            readList(node.blasList, cachedNode.numBlas);
+
+            node.strips.assign(strips, strips + cachedNode.numStrips);
+            strips += cachedNode.numStrips;
+            for (TriangleStrip& strip : node.strips)
+                strip.vertexOffset += baseVertexOffset;
+        }
+
+        m_aabb = header.aabb;
+        m_meanTriangleSize = header.meanTriangleSize;
+        for (BlasInstance& instance : m_blasInstances)
+            instance.aabb = m_blas[instance.blasId]->getAABB();
+
+        std::cout << "BVH " << m_name << " loaded from cache (" << header.numNodes << " nodes)\n";
+        return true;
+    }
+
+    void BVHBuilder::saveToCache(BVHCache& _cache, const BVHCache::Key& _key) const
+    {
+        BVHCacheHeader header;
+        _key.get(header.key);
+        header.numNodes = u32(m_nodes.size());
+        header.numTriangles = u32(m_triangles.size());
+        header.numObjects = u32(m_objects.size());
+        header.numLights = u32(m_lights.size());
+        header.numBlasInstances = u32(m_blasInstances.size());
+        header.aabb = m_aabb;
+        header.meanTriangleSize = m_meanTriangleSize;
+
+        std::vector<BVHCacheNode> cachedNodes(m_nodes.size());
+        std::vector<u32> listItems;
+        std::vector<TriangleStrip> strips;
+
+        const u32 baseVertexOffset = getBaseVertexOffset();
+        auto getIndex = [](const Node* _node) { return _node ? _node->nid : u32(-1); };
+        for (size_t i = 0; i < m_nodes.size(); ++i)
+        {
+            const Node& node = *m_nodes[i];
+            TIM_ASSERT(node.nid == i);
+
+            cachedNodes[i] = { node.extent, getIndex(node.parent), getIndex(node.sibling), getIndex(node.left), getIndex(node.right),
+                               u32(node.primitiveList.size()), u32(node.triangleList.size()), u32(node.lightList.size()), u32(node.blasList.size()), u32(node.strips.size()) };
+
+            listItems.insert(listItems.end(), node.primitiveList.begin(), node.primitiveList.end());
+            listItems.insert(listItems.end(), node.triangleList.begin(), node.triangleList.end());
+            listItems.insert(listItems.end(), node.lightList.begin(), node.lightList.end());
+            listItems.insert(listItems.end(), node.blasList.begin(), node.blasList.end());
+            for (TriangleStrip strip : node.strips)
+            {
+                strip.vertexOffset -= baseVertexOffset;
+                strips.push_back(strip);
+            }
+        }
+
+        std::vector<BVHCacheLodMesh> lodMeshes;
+        std::vector<u32> lodItems;
+        for (const SimplifiedMesh& mesh : m_lodMeshes)
+        {
+            lodMeshes.push_back({ u32(mesh.groups.size()), mesh.error });
+            lodItems.insert(lodItems.end(), mesh.indices.begin(), mesh.indices.end());
+            lodItems.insert(lodItems.end(), mesh.groups.begin(), mesh.groups.end());
+        }
+
+        header.numListItems = u32(listItems.size());
+        header.numStrips = u32(strips.size());
+        header.numLodMeshes = u32(lodMeshes.size());
+        header.numLodItems = u32(lodItems.size());
+
+        std::vector<ubyte> data(getCacheEntrySize(header));
+        ubyte* out = data.data();
+        auto write = [&out](const void* _src, size_t _size)
+        {
+            if (_size > 0)
+                memcpy(out, _src, _size);
+            out += _size;
+        };
+
+        write(&header, sizeof(header));
+        write(cachedNodes.data(), cachedNodes.size() * sizeof(BVHCacheNode));
+        write(listItems.data(), listItems.size() * sizeof(u32));
+        write(strips.data(), strips.size() * sizeof(TriangleStrip));
+        write(lodMeshes.data(), lodMeshes.size() * sizeof(BVHCacheLodMesh));
+        write(lodItems.data(), lodItems.size() * sizeof(u32));
+
+        if (!_cache.save(_key, data))
+            std::cout << "Failed to write BVH " << m_name << " to the cache\n";
+    }
+
+    bool BVHBuilder::loadLodMeshesFromCache(BVHCache& _cache, const BVHCache::Key& _key, u32 _numLodMeshes)
+    {
+        MappedFile file;
+        if (!_cache.load(_key, file))
+            return false;
+
+        const BVHCacheHeader& header = *reinterpret_cast<const BVHCacheHeader*>(file.data());
+        if (file.size() != getCacheEntrySize(header) || header.numTriangles != m_triangles.size() || header.numLodMeshes != _numLodMeshes)
+            return false;
+
+        const ubyte* lodSection = file.data() + getCacheEntrySize(header) - u64(header.numLodMeshes) * sizeof(BVHCacheLodMesh) - u64(header.numLodItems) * sizeof(u32);
+        const BVHCacheLodMesh* cachedMeshes = reinterpret_cast<const BVHCacheLodMesh*>(lodSection);
+        const u32* lodItems = reinterpret_cast<const u32*>(cachedMeshes + header.numLodMeshes);
+
+        m_lodMeshes.resize(_numLodMeshes);
+        for (u32 i = 0; i < _numLodMeshes; ++i)
+        {
+            SimplifiedMesh& mesh = m_lodMeshes[i];
+            mesh.indices.assign(lodItems, lodItems + cachedMeshes[i].numTriangles * 3);
+            lodItems += cachedMeshes[i].numTriangles * 3;
+            mesh.groups.assign(lodItems, lodItems + cachedMeshes[i].numTriangles);
+            lodItems += cachedMeshes[i].numTriangles;
+            mesh.error = cachedMeshes[i].error;
+        }
+
+        std::cout << "LODs of " << m_name << " loaded from cache\n";
+        return true;
     }
 
     void BVHBuilder::computeSceneAABB()
@@ -466,6 +808,9 @@ namespace tim
                          { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() } };
         for (u32 i = 0; i < m_objects.size(); ++i)
         {
+            if (m_removedPrimitives.count(i))
+                continue;
+
             Box box = getAABB(m_objects[i]);
             tightBox.minExtent = linalg::min_(tightBox.minExtent, box.minExtent);
             tightBox.maxExtent = linalg::max_(tightBox.maxExtent, box.maxExtent);
@@ -479,6 +824,9 @@ namespace tim
         for (u32 i = 0; i < m_blasInstances.size(); ++i)
         {
             m_blasInstances[i].aabb = m_blas[m_blasInstances[i].blasId]->getAABB();
+            if (m_removedBlasInstances.count(i))
+                continue;
+
             tightBox.minExtent = linalg::min_(tightBox.minExtent, m_blasInstances[i].aabb.minExtent);
             tightBox.maxExtent = linalg::max_(tightBox.maxExtent, m_blasInstances[i].aabb.maxExtent);
         }
@@ -540,7 +888,7 @@ namespace tim
             return u64(ids[0]) + (u64(ids[1]) << 16) + (u64(ids[2]) << 32);
         }
 
-        void removeDuplicates(std::vector<u32>& _triangleIds, const std::vector<Triangle>& _triangles)
+        void removeDuplicates(TaggedVector<u32, MemoryTag::BvhLeafData>& _triangleIds, const TaggedVector<Triangle, MemoryTag::BvhPrimitives>& _triangles)
         {
             std::sort(_triangleIds.begin(), _triangleIds.end(), [&](u32 tri1, u32 tri2)
                 {
@@ -587,7 +935,7 @@ namespace tim
             return strip;
         }
 
-        void fillTriangleStrips(const std::vector<u32>& _triangleIds, const std::vector<Triangle>& _triangles, std::vector<TriangleStrip>& _strips)
+        void fillTriangleStrips(const TaggedVector<u32, MemoryTag::BvhLeafData>& _triangleIds, const TaggedVector<Triangle, MemoryTag::BvhPrimitives>& _triangles, TaggedVector<TriangleStrip, MemoryTag::BvhLeafData>& _strips)
         {
             constexpr u32 MaxTrianglesInStrip = 2;
 
@@ -731,19 +1079,291 @@ namespace tim
     #endif
     }
 
+    template<typename Fun>
+    void BVHBuilder::forEachLeafTriangle(const Fun& _fun) const
+    {
+        if (m_nodes.empty())
+            return;
+
+        std::vector<const Node*> stack = { m_nodes[0].get() };
+        while (!stack.empty())
+        {
+            const Node* node = stack.back();
+            stack.pop_back();
+
+            if (node->left)
+            {
+                stack.push_back(node->right);
+                stack.push_back(node->left);
+            }
+            else
+            {
+                for (u32 tri : node->triangleList)
+                    _fun(node, tri);
+            }
+        }
+    }
+
+    // Mean number of 64 bytes lines of the position stream touched by the triangles of a leaf
+    float BVHBuilder::computeVertexCacheLinesPerLeaf() const
+    {
+        ska::flat_hash_set<u32> lines;
+        const Node* curLeaf = nullptr;
+        u64 numLines = 0;
+        u32 numLeafs = 0;
+
+        forEachLeafTriangle([&](const Node* _leaf, u32 _tri)
+        {
+            if (_leaf != curLeaf)
+            {
+                numLines += lines.size();
+                numLeafs++;
+                lines.clear();
+                curLeaf = _leaf;
+            }
+
+            const Triangle& triangle = m_triangles[_tri];
+            for (u32 i = 0; i < 3; ++i)
+                lines.insert(u32((triangle.vertexOffset + TriangleStripHelpers::getVertex(triangle, i)) * sizeof(vec3) / 64));
+        });
+        numLines += lines.size();
+
+        return numLeafs > 0 ? float(numLines) / numLeafs : 0.f;
+    }
+
+    void BVHBuilder::reorderVertices(BVHGeometry& _geometry)
+    {
+        TIM_PROFILE_SCOPE("BVH reorder vertices");
+        for (auto& blas : m_blas)
+            blas->reorderVertices(_geometry);
+        for (auto& lod : m_lods)
+            lod->reorderVertices(_geometry);
+
+        if (m_triangles.empty())
+            return;
+
+        const float linesBefore = computeVertexCacheLinesPerLeaf();
+
+        // Old to new index of the vertices of each range, in order of first use
+        struct RangeRemap
+        {
+            std::vector<u32> oldToNew;
+            u32 numUsed = 0;
+        };
+        ska::flat_hash_map<u32, RangeRemap> remaps;
+
+        auto touchTriangle = [&](const Triangle& _triangle)
+        {
+            RangeRemap& remap = remaps[_triangle.vertexOffset];
+            if (remap.oldToNew.empty())
+            {
+                const u32 rangeSize = _geometry.getRangeSize(_triangle.vertexOffset);
+                TIM_ASSERT(rangeSize > 0);
+                remap.oldToNew.resize(rangeSize, u32(-1));
+            }
+
+            for (u32 i = 0; i < 3; ++i)
+            {
+                u32& newIndex = remap.oldToNew[TriangleStripHelpers::getVertex(_triangle, i)];
+                if (newIndex == u32(-1))
+                    newIndex = remap.numUsed++;
+            }
+        };
+
+        forEachLeafTriangle([&](const Node*, u32 _tri) { touchTriangle(m_triangles[_tri]); });
+        for (const Triangle& triangle : m_triangles)
+            touchTriangle(triangle);
+
+        std::vector<u32> newToOld;
+        for (auto& [vertexOffset, remap] : remaps)
+        {
+            // Vertices no triangle uses go last
+            for (u32& newIndex : remap.oldToNew)
+            {
+                if (newIndex == u32(-1))
+                    newIndex = remap.numUsed++;
+            }
+
+            newToOld.resize(remap.oldToNew.size());
+            for (u32 i = 0; i < remap.oldToNew.size(); ++i)
+                newToOld[remap.oldToNew[i]] = i;
+
+            _geometry.reorderVertices(vertexOffset, newToOld);
+        }
+
+        auto remapIndex = [&](u32 _vertexOffset, u32 _index) { return remaps[_vertexOffset].oldToNew[_index]; };
+        for (Triangle& triangle : m_triangles)
+        {
+            const u32 v0 = remapIndex(triangle.vertexOffset, TriangleStripHelpers::getVertex(triangle, 0));
+            const u32 v1 = remapIndex(triangle.vertexOffset, TriangleStripHelpers::getVertex(triangle, 1));
+            const u32 v2 = remapIndex(triangle.vertexOffset, TriangleStripHelpers::getVertex(triangle, 2));
+            triangle.index01 = v0 | (v1 << 16);
+            triangle.index2_matId = v2 | (triangle.index2_matId & 0xFFFF0000);
+        }
+
+        for (auto& node : m_nodes)
+        {
+            for (TriangleStrip& strip : node->strips)
+            {
+                auto remapPacked = [&](u32 _packed) { return _packed == 0xFFFF ? 0xFFFF : remapIndex(strip.vertexOffset, _packed); };
+                strip.index01 = remapPacked(strip.index01 & 0xFFFF) | (remapPacked(strip.index01 >> 16) << 16);
+                strip.index2_matId = remapPacked(strip.index2_matId & 0xFFFF) | (strip.index2_matId & 0xFFFF0000);
+                strip.index34 = remapPacked(strip.index34 & 0xFFFF) | (remapPacked(strip.index34 >> 16) << 16);
+            }
+        }
+
+        std::cout << "Vertex reordering of " << m_name << ": " << linesBefore << " -> " << computeVertexCacheLinesPerLeaf() << " position cache lines per leaf\n";
+    }
+
+    void BVHBuilder::generateLods(BVHGeometry& _geometry, const BVHBuildParameters& _params, BVHCache* _cache)
+    {
+        m_lods.clear();
+        m_lodErrors.clear();
+
+        // Each vertex range is simplified on its own so a LOD triangle still indexes a single range
+        std::map<u32, std::vector<u32>> rangeTriangles;
+        for (u32 i = 0; i < m_triangles.size(); ++i)
+            rangeTriangles[m_triangles[i].vertexOffset].push_back(i);
+
+        struct LodJob
+        {
+            u32 vertexOffset;
+            u32 level;
+            const std::vector<u32>* triangles;
+            SimplifiedMesh* result;
+        };
+
+        std::vector<LodJob> jobs;
+        for (const auto& [vertexOffset, triangles] : rangeTriangles)
+        {
+            for (u32 level = 1; level < BLAS_LOD_COUNT; ++level)
+                jobs.push_back({ vertexOffset, level, &triangles, nullptr });
+        }
+
+        // The results are stored with the tree by the build using the same key, the jobs keep their order
+        m_lodMeshes.clear();
+        bool loaded = false;
+        if (_cache)
+        {
+            setParameters(_params);
+            loaded = loadLodMeshesFromCache(*_cache, computeCacheKey(), u32(jobs.size()));
+        }
+
+        m_lodMeshes.resize(jobs.size());
+        for (u32 i = 0; i < jobs.size(); ++i)
+            jobs[i].result = &m_lodMeshes[i];
+
+        // Every level starts from the full resolution triangles, the materials are the simplification groups
+        if (!loaded)
+        {
+            std::for_each(std::execution::par, jobs.begin(), jobs.end(), [&](LodJob& _job)
+            {
+                std::vector<u32> indices;
+                std::vector<u32> groups;
+                for (u32 tri : *_job.triangles)
+                {
+                    for (u32 i = 0; i < 3; ++i)
+                        indices.push_back(TriangleStripHelpers::getVertex(m_triangles[tri], i));
+                    groups.push_back(m_triangles[tri].index2_matId >> 16);
+                }
+
+                const u32 numTriangle = u32(groups.size());
+                const u32 targetTriangleCount = u32(numTriangle * std::pow(g_LodTriangleRatio, float(_job.level)));
+                simplifyMesh(_geometry.getPositions() + _job.vertexOffset, _geometry.getRangeSize(_job.vertexOffset), indices.data(), groups.data(), numTriangle,
+                             targetTriangleCount, FLT_MAX, *_job.result);
+            });
+        }
+
+        u32 prevTriangleCount = u32(m_triangles.size());
+        float prevError = 0;
+        std::vector<u32> remap;
+        std::vector<u32> usedVertices;
+
+        for (u32 level = 1; level < BLAS_LOD_COUNT; ++level)
+        {
+            u32 triangleCount = 0;
+            float error = prevError;
+            for (const LodJob& job : jobs)
+            {
+                if (job.level == level)
+                {
+                    triangleCount += u32(job.result->groups.size());
+                    error = std::max(error, job.result->error);
+                }
+            }
+
+            // The locked vertices (borders, seams) stop the simplification
+            if (triangleCount == 0 || triangleCount > prevTriangleCount * g_LodMinReduction)
+                break;
+
+            auto lod = std::make_unique<BVHBuilder>(m_name + "_lod" + std::to_string(level), m_geometryBuffer, false);
+            lod->m_triangleMaterials = m_triangleMaterials;
+
+            for (const LodJob& job : jobs)
+            {
+                if (job.level != level || job.result->groups.empty())
+                    continue;
+
+                // Copy the vertices the level still uses in a range of its own
+                remap.assign(_geometry.getRangeSize(job.vertexOffset), u32(-1));
+                usedVertices.clear();
+                for (u32 index : job.result->indices)
+                {
+                    if (remap[index] == u32(-1))
+                    {
+                        remap[index] = u32(usedVertices.size());
+                        usedVertices.push_back(index);
+                    }
+                }
+
+                const u32 vertexOffset = _geometry.allocateVertices(u32(usedVertices.size()));
+                vec3 *srcPositions, *srcNormals, *dstPositions, *dstNormals;
+                vec2 *srcTexCoords, *dstTexCoords;
+                _geometry.getVertexStreams(job.vertexOffset, srcPositions, srcNormals, srcTexCoords);
+                _geometry.getVertexStreams(vertexOffset, dstPositions, dstNormals, dstTexCoords);
+                for (u32 i = 0; i < usedVertices.size(); ++i)
+                {
+                    dstPositions[i] = srcPositions[usedVertices[i]];
+                    dstNormals[i] = srcNormals[usedVertices[i]];
+                    dstTexCoords[i] = srcTexCoords[usedVertices[i]];
+                }
+
+                BVHGeometry::TriangleData triangle;
+                triangle.vertexOffset = vertexOffset;
+                for (u32 i = 0; i < job.result->groups.size(); ++i)
+                {
+                    for (u32 j = 0; j < 3; ++j)
+                        triangle.index[j] = uint16_t(remap[job.result->indices[i * 3 + j]]);
+                    lod->addTriangle(triangle, job.result->groups[i]);
+                }
+            }
+
+            std::cout << "LOD " << level << " of " << m_name << ": " << triangleCount << " triangles, error " << error << "\n";
+            m_lods.push_back(std::move(lod));
+            m_lodErrors.push_back(error);
+            prevTriangleCount = triangleCount;
+            prevError = error;
+        }
+    }
+
     void BVHBuilder::fillLeafData(Node* _curNode, u32 _depth, ObjectIt _objectsBegin, ObjectIt _objectsEnd, ObjectIt _trianglesBegin, ObjectIt _trianglesEnd, ObjectIt _blasBegin, ObjectIt _blasEnd)
     {
         const u32 numBlasAndObj = u32(std::distance(_blasBegin, _blasEnd) + std::distance(_objectsBegin, _objectsEnd));
 
-        for (auto it = _objectsBegin; it != _objectsEnd && _curNode->primitiveList.size() < (1u << PrimitiveBitCount); ++it)
+        // addObjectsRec splits the nodes holding too many items for the packed counts
+        TIM_ASSERT(std::distance(_objectsBegin, _objectsEnd) < (1 << PrimitiveBitCount));
+        TIM_ASSERT(std::distance(_trianglesBegin, _trianglesEnd) < (1 << TriangleBitCount));
+        TIM_ASSERT(std::distance(_blasBegin, _blasEnd) < (1 << BlasBitCount));
+
+        for (auto it = _objectsBegin; it != _objectsEnd; ++it)
             _curNode->primitiveList.push_back(*it);
 
-        for (auto it = _trianglesBegin; it != _trianglesEnd && _curNode->triangleList.size() < (1u << TriangleBitCount); ++it)
+        for (auto it = _trianglesBegin; it != _trianglesEnd; ++it)
             _curNode->triangleList.push_back(*it);
 
         TriangleStripHelpers::removeDuplicates(_curNode->triangleList, m_triangles);
 
-        for (auto it = _blasBegin; it != _blasEnd && _curNode->blasList.size() < (1u << BlasBitCount); ++it)
+        for (auto it = _blasBegin; it != _blasEnd; ++it)
             _curNode->blasList.push_back(*it);
 
         for (u32 i = 0; i < m_lights.size() && _curNode->lightList.size() < (1u << LightBitCount); ++i)
@@ -771,8 +1391,14 @@ namespace tim
 
         u32 numObjects = u32(std::distance(_objectsBegin, _objectsEnd) + std::distance(_trianglesBegin, _trianglesEnd) + std::distance(_blasBegin, _blasEnd));
 
+        // The leaf counts are packed in a single u32, a leaf holding more items is split whatever the parameters
+        const bool leafOverflows = std::distance(_trianglesBegin, _trianglesEnd) >= (1 << TriangleBitCount) ||
+                                   std::distance(_objectsBegin, _objectsEnd) >= (1 << PrimitiveBitCount) ||
+                                   std::distance(_blasBegin, _blasEnd) >= (1 << BlasBitCount);
+        const bool forceSplit = _numUniqueItems <= m_params.minObjPerNode || _depth >= m_params.maxDepth;
+
         // Fill leafs
-        if (_numUniqueItems <= m_params.minObjPerNode || _depth >= m_params.maxDepth)
+        if (forceSplit && !leafOverflows)
         {
             fillLeafData(_curNode, _depth, _objectsBegin, _objectsEnd, _trianglesBegin, _trianglesEnd, _blasBegin, _blasEnd);
             return;
@@ -781,8 +1407,13 @@ namespace tim
         {
             constexpr u32 selectBestSplitItemCountThreshold = 1024;
             SplitData bestSplit;
-            
-            if (numObjects < selectBestSplitItemCountThreshold)
+            bool useMedianSplit = forceSplit;
+
+            if (forceSplit)
+            {
+                TIM_ASSERT(_depth + 1 < g_MaxTraversalDepth);
+            }
+            else if (numObjects < selectBestSplitItemCountThreshold)
             {
                 SplitData splitData[3];
                 searchBestSplit(_curNode, _objectsBegin, _objectsEnd, _trianglesBegin, _trianglesEnd, _blasBegin, _blasEnd,
@@ -832,13 +1463,17 @@ namespace tim
             //    __debugbreak();
             //}
 
-            if (_depth > 0)
+            if (_depth > 0 && !forceSplit)
             {
                 if (numObjects - bestSplit.numItemsLeft < m_params.minObjGain && numObjects - bestSplit.numItemsRight < m_params.minObjGain ||
                     bestSplit.numUniqueItemsLeft == 0 || bestSplit.numUniqueItemsRight == 0)
                 {
-                    fillLeafData(_curNode, _depth, _objectsBegin, _objectsEnd, _trianglesBegin, _trianglesEnd, _blasBegin, _blasEnd);
-                    return;
+                    if (!leafOverflows)
+                    {
+                        fillLeafData(_curNode, _depth, _objectsBegin, _objectsEnd, _trianglesBegin, _trianglesEnd, _blasBegin, _blasEnd);
+                        return;
+                    }
+                    useMedianSplit = true;
                 }
             }
 
@@ -846,7 +1481,10 @@ namespace tim
             fillLeafData(_curNode, _depth, _objectsEnd, _objectsEnd, _trianglesEnd, _trianglesEnd, _blasEnd, _blasEnd);
 
             SplitData bestSplitData;
-            fillSplitData<true>(bestSplitData, _curNode->extent, bestSplit.leftBox, bestSplit.rightBox, _objectsBegin, _objectsEnd, _trianglesBegin, _trianglesEnd, _blasBegin, _blasEnd);
+            if (useMedianSplit)
+                fillMedianSplit(bestSplitData, _curNode->extent, _objectsBegin, _objectsEnd, _trianglesBegin, _trianglesEnd, _blasBegin, _blasEnd);
+            else
+                fillSplitData<true>(bestSplitData, _curNode->extent, bestSplit.leftBox, bestSplit.rightBox, _objectsBegin, _objectsEnd, _trianglesBegin, _trianglesEnd, _blasBegin, _blasEnd);
 
             m_mutex.lock();
             m_nodes.push_back(std::make_unique<Node>(m_nodes.size()));
@@ -904,16 +1542,16 @@ namespace tim
 
             if (m_isTlas)
             {
-                auto mergeCommonItems = [](std::vector<u32>& _left, std::vector<u32>& _right)
+                auto mergeCommonItems = [](LeafList& _left, LeafList& _right)
                 {
                     std::sort(_left.begin(), _left.end());
                     std::sort(_right.begin(), _right.end());
-                    std::vector<u32> commonItems(std::min(_right.size(), _left.size()));
+                    LeafList commonItems(std::min(_right.size(), _left.size()));
                     auto it = std::set_intersection(_left.begin(), _left.end(), _right.begin(), _right.end(), commonItems.begin());
 
                     commonItems.resize(std::distance(commonItems.begin(), it));
-                    std::vector<u32> newLeft; newLeft.reserve(_left.size() - commonItems.size());
-                    std::vector<u32> newRight; newRight.reserve(_right.size() - commonItems.size());
+                    LeafList newLeft; newLeft.reserve(_left.size() - commonItems.size());
+                    LeafList newRight; newRight.reserve(_right.size() - commonItems.size());
 
                     auto itLeft = _left.begin();
                     auto itRight = _right.begin();
@@ -941,28 +1579,64 @@ namespace tim
         }
     }
 
-    static float computeMaxDistanceBetweenBoxDimensions(const Box& _box1, const Box& _box2)
+    void BVHBuilder::fillMedianSplit(SplitData& _splitData, const Box& _parentBox, ObjectIt _objectsBegin, ObjectIt _objectsEnd,
+                                     ObjectIt _trianglesBegin, ObjectIt _trianglesEnd, ObjectIt _blasBegin, ObjectIt _blasEnd) const
     {
-        vec3 dim1 = _box1.maxExtent - _box1.minExtent;
-        vec3 dim2 = _box2.maxExtent - _box2.minExtent;
+        // Sorting the item centers along the longest axis always halves the counts, even for flat or stacked items
+        const vec3 dim = _parentBox.maxExtent - _parentBox.minExtent;
+        const u32 axis = dim.x >= dim.y && dim.x >= dim.z ? 0 : (dim.y >= dim.z ? 1 : 2);
+
+        Box leftBox = getEmptyBox(), rightBox = getEmptyBox();
+        auto split = [&](ObjectIt _begin, ObjectIt _end, std::vector<u32>& _left, std::vector<u32>& _right, auto&& _getAABB)
+        {
+            const ObjectIt median = _begin + std::distance(_begin, _end) / 2;
+            std::nth_element(_begin, median, _end, [&](u32 _a, u32 _b)
+            {
+                const Box a = _getAABB(_a), b = _getAABB(_b);
+                return a.minExtent[axis] + a.maxExtent[axis] < b.minExtent[axis] + b.maxExtent[axis];
+            });
+
+            _left.assign(_begin, median);
+            _right.assign(median, _end);
+            for (u32 id : _left)
+                leftBox = mergeBox(leftBox, _getAABB(id));
+            for (u32 id : _right)
+                rightBox = mergeBox(rightBox, _getAABB(id));
+        };
 
-        return linalg::maxelem(linalg::abs(dim1 - dim2));
+        split(_objectsBegin, _objectsEnd, _splitData.objectLeft, _splitData.objectRight, [&](u32 _id) { return getAABB(m_objects[_id]); });
+        split(_trianglesBegin, _trianglesEnd, _splitData.triangleLeft, _splitData.triangleRight, [&](u32 _id) { return getAABB(m_triangles[_id]); });
+        split(_blasBegin, _blasEnd, _splitData.blasLeft, _splitData.blasRight, [&](u32 _id) { return m_blasInstances[_id].aabb; });
+
+        _splitData.leftBox = intersectionBox(leftBox, _parentBox);
+        _splitData.rightBox = intersectionBox(rightBox, _parentBox);
+        _splitData.numItemsLeft = _splitData.numUniqueItemsLeft = u32(_splitData.objectLeft.size() + _splitData.triangleLeft.size() + _splitData.blasLeft.size());
+        _splitData.numItemsRight = _splitData.numUniqueItemsRight = u32(_splitData.objectRight.size() + _splitData.triangleRight.size() + _splitData.blasRight.size());
+    }
+
+    static float computeMaxDistanceBetweenBoxDimensions(const BoxA& _box1, const BoxA& _box2)
+    {
+        vec3 diff = ((_box1.maxExtent - _box1.minExtent) - (_box2.maxExtent - _box2.minExtent)).toVec3();
+        return linalg::maxelem(linalg::abs(diff));
     }
 
     template<bool FillItems>
     void BVHBuilder::fillSplitData(SplitData& _splitData, const Box& parentBox, const Box& leftBox, const Box& rightBox,
                                    ObjectIt _objectsBegin, ObjectIt _objectsEnd, ObjectIt _trianglesBegin, ObjectIt _trianglesEnd, ObjectIt _blasBegin, ObjectIt _blasEnd) const
     {
-        _splitData.leftBox = leftBox;
-        _splitData.rightBox = rightBox;
+        // The boxes stay in registers for all the items, see the split update rows of -benchSimdMath
+        const BoxA parentBoxA = BoxA::load(&parentBox.minExtent);
+        const BoxA leftBoxA = BoxA::load(&leftBox.minExtent);
+        const BoxA rightBoxA = BoxA::load(&rightBox.minExtent);
 
-        const float leftVolume = getBoxVolume(leftBox);
-        const float rightVolume = getBoxVolume(rightBox);
+        const float leftVolume = getBoxVolume(leftBoxA);
+        const float rightVolume = getBoxVolume(rightBoxA);
 
         // This vars are only used if FillItems
         bool isLeftBoxInitialized = false;
         bool isRightBoxInitialized = false;
-        Box curLeftBox = leftBox, curRightBox = rightBox;
+        BoxA splitLeftBox = leftBoxA, splitRightBox = rightBoxA;
+        BoxA curLeftBox = leftBoxA, curRightBox = rightBoxA;
 
         auto processObject = [&](auto _fillItems, std::vector<u32>& _itemsLeft, std::vector<u32>& _itemsRight, 
                                  ObjectIt _begin, ObjectIt _end, auto&& _collideObj, auto&& _getAABB)
@@ -972,7 +1646,8 @@ namespace tim
                 bool collideLeft = _collideObj(it, leftBox) != CollisionType::Disjoint;
                 bool collideRight = _collideObj(it, rightBox) != CollisionType::Disjoint;
 
-                Box aabb = _getAABB(it);
+                const Box itemBox = _getAABB(it);
+                const BoxA aabb = BoxA::load(&itemBox.minExtent);
 
                 if (!collideLeft && collideRight)
                 {
@@ -982,7 +1657,7 @@ namespace tim
                     if constexpr (_fillItems)
                     {
                         _itemsRight.push_back(*it);
-                        _splitData.rightBox = intersectionBox(isRightBoxInitialized ? mergeBox(aabb, _splitData.rightBox) : aabb, curRightBox);
+                        splitRightBox = intersectionBox(isRightBoxInitialized ? mergeBox(aabb, splitRightBox) : aabb, curRightBox);
                         isRightBoxInitialized = true;
                     }
                 }
@@ -994,7 +1669,7 @@ namespace tim
                     if constexpr (_fillItems)
                     {
                         _itemsLeft.push_back(*it);
-                        _splitData.leftBox = intersectionBox(isLeftBoxInitialized ? mergeBox(aabb, _splitData.leftBox) : aabb, curLeftBox);
+                        splitLeftBox = intersectionBox(isLeftBoxInitialized ? mergeBox(aabb, splitLeftBox) : aabb, curLeftBox);
                         isLeftBoxInitialized = true;
                     }
                 }
@@ -1016,23 +1691,23 @@ namespace tim
                             _itemsLeft.push_back(*it);
                             _itemsRight.push_back(*it);
 
-                            _splitData.leftBox = intersectionBox(isLeftBoxInitialized ? mergeBox(aabb, _splitData.leftBox) : aabb, curLeftBox);
+                            splitLeftBox = intersectionBox(isLeftBoxInitialized ? mergeBox(aabb, splitLeftBox) : aabb, curLeftBox);
                             isLeftBoxInitialized = true;
 
-                            _splitData.rightBox = intersectionBox(isRightBoxInitialized ? mergeBox(aabb, _splitData.rightBox) : aabb, curRightBox);
+                            splitRightBox = intersectionBox(isRightBoxInitialized ? mergeBox(aabb, splitRightBox) : aabb, curRightBox);
                             isRightBoxInitialized = true;
                         }
                     };
 
                     float smallestVolume = std::min(leftVolume, rightVolume);
-                    Box newLeftBox = intersectionBox(mergeBox(leftBox, aabb), parentBox);
-                    Box newRightBox = intersectionBox(mergeBox(rightBox, aabb), parentBox);
+                    const BoxA newLeftBox = intersectionBox(mergeBox(leftBoxA, aabb), parentBoxA);
+                    const BoxA newRightBox = intersectionBox(mergeBox(rightBoxA, aabb), parentBoxA);
                     float diffLeft = getBoxVolume(newLeftBox) - leftVolume;
                     float diffRight = getBoxVolume(newRightBox) - rightVolume;
 
                     if (diffLeft < diffRight) // better to add in left
                     {
-                        float distAugmentation = computeMaxDistanceBetweenBoxDimensions(newLeftBox, leftBox);
+                        float distAugmentation = computeMaxDistanceBetweenBoxDimensions(newLeftBox, leftBoxA);
 
                         if ((diffLeft / smallestVolume) >= m_params.expandNodeVolumeThreshold || distAugmentation > m_meanTriangleSize)
                         {
@@ -1047,15 +1722,15 @@ namespace tim
                             if constexpr (_fillItems)
                             {
                                 _itemsLeft.push_back(*it);
-                                _splitData.leftBox = intersectionBox(isLeftBoxInitialized ? mergeBox(_splitData.leftBox, aabb) : aabb, parentBox);
-                                curLeftBox = intersectionBox(mergeBox(aabb, curLeftBox), parentBox);
+                                splitLeftBox = intersectionBox(isLeftBoxInitialized ? mergeBox(splitLeftBox, aabb) : aabb, parentBoxA);
+                                curLeftBox = intersectionBox(mergeBox(aabb, curLeftBox), parentBoxA);
                                 isLeftBoxInitialized = true;
                             }
                         }
                     }
                     else // better to add in right
                     {
-                        float distAugmentation = computeMaxDistanceBetweenBoxDimensions(newRightBox, rightBox);
+                        float distAugmentation = computeMaxDistanceBetweenBoxDimensions(newRightBox, rightBoxA);
 
                         if ((diffRight / smallestVolume) >= m_params.expandNodeVolumeThreshold || distAugmentation > m_meanTriangleSize)
                         {
@@ -1070,8 +1745,8 @@ namespace tim
                             if constexpr (_fillItems)
                             {
                                 _itemsRight.push_back(*it);
-                                _splitData.rightBox = intersectionBox(isRightBoxInitialized ? mergeBox(_splitData.rightBox, aabb) : aabb, parentBox);
-                                curRightBox = intersectionBox(mergeBox(aabb, curRightBox), parentBox);
+                                splitRightBox = intersectionBox(isRightBoxInitialized ? mergeBox(splitRightBox, aabb) : aabb, parentBoxA);
+                                curRightBox = intersectionBox(mergeBox(aabb, curRightBox), parentBoxA);
                                 isRightBoxInitialized = true;
                             }
                         }
@@ -1091,6 +1766,9 @@ namespace tim
         processObject(std::integral_constant<bool, FillItems>{}, _splitData.blasLeft, _splitData.blasRight, _blasBegin, _blasEnd,
             [&](ObjectIt it, const Box& _box) { return boxBoxCollision(m_blasInstances[*it].aabb, _box); },
             [&](ObjectIt it) { return m_blasInstances[*it].aabb; });
+
+        splitLeftBox.store(&_splitData.leftBox.minExtent);
+        splitRightBox.store(&_splitData.rightBox.minExtent);
     }
 
     template<typename Fun1, typename Fun2>
@@ -1184,39 +1862,36 @@ namespace tim
 
     u32 BVHBuilder::getBvhGpuSize() const
     {
-        u32 size = alignUp<u32>((u32)(m_triangleMaterials.size() + m_objects.size()) * sizeof(Material), m_bufferAlignment);
+        const u32 primitiveCapacity = u32(m_objects.size()) + g_PrimitiveReserve;
+        const u32 triangleMaterialCapacity = u32(m_triangleMaterials.size()) + blasReserve(m_isTlas, g_BlasMaterialReserve);
+        u32 size = alignUp<u32>((triangleMaterialCapacity + primitiveCapacity) * sizeof(Material), m_bufferAlignment);
 
-        u32 numberOfTriangles = (u32)m_triangles.size();
-        for (u32 i = 0; i < m_blas.size(); ++i)
-            numberOfTriangles += m_blas[i]->getTrianglesCount();
+        u32 numberOfTriangles = (u32)m_triangles.size() + blasReserve(m_isTlas, g_BlasTriangleReserve);
+        for (const BVHBuilder* blas : getBlasLevels())
+            numberOfTriangles += blas->getTrianglesCount();
 
         size += alignUp<u32>(numberOfTriangles * sizeof(Triangle), m_bufferAlignment);
-        size += alignUp<u32>((u32)m_objects.size() * sizeof(PackedPrimitive), m_bufferAlignment);
+        size += alignUp<u32>(primitiveCapacity * sizeof(PackedPrimitive), m_bufferAlignment);
         size += alignUp<u32>((u32)m_lights.size() * sizeof(PackedLight), m_bufferAlignment);
-        size += alignUp<u32>((u32)m_blasInstances.size() * sizeof(BlasHeader), m_bufferAlignment);
+        size += alignUp<u32>((u32(m_blasInstances.size()) + blasReserve(m_isTlas, g_BlasInstanceReserve)) * sizeof(BlasHeader), m_bufferAlignment);
 
-        auto sizeOfNodes = [this](const auto& _nodes)
+        u32 numNodes = u32(m_nodes.size()) + g_NodeReserve + blasReserve(m_isTlas, g_BlasNodeReserve);
+        u32 leafDataSize = g_LeafDataReserve + blasReserve(m_isTlas, g_BlasLeafDataReserve);
+        auto addNodes = [&](const BVHBuilder& _builder)
         {
-            u32 size = 0;
-            size += alignUp<u32>((u32)_nodes.size() * sizeof(PackedBVHNode), m_bufferAlignment);
-            for (const auto& n : _nodes)
-            {
-                size += (u32)(1 + n->primitiveList.size() + n->lightList.size() + n->blasList.size()) * sizeof(u32);
-            #if INLINE_TRIANGLES
-                size += u32(n->triangleList.size()) * sizeof(Triangle);
-            #elif INLINE_STRIPS
-                size += u32(n->strips.size()) * sizeof(TriangleStrip);
-            #else  
-                size += u32(n->triangleList.size()) * sizeof(u32);
-            #endif      
-            }
-
-            return size;
+            for (const auto& n : _builder.m_nodes)
+                leafDataSize += _builder.getLeafDataSize(*n);
         };
-        size += sizeOfNodes(m_nodes);
+        addNodes(*this);
 
-        for (const auto& blas : m_blas)
-            size += sizeOfNodes(blas->m_nodes);
+        for (const BVHBuilder* blas : getBlasLevels())
+        {
+            numNodes += u32(blas->m_nodes.size());
+            addNodes(*blas);
+        }
+
+        size += alignUp<u32>(numNodes * sizeof(PackedBVHNode), m_bufferAlignment);
+        size += leafDataSize * sizeof(u32);
 
         return size;
     }
@@ -1278,9 +1953,112 @@ namespace tim
 
             light->fparam[12] = _al.attenuationRadius;
         }
+
+        void packLight(PackedLight* light, const Light& _light)
+        {
+            switch (_light.type)
+            {
+            case Light_Sphere:
+                packSphereLight(light, _light.m_sphere);
+                break;
+            case Light_Area:
+                packAreaLight(light, _light.m_area);
+                break;
+            default:
+                TIM_ASSERT(false);
+                break;
+            }
+        }
     }
 
-    void BVHBuilder::packNodeData(PackedBVHNode* _outNode, const BVHBuilder::Node& _node, u32 _leafDataOffset)
+    void BVHBuilder::packPrimitive(PackedPrimitive* _outPrim, u32 _index) const
+    {
+        if (m_removedPrimitives.count(_index))
+        {
+            *_outPrim = {};
+            _outPrim->iparam = Primitive_Removed;
+            return;
+        }
+
+        // primitive materials are packed after triangle materials
+        const u32 materialId = m_packedTriangleMaterialCapacity + _index;
+        _outPrim->iparam = m_objects[_index].type + (materialId << 16);
+        switch (m_objects[_index].type)
+        {
+        case Primitive_Sphere:
+            packSphere(_outPrim, m_objects[_index].m_sphere);
+            break;
+        case Primitive_AABB:
+            packAabb(_outPrim, m_objects[_index].m_aabb);
+            break;
+        default:
+        case Primitive_OBB:
+            TIM_ASSERT(false);
+            break;
+        }
+    }
+
+    u32 BVHBuilder::getLeafDataSize(const Node& _node) const
+    {
+        if (isEmptyNode(_node))
+            return 0;
+
+        u32 size = u32(1 + _node.primitiveList.size() + _node.lightList.size() + _node.blasList.size());
+    #if INLINE_TRIANGLES
+        size += u32(_node.triangleList.size() * sizeof(Triangle) / sizeof(u32));
+    #elif INLINE_STRIPS
+        size += u32(_node.strips.size() * sizeof(TriangleStrip) / sizeof(u32));
+    #else
+        size += u32(_node.triangleList.size());
+    #endif
+        return size;
+    }
+
+    void BVHBuilder::packLeafData(const Node& _node, u32* _outData, const Triangle* _triangles, u32 _firstTriangle) const
+    {
+    #if INLINE_STRIPS
+        u32 triangleCount = u32(_node.strips.size());
+    #else
+        u32 triangleCount = u32(_node.triangleList.size());
+    #endif  
+
+        // First write node data (objects, triangles and lights)
+        static_assert(TriangleBitCount + PrimitiveBitCount + LightBitCount + BlasBitCount == 32);
+        TIM_ASSERT(triangleCount < (1 << TriangleBitCount));
+        TIM_ASSERT(u32(_node.blasList.size()) < (1 << BlasBitCount));
+        TIM_ASSERT(u32(_node.primitiveList.size()) < (1 << PrimitiveBitCount));
+        TIM_ASSERT(u32(_node.lightList.size()) < (1 << LightBitCount));
+
+        u32 packedCount = triangleCount +
+            (u32(_node.blasList.size()) << TriangleBitCount) +
+            (u32(_node.primitiveList.size()) << (TriangleBitCount + BlasBitCount)) +
+            (u32(_node.lightList.size()) << (TriangleBitCount + BlasBitCount + PrimitiveBitCount));
+
+        *_outData = packedCount;
+        ++_outData;
+    #if INLINE_TRIANGLES
+        for (u32 tri : _node.triangleList)
+        {
+            memcpy(_outData, _triangles + (tri - _firstTriangle), sizeof(Triangle));
+            _outData += (sizeof(Triangle) / sizeof(u32));
+        }
+    #elif INLINE_STRIPS
+        TIM_ASSERT(!m_isTlas);
+        memcpy(_outData, _node.strips.data(), _node.strips.size() * sizeof(TriangleStrip));
+        _outData += _node.strips.size() * (sizeof(TriangleStrip) / sizeof(u32));
+    #else
+        memcpy(_outData, _node.triangleList.data(), sizeof(u32) * _node.triangleList.size());
+        _outData += _node.triangleList.size();
+    #endif
+
+        memcpy(_outData, _node.blasList.data(), sizeof(u32) * _node.blasList.size());
+        _outData += _node.blasList.size();
+        memcpy(_outData, _node.primitiveList.data(), sizeof(u32) * _node.primitiveList.size());
+        _outData += _node.primitiveList.size();
+        memcpy(_outData, _node.lightList.data(), sizeof(u32) * _node.lightList.size());
+    }
+
+    void BVHBuilder::packNodeData(PackedBVHNode* _outNode, const BVHBuilder::Node& _node, u32 _leafDataOffset)
     {
         TIM_ASSERT((_node.left && _node.right) || (!_node.left && !_node.right));
         constexpr u32 InvalidNodeId = NID_MASK;
@@ -1324,81 +2102,79 @@ namespace tim
 
         // Save blas header data write pointer
         ubyte* blasHeaderWritePtr = out;
-        u32 blasHeaderBufferSize = u32(m_blasInstances.size() * sizeof(BlasHeader));
+        m_packedBlasInstanceCapacity = u32(m_blasInstances.size()) + blasReserve(m_isTlas, g_BlasInstanceReserve);
+        u32 blasHeaderBufferSize = u32(m_packedBlasInstanceCapacity * sizeof(BlasHeader));
         _blasOffsetRange = { (u32)std::distance((ubyte*)_data, out), blasHeaderBufferSize };
         _blasOffsetRange.y = std::max(m_bufferAlignment, _blasOffsetRange.y);
 
         out = prevout + alignUp(blasHeaderBufferSize, m_bufferAlignment);
         prevout = out;
 
-        // Store triangle data
-        u32 totalTriangleCount = u32(m_triangles.size());
-        std::vector<u32> blasTriangleOffset(m_blas.size());
+        // Store triangle data, the LODs of a blas follow it and use its materials
+        const std::vector<BVHBuilder*> blasLevels = getBlasLevels();
+        std::vector<u32> blasLevelMaterialIdOffset;
         for (u32 i = 0; i < m_blas.size(); ++i)
+            blasLevelMaterialIdOffset.insert(blasLevelMaterialIdOffset.end(), 1 + m_blas[i]->m_lods.size(), m_blasMaterialIdOffset[i]);
+
+        u32 totalTriangleCount = u32(m_triangles.size());
+        std::vector<u32> blasTriangleOffset(blasLevels.size());
+        for (u32 i = 0; i < blasLevels.size(); ++i)
         {
             blasTriangleOffset[i] = totalTriangleCount;
-            totalTriangleCount += m_blas[i]->getTrianglesCount();
+            totalTriangleCount += blasLevels[i]->getTrianglesCount();
         }
 
-        u32 triangleBufferSize = u32(totalTriangleCount * sizeof(Triangle));
+        m_packedTriangleCount = totalTriangleCount;
+        m_packedTriangleCapacity = totalTriangleCount + blasReserve(m_isTlas, g_BlasTriangleReserve);
+        u32 triangleBufferSize = u32(m_packedTriangleCapacity * sizeof(Triangle));
         _triangleOffsetRange = { (u32)std::distance((ubyte*)_data, out), triangleBufferSize };
         _triangleOffsetRange.y = std::max(m_bufferAlignment, _triangleOffsetRange.y);
         
+        const Triangle* packedTriangles = reinterpret_cast<const Triangle*>(out);
         fillTriangles(out);
         out += sizeof(Triangle) * getTrianglesCount();
 
-        for (u32 i = 0; i < m_blas.size(); ++i)
+        for (u32 i = 0; i < blasLevels.size(); ++i)
         {
-            m_blas[i]->fillTriangles(out, m_blasMaterialIdOffset[i]);
-            out += sizeof(Triangle) * m_blas[i]->getTrianglesCount();
+            blasLevels[i]->fillTriangles(out, blasLevelMaterialIdOffset[i]);
+            out += sizeof(Triangle) * blasLevels[i]->getTrianglesCount();
         }
+        memset(out, 0, (m_packedTriangleCapacity - totalTriangleCount) * sizeof(Triangle));
         
         out = prevout + alignUp(triangleBufferSize, m_bufferAlignment);
         prevout = out;
 
-        // Store primitive data
-        u32 curMaterialId = (u32)m_triangleMaterials.size(); // primitive materials are packed after triangle materials
-        u32 objectBufferSize = u32(m_objects.size() * sizeof(PackedPrimitive));
+        // Store primitive data, followed by the slots of the primitives inserted later
+        m_packedPrimitiveCapacity = u32(m_objects.size()) + g_PrimitiveReserve;
+        m_packedTriangleMaterialCapacity = u32(m_triangleMaterials.size()) + blasReserve(m_isTlas, g_BlasMaterialReserve);
+        u32 objectBufferSize = u32(m_packedPrimitiveCapacity * sizeof(PackedPrimitive));
         _primitiveOffsetRange = { (u32)std::distance((ubyte*)_data, out), objectBufferSize };
         _primitiveOffsetRange.y = std::max(m_bufferAlignment, _primitiveOffsetRange.y);
 
+        memset(out, 0, objectBufferSize);
         for (u32 i = 0; i < m_objects.size(); ++i)
         {
-            PackedPrimitive* prim = reinterpret_cast<PackedPrimitive*>(out);
-            prim->iparam = m_objects[i].type + (curMaterialId << 16);
-            switch (m_objects[i].type)
-            {
-            case Primitive_Sphere:
-                packSphere(prim, m_objects[i].m_sphere);
-                break;
-            case Primitive_AABB:
-                packAabb(prim, m_objects[i].m_aabb);
-                break;
-            default:
-            case Primitive_OBB:
-                TIM_ASSERT(false);
-                break;
-            }
-
+            packPrimitive(reinterpret_cast<PackedPrimitive*>(out), i);
             out += sizeof(PackedPrimitive);
-            curMaterialId++;
         }
         out = prevout + alignUp(objectBufferSize, m_bufferAlignment);
         prevout = out;
 
         // Store material data
-        u32 materialCount = u32(m_triangleMaterials.size() + m_objects.size());
+        u32 materialCount = m_packedTriangleMaterialCapacity + m_packedPrimitiveCapacity;
         TIM_ASSERT(materialCount < g_MaxMaterialCount);
         u32 materialBufferSize = materialCount * sizeof(Material);
         _materialOffsetRange = { (u32)std::distance((ubyte*)_data, out), materialBufferSize };
         _materialOffsetRange.y = std::max(m_bufferAlignment, _materialOffsetRange.y);
 
         // first pack triangle materials
+        memset(out, 0, materialBufferSize);
         for (u32 i = 0; i < m_triangleMaterials.size(); ++i)
         {
             *reinterpret_cast<Material*>(out) = m_triangleMaterials[i];
             out += sizeof(Material);
         }
+        out = prevout + m_packedTriangleMaterialCapacity * sizeof(Material);
         for (u32 i = 0; i < m_objects.size(); ++i)
         {
             *reinterpret_cast<Material*>(out) = m_objects[i].material;
@@ -1414,123 +2190,954 @@ namespace tim
 
         for (u32 i = 0; i < m_lights.size(); ++i)
         {
-            PackedLight* lightDat = reinterpret_cast<PackedLight*>(out);
-            switch (m_lights[i].type)
-            {
-            case Light_Sphere:
-                packSphereLight(lightDat, m_lights[i].m_sphere);
-                break;
-            case Light_Area:
-                packAreaLight(lightDat, m_lights[i].m_area);
-                break;
-            default:
-                TIM_ASSERT(false);
-                break;
-            }
-
+            packLight(reinterpret_cast<PackedLight*>(out), m_lights[i]);
             out += sizeof(PackedLight);
         }
         out = prevout + alignUp(lightBufferSize, m_bufferAlignment);
         prevout = out;
 
-        // Store node data
+        // Store node data, the nodes inserted later take the free slots after the ones of this tree
+        m_packedNodeCapacity = u32(m_nodes.size()) + g_NodeReserve;
         std::vector<Node*> nodes;
         for (auto& n : m_nodes)
             nodes.push_back(n.get());
 
-        std::vector<u32> blasRootIndex(m_blas.size());
+        std::vector<u32> blasRootIndex(blasLevels.size());
+        u32 numNodes = m_packedNodeCapacity;
 
-        // merge blas nodes
-        for (u32 i = 0; i < m_blas.size(); ++i)
+        // merge blas nodes, the offsets applied by a previous fill are replaced
+        for (u32 i = 0; i < blasLevels.size(); ++i)
         {
-            blasRootIndex[i] = u32(nodes.size());
-            for (auto& n : m_blas[i]->m_nodes)
+            BVHBuilder& level = *blasLevels[i];
+            blasRootIndex[i] = numNodes;
+            for (auto& n : level.m_nodes)
             {
-                n->nid += blasRootIndex[i];
+                n->nid += blasRootIndex[i] - level.m_packedNodeOffset;
                 TIM_ASSERT(n->lightList.empty() && n->blasList.empty() && n->primitiveList.empty());
 
                 for (u32& triangleIndex : n->triangleList)
-                    triangleIndex += blasTriangleOffset[i];
+                    triangleIndex += blasTriangleOffset[i] - level.m_packedTriangleOffset;
 
                 nodes.push_back(n.get());
             }
+            numNodes += u32(level.m_nodes.size());
+            level.m_packedNodeOffset = blasRootIndex[i];
+            level.m_packedTriangleOffset = blasTriangleOffset[i];
+            level.m_translated = false;
         }
+        m_packedBlasNodeCount = numNodes;
+        numNodes += blasReserve(m_isTlas, g_BlasNodeReserve);
+        m_packedBlasNodeCapacity = numNodes;
 
-        u32 nodeBufferSize = u32(nodes.size() * sizeof(PackedBVHNode));
+        u32 nodeBufferSize = u32(numNodes * sizeof(PackedBVHNode));
         _nodeOffsetRange = { (u32)std::distance((ubyte*)_data, out), nodeBufferSize };
         _nodeOffsetRange.y = std::max(m_bufferAlignment, _nodeOffsetRange.y);
 
         u32* objectListBegin = reinterpret_cast<u32*>(out + alignUp(nodeBufferSize, m_bufferAlignment));
         u32* objectListCurPtr = objectListBegin;
-
-        for (const BVHBuilder::Node* n : nodes)
+        auto writeLeafData = [&](Node* _node)
         {
-            u32 leafDataIndex = u32(objectListCurPtr - objectListBegin);
-
-        #if INLINE_STRIPS
-            u32 triangleCount = u32(n->strips.size());
-        #else
-            u32 triangleCount = u32(n->triangleList.size());
-        #endif  
+            const u32 size = getLeafDataSize(*_node);
+            _node->leafDataOffset = size > 0 ? u32(objectListCurPtr - objectListBegin) : 0xFFFFffff;
+            if (size > 0)
+                packLeafData(*_node, objectListCurPtr, packedTriangles);
 
-            // First write node data (objects, triangles and lights)
-            static_assert(TriangleBitCount + PrimitiveBitCount + LightBitCount + BlasBitCount == 32);
-            TIM_ASSERT(triangleCount < (1 << TriangleBitCount));
-            TIM_ASSERT(u32(n->blasList.size()) < (1 << BlasBitCount));
-            TIM_ASSERT(u32(n->primitiveList.size()) < (1 << PrimitiveBitCount));
-            TIM_ASSERT(u32(n->lightList.size()) < (1 << LightBitCount));
+            objectListCurPtr += size;
+            return size;
+        };
 
-            u32 packedCount = triangleCount +
-                (u32(n->blasList.size()) << TriangleBitCount) +
-                (u32(n->primitiveList.size()) << (TriangleBitCount + BlasBitCount)) +
-                (u32(n->lightList.size()) << (TriangleBitCount + BlasBitCount + PrimitiveBitCount));
+        // The leaf data of this tree goes last, followed by the room for the incremental edits
+        for (u32 i = u32(m_nodes.size()); i < nodes.size(); ++i)
+            writeLeafData(nodes[i]);
 
-            *objectListCurPtr = packedCount;
-            ++objectListCurPtr;
-        #if INLINE_TRIANGLES
-            TIM_ASSERT(!m_isTlas);
-            for (u32 tri : n->triangleList)
+        m_leafDataBase = u32(objectListCurPtr - objectListBegin);
+        m_leafDataAllocator.clear();
+        for (auto& n : m_nodes)
+        {
+            const u32 size = writeLeafData(n.get());
+            if (size > 0)
             {
-                memcpy(objectListCurPtr, &m_triangles[tri], sizeof(Triangle));
-                objectListCurPtr += (sizeof(Triangle) / sizeof(u32));
+                [[maybe_unused]] const u32 offset = m_leafDataBase + m_leafDataAllocator.allocate(size);
+                TIM_ASSERT(offset == n->leafDataOffset);
             }
-        #elif INLINE_STRIPS
-            TIM_ASSERT(!m_isTlas);
-            memcpy(objectListCurPtr, n->strips.data(), n->strips.size() * sizeof(TriangleStrip));
-            objectListCurPtr += n->strips.size() * (sizeof(TriangleStrip) / sizeof(u32));
-        #else
-            memcpy(objectListCurPtr, n->triangleList.data(), sizeof(u32) * n->triangleList.size());
-            objectListCurPtr += n->triangleList.size();
-        #endif
-
-            memcpy(objectListCurPtr, n->blasList.data(), sizeof(u32) * n->blasList.size());
-            objectListCurPtr += n->blasList.size();
-            memcpy(objectListCurPtr, n->primitiveList.data(), sizeof(u32) * n->primitiveList.size());
-            objectListCurPtr += n->primitiveList.size();
-            memcpy(objectListCurPtr, n->lightList.data(), sizeof(u32) * n->lightList.size());
-            objectListCurPtr += n->lightList.size();
-
-            // Then write the BVH node itself
-            PackedBVHNode* node = reinterpret_cast<PackedBVHNode*>(out);
-            packNodeData(node, *n, packedCount != 0 ? leafDataIndex : 0xFFFFffff);
-            out += sizeof(PackedBVHNode);
         }
+        const u32 leafDataReserve = g_LeafDataReserve + blasReserve(m_isTlas, g_BlasLeafDataReserve);
+        m_leafDataCapacity = u32(objectListCurPtr - objectListBegin) + leafDataReserve;
+
+        // Then write the BVH nodes themselves
+        PackedBVHNode* packedNodes = reinterpret_cast<PackedBVHNode*>(out);
+        std::fill_n(packedNodes, numNodes, PackedBVHNode{});
+        for (const Node* n : nodes)
+            packNodeData(packedNodes + n->nid, *n, n->leafDataOffset);
 
-        _leafDataOffsetRange = { (u32)std::distance((ubyte*)_data, (ubyte*)objectListBegin), (u32)std::distance((ubyte*)objectListBegin, (ubyte*)objectListCurPtr) };
+        _leafDataOffsetRange = { (u32)std::distance((ubyte*)_data, (ubyte*)objectListBegin), m_leafDataCapacity * u32(sizeof(u32)) };
+        memset(objectListCurPtr, 0, leafDataReserve * sizeof(u32));
+        m_needsRepack = false;
+        clearRefitPatches();
 
         // Fill blas header data
+        std::vector<u32> blasFirstLevel(m_blas.size());
+        for (u32 i = 0, level = 0; i < m_blas.size(); level += 1 + u32(m_blas[i]->m_lods.size()), ++i)
+            blasFirstLevel[i] = level;
+
+        memset(blasHeaderWritePtr, 0, blasHeaderBufferSize);
+        m_blasHeaders.resize(m_blasInstances.size());
         for (u32 i = 0; i < m_blasInstances.size(); ++i)
         {
             const u32 blasId = m_blasInstances[i].blasId;
+            const BVHBuilder& blas = *m_blas[blasId];
 
-            BlasHeader* header = reinterpret_cast<BlasHeader*>(blasHeaderWritePtr);
+            BlasHeader* header = &m_blasHeaders[i];
 
             header->minExtent = m_blasInstances[i].aabb.minExtent;
             header->maxExtent = m_blasInstances[i].aabb.maxExtent;
-            header->rootIndex = blasRootIndex[blasId];
+            header->rootIndex = blasRootIndex[blasFirstLevel[blasId]];
 
-            blasHeaderWritePtr += sizeof(BlasHeader);
+            for (u32 lod = 0; lod < BLAS_LOD_COUNT; ++lod)
+            {
+                const u32 level = std::min(lod, u32(blas.m_lods.size()));
+                header->lodRootIndex[lod] = blasRootIndex[blasFirstLevel[blasId] + level];
+                header->lodError[lod] = level > 0 ? blas.m_lodErrors[level - 1] : 0.f;
+            }
+        }
+        memcpy(blasHeaderWritePtr, m_blasHeaders.data(), m_blasHeaders.size() * sizeof(BlasHeader));
+    }
+
+    std::vector<BVHBuilder*> BVHBuilder::getBlasLevels() const
+    {
+        std::vector<BVHBuilder*> levels;
+        for (const auto& blas : m_blas)
+        {
+            levels.push_back(blas.get());
+            for (const auto& lod : blas->m_lods)
+                levels.push_back(lod.get());
         }
+
+        return levels;
+    }
+
+    void BVHBuilder::updatePrimitive(u32 _index, const Sphere& _sphere)
+    {
+        TIM_ASSERT(m_objects[_index].type == Primitive_Sphere);
+        prepareRefit();
+        m_objects[_index].m_sphere = _sphere;
+        m_objects[_index].m_sphere.invRadius = 1.f / _sphere.radius;
+        m_refit->dirtyPrimitives.push_back(_index);
+        m_refit->refitNodes.insert(m_refit->refitNodes.end(), m_refit->primitiveNodes[_index].begin(), m_refit->primitiveNodes[_index].end());
+    }
+
+    void BVHBuilder::updatePrimitive(u32 _index, const Box& _box)
+    {
+        TIM_ASSERT(m_objects[_index].type == Primitive_AABB);
+        prepareRefit();
+        m_objects[_index].m_aabb = _box;
+        m_refit->dirtyPrimitives.push_back(_index);
+        m_refit->refitNodes.insert(m_refit->refitNodes.end(), m_refit->primitiveNodes[_index].begin(), m_refit->primitiveNodes[_index].end());
+    }
+
+    // The traversal loops over all the lights, the node light lists are left as built
+    void BVHBuilder::updateLight(u32 _index, const SphereLight& _light)
+    {
+        TIM_ASSERT(m_lights[_index].type == Light_Sphere);
+        prepareRefit();
+        m_lights[_index].m_sphere = _light;
+        m_refit->dirtyLights.push_back(_index);
+    }
+
+    void BVHBuilder::updateLight(u32 _index, const AreaLight& _light)
+    {
+        TIM_ASSERT(m_lights[_index].type == Light_Area);
+        prepareRefit();
+        m_lights[_index].m_area = _light;
+        m_refit->dirtyLights.push_back(_index);
+    }
+
+    void BVHBuilder::translateBlasInstance(u32 _instance, vec3 _offset, BVHGeometry& _geometry)
+    {
+        prepareRefit();
+
+        // Instances have no transform, the vertices of the blas and of its LODs move
+        BVHBuilder& blas = *m_blas[m_blasInstances[_instance].blasId];
+        ska::flat_hash_set<u32> vertexOffsets;
+        auto translateLevel = [&](BVHBuilder& _level)
+        {
+            for (const Triangle& triangle : _level.m_triangles)
+                vertexOffsets.insert(triangle.vertexOffset);
+            _level.translate(_offset);
+        };
+
+        translateLevel(blas);
+        for (auto& lod : blas.m_lods)
+            translateLevel(*lod);
+
+        for (u32 vertexOffset : vertexOffsets)
+            _geometry.translateVertices(vertexOffset, _offset);
+
+        m_blasInstances[_instance].aabb = blas.getAABB();
+        m_refit->dirtyBlasInstances.push_back(_instance);
+        m_refit->refitNodes.insert(m_refit->refitNodes.end(), m_refit->blasNodes[_instance].begin(), m_refit->blasNodes[_instance].end());
+    }
+
+    void BVHBuilder::translate(vec3 _offset)
+    {
+        for (auto& n : m_nodes)
+        {
+            n->extent.minExtent += _offset;
+            n->extent.maxExtent += _offset;
+        }
+
+        m_aabb.minExtent += _offset;
+        m_aabb.maxExtent += _offset;
+        m_translated = true;
+    }
+
+    u32 BVHBuilder::insertSphere(const Sphere& _sphere, const Material& _mat)
+    {
+        Primitive prim{ _sphere, _mat };
+        prim.m_sphere.invRadius = 1.f / _sphere.radius;
+        return insertPrimitive(prim);
+    }
+
+    u32 BVHBuilder::insertBox(const Box& _box, const Material& _mat)
+    {
+        return insertPrimitive({ _box, _mat });
+    }
+
+    u32 BVHBuilder::insertPrimitive(const Primitive& _prim)
+    {
+        prepareRefit();
+        RefitData& refit = *m_refit;
+
+        u32 index;
+        if (!m_removedPrimitives.empty())
+        {
+            index = *m_removedPrimitives.begin();
+            m_removedPrimitives.erase(index);
+            m_objects[index] = _prim;
+        }
+        else
+        {
+            index = u32(m_objects.size());
+            m_objects.push_back(_prim);
+            refit.primitiveNodes.emplace_back();
+        }
+
+        // The primitive and its material are patched in the slots reserved by fillGpuBuffer
+        if (index >= m_packedPrimitiveCapacity)
+            m_needsRepack = true;
+        refit.dirtyPrimitives.push_back(index);
+        refit.dirtyMaterials.push_back(index);
+
+        Node* leaf = insertLeaf(getAABB(_prim));
+        leaf->primitiveList.push_back(index);
+        refit.primitiveNodes[index].push_back(leaf);
+        reallocateLeafData(leaf);
+        return index;
+    }
+
+    void BVHBuilder::removePrimitive(u32 _index)
+    {
+        TIM_ASSERT(m_removedPrimitives.count(_index) == 0);
+        prepareRefit();
+        m_removedPrimitives.insert(_index);
+        m_refit->dirtyPrimitives.push_back(_index);
+
+        std::vector<Node*> nodes = std::move(m_refit->primitiveNodes[_index]);
+        m_refit->primitiveNodes[_index].clear();
+        for (Node* n : nodes)
+            n->primitiveList.erase(std::remove(n->primitiveList.begin(), n->primitiveList.end(), _index), n->primitiveList.end());
+        for (Node* n : nodes)
+            releaseNode(n);
+    }
+
+    u32 BVHBuilder::insertBlas(std::unique_ptr<BVHBuilder> _blas, const BVHBuildParameters& _params)
+    {
+        prepareRefit();
+        buildBlasLevels(*_blas, _params, nullptr);
+
+        const u32 instance = u32(m_blasInstances.size());
+        addBlas(std::move(_blas));
+        m_blasInstances[instance].aabb = m_blas.back()->getAABB();
+        m_refit->blasNodes.emplace_back();
+
+        Node* leaf = insertLeaf(m_blasInstances[instance].aabb);
+        leaf->blasList.push_back(instance);
+        m_refit->blasNodes[instance].push_back(leaf);
+        reallocateLeafData(leaf);
+
+        if (!packInsertedBlas(instance))
+            m_needsRepack = true;
+        return instance;
+    }
+
+    bool BVHBuilder::packInsertedBlas(u32 _instance)
+    {
+        const u32 blasId = m_blasInstances[_instance].blasId;
+        BVHBuilder& blas = *m_blas[blasId];
+        std::vector<BVHBuilder*> levels = { &blas };
+        for (const auto& lod : blas.m_lods)
+            levels.push_back(lod.get());
+
+        u32 numTriangles = 0, numNodes = 0;
+        for (const BVHBuilder* level : levels)
+        {
+            numTriangles += level->getTrianglesCount();
+            numNodes += u32(level->m_nodes.size());
+        }
+
+        if (_instance >= m_packedBlasInstanceCapacity || m_triangleMaterials.size() > m_packedTriangleMaterialCapacity ||
+            m_packedTriangleCount + numTriangles > m_packedTriangleCapacity || m_packedBlasNodeCount + numNodes > m_packedBlasNodeCapacity)
+        {
+            return false;
+        }
+
+        // Same relocation as fillGpuBuffer, the levels follow the blas packed last
+        RefitData& refit = *m_refit;
+        for (BVHBuilder* level : levels)
+        {
+            for (auto& n : level->m_nodes)
+            {
+                n->nid += m_packedBlasNodeCount - level->m_packedNodeOffset;
+                for (u32& triangleIndex : n->triangleList)
+                    triangleIndex += m_packedTriangleCount - level->m_packedTriangleOffset;
+
+                const u32 size = getLeafDataSize(*n);
+                n->leafDataOffset = size > 0 ? m_leafDataBase + m_leafDataAllocator.allocate(size) : 0xFFFFffff;
+            }
+
+            level->m_packedNodeOffset = m_packedBlasNodeCount;
+            level->m_packedTriangleOffset = m_packedTriangleCount;
+            level->m_translated = false;
+            m_packedBlasNodeCount += u32(level->m_nodes.size());
+            m_packedTriangleCount += level->getTrianglesCount();
+            refit.insertedBlasLevels.push_back({ level, m_blasMaterialIdOffset[blasId] });
+        }
+
+        if (m_leafDataBase + m_leafDataAllocator.getSize() > m_leafDataCapacity)
+            return false;
+
+        m_blasHeaders.resize(m_blasInstances.size());
+        BlasHeader& header = m_blasHeaders[_instance];
+        header.rootIndex = levels[0]->m_packedNodeOffset;
+        for (u32 lod = 0; lod < BLAS_LOD_COUNT; ++lod)
+        {
+            const u32 level = std::min(lod, u32(blas.m_lods.size()));
+            header.lodRootIndex[lod] = levels[level]->m_packedNodeOffset;
+            header.lodError[lod] = level > 0 ? blas.m_lodErrors[level - 1] : 0.f;
+        }
+        refit.dirtyBlasInstances.push_back(_instance);
+
+        for (u32 material = m_blasMaterialIdOffset[blasId]; material < m_triangleMaterials.size(); ++material)
+            refit.dirtyTriangleMaterials.push_back(material);
+
+        return true;
+    }
+
+    void BVHBuilder::removeBlasInstance(u32 _instance)
+    {
+        TIM_ASSERT(m_removedBlasInstances.count(_instance) == 0);
+        prepareRefit();
+        m_removedBlasInstances.insert(_instance);
+
+        std::vector<Node*> nodes = std::move(m_refit->blasNodes[_instance]);
+        m_refit->blasNodes[_instance].clear();
+        for (Node* n : nodes)
+            n->blasList.erase(std::remove(n->blasList.begin(), n->blasList.end(), _instance), n->blasList.end());
+        for (Node* n : nodes)
+            releaseNode(n);
+    }
+
+    bool BVHBuilder::isEmptyNode(const Node& _node)
+    {
+        return _node.primitiveList.empty() && _node.triangleList.empty() && _node.lightList.empty() && _node.blasList.empty();
+    }
+
+    void BVHBuilder::replaceChild(Node* _parent, Node* _child, Node* _newChild)
+    {
+        TIM_ASSERT(_parent->left == _child || _parent->right == _child);
+        (_parent->left == _child ? _parent->left : _parent->right) = _newChild;
+    }
+
+    BVHBuilder::Node* BVHBuilder::insertLeaf(const Box& _box)
+    {
+        RefitData& refit = *m_refit;
+        refit.structureChanged = true;
+
+        // An empty tree is a single leaf without items
+        Node* root = m_nodes[0].get();
+        if (!root->left && isEmptyNode(*root))
+        {
+            root->extent = adjustAABB(_box);
+            m_aabb = root->extent;
+            touchNode(root);
+            return root;
+        }
+
+        // The sibling takes the first node of a new pair, the new leaf the second one and their parent the former slot of the sibling
+        Node* sibling = findBestSibling(_box);
+        const u32 pair = allocateNodePair();
+        Node* parent = m_nodes[pair].get();
+        Node* leaf = m_nodes[pair + 1].get();
+        swapNodeSlots(parent, sibling);
+
+        parent->parent = sibling->parent;
+        parent->sibling = sibling->sibling;
+        if (parent->sibling)
+            parent->sibling->sibling = parent;
+        if (parent->parent)
+            replaceChild(parent->parent, sibling, parent);
+
+        parent->left = sibling;
+        parent->right = leaf;
+        sibling->parent = parent;
+        sibling->sibling = leaf;
+        leaf->parent = parent;
+        leaf->sibling = sibling;
+
+        leaf->extent = adjustAABB(_box);
+        parent->extent = adjustAABB(mergeBox(sibling->extent, leaf->extent));
+        touchNode(parent);
+        touchNode(sibling);
+        touchNode(leaf);
+
+        for (Node* n = parent->parent; n; n = n->parent)
+        {
+            const Box box = adjustAABB(computeNodeBox(*n));
+            if (box.minExtent != n->extent.minExtent || box.maxExtent != n->extent.maxExtent)
+            {
+                n->extent = box;
+                touchNode(n);
+            }
+            rotateNode(n);
+        }
+
+        m_aabb = m_nodes[0]->extent;
+        return leaf;
+    }
+
+    BVHBuilder::Node* BVHBuilder::findBestSibling(const Box& _box) const
+    {
+        // Branch and bound on the area added to the tree, the growth of the ancestors is inherited by the children
+        const double boxArea = getBoxArea(_box);
+        Node* bestNode = m_nodes[0].get();
+        double bestCost = std::numeric_limits<double>::max();
+
+        std::vector<std::pair<Node*, double>> stack = { { bestNode, 0.0 } };
+        while (!stack.empty())
+        {
+            auto [node, inheritedCost] = stack.back();
+            stack.pop_back();
+
+            const double directCost = getBoxArea(mergeBox(node->extent, _box));
+            if (directCost + inheritedCost < bestCost)
+            {
+                bestCost = directCost + inheritedCost;
+                bestNode = node;
+            }
+
+            const double childInheritedCost = inheritedCost + directCost - getBoxArea(node->extent);
+            if (node->left && boxArea + childInheritedCost < bestCost)
+            {
+                stack.push_back({ node->left, childInheritedCost });
+                stack.push_back({ node->right, childInheritedCost });
+            }
+        }
+
+        return bestNode;
+    }
+
+    void BVHBuilder::rotateNode(Node* _node)
+    {
+        if (!_node->left)
+            return;
+
+        // Swap a child with a grandchild on the other side when it shrinks the node between them
+        Node* bestChild = nullptr;
+        Node* bestGrandChild = nullptr;
+        double bestGain = 0;
+        auto tryRotations = [&](Node* _child, Node* _other)
+        {
+            if (!_other->left)
+                return;
+
+            const Box ownBox = computeOwnBox(*_other);
+            for (Node* grandChild : { _other->left, _other->right })
+            {
+                const Box box = mergeBox(ownBox, mergeBox(_child->extent, grandChild->sibling->extent));
+                const double gain = getBoxArea(_other->extent) - getBoxArea(box);
+                if (gain > bestGain)
+                {
+                    bestGain = gain;
+                    bestChild = _child;
+                    bestGrandChild = grandChild;
+                }
+            }
+        };
+        tryRotations(_node->left, _node->right);
+        tryRotations(_node->right, _node->left);
+
+        if (!bestChild)
+            return;
+
+        Node* other = bestGrandChild->parent;
+        swapSubtrees(bestChild, bestGrandChild);
+        other->extent = adjustAABB(computeNodeBox(*other));
+        touchNode(bestChild);
+        touchNode(bestGrandChild);
+        touchNode(other);
+    }
+
+    void BVHBuilder::removeLeaf(Node* _leaf)
+    {
+        Node* parent = _leaf->parent;
+        if (!parent)
+        {
+            // The root stays, empty
+            reallocateLeafData(_leaf);
+            return;
+        }
+
+        RefitData& refit = *m_refit;
+        refit.structureChanged = true;
+
+        // The sibling takes the slot of the parent, and its items
+        Node* sibling = _leaf->sibling;
+        Node* grandParent = parent->parent;
+        moveNodeItems(parent, sibling);
+        swapNodeSlots(sibling, parent);
+
+        sibling->parent = grandParent;
+        sibling->sibling = parent->sibling;
+        if (sibling->sibling)
+            sibling->sibling->sibling = sibling;
+        if (grandParent)
+            replaceChild(grandParent, parent, sibling);
+
+        touchNode(sibling);
+        refit.refitNodes.push_back(sibling);
+
+        // The parent is now where the sibling was, next to the leaf
+        freeNodePair(std::min(_leaf->nid, parent->nid));
+    }
+
+    void BVHBuilder::releaseNode(Node* _node)
+    {
+        // Freed by the removal of a previous leaf
+        if (!_node->parent && _node != m_nodes[0].get())
+            return;
+
+        if (!_node->left && isEmptyNode(*_node))
+        {
+            removeLeaf(_node);
+            return;
+        }
+
+        reallocateLeafData(_node);
+        m_refit->refitNodes.push_back(_node);
+    }
+
+    void BVHBuilder::moveNodeItems(Node* _from, Node* _to)
+    {
+        if (isEmptyNode(*_from))
+            return;
+
+        RefitData& refit = *m_refit;
+        auto moveItems = [_from, _to](LeafList& _fromList, LeafList& _toList, std::vector<std::vector<Node*>>* _itemNodes)
+        {
+            for (u32 item : _fromList)
+            {
+                std::vector<Node*>* nodes = _itemNodes ? &(*_itemNodes)[item] : nullptr;
+                if (std::find(_toList.begin(), _toList.end(), item) != _toList.end())
+                {
+                    if (nodes)
+                        nodes->erase(std::remove(nodes->begin(), nodes->end(), _from), nodes->end());
+                    continue;
+                }
+
+                _toList.push_back(item);
+                if (nodes)
+                    std::replace(nodes->begin(), nodes->end(), _from, _to);
+            }
+            _fromList.clear();
+        };
+
+        moveItems(_from->primitiveList, _to->primitiveList, &refit.primitiveNodes);
+        moveItems(_from->blasList, _to->blasList, &refit.blasNodes);
+        moveItems(_from->triangleList, _to->triangleList, nullptr);
+        moveItems(_from->lightList, _to->lightList, nullptr);
+        _to->strips.insert(_to->strips.end(), _from->strips.begin(), _from->strips.end());
+        _from->strips.clear();
+
+        refit.staticExtents[_to->nid] = mergeBox(refit.staticExtents[_to->nid], refit.staticExtents[_from->nid]);
+        refit.staticExtents[_from->nid] = getEmptyBox();
+        reallocateLeafData(_to);
+    }
+
+    void BVHBuilder::swapNodeSlots(Node* _node1, Node* _node2)
+    {
+        std::swap(m_nodes[_node1->nid], m_nodes[_node2->nid]);
+        std::swap(m_refit->staticExtents[_node1->nid], m_refit->staticExtents[_node2->nid]);
+        std::swap(_node1->nid, _node2->nid);
+    }
+
+    void BVHBuilder::swapSubtrees(Node* _node1, Node* _node2)
+    {
+        Node* parent1 = _node1->parent;
+        Node* parent2 = _node2->parent;
+        Node* sibling1 = _node1->sibling;
+        Node* sibling2 = _node2->sibling;
+        TIM_ASSERT(parent1 != parent2);
+
+        swapNodeSlots(_node1, _node2);
+        replaceChild(parent1, _node1, _node2);
+        replaceChild(parent2, _node2, _node1);
+
+        _node1->parent = parent2;
+        _node1->sibling = sibling2;
+        sibling2->sibling = _node1;
+        _node2->parent = parent1;
+        _node2->sibling = sibling1;
+        sibling1->sibling = _node2;
+    }
+
+    u32 BVHBuilder::allocateNodePair()
+    {
+        if (!m_freeNodePairs.empty())
+        {
+            const u32 nid = m_freeNodePairs.back();
+            m_freeNodePairs.pop_back();
+            return nid;
+        }
+
+        const u32 nid = u32(m_nodes.size());
+        m_nodes.push_back(std::make_unique<Node>(nid));
+        m_nodes.push_back(std::make_unique<Node>(nid + 1));
+        m_refit->staticExtents.resize(m_nodes.size(), getEmptyBox());
+        TIM_ASSERT(m_nodes.size() < g_MaxNodeCount);
+
+        if (m_nodes.size() > m_packedNodeCapacity)
+            m_needsRepack = true;
+
+        return nid;
+    }
+
+    void BVHBuilder::freeNodePair(u32 _nid)
+    {
+        for (u32 nid : { _nid, _nid + 1 })
+        {
+            Node& node = *m_nodes[nid];
+            TIM_ASSERT(isEmptyNode(node));
+            if (node.leafDataOffset != 0xFFFFffff)
+                m_leafDataAllocator.free(node.leafDataOffset - m_leafDataBase);
+
+            node = Node(nid);
+            m_refit->staticExtents[nid] = getEmptyBox();
+        }
+        m_freeNodePairs.push_back(_nid);
+    }
+
+    void BVHBuilder::reallocateLeafData(Node* _node)
+    {
+        const u32 size = getLeafDataSize(*_node);
+        if (_node->leafDataOffset != 0xFFFFffff && (size == 0 || m_leafDataAllocator.getAllocationSize(_node->leafDataOffset - m_leafDataBase) < size))
+        {
+            m_leafDataAllocator.free(_node->leafDataOffset - m_leafDataBase);
+            _node->leafDataOffset = 0xFFFFffff;
+        }
+
+        if (size > 0 && _node->leafDataOffset == 0xFFFFffff)
+        {
+            _node->leafDataOffset = m_leafDataBase + m_leafDataAllocator.allocate(size);
+            if (m_leafDataBase + m_leafDataAllocator.getSize() > m_leafDataCapacity)
+                m_needsRepack = true;
+        }
+
+        m_refit->dirtyLeafData.push_back(_node);
+        m_refit->dirtyPackedNodes.push_back(_node);
+    }
+
+    void BVHBuilder::touchNode(Node* _node)
+    {
+        // A packed node stores the boxes and leaf bits of its children and the nids of its neighbours
+        for (Node* n : { _node, _node->parent, _node->sibling, _node->left, _node->right })
+        {
+            if (n)
+                m_refit->dirtyPackedNodes.push_back(n);
+        }
+    }
+
+    Box BVHBuilder::computeOwnBox(const Node& _node) const
+    {
+        Box box = m_refit->staticExtents[_node.nid];
+        for (u32 prim : _node.primitiveList)
+            box = mergeBox(box, getAABB(m_objects[prim]));
+        for (u32 blas : _node.blasList)
+            box = mergeBox(box, m_blasInstances[blas].aabb);
+
+        return box;
+    }
+
+    Box BVHBuilder::computeNodeBox(const Node& _node) const
+    {
+        Box box = computeOwnBox(_node);
+        if (_node.left)
+            box = mergeBox(box, mergeBox(_node.left->extent, _node.right->extent));
+
+        return box;
+    }
+
+    double BVHBuilder::computeSahCost(const Node& _node) const
+    {
+        const size_t numItems = _node.triangleList.size() + _node.primitiveList.size() + _node.blasList.size();
+        return getBoxArea(_node.extent) * double((_node.left ? 1 : 0) + numItems);
+    }
+
+    double BVHBuilder::computeTreeSahCost() const
+    {
+        double cost = 0;
+        std::vector<const Node*> stack = { m_nodes[0].get() };
+        while (!stack.empty())
+        {
+            const Node* node = stack.back();
+            stack.pop_back();
+
+            cost += computeSahCost(*node);
+            if (node->left)
+            {
+                stack.push_back(node->left);
+                stack.push_back(node->right);
+            }
+        }
+
+        return cost;
+    }
+
+    void BVHBuilder::prepareRefit()
+    {
+        if (m_refit)
+            return;
+
+        // The tree is packed at the start of the node section
+        TIM_ASSERT(m_packedNodeOffset == 0 && !m_nodes.empty());
+
+        m_refit = std::make_unique<RefitData>();
+        RefitData& refit = *m_refit;
+        refit.staticExtents.resize(m_nodes.size(), getEmptyBox());
+        refit.primitiveNodes.resize(m_objects.size());
+        refit.blasNodes.resize(m_blasInstances.size());
+
+        for (const auto& n : m_nodes)
+        {
+            // Triangles can be shared by several nodes after a spatial split, their bounds are clipped by the node
+            Box triangleBox = getEmptyBox();
+            for (u32 tri : n->triangleList)
+                triangleBox = mergeBox(triangleBox, getAABB(m_triangles[tri]));
+            if (!n->triangleList.empty())
+                refit.staticExtents[n->nid] = intersectionBox(n->extent, triangleBox);
+
+            for (u32 prim : n->primitiveList)
+                refit.primitiveNodes[prim].push_back(n.get());
+            for (u32 blas : n->blasList)
+                refit.blasNodes[blas].push_back(n.get());
+        }
+
+        refit.builtSahCost = computeTreeSahCost();
+        refit.sahCost = refit.builtSahCost;
+    }
+
+    void BVHBuilder::refit()
+    {
+        TIM_PROFILE_SCOPE("BVH refit");
+        if (!m_refit)
+            return;
+
+        // The nodes to refit and their ancestors, deepest first so the children are done before their parent
+        RefitData& refit = *m_refit;
+        std::vector<ubyte> marked(m_nodes.size(), 0);
+        std::vector<std::pair<u32, Node*>> nodes;
+        for (Node* seed : refit.refitNodes)
+        {
+            for (Node* n = seed; n && !marked[n->nid]; n = n->parent)
+            {
+                marked[n->nid] = 1;
+                nodes.push_back({ 0, n });
+            }
+        }
+        refit.refitNodes.clear();
+
+        for (auto& [depth, node] : nodes)
+        {
+            for (const Node* n = node->parent; n; n = n->parent)
+                ++depth;
+        }
+        std::sort(nodes.begin(), nodes.end(), [](const auto& _a, const auto& _b) { return _a.first > _b.first; });
+
+        for (auto [depth, node] : nodes)
+        {
+            Box box = computeNodeBox(*node);
+
+            // Nothing left to bound, the built extent stays
+            if (!checkBox(box))
+                continue;
+
+            box = adjustAABB(box);
+            if (box.minExtent == node->extent.minExtent && box.maxExtent == node->extent.maxExtent)
+                continue;
+
+            refit.sahCost -= computeSahCost(*node);
+            node->extent = box;
+            refit.sahCost += computeSahCost(*node);
+
+            // The box of a node is packed in its parent
+            if (node->parent)
+                refit.dirtyPackedNodes.push_back(node->parent);
+        }
+        m_aabb = m_nodes[0]->extent;
+
+        if (refit.structureChanged)
+        {
+            refit.sahCost = computeTreeSahCost();
+            refit.structureChanged = false;
+        }
+    }
+
+    void BVHBuilder::packRefitData(BVHRefitData& _data)
+    {
+        _data.nodes.clear();
+        _data.triangles.clear();
+        _data.leafData.clear();
+        _data.primitives.clear();
+        _data.materials.clear();
+        _data.lights.clear();
+        _data.blasHeaders.clear();
+
+        if (!m_refit)
+            return;
+
+        RefitData& refit = *m_refit;
+        auto sortUnique = [](auto& _list)
+        {
+            std::sort(_list.begin(), _list.end());
+            _list.erase(std::unique(_list.begin(), _list.end()), _list.end());
+        };
+
+        PackedBVHNode packedNode = {};
+        sortUnique(refit.dirtyPackedNodes);
+        for (Node* n : refit.dirtyPackedNodes)
+        {
+            packNodeData(&packedNode, *n, n->leafDataOffset);
+            _data.nodes.push_back({ n->nid, packedNode });
+        }
+
+        // Translated blas levels are repacked entirely, their nids are already the packed ones
+        for (BVHBuilder* level : getBlasLevels())
+        {
+            if (!level->m_translated)
+                continue;
+
+            for (const auto& n : level->m_nodes)
+            {
+                packNodeData(&packedNode, *n, n->leafDataOffset);
+                _data.nodes.push_back({ n->nid, packedNode });
+            }
+            level->m_translated = false;
+        }
+
+        // Inserted blas levels are packed entirely in the reserved room
+        std::vector<Triangle> triangles;
+        for (auto [level, materialIdOffset] : refit.insertedBlasLevels)
+        {
+            triangles.resize(level->getTrianglesCount());
+            level->fillTriangles((byte*)triangles.data(), materialIdOffset);
+            for (u32 i = 0; i < triangles.size(); ++i)
+                _data.triangles.push_back({ level->m_packedTriangleOffset + i, triangles[i] });
+
+            for (const auto& n : level->m_nodes)
+            {
+                packNodeData(&packedNode, *n, n->leafDataOffset);
+                _data.nodes.push_back({ n->nid, packedNode });
+
+                if (n->leafDataOffset != 0xFFFFffff)
+                {
+                    std::vector<u32> leafData(getLeafDataSize(*n));
+                    packLeafData(*n, leafData.data(), triangles.data(), level->m_packedTriangleOffset);
+                    _data.leafData.push_back({ n->leafDataOffset, std::move(leafData) });
+                }
+            }
+        }
+        std::sort(_data.nodes.begin(), _data.nodes.end(), [](const auto& _a, const auto& _b) { return _a.first < _b.first; });
+        std::sort(_data.triangles.begin(), _data.triangles.end(), [](const auto& _a, const auto& _b) { return _a.first < _b.first; });
+
+        sortUnique(refit.dirtyLeafData);
+        for (const Node* n : refit.dirtyLeafData)
+        {
+            if (n->leafDataOffset == 0xFFFFffff)
+                continue;
+
+            std::vector<u32> leafData(getLeafDataSize(*n));
+            packLeafData(*n, leafData.data(), m_triangles.data());
+            _data.leafData.push_back({ n->leafDataOffset, std::move(leafData) });
+        }
+
+        PackedPrimitive packedPrim = {};
+        sortUnique(refit.dirtyPrimitives);
+        for (u32 prim : refit.dirtyPrimitives)
+        {
+            packPrimitive(&packedPrim, prim);
+            _data.primitives.push_back({ prim, packedPrim });
+        }
+
+        sortUnique(refit.dirtyTriangleMaterials);
+        for (u32 material : refit.dirtyTriangleMaterials)
+            _data.materials.push_back({ material, m_triangleMaterials[material] });
+
+        sortUnique(refit.dirtyMaterials);
+        for (u32 prim : refit.dirtyMaterials)
+            _data.materials.push_back({ m_packedTriangleMaterialCapacity + prim, m_objects[prim].material });
+
+        PackedLight packedLight = {};
+        sortUnique(refit.dirtyLights);
+        for (u32 light : refit.dirtyLights)
+        {
+            packLight(&packedLight, m_lights[light]);
+            _data.lights.push_back({ light, packedLight });
+        }
+
+        sortUnique(refit.dirtyBlasInstances);
+        for (u32 instance : refit.dirtyBlasInstances)
+        {
+            BlasHeader& header = m_blasHeaders[instance];
+            header.minExtent = m_blasInstances[instance].aabb.minExtent;
+            header.maxExtent = m_blasInstances[instance].aabb.maxExtent;
+            _data.blasHeaders.push_back({ instance, header });
+        }
+
+        clearRefitPatches();
+    }
+
+    void BVHBuilder::clearRefitPatches()
+    {
+        if (!m_refit)
+            return;
+
+        m_refit->dirtyPackedNodes.clear();
+        m_refit->dirtyLeafData.clear();
+        m_refit->dirtyPrimitives.clear();
+        m_refit->dirtyMaterials.clear();
+        m_refit->dirtyLights.clear();
+        m_refit->dirtyBlasInstances.clear();
+        m_refit->dirtyTriangleMaterials.clear();
+        m_refit->insertedBlasLevels.clear();
+    }
+
+    float BVHBuilder::getRefitCostRatio() const
+    {
+        return m_refit && m_refit->builtSahCost > 0 ? float(m_refit->sahCost / m_refit->builtSahCost) : 1.f;
+    }
+
+    bool BVHBuilder::needsRebuild() const
+    {
+        return getRefitCostRatio() > g_RefitRebuildCostRatio;
     }
 
     void BVHBuilder::fillTriangles(byte* _outData, u32 _matIdOffset) const
@@ -5,6 +5,8 @@
 
 #include "Shaders/core/primitive_cpp.glsl"
 #include "BVHGeometry.h"
+#include "BVHCache.h"
+#include "MeshSimplifier.h"
 #include <mutex>
 
 namespace tim
@@ -48,6 +50,18 @@ namespace tim
         Box aabb;
     };
 
+    // GPU entries changed by a refit, by index in their section of the packed buffer
+    struct BVHRefitData
+    {
+        std::vector<std::pair<u32, PackedBVHNode>> nodes;
+        std::vector<std::pair<u32, Triangle>> triangles;
+        std::vector<std::pair<u32, std::vector<u32>>> leafData;
+        std::vector<std::pair<u32, PackedPrimitive>> primitives;
+        std::vector<std::pair<u32, Material>> materials;
+        std::vector<std::pair<u32, PackedLight>> lights;
+        std::vector<std::pair<u32, BlasHeader>> blasHeaders;
+    };
+
     enum class CollisionType { Disjoint, Intersect, Contained };
 
     struct BVHBuildParameters
@@ -83,20 +97,57 @@ namespace tim
         void addAreaLight(const AreaLight& _light);
         void mergeBlas(const std::unique_ptr<BVHBuilder>& _blas);
 
-        void buildBlas(const BVHBuildParameters& _params);
-        void build(bool _useMultipleThreads);
+        // With a cache, the result of a build is reused as long as the geometry, the lights, the blas bounds and the parameters are the same
+        void buildBlas(const BVHBuildParameters& _params, BVHCache* _cache = nullptr);
+        void build(bool _useMultipleThreads, BVHCache* _cache = nullptr);
         void computeSceneAABB();
         void setParameters(const BVHBuildParameters&);
+        // Post build pass, renumber the vertices of each vertex range in the order the leaves use them (depth first) and remap the triangles
+        void reorderVertices(BVHGeometry& _geometry);
+        // Refit path for moving items, they keep their index and the tree its topology. refit() grows or shrinks the boxes
+        // of the nodes referencing them along the parent links, packRefitData returns the GPU entries to patch.
+        void updatePrimitive(u32 _index, const Sphere& _sphere);
+        void updatePrimitive(u32 _index, const Box& _box);
+        void updateLight(u32 _index, const SphereLight& _light);
+        void updateLight(u32 _index, const AreaLight& _light);
+        void translateBlasInstance(u32 _instance, vec3 _offset, BVHGeometry& _geometry);
+        void refit();
+        void packRefitData(BVHRefitData& _data);
+        // SAH cost of the refit tree over the one of the last build
+        float getRefitCostRatio() const;
+        bool needsRebuild() const;
+
+        // Incremental edits of a built tree: a new item gets a leaf next to the node adding the least area, removed items
+        // leave their slot to the next insertion (a removed primitive is packed as Primitive_Removed). Patched like a refit as
+        // long as the room reserved by fillGpuBuffer is enough.
+        u32 insertSphere(const Sphere& _sphere, const Material& _mat = createLambertianMaterial({ 0.7f, 0.7f, 0.7f }));
+        u32 insertBox(const Box& _box, const Material& _mat = createLambertianMaterial({ 0.7f, 0.7f, 0.7f }));
+        void removePrimitive(u32 _index);
+        // The blas and its LODs are built with _params, their triangles, nodes and materials go in the room reserved for blas
+        u32 insertBlas(std::unique_ptr<BVHBuilder> _blas, const BVHBuildParameters& _params);
+        void removeBlasInstance(u32 _instance);
+        bool needsRepack() const { return m_needsRepack; }
+
+        // Simplified copies of the triangles, up to BLAS_LOD_COUNT - 1 levels each in new vertex ranges. Built and packed with the blas,
+        // the rays tolerating their error trace them instead. With a cache the simplification results are stored with the entry of the
+        // blas built with _params, the geometry has to be flushed first so the positions are the ones of that build.
+        void generateLods(BVHGeometry& _geometry, const BVHBuildParameters& _params = {}, BVHCache* _cache = nullptr);
 
         Box getAABB() const { return m_aabb; }
-        u32 getPrimitivesCount() const { return u32(m_objects.size()); }
+        u32 getPrimitivesCount() const { return u32(m_objects.size()); } // packed slots, removed primitives included
         u32 getTrianglesCount() const { return u32(m_triangles.size()); }
         u32 getBlasInstancesCount() const { return u32(m_blasInstances.size()); }
         u32 getLightsCount() const { return u32(m_lights.size()); }
         u32 getNodesCount() const { return u32(m_nodes.size()); }
+        u32 getLodCount() const { return u32(m_lods.size()); }
+        const BVHBuilder& getLod(u32 _level) const { return *m_lods[_level]; }
+        float getLodError(u32 _level) const { return m_lodErrors[_level]; }
 
         u32 getBvhGpuSize() const;
 
+        // CPU traversal of the tree, the live primitives colliding with _box. Used to check refits and edits against a rebuild.
+        void queryPrimitives(const Box& _box, std::vector<u32>& _result) const;
+
         // return offset to root node + offset to first primitive list of leafs, offset 0 is for primitive data
         void fillGpuBuffer(void* _data, uvec2& _triangleOffsetRange, uvec2& _primitiveOffsetRange, uvec2& _materialOffsetRange, uvec2& _lightOffsetRange, uvec2& _nodeOffsetRange, uvec2& m_leafDataOffsetRange, uvec2& _blasOffsetRange);
 
@@ -108,6 +159,8 @@ namespace tim
 
         struct Node;
         struct SplitData;
+        using LeafList = TaggedVector<u32, MemoryTag::BvhLeafData>;
+        using TriangleList = TaggedVector<Triangle, MemoryTag::BvhPrimitives>;
 
         using ObjectIt = std::vector<u32>::iterator;
         void addObjectsRec(u32 _depth, u32 _numUniqueItems,
@@ -124,12 +177,49 @@ namespace tim
         void fillSplitData(SplitData& _splitData, const Box& parentBox, const Box& leftBox, const Box& rightBox,
                            ObjectIt _objectsBegin, ObjectIt _objectsEnd, ObjectIt _trianglesBegin, ObjectIt _trianglesEnd, ObjectIt _blasBegin, ObjectIt _blasEnd) const;
 
+        // Split in two halves of the items, for the nodes that can neither be split by searchBestSplit nor fit in a leaf
+        void fillMedianSplit(SplitData& _splitData, const Box& _parentBox, ObjectIt _objectsBegin, ObjectIt _objectsEnd,
+                             ObjectIt _trianglesBegin, ObjectIt _trianglesEnd, ObjectIt _blasBegin, ObjectIt _blasEnd) const;
         void fillLeafData(Node* _curNode, u32 _depth, ObjectIt _objectsBegin, ObjectIt _objectsEnd, ObjectIt _trianglesBegin, ObjectIt _trianglesEnd, ObjectIt _blasBegin, ObjectIt _blasEnd);
         void fillTriangleStrips(Node* _leaf);
         static float computeAvgObjGain(const SplitData& _data);
         static float computeSplitScore(const SplitData& _data);
 
         void packNodeData(PackedBVHNode* _outNode, const BVHBuilder::Node& _node, u32 _leafDataOffset);
+        // Every blas followed by its LODs, the order of their triangles and nodes in the GPU buffer
+        std::vector<BVHBuilder*> getBlasLevels() const;
+        void packPrimitive(PackedPrimitive* _outPrim, u32 _index) const;
+
+        u32 getLeafDataSize(const Node& _node) const;
+        // Blas node lists index the whole triangle section, _triangles is the packed one starting at _firstTriangle
+        void packLeafData(const Node& _node, u32* _outData, const Triangle* _triangles, u32 _firstTriangle = 0) const;
+
+        static void buildBlasLevels(BVHBuilder& _blas, const BVHBuildParameters& _params, BVHCache* _cache);
+        void prepareRefit();
+        void clearRefitPatches();
+        void translate(vec3 _offset);
+        Box computeOwnBox(const Node& _node) const;
+        Box computeNodeBox(const Node& _node) const;
+        double computeSahCost(const Node& _node) const;
+        double computeTreeSahCost() const;
+
+        u32 insertPrimitive(const Primitive& _prim);
+        Node* insertLeaf(const Box& _box);
+        Node* findBestSibling(const Box& _box) const;
+        void rotateNode(Node* _node);
+        void removeLeaf(Node* _leaf);
+        // Remove the node if it is an empty leaf, refit it otherwise
+        void releaseNode(Node* _node);
+        void moveNodeItems(Node* _from, Node* _to);
+        void swapNodeSlots(Node* _node1, Node* _node2);
+        void swapSubtrees(Node* _node1, Node* _node2);
+        u32 allocateNodePair();
+        void freeNodePair(u32 _nid);
+        void reallocateLeafData(Node* _node);
+        bool packInsertedBlas(u32 _instance);
+        void touchNode(Node* _node);
+        static bool isEmptyNode(const Node& _node);
+        static void replaceChild(Node* _parent, Node* _child, Node* _newChild);
 
         Box getAABB(const Triangle& _triangle) const;
         Box getAABB(const Primitive& _prim) const;
@@ -156,6 +246,16 @@ namespace tim
         };
         void computeStatsRec(Stats& _stats, Node* _curNode, u32 _depth) const;
 
+        template<typename Fun>
+        void forEachLeafTriangle(const Fun& _fun) const;
+        float computeVertexCacheLinesPerLeaf() const;
+
+        u32 getBaseVertexOffset() const;
+        BVHCache::Key computeCacheKey() const;
+        bool loadFromCache(BVHCache& _cache, const BVHCache::Key& _key);
+        void saveToCache(BVHCache& _cache, const BVHCache::Key& _key) const;
+        bool loadLodMeshesFromCache(BVHCache& _cache, const BVHCache::Key& _key, u32 _numLodMeshes);
+
     private:
         std::string m_name;
         const u32 m_bufferAlignment = 32;
@@ -167,7 +267,7 @@ namespace tim
 
         const BVHGeometry& m_geometryBuffer;
 
-        struct Node
+        struct Node : TaggedObject<MemoryTag::BvhNodes>
         { 
             Node(size_t _nid) : nid{ u32(_nid) } {}
 
@@ -178,11 +278,36 @@ namespace tim
             Node* left = nullptr;
             Node* right = nullptr;
 
-            std::vector<u32> primitiveList;
-            std::vector<u32> triangleList;
-            std::vector<u32> lightList;
-            std::vector<u32> blasList;
-            std::vector<TriangleStrip> strips;
+            LeafList primitiveList;
+            LeafList triangleList;
+            LeafList lightList;
+            LeafList blasList;
+            TaggedVector<TriangleStrip, MemoryTag::BvhLeafData> strips;
+
+            u32 leafDataOffset = 0xFFFFffff; // set by fillGpuBuffer
+        };
+
+        // Set up by the first update after a build
+        struct RefitData
+        {
+            std::vector<Box> staticExtents;                 // bounds of the triangles of each node, by nid
+            std::vector<std::vector<Node*>> primitiveNodes; // nodes referencing each primitive
+            std::vector<std::vector<Node*>> blasNodes;      // nodes referencing each blas instance
+            std::vector<Node*> refitNodes;                  // pending for refit
+            bool structureChanged = false;
+
+            // Pending for packRefitData
+            std::vector<Node*> dirtyPackedNodes;
+            std::vector<Node*> dirtyLeafData;
+            std::vector<u32> dirtyPrimitives;
+            std::vector<u32> dirtyMaterials;
+            std::vector<u32> dirtyLights;
+            std::vector<u32> dirtyBlasInstances;
+            std::vector<u32> dirtyTriangleMaterials;
+            std::vector<std::pair<BVHBuilder*, u32>> insertedBlasLevels; // with their material offset
+
+            double builtSahCost = 0;
+            double sahCost = 0;
         };
 
         struct SplitData
@@ -208,13 +333,43 @@ namespace tim
         Box m_aabb;
         float m_meanTriangleSize = 0;
         std::vector<std::unique_ptr<Node>> m_nodes;
-        std::vector<Triangle> m_triangles;
+        TriangleList m_triangles;
         std::vector<Material> m_triangleMaterials;
         std::vector<Primitive> m_objects;
         std::vector<Light> m_lights;
         std::vector<std::unique_ptr<BVHBuilder>> m_blas;
         std::vector<u32> m_blasMaterialIdOffset;
         std::vector<BlasInstance> m_blasInstances;
+        std::vector<std::unique_ptr<BVHBuilder>> m_lods;
+        std::vector<float> m_lodErrors;
+        // Kept by generateLods until the next build stores them with the tree
+        std::vector<SimplifiedMesh> m_lodMeshes;
+
+        std::unique_ptr<RefitData> m_refit;
+        std::vector<BlasHeader> m_blasHeaders;
+        // Where fillGpuBuffer moved the nodes and the triangle lists of a blas
+        u32 m_packedNodeOffset = 0;
+        u32 m_packedTriangleOffset = 0;
+        bool m_translated = false;
+
+        // Incremental edits, nodes are allocated by pairs of siblings
+        ska::flat_hash_set<u32> m_removedPrimitives;
+        ska::flat_hash_set<u32> m_removedBlasInstances;
+        std::vector<u32> m_freeNodePairs;
+        // Room reserved by the last fillGpuBuffer, the leaf data of this tree is allocated after the one of the blas
+        RangeAllocator m_leafDataAllocator;
+        u32 m_leafDataBase = 0;
+        u32 m_leafDataCapacity = 0;
+        u32 m_packedNodeCapacity = 0;
+        u32 m_packedPrimitiveCapacity = 0;
+        u32 m_packedTriangleMaterialCapacity = 0;
+        // The blas inserted after the last fillGpuBuffer take the slots after the packed ones
+        u32 m_packedBlasInstanceCapacity = 0;
+        u32 m_packedTriangleCount = 0;
+        u32 m_packedTriangleCapacity = 0;
+        u32 m_packedBlasNodeCount = 0;
+        u32 m_packedBlasNodeCapacity = 0;
+        bool m_needsRepack = false;
     };
 
     struct Edge
@@ -0,0 +1,112 @@
+#include "BVHCache.h"
+#include "timCore/Common.h"
+
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+
+namespace fs = std::filesystem;
+
+namespace tim
+{
+    std::string BVHCache::Key::toString() const
+    {
+        u64 hash[2];
+        get(hash);
+
+        char str[40];
+        snprintf(str, sizeof(str), "%016llx%016llx", (unsigned long long)hash[0], (unsigned long long)hash[1]);
+        return str;
+    }
+
+    BVHCache::BVHCache(const std::string& _cacheFolder, u64 _maxSize) : m_cacheFolder{ _cacheFolder }, m_maxSize{ _maxSize }
+    {
+    }
+
+    std::string BVHCache::getPath(const Key& _key) const
+    {
+        return m_cacheFolder + _key.toString() + ".timbvh";
+    }
+
+    bool BVHCache::load(const Key& _key, MappedFile& _file)
+    {
+        const std::string path = getPath(_key);
+        if (!_file.open(path))
+            return false;
+
+        u64 hash[2];
+        _key.get(hash);
+
+        const BVHCacheHeader* header = reinterpret_cast<const BVHCacheHeader*>(_file.data());
+        const bool valid = _file.size() >= sizeof(BVHCacheHeader) && header->magic == BVHCacheHeader::Magic && header->version == BVHCacheHeader::Version &&
+                           header->key[0] == hash[0] && header->key[1] == hash[1];
+
+        if (!valid)
+        {
+            _file.close();
+            return false;
+        }
+
+        // The write time is the LRU timestamp
+        std::error_code ec;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+        return true;
+    }
+
+    bool BVHCache::save(const Key& _key, const std::vector<ubyte>& _data)
+    {
+        // Blas are built in parallel
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // Write to a temporary file first so a crash never leaves a truncated entry in the cache
+        const std::string path = getPath(_key);
+        const std::string tmpPath = path + ".tmp";
+
+        std::error_code ec;
+        fs::create_directories(m_cacheFolder, ec);
+        {
+            std::ofstream file(tmpPath, std::ios::binary);
+            if (!file)
+                return false;
+            file.write((const char*)_data.data(), _data.size());
+            if (!file)
+                return false;
+        }
+
+        fs::rename(tmpPath, path, ec);
+        if (ec)
+            return false;
+
+        evictEntries();
+        return true;
+    }
+
+    void BVHCache::evictEntries()
+    {
+        struct Entry
+        {
+            fs::path path;
+            fs::file_time_type lastUse;
+            u64 size;
+        };
+
+        std::error_code ec;
+        std::vector<Entry> entries;
+        u64 totalSize = 0;
+        for (const fs::directory_entry& file : fs::directory_iterator(m_cacheFolder, ec))
+        {
+            if (file.path().extension() != ".timbvh")
+                continue;
+
+            entries.push_back({ file.path(), file.last_write_time(ec), file.file_size(ec) });
+            totalSize += entries.back().size;
+        }
+
+        std::sort(entries.begin(), entries.end(), [](const Entry& _a, const Entry& _b) { return _a.lastUse < _b.lastUse; });
+        for (size_t i = 0; i < entries.size() && totalSize > m_maxSize; ++i)
+        {
+            if (fs::remove(entries[i].path, ec))
+                totalSize -= entries[i].size;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "timCore/type.h"
+#include "timCore/MappedFile.h"
+#include "timCore/hash.h"
+#include "Shaders/core/primitive_cpp.glsl"
+
+#include <vector>
+#include <string>
+#include <mutex>
+
+namespace tim
+{
+    struct BVHCacheHeader
+    {
+        static constexpr u32 Magic = 0x56424D54; // 'TMBV'
+        static constexpr u32 Version = 4;
+
+        u32 magic = Magic;
+        u32 version = Version;
+        u64 key[2] = {};
+
+        u32 numNodes = 0;
+        u32 numTriangles = 0;
+        u32 numObjects = 0;
+        u32 numLights = 0;
+        u32 numBlasInstances = 0;
+        u32 numListItems = 0;
+        u32 numStrips = 0;
+        u32 numLodMeshes = 0;
+        u32 numLodItems = 0;
+
+        Box aabb = {};
+        float meanTriangleSize = 0;
+    };
+
+    // Node links are node indices, u32(-1) when missing. The items of the node lists follow each other in the list section.
+    struct BVHCacheNode
+    {
+        Box extent;
+        u32 parent, sibling, left, right;
+        u32 numPrimitives, numTriangles, numLights, numBlas, numStrips;
+    };
+
+    // Simplification results of generateLods, one per vertex range and level. The indices (relative to the range) and the groups
+    // of the triangles follow each other in the LOD item section.
+    struct BVHCacheLodMesh
+    {
+        u32 numTriangles;
+        float error;
+    };
+
+    // Directory of built BVHs, one file per builder named after the hash of everything the build depends on.
+    // The directory is kept under _maxSize bytes by deleting the least recently used entries.
+    class BVHCache
+    {
+    public:
+        // 128 bits MurmurHash3 of everything added
+        struct Key
+        {
+            Hash128 state;
+
+            void add(const void* _data, size_t _size) { state.add(_data, _size); }
+            template<typename T> void add(const T& _value) { add(&_value, sizeof(T)); }
+            void get(u64 _hash[2]) const { state.get(_hash); }
+            std::string toString() const;
+        };
+
+        BVHCache(const std::string& _cacheFolder, u64 _maxSize);
+
+        // Map the entry of _key and mark it as recently used
+        bool load(const Key& _key, MappedFile& _file);
+        bool save(const Key& _key, const std::vector<ubyte>& _data);
+
+    private:
+        std::string getPath(const Key& _key) const;
+        void evictEntries();
+
+        std::string m_cacheFolder;
+        u64 m_maxSize;
+        std::mutex m_mutex;
+    };
+}
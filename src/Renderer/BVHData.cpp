@@ -1,50 +1,155 @@
 #include "timCore/Common.h"
+#include "timCore/Profiler.h"
 #include "BVHData.h"
 #include "Shaders/struct_cpp.glsl"
 #include "Shaders/bvh/bvhBindings_cpp.glsl"
 
 namespace tim
 {
-    BVHData::BVHData(IRenderer* _renderer, const BVHGeometry& _geometry) : m_renderer{ _renderer }, m_geometry{ _geometry }
+    namespace
+    {
+        // Consecutive entries go in one upload
+        template<class T>
+        void uploadEntries(IRenderer* _renderer, BufferHandle _buffer, u32 _sectionOffset, const std::vector<std::pair<u32, T>>& _entries)
+        {
+            std::vector<T> run;
+            for (size_t i = 0; i < _entries.size(); ++i)
+            {
+                run.push_back(_entries[i].second);
+                if (i + 1 == _entries.size() || _entries[i + 1].first != _entries[i].first + 1)
+                {
+                    const u32 first = _entries[i].first + 1 - u32(run.size());
+                    _renderer->UploadBuffer(_buffer, _sectionOffset + first * u32(sizeof(T)), run.data(), u32(run.size() * sizeof(T)));
+                    run.clear();
+                }
+            }
+        }
+    }
+
+    BVHData::BVHData(IRenderer* _renderer, BVHGeometry& _geometry) : m_renderer{ _renderer }, m_geometry{ _geometry }
     { 
     }
 
 	BVHData::~BVHData()
 	{
+		if (m_bvhBuffer.ptr)
+			trackGpuMemory(false);
 		m_renderer->DestroyBuffer(m_bvhBuffer);
 	}
 
     void BVHData::fillBvhBindings(std::vector<BufferBinding>& _bindings) const
     {
-        _bindings.push_back({ { m_bvhBuffer, m_bvhPrimitiveOffsetRange.x, m_bvhPrimitiveOffsetRange.y }, { 0, g_BvhPrimitives_bind } });
-        _bindings.push_back({ { m_bvhBuffer, m_bvhTriangleOffsetRange.x, m_bvhTriangleOffsetRange.y }, { 0, g_BvhTriangles_bind } });
-        _bindings.push_back({ { m_bvhBuffer, m_bvhMaterialOffsetRange.x, m_bvhMaterialOffsetRange.y }, { 0, g_BvhMaterials_bind } });
-        _bindings.push_back({ { m_bvhBuffer, m_bvhLightOffsetRange.x, m_bvhLightOffsetRange.y }, { 0, g_BvhLights_bind } });
-        _bindings.push_back({ { m_bvhBuffer, m_bvhNodeOffsetRange.x, m_bvhNodeOffsetRange.y }, { 0, g_BvhNodes_bind } });
-        _bindings.push_back({ { m_bvhBuffer, m_bvhBlasHeaderDataOffsetRange.x, m_bvhBlasHeaderDataOffsetRange.y }, { 0, g_BlasHeaders_bind } });
-        _bindings.push_back({ { m_bvhBuffer, m_bvhLeafDataOffsetRange.x, m_bvhLeafDataOffsetRange.y }, { 0, g_BvhLeafData_bind } });
+        _bindings.push_back({ { m_bvhBuffer, m_ranges.primitive.x, m_ranges.primitive.y }, { 0, g_BvhPrimitives_bind } });
+        _bindings.push_back({ { m_bvhBuffer, m_ranges.triangle.x, m_ranges.triangle.y }, { 0, g_BvhTriangles_bind } });
+        _bindings.push_back({ { m_bvhBuffer, m_ranges.material.x, m_ranges.material.y }, { 0, g_BvhMaterials_bind } });
+        _bindings.push_back({ { m_bvhBuffer, m_ranges.light.x, m_ranges.light.y }, { 0, g_BvhLights_bind } });
+        _bindings.push_back({ { m_bvhBuffer, m_ranges.node.x, m_ranges.node.y }, { 0, g_BvhNodes_bind } });
+        _bindings.push_back({ { m_bvhBuffer, m_ranges.blasHeader.x, m_ranges.blasHeader.y }, { 0, g_BlasHeaders_bind } });
+        _bindings.push_back({ { m_bvhBuffer, m_ranges.leafData.x, m_ranges.leafData.y }, { 0, g_BvhLeafData_bind } });
     }
 
-    void BVHData::build(BVHBuilder& _builder, const BVHBuildParameters& _bvhParams, const BVHBuildParameters& _tlasParams, bool _useTlasBlas)
+    void BVHData::build(BVHBuilder& _builder, const BVHBuildParameters& _bvhParams, const BVHBuildParameters& _tlasParams, bool _useTlasBlas, BVHCache* _cache, std::vector<ubyte>* _packedData)
     {
         {
             auto start = std::chrono::system_clock::now();
-            _builder.buildBlas(_bvhParams);
+            _builder.buildBlas(_bvhParams, _cache);
         
             const bool multithread = true;
             _builder.setParameters(_useTlasBlas ? _tlasParams : _bvhParams);
-            _builder.build(multithread);
+            _builder.build(multithread, _cache);
             _builder.dumpStats();
+            // The geometry has to be flushed again
+            _builder.reorderVertices(m_geometry);
             auto end = std::chrono::system_clock::now();
             std::chrono::duration<double> elapsed_seconds = end - start;
             std::cout << "Build BVH time: " << elapsed_seconds.count() << "s\n";
         }
         
+        packAndUpload(_builder, _packedData);
+    }
+
+    bool BVHData::refit(BVHBuilder& _builder)
+    {
+        _builder.refit();
+        if (_builder.needsRebuild())
+        {
+            std::cout << "BVH refit cost ratio " << _builder.getRefitCostRatio() << ", rebuilding\n";
+
+            // Blas are kept, only the top level tree is built again
+            auto start = std::chrono::system_clock::now();
+            _builder.build(true);
+            auto end = std::chrono::system_clock::now();
+            std::chrono::duration<double> elapsed_seconds = end - start;
+            std::cout << "Rebuild BVH time: " << elapsed_seconds.count() << "s\n";
+
+            packAndUpload(_builder, nullptr);
+            return true;
+        }
+
+        // Inserted items did not fit in the room left by the last pack
+        if (_builder.needsRepack())
+        {
+            packAndUpload(_builder, nullptr);
+            return true;
+        }
+
+        _builder.packRefitData(m_refitData);
+        uploadEntries(m_renderer, m_bvhBuffer, m_ranges.node.x, m_refitData.nodes);
+        uploadEntries(m_renderer, m_bvhBuffer, m_ranges.triangle.x, m_refitData.triangles);
+        for (auto& [offset, leafData] : m_refitData.leafData)
+            m_renderer->UploadBuffer(m_bvhBuffer, m_ranges.leafData.x + offset * u32(sizeof(u32)), leafData.data(), u32(leafData.size() * sizeof(u32)));
+        uploadEntries(m_renderer, m_bvhBuffer, m_ranges.primitive.x, m_refitData.primitives);
+        uploadEntries(m_renderer, m_bvhBuffer, m_ranges.material.x, m_refitData.materials);
+        uploadEntries(m_renderer, m_bvhBuffer, m_ranges.light.x, m_refitData.lights);
+        uploadEntries(m_renderer, m_bvhBuffer, m_ranges.blasHeader.x, m_refitData.blasHeaders);
+        return false;
+    }
+
+    void BVHData::packAndUpload(BVHBuilder& _builder, std::vector<ubyte>* _packedData)
+    {
+        TIM_PROFILE_SCOPE("BVH pack and upload");
         u32 size = _builder.getBvhGpuSize();
-        std::cout << "Uploading " << (size >> 10) << " Ko of BVH data\n";
-        m_bvhBuffer = m_renderer->CreateBuffer(size, MemoryType::Default, BufferUsage::Storage | BufferUsage::Transfer);
-        std::unique_ptr<ubyte[]> buffer = std::unique_ptr<ubyte[]>(new ubyte[size]);
-        _builder.fillGpuBuffer(buffer.get(), m_bvhTriangleOffsetRange, m_bvhPrimitiveOffsetRange, m_bvhMaterialOffsetRange, m_bvhLightOffsetRange, m_bvhNodeOffsetRange, m_bvhLeafDataOffsetRange, m_bvhBlasHeaderDataOffsetRange);
-        m_renderer->UploadBuffer(m_bvhBuffer, buffer.get(), size);
+        std::vector<ubyte> buffer(size);
+        BVHOffsetRanges ranges;
+        _builder.fillGpuBuffer(buffer.data(), ranges.triangle, ranges.primitive, ranges.material, ranges.light, ranges.node, ranges.leafData, ranges.blasHeader);
+        upload(buffer.data(), size, ranges);
+
+        if (_packedData)
+            *_packedData = std::move(buffer);
+    }
+
+    void BVHData::upload(const void* _packedData, u32 _size, const BVHOffsetRanges& _ranges)
+    {
+        std::cout << "Uploading " << (_size >> 10) << " Ko of BVH data\n";
+        // A repack after a refit replaces the buffer while frames using it are in flight
+        if (m_bvhBuffer.ptr)
+        {
+            trackGpuMemory(false);
+            m_renderer->WaitForIdle();
+            m_renderer->DestroyBuffer(m_bvhBuffer);
+        }
+
+        m_ranges = _ranges;
+        m_bufferSize = _size;
+        m_bvhBuffer = m_renderer->CreateBuffer(_size, MemoryType::Default, BufferUsage::Storage | BufferUsage::Transfer, MemoryTag::Untracked);
+        m_renderer->UploadBuffer(m_bvhBuffer, const_cast<void*>(_packedData), _size);
+        trackGpuMemory(true);
+    }
+
+    void BVHData::trackGpuMemory(bool _alloc)
+    {
+        // One buffer holds every section, the nodes and the leaf data are reported apart from the rest
+        const u64 nodeBytes = m_ranges.node.y;
+        const u64 leafDataBytes = m_ranges.leafData.y;
+        const u64 sizes[] = { nodeBytes, leafDataBytes, m_bufferSize - nodeBytes - leafDataBytes };
+        const MemoryTag tags[] = { MemoryTag::BvhNodes, MemoryTag::BvhLeafData, MemoryTag::BvhPrimitives };
+
+        for (u32 i = 0; i < 3; ++i)
+        {
+            if (_alloc)
+                MemoryTracker::get().onAlloc(MemoryPool::Gpu, tags[i], sizes[i]);
+            else
+                MemoryTracker::get().onFree(MemoryPool::Gpu, tags[i], sizes[i]);
+        }
     }
 }
\ No newline at end of file
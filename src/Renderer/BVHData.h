@@ -10,26 +10,50 @@ namespace tim
     struct BVHBuildParameters;
     class BVHBuilder;
 
+    // Offset and size of each section of the packed BVH buffer
+    struct BVHOffsetRanges
+    {
+        uvec2 triangle;
+        uvec2 primitive;
+        uvec2 material;
+        uvec2 light;
+        uvec2 node;
+        uvec2 leafData;
+        uvec2 blasHeader;
+    };
+
     class BVHData
     {
     public:
-        BVHData(IRenderer* _renderer, const BVHGeometry& _geometry);
+        BVHData(IRenderer* _renderer, BVHGeometry& _geometry);
         ~BVHData();
 
-        void build(BVHBuilder& _builder, const BVHBuildParameters& _bvhParams, const BVHBuildParameters& _tlasParams, bool _useTlasBlas);
+        // When _packedData is provided the packed buffer is kept there after the upload
+        void build(BVHBuilder& _builder, const BVHBuildParameters& _bvhParams, const BVHBuildParameters& _tlasParams, bool _useTlasBlas,
+                   BVHCache* _cache = nullptr, std::vector<ubyte>* _packedData = nullptr);
+
+        // Upload an already packed BVH (scene cache)
+        void upload(const void* _packedData, u32 _size, const BVHOffsetRanges& _ranges);
+
+        // Refit the builder after its items moved, were inserted or removed and patch the changed entries. The whole buffer is
+        // uploaded again when the tree got too slow to traverse (rebuild) or outgrew the room left for insertions. Returns true then.
+        bool refit(BVHBuilder& _builder);
+
+        const BVHOffsetRanges& getOffsetRanges() const { return m_ranges; }
+        BufferHandle getBuffer() const { return m_bvhBuffer; }
 
         void fillBvhBindings(std::vector<BufferBinding>& _bindings) const;
 
+    private:
+        void packAndUpload(BVHBuilder& _builder, std::vector<ubyte>* _packedData);
+        void trackGpuMemory(bool _alloc);
+
     private:
         IRenderer* m_renderer;
-        const BVHGeometry& m_geometry;
+        BVHGeometry& m_geometry;
         BufferHandle m_bvhBuffer;
-        uvec2 m_bvhTriangleOffsetRange;
-        uvec2 m_bvhPrimitiveOffsetRange;
-        uvec2 m_bvhMaterialOffsetRange;
-        uvec2 m_bvhLightOffsetRange;
-        uvec2 m_bvhNodeOffsetRange;
-        uvec2 m_bvhLeafDataOffsetRange;
-        uvec2 m_bvhBlasHeaderDataOffsetRange;
+        BVHOffsetRanges m_ranges;
+        u32 m_bufferSize = 0;
+        BVHRefitData m_refitData;
     };
 }
\ No newline at end of file
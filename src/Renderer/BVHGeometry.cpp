@@ -1,86 +1,360 @@
-#include "BVHGeometry.h"
-#include "timCore/Common.h"
-
-namespace tim
-{
-
-	BVHGeometry::BVHGeometry(IRenderer* _renderer, u32 _numVertexInBuffer) : m_renderer{ _renderer }, m_maxVertexCount{ _numVertexInBuffer }
-	{
-		u32 totalBufferSize = (sizeof(vec3) + sizeof(vec3) + sizeof(vec2)) * m_maxVertexCount;
-		m_gpuBuffer = m_renderer->CreateBuffer(totalBufferSize, MemoryType::Default, BufferUsage::Storage | BufferUsage::Transfer);
-	}
-
-	BVHGeometry::~BVHGeometry()
-	{
-		m_renderer->DestroyBuffer(m_gpuBuffer);
-	}
-
-	BVHGeometry::TriangleData BVHGeometry::addTriangle(vec3 _p0, vec3 _p1, vec3 _p2)
-	{
-		TIM_ASSERT(m_cpuBufferPosition.size() + 3 < m_maxVertexCount);
-
-		TriangleData triangle;
-		triangle.vertexOffset = (u32)m_cpuBufferPosition.size();
-		triangle.index[0] = 0;
-		triangle.index[1] = 1;
-		triangle.index[2] = 2;
-
-		m_cpuBufferPosition.push_back(_p0);
-		m_cpuBufferPosition.push_back(_p1);
-		m_cpuBufferPosition.push_back(_p2);
-
-		vec3 normal = linalg::cross((_p1 - _p0), (_p2 - _p0));
-		normal = linalg::normalize(normal);
-
-		m_cpuBufferNormal.push_back(normal);
-		m_cpuBufferNormal.push_back(normal);
-		m_cpuBufferNormal.push_back(normal);
-
-		m_cpuBufferUv.push_back({ 0,0 });
-		m_cpuBufferUv.push_back({ 0,1 });
-		m_cpuBufferUv.push_back({ 1,0 });
-
-		return triangle;
-	}
-
-    u32 BVHGeometry::addTriangleList(u32 _numVertex, const vec3 * _positions, const vec3 * _normals, const vec2 * _texCoords)
-    {
-        TIM_ASSERT(m_cpuBufferPosition.size() + _numVertex < m_maxVertexCount);
-        u32 vertexOffset = (u32)m_cpuBufferPosition.size();
-
-        for (u32 i = 0; i < _numVertex; ++i)
-        {
-            m_cpuBufferPosition.push_back(_positions[i]);
-            m_cpuBufferNormal.push_back(_normals[i]);
-            if (_texCoords)
-                m_cpuBufferUv.push_back(_texCoords[i]);
-            else
-                m_cpuBufferUv.push_back({ 0,0 });
-        }
-
-        return vertexOffset;
-    }
-
-    vec3 BVHGeometry::getVertexPosition(u32 _vertexOffet, u32 _index) const
-    {
-        return m_cpuBufferPosition[_vertexOffet + _index];
-    }
-
-	void BVHGeometry::flush(IRenderer* _renderer)
+#include "BVHGeometry.h"
+#include "timCore/Common.h"
+
+namespace tim
+{
+    namespace
+    {
+#if COMPRESSED_VERTEX_STREAMS
+        constexpr u32 g_positionStride = sizeof(uvec2);
+        constexpr u32 g_normalStride = sizeof(u32);
+        constexpr u32 g_texCoordStride = sizeof(u32);
+        // Ranges never share a quantization block
+        constexpr u32 g_vertexAlignment = VERTEX_BLOCK_SIZE;
+#else
+        constexpr u32 g_positionStride = sizeof(vec3);
+        constexpr u32 g_normalStride = sizeof(vec3);
+        constexpr u32 g_texCoordStride = sizeof(vec2);
+        constexpr u32 g_vertexAlignment = 1;
+#endif
+        // Covers minStorageBufferOffsetAlignment
+        constexpr u32 g_streamAlignment = 256;
+        constexpr u32 g_minVertexCapacity = 256;
+    }
+
+	BVHGeometry::BVHGeometry(IRenderer* _renderer) : m_renderer{ _renderer }, m_allocator{ g_vertexAlignment }
 	{
-        if (m_cpuBufferPosition.size() > 0)
+	}
+
+	BVHGeometry::~BVHGeometry()
+	{
+        if (m_gpuBuffer.ptr)
+            m_renderer->DestroyBuffer(m_gpuBuffer);
+	}
+
+	BVHGeometry::TriangleData BVHGeometry::addTriangle(vec3 _p0, vec3 _p1, vec3 _p2)
+	{
+		vec3 normal = linalg::cross((_p1 - _p0), (_p2 - _p0));
+		normal = linalg::normalize(normal);
+
+        const vec3 positions[3] = { _p0, _p1, _p2 };
+        const vec3 normals[3] = { normal, normal, normal };
+        const vec2 texCoords[3] = { { 0,0 }, { 0,1 }, { 1,0 } };
+
+		TriangleData triangle;
+		triangle.vertexOffset = addTriangleList(3, positions, normals, texCoords);
+		triangle.index[0] = 0;
+		triangle.index[1] = 1;
+		triangle.index[2] = 2;
+
+		return triangle;
+	}
+
+    u32 BVHGeometry::addTriangleList(u32 _numVertex, const vec3 * _positions, const vec3 * _normals, const vec2 * _texCoords)
+    {
+        const u32 vertexOffset = allocateVertices(_numVertex);
+
+        std::copy(_positions, _positions + _numVertex, m_cpuBufferPosition.begin() + vertexOffset);
+        std::copy(_normals, _normals + _numVertex, m_cpuBufferNormal.begin() + vertexOffset);
+        if (_texCoords)
+            std::copy(_texCoords, _texCoords + _numVertex, m_cpuBufferUv.begin() + vertexOffset);
+        else
+            std::fill(m_cpuBufferUv.begin() + vertexOffset, m_cpuBufferUv.begin() + vertexOffset + _numVertex, vec2{ 0,0 });
+
+        return vertexOffset;
+    }
+
+    u32 BVHGeometry::allocateVertices(u32 _numVertex)
+    {
+        const u32 vertexOffset = m_allocator.allocate(_numVertex);
+        if (m_allocator.getSize() > m_cpuBufferPosition.size())
+        {
+            m_cpuBufferPosition.resize(m_allocator.getSize());
+            m_cpuBufferNormal.resize(m_allocator.getSize());
+            m_cpuBufferUv.resize(m_allocator.getSize());
+        }
+
+        m_rangeSizes[vertexOffset] = _numVertex;
+        m_dirtyRanges.push_back({ vertexOffset, _numVertex });
+        return vertexOffset;
+    }
+
+    void BVHGeometry::freeVertices(u32 _vertexOffset)
+    {
+        m_allocator.free(_vertexOffset);
+        m_rangeSizes.erase(_vertexOffset);
+        m_dirtyRanges.erase(std::remove_if(m_dirtyRanges.begin(), m_dirtyRanges.end(), [_vertexOffset](const uvec2& _range) { return _range.x == _vertexOffset; }), m_dirtyRanges.end());
+
+        if (m_allocator.getSize() < m_cpuBufferPosition.size())
+        {
+            m_cpuBufferPosition.resize(m_allocator.getSize());
+            m_cpuBufferNormal.resize(m_allocator.getSize());
+            m_cpuBufferUv.resize(m_allocator.getSize());
+        }
+    }
+
+    void BVHGeometry::getVertexStreams(u32 _vertexOffset, vec3*& _positions, vec3*& _normals, vec2*& _texCoords)
+    {
+        TIM_ASSERT(_vertexOffset < m_cpuBufferPosition.size());
+        _positions = m_cpuBufferPosition.data() + _vertexOffset;
+        _normals = m_cpuBufferNormal.data() + _vertexOffset;
+        _texCoords = m_cpuBufferUv.data() + _vertexOffset;
+    }
+
+    void BVHGeometry::reorderVertices(u32 _vertexOffset, const std::vector<u32>& _newToOld)
+    {
+        TIM_ASSERT(_newToOld.size() <= getRangeSize(_vertexOffset));
+
+        auto reorder = [&](auto& _stream)
+        {
+            std::vector<std::decay_t<decltype(_stream[0])>> copy(_stream.begin() + _vertexOffset, _stream.begin() + _vertexOffset + _newToOld.size());
+            for (size_t i = 0; i < _newToOld.size(); ++i)
+                _stream[_vertexOffset + i] = copy[_newToOld[i]];
+        };
+        reorder(m_cpuBufferPosition);
+        reorder(m_cpuBufferNormal);
+        reorder(m_cpuBufferUv);
+
+        m_dirtyRanges.push_back({ _vertexOffset, (u32)_newToOld.size() });
+    }
+
+    void BVHGeometry::translateVertices(u32 _vertexOffset, vec3 _offset)
+    {
+        const u32 numVertex = getRangeSize(_vertexOffset);
+        TIM_ASSERT(numVertex > 0);
+
+        for (u32 i = 0; i < numVertex; ++i)
+            m_cpuBufferPosition[_vertexOffset + i] += _offset;
+
+        m_dirtyRanges.push_back({ _vertexOffset, numVertex });
+    }
+
+    u32 BVHGeometry::getRangeSize(u32 _vertexOffset) const
+    {
+        auto it = m_rangeSizes.find(_vertexOffset);
+        return it != m_rangeSizes.end() ? it->second : 0;
+    }
+
+    void BVHGeometry::getRanges(std::vector<uvec2>& _ranges) const
+    {
+        _ranges.clear();
+        for (const auto& [offset, size] : m_rangeSizes)
+            _ranges.push_back({ offset, size });
+        std::sort(_ranges.begin(), _ranges.end(), [](const uvec2& _a, const uvec2& _b) { return _a.x < _b.x; });
+    }
+
+    vec3 BVHGeometry::getVertexPosition(u32 _vertexOffet, u32 _index) const
+    {
+        return m_cpuBufferPosition[_vertexOffet + _index];
+    }
+
+    BVHGeometry::Stats BVHGeometry::getStats() const
+    {
+        const RangeAllocator::Stats allocStats = m_allocator.getStats();
+
+        Stats stats;
+        stats.numVertices = allocStats.allocatedSize;
+        stats.numFreeVertices = allocStats.size - allocStats.allocatedSize;
+        stats.largestFreeRange = allocStats.largestFreeRange;
+        stats.gpuVertexCapacity = m_gpuVertexCapacity;
+        stats.gpuBufferSize = m_bufferSize;
+        return stats;
+    }
+
+    BVHGeometry::GpuStreams BVHGeometry::getGpuStreams() const
+    {
+        TIM_ASSERT(m_dirtyRanges.empty());
+
+        GpuStreams streams;
+        streams.numVertex = getVertexCount();
+#if COMPRESSED_VERTEX_STREAMS
+        TIM_ASSERT(m_compressedStreams.positions.size() >= streams.numVertex);
+        streams.positions = m_compressedStreams.positions.data();
+        streams.normals = m_compressedStreams.normals.data();
+        streams.texCoords = m_compressedStreams.texCoords.data();
+        streams.blocks = m_compressedStreams.blocks.data();
+        streams.blocksSize = ((streams.numVertex + VERTEX_BLOCK_SIZE - 1) / VERTEX_BLOCK_SIZE) * sizeof(VertexBlockHeader);
+#else
+        streams.positions = m_cpuBufferPosition.data();
+        streams.normals = m_cpuBufferNormal.data();
+        streams.texCoords = m_cpuBufferUv.data();
+#endif
+        streams.positionsSize = streams.numVertex * g_positionStride;
+        streams.normalsSize = streams.numVertex * g_normalStride;
+        streams.texCoordsSize = streams.numVertex * g_texCoordStride;
+        return streams;
+    }
+
+    void BVHGeometry::restoreGpuStreams(const GpuStreams& _streams, const uvec2* _ranges, u32 _numRanges)
+    {
+        TIM_ASSERT(getVertexCount() == 0);
+
+        // Holes between the ranges are allocated while filling and freed after
+        std::vector<u32> holes;
+        for (u32 i = 0; i < _numRanges; ++i)
+        {
+            if (_ranges[i].x > m_allocator.getSize())
+                holes.push_back(allocateVertices(_ranges[i].x - m_allocator.getSize()));
+
+            [[maybe_unused]] const u32 vertexOffset = allocateVertices(_ranges[i].y);
+            TIM_ASSERT(vertexOffset == _ranges[i].x);
+        }
+        for (u32 hole : holes)
+            freeVertices(hole);
+        m_dirtyRanges.clear();
+
+        const u32 numVertex = getVertexCount();
+        TIM_ASSERT(_streams.numVertex == numVertex && _streams.positionsSize == numVertex * g_positionStride &&
+                   _streams.normalsSize == numVertex * g_normalStride && _streams.texCoordsSize == numVertex * g_texCoordStride);
+
+#if COMPRESSED_VERTEX_STREAMS
+        auto restore = [](auto& _stream, const void* _data, u32 _size)
+        {
+            _stream.resize(_size / sizeof(_stream[0]));
+            memcpy(_stream.data(), _data, _size);
+        };
+        restore(m_compressedStreams.positions, _streams.positions, _streams.positionsSize);
+        restore(m_compressedStreams.normals, _streams.normals, _streams.normalsSize);
+        restore(m_compressedStreams.texCoords, _streams.texCoords, _streams.texCoordsSize);
+        restore(m_compressedStreams.blocks, _streams.blocks, _streams.blocksSize);
+
+        // The CPU copy holds the decoded vertices, as after quantizeRange
+        decompressVertexStreams(m_compressedStreams, m_cpuBufferPosition.data(), m_cpuBufferNormal.data(), m_cpuBufferUv.data());
+#else
+        memcpy(m_cpuBufferPosition.data(), _streams.positions, _streams.positionsSize);
+        memcpy(m_cpuBufferNormal.data(), _streams.normals, _streams.normalsSize);
+        memcpy(m_cpuBufferUv.data(), _streams.texCoords, _streams.texCoordsSize);
+#endif
+    }
+
+	void BVHGeometry::flush(IRenderer* _renderer)
+	{
+        TIM_ASSERT(_renderer == m_renderer);
+
+        // A range written several times since the last flush is quantized once, from its source data
+        std::sort(m_dirtyRanges.begin(), m_dirtyRanges.end(), [](const uvec2& _a, const uvec2& _b) { return _a.x < _b.x || (_a.x == _b.x && _a.y > _b.y); });
+        m_dirtyRanges.erase(std::unique(m_dirtyRanges.begin(), m_dirtyRanges.end(), [](const uvec2& _a, const uvec2& _b) { return _a.x == _b.x; }), m_dirtyRanges.end());
+
+        const u32 numVertex = m_allocator.getSize();
+        const bool resize = !m_gpuBuffer.ptr || numVertex > m_gpuVertexCapacity;
+        if (!resize && m_dirtyRanges.empty())
+            return;
+
+        VertexCompressionError error;
+#if COMPRESSED_VERTEX_STREAMS
+        m_compressedStreams.positions.resize(numVertex);
+        m_compressedStreams.normals.resize(numVertex);
+        m_compressedStreams.texCoords.resize(numVertex);
+        m_compressedStreams.blocks.resize((numVertex + VERTEX_BLOCK_SIZE - 1) / VERTEX_BLOCK_SIZE);
+#endif
+        for (const uvec2& range : m_dirtyRanges)
+            quantizeRange(range.x, range.y, error);
+
+        std::vector<uvec2> uploadRanges;
+        if (resize)
+        {
+            // Sized to the content the first time, then grows by half to amortize streaming
+            u32 capacity = std::max(numVertex, g_minVertexCapacity);
+            if (m_gpuBuffer.ptr)
+                capacity = std::max(capacity, m_gpuVertexCapacity + m_gpuVertexCapacity / 2);
+            resizeGpuBuffer(alignUp(capacity, g_minVertexCapacity));
+
+            // Each live range keeps its own quantization, the holes are left out
+            getRanges(uploadRanges);
+        }
+        else
+        {
+            uploadRanges = std::move(m_dirtyRanges);
+        }
+        m_dirtyRanges.clear();
+
+        u32 numUploaded = 0;
+        for (const uvec2& range : uploadRanges)
+        {
+            uploadRange(range.x, range.y);
+            numUploaded += range.y;
+        }
+
+#if COMPRESSED_VERTEX_STREAMS
+        std::cout << "Vertex compression max error: position " << error.position << ", normal " << error.normal << ", uv " << error.texCoord << std::endl;
+#endif
+
+        const Stats stats = getStats();
+        std::cout << "Total loaded vertex: " << stats.numVertices << " (" << numUploaded << " uploaded), GPU capacity " << stats.gpuVertexCapacity << " vertices (" << stats.gpuBufferSize / 1024 << " KB)"
+                  << ", utilization " << 100.f * stats.numVertices / std::max(stats.gpuVertexCapacity, 1u) << "%"
+                  << ", fragmentation " << (stats.numFreeVertices > 0 ? 100.f * (1.f - float(stats.largestFreeRange) / stats.numFreeVertices) : 0.f) << "%" << std::endl;
+	}
+
+    void BVHGeometry::resizeGpuBuffer(u32 _vertexCapacity)
+    {
+        if (m_gpuBuffer.ptr)
         {
-            std::cout << "Total loaded vertex: " << m_cpuBufferPosition.size() << std::endl;
-            _renderer->UploadBuffer(m_gpuBuffer, 0, &m_cpuBufferPosition[0], (u32)m_cpuBufferPosition.size() * sizeof(vec3));
-            _renderer->UploadBuffer(m_gpuBuffer, m_maxVertexCount * sizeof(vec3), &m_cpuBufferNormal[0], (u32)m_cpuBufferNormal.size() * sizeof(vec3));
-            _renderer->UploadBuffer(m_gpuBuffer, m_maxVertexCount * (sizeof(vec3) + sizeof(vec3)), &m_cpuBufferUv[0], (u32)m_cpuBufferUv.size() * sizeof(vec2));
-        }
-	}
-
-    void BVHGeometry::generateGeometryBufferBindings(BufferBinding& _positions, BufferBinding& _normals, BufferBinding& _texcoords) const
-    {
-        _positions = { { m_gpuBuffer, 0, m_maxVertexCount * sizeof(vec3) }, { 1, 0 } };
-        _normals = { { m_gpuBuffer, m_maxVertexCount * sizeof(vec3), m_maxVertexCount * sizeof(vec3) }, { 1, 1 } };
-        _texcoords = { { m_gpuBuffer, m_maxVertexCount * (sizeof(vec3) + sizeof(vec3)), m_maxVertexCount * sizeof(vec2) }, { 1, 2 } };
-    }
+            m_renderer->WaitForIdle();
+            m_renderer->DestroyBuffer(m_gpuBuffer);
+        }
+
+        m_gpuVertexCapacity = _vertexCapacity;
+        m_normalOffset = alignUp(g_positionStride * m_gpuVertexCapacity, g_streamAlignment);
+        m_texCoordOffset = alignUp(m_normalOffset + g_normalStride * m_gpuVertexCapacity, g_streamAlignment);
+        m_blockOffset = alignUp(m_texCoordOffset + g_texCoordStride * m_gpuVertexCapacity, g_streamAlignment);
+#if COMPRESSED_VERTEX_STREAMS
+        m_bufferSize = m_blockOffset + (u32)sizeof(VertexBlockHeader) * (m_gpuVertexCapacity / VERTEX_BLOCK_SIZE);
+#else
+        m_bufferSize = m_blockOffset;
+#endif
+        m_gpuBuffer = m_renderer->CreateBuffer(m_bufferSize, MemoryType::Default, BufferUsage::Storage | BufferUsage::Transfer, MemoryTag::Geometry);
+    }
+
+    void BVHGeometry::quantizeRange(u32 _vertexOffset, u32 _numVertex, VertexCompressionError& _error)
+    {
+#if COMPRESSED_VERTEX_STREAMS
+        TIM_ASSERT(_vertexOffset % VERTEX_BLOCK_SIZE == 0);
+        vec3* positions = m_cpuBufferPosition.data() + _vertexOffset;
+        vec3* normals = m_cpuBufferNormal.data() + _vertexOffset;
+        vec2* texCoords = m_cpuBufferUv.data() + _vertexOffset;
+
+        CompressedVertexStreams streams;
+        compressVertexStreams(_numVertex, positions, normals, texCoords, streams);
+
+        const VertexCompressionError error = measureVertexCompressionError(streams, positions, normals, texCoords);
+        _error.position = std::max(_error.position, error.position);
+        _error.normal = std::max(_error.normal, error.normal);
+        _error.texCoord = std::max(_error.texCoord, error.texCoord);
+
+        // Keep the decoded vertices on the CPU so the BVH is built on exactly what the shaders read
+        decompressVertexStreams(streams, positions, normals, texCoords);
+
+        std::copy(streams.positions.begin(), streams.positions.end(), m_compressedStreams.positions.begin() + _vertexOffset);
+        std::copy(streams.normals.begin(), streams.normals.end(), m_compressedStreams.normals.begin() + _vertexOffset);
+        std::copy(streams.texCoords.begin(), streams.texCoords.end(), m_compressedStreams.texCoords.begin() + _vertexOffset);
+        std::copy(streams.blocks.begin(), streams.blocks.end(), m_compressedStreams.blocks.begin() + _vertexOffset / VERTEX_BLOCK_SIZE);
+#endif
+    }
+
+    void BVHGeometry::uploadRange(u32 _vertexOffset, u32 _numVertex)
+    {
+#if COMPRESSED_VERTEX_STREAMS
+        const u32 firstBlock = _vertexOffset / VERTEX_BLOCK_SIZE;
+        const u32 numBlocks = (_numVertex + VERTEX_BLOCK_SIZE - 1) / VERTEX_BLOCK_SIZE;
+        m_renderer->UploadBuffer(m_gpuBuffer, _vertexOffset * sizeof(uvec2), &m_compressedStreams.positions[_vertexOffset], _numVertex * sizeof(uvec2));
+        m_renderer->UploadBuffer(m_gpuBuffer, m_normalOffset + _vertexOffset * sizeof(u32), &m_compressedStreams.normals[_vertexOffset], _numVertex * sizeof(u32));
+        m_renderer->UploadBuffer(m_gpuBuffer, m_texCoordOffset + _vertexOffset * sizeof(u32), &m_compressedStreams.texCoords[_vertexOffset], _numVertex * sizeof(u32));
+        m_renderer->UploadBuffer(m_gpuBuffer, m_blockOffset + firstBlock * sizeof(VertexBlockHeader), &m_compressedStreams.blocks[firstBlock], numBlocks * sizeof(VertexBlockHeader));
+#else
+        m_renderer->UploadBuffer(m_gpuBuffer, _vertexOffset * sizeof(vec3), m_cpuBufferPosition.data() + _vertexOffset, _numVertex * sizeof(vec3));
+        m_renderer->UploadBuffer(m_gpuBuffer, m_normalOffset + _vertexOffset * sizeof(vec3), m_cpuBufferNormal.data() + _vertexOffset, _numVertex * sizeof(vec3));
+        m_renderer->UploadBuffer(m_gpuBuffer, m_texCoordOffset + _vertexOffset * sizeof(vec2), m_cpuBufferUv.data() + _vertexOffset, _numVertex * sizeof(vec2));
+#endif
+    }
+
+    void BVHGeometry::generateGeometryBufferBindings(std::vector<BufferBinding>& _bindings) const
+    {
+        TIM_ASSERT(m_gpuBuffer.ptr);
+        _bindings.push_back({ { m_gpuBuffer, 0, m_normalOffset }, { 1, 0 } });
+        _bindings.push_back({ { m_gpuBuffer, m_normalOffset, m_texCoordOffset - m_normalOffset }, { 1, 1 } });
+        _bindings.push_back({ { m_gpuBuffer, m_texCoordOffset, m_blockOffset - m_texCoordOffset }, { 1, 2 } });
+#if COMPRESSED_VERTEX_STREAMS
+        _bindings.push_back({ { m_gpuBuffer, m_blockOffset, m_bufferSize - m_blockOffset }, { 1, 3 } });
+#endif
+    }
 }
\ No newline at end of file
@@ -1,12 +1,25 @@
 #pragma once
 #include "rtDevice/public/IRenderer.h"
+#include "VertexCompression.h"
+#include "timCore/RangeAllocator.h"
 
 namespace tim
 {
+	// Vertex streams of the scene. Vertex ranges are sub-allocated and can be freed while the others stay valid,
+	// the GPU buffer is sized to the content and grows on flush.
 	class BVHGeometry
 	{
 	public:
-		BVHGeometry(IRenderer* _renderer, u32 _numVertexInBuffer);
+		struct Stats
+		{
+			u32 numVertices = 0;        // allocated, padding included
+			u32 numFreeVertices = 0;    // in the holes left by freed ranges
+			u32 largestFreeRange = 0;
+			u32 gpuVertexCapacity = 0;
+			u32 gpuBufferSize = 0;
+		};
+
+		BVHGeometry(IRenderer* _renderer);
 		~BVHGeometry();
 
 		struct TriangleData
@@ -16,18 +29,73 @@ namespace tim
 		};
 		TriangleData addTriangle(vec3 _p0, vec3 _p1, vec3 _p2);
         u32 addTriangleList(u32 _numVertex, const vec3 * _positions, const vec3 * _normals, const vec2 * _texCoords = nullptr);
+        // Reserve _numVertex vertices written by the caller through getVertexStreams
+        u32 allocateVertices(u32 _numVertex);
+        // The range is reused by later allocations, triangles must not reference it anymore
+        void freeVertices(u32 _vertexOffset);
+        // Pointers stay valid until the next allocation
+        void getVertexStreams(u32 _vertexOffset, vec3*& _positions, vec3*& _normals, vec2*& _texCoords);
+        // The vertex at _vertexOffset + i moves to _vertexOffset + j where _newToOld[j] == i
+        void reorderVertices(u32 _vertexOffset, const std::vector<u32>& _newToOld);
+        // Move the positions of the range, uploaded with the next flush
+        void translateVertices(u32 _vertexOffset, vec3 _offset);
+        // Vertex count requested for the range, without the alignment padding
+        u32 getRangeSize(u32 _vertexOffset) const;
+        // offset, size of the live ranges sorted by offset
+        void getRanges(std::vector<uvec2>& _ranges) const;
         
         vec3 getVertexPosition(u32 _vertexOffet, u32 _index) const;
 
+        u32 getVertexCount() const { return (u32)m_cpuBufferPosition.size(); }
+        const vec3* getPositions() const { return m_cpuBufferPosition.data(); }
+        const vec3* getNormals() const { return m_cpuBufferNormal.data(); }
+        const vec2* getTexCoords() const { return m_cpuBufferUv.data(); }
+        Stats getStats() const;
+
+        // Content of the GPU buffer after a flush, see COMPRESSED_VERTEX_STREAMS for the layout. Sizes are in bytes.
+        struct GpuStreams
+        {
+            u32 numVertex = 0;
+            const void* positions = nullptr;
+            const void* normals = nullptr;
+            const void* texCoords = nullptr;
+            const void* blocks = nullptr;
+            u32 positionsSize = 0, normalsSize = 0, texCoordsSize = 0, blocksSize = 0;
+        };
+        GpuStreams getGpuStreams() const;
+        // Allocate _ranges (offset, size sorted by offset) in an empty geometry at the same offsets and fill them with _streams,
+        // saved by getGpuStreams. The next flush uploads them as they are, without quantizing them again.
+        void restoreGpuStreams(const GpuStreams& _streams, const uvec2* _ranges, u32 _numRanges);
+
+		// Quantize and upload the ranges written since the last flush. When the GPU buffer grows, the other live ranges
+		// are uploaded again as they were quantized.
 		void flush(IRenderer* _renderer);
-        void generateGeometryBufferBindings(BufferBinding& _positions, BufferBinding& _normals, BufferBinding& _texcoords) const;
+        void generateGeometryBufferBindings(std::vector<BufferBinding>& _bindings) const;
 
 	private:
+        void resizeGpuBuffer(u32 _vertexCapacity);
+        void quantizeRange(u32 _vertexOffset, u32 _numVertex, VertexCompressionError& _error);
+        void uploadRange(u32 _vertexOffset, u32 _numVertex);
+
 		IRenderer* m_renderer;
-		u32 m_maxVertexCount;
+        RangeAllocator m_allocator;
+        ska::flat_hash_map<u32, u32> m_rangeSizes;
+        std::vector<uvec2> m_dirtyRanges; // offset, count
+
 		BufferHandle m_gpuBuffer;
-		std::vector<vec3> m_cpuBufferPosition;
-		std::vector<vec3> m_cpuBufferNormal;
-		std::vector<vec2> m_cpuBufferUv;
+        u32 m_gpuVertexCapacity = 0;
+        // Stream offsets in m_gpuBuffer, see COMPRESSED_VERTEX_STREAMS for the layout
+        u32 m_normalOffset = 0;
+        u32 m_texCoordOffset = 0;
+        u32 m_blockOffset = 0;
+        u32 m_bufferSize = 0;
+
+		TaggedVector<vec3, MemoryTag::Geometry> m_cpuBufferPosition;
+		TaggedVector<vec3, MemoryTag::Geometry> m_cpuBufferNormal;
+		TaggedVector<vec2, MemoryTag::Geometry> m_cpuBufferUv;
+#if COMPRESSED_VERTEX_STREAMS
+        // Content of the GPU buffer, the streams of each range are encoded against their own header
+        CompressedVertexStreams m_compressedStreams;
+#endif
 	};
 }
\ No newline at end of file
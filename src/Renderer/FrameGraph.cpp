@@ -0,0 +1,331 @@
+#include "FrameGraph.h"
+#include "timCore/Common.h"
+
+#include <iostream>
+
+namespace tim
+{
+    FrameResource FrameGraph::PassBuilder::createBuffer(const char* _name, u32 _size, BufferUsage _usage, MemoryType _memType)
+    {
+        Resource resource = { _name, ResourceType::Buffer, false, _size, _usage, _memType };
+        return write(m_graph.addResource(std::move(resource)));
+    }
+
+    FrameResource FrameGraph::PassBuilder::createTexture(const char* _name, const ImageCreateInfo& _createInfo)
+    {
+        Resource resource = { _name, ResourceType::Texture, false, 0, BufferUsage::Storage, _createInfo.memory, _createInfo };
+        return write(m_graph.addResource(std::move(resource)));
+    }
+
+    FrameResource FrameGraph::PassBuilder::read(FrameResource _resource)
+    {
+        // Passes run in declaration order, a transient must be written by a previous pass
+        Resource& resource = m_graph.m_resources[_resource];
+        TIM_ASSERT(resource.imported || !resource.writers.empty());
+
+        resource.numReaders++;
+        m_graph.m_passes[m_pass].reads.push_back(_resource);
+        return _resource;
+    }
+
+    FrameResource FrameGraph::PassBuilder::write(FrameResource _resource)
+    {
+        m_graph.m_resources[_resource].writers.push_back(m_pass);
+        m_graph.m_passes[m_pass].writes.push_back(_resource);
+        return _resource;
+    }
+
+    void FrameGraph::PassBuilder::setSideEffect()
+    {
+        m_graph.m_passes[m_pass].sideEffect = true;
+    }
+
+    FrameGraph::FrameGraph(ResourceAllocator& _allocator) : m_allocator{ _allocator }
+    {
+
+    }
+
+    FrameGraph::~FrameGraph()
+    {
+#ifdef _DEBUG
+        for (const Resource& resource : m_resources)
+            TIM_ASSERT(resource.imported || resource.ptr == nullptr);
+#endif
+    }
+
+    FrameResource FrameGraph::importBuffer(const char* _name, BufferHandle _buffer, u32 _size)
+    {
+        Resource resource = { _name, ResourceType::Buffer, true, _size, BufferUsage::Storage, MemoryType::Default };
+        resource.ptr = _buffer.ptr;
+        return addResource(std::move(resource));
+    }
+
+    FrameResource FrameGraph::importTexture(const char* _name, ImageHandle _image)
+    {
+        Resource resource = { _name, ResourceType::Texture, true, 0, BufferUsage::Storage, MemoryType::Default };
+        resource.ptr = _image.ptr;
+        return addResource(std::move(resource));
+    }
+
+    void FrameGraph::addPass(const char* _name, const SetupFunc& _setup, ExecuteFunc _execute)
+    {
+        TIM_ASSERT(!m_compiled);
+
+        Pass pass;
+        pass.name = _name;
+        pass.execute = std::move(_execute);
+        m_passes.push_back(std::move(pass));
+
+        PassBuilder builder(*this, u32(m_passes.size() - 1));
+        _setup(builder);
+    }
+
+    void FrameGraph::compile()
+    {
+        TIM_ASSERT(!m_compiled);
+
+        cullPasses();
+        computeLifetimes();
+        computeMemoryReport();
+        m_compiled = true;
+    }
+
+    void FrameGraph::execute(IRenderContext* _context)
+    {
+        if (!m_compiled)
+            compile();
+
+        for (u32 i = 0; i < m_passes.size(); ++i)
+        {
+            Pass& pass = m_passes[i];
+            if (pass.culled)
+                continue;
+
+            for (FrameResource id : pass.writes)
+            {
+                Resource& resource = m_resources[id];
+                if (resource.imported || resource.firstPass != i || resource.ptr)
+                    continue;
+
+                if (resource.type == ResourceType::Buffer)
+                    resource.ptr = m_allocator.allocBuffer(resource.size, resource.bufferUsage, resource.memType).ptr;
+                else
+                    resource.ptr = m_allocator.allocTexture(resource.imageInfo).ptr;
+            }
+
+            if (_context)
+                _context->BeginScope(pass.name);
+            pass.execute(*this);
+            if (_context)
+                _context->EndScope();
+
+            // Released resources go back to the pool and are handed to the next transient with the same description
+            auto release = [this, i](FrameResource _id)
+            {
+                Resource& resource = m_resources[_id];
+                if (resource.imported || resource.lastPass != i || !resource.ptr)
+                    return;
+
+                if (resource.type == ResourceType::Buffer)
+                    m_allocator.releaseBuffer({ resource.ptr });
+                else
+                    m_allocator.releaseTexture({ resource.ptr });
+                resource.ptr = nullptr;
+            };
+
+            for (FrameResource id : pass.reads)
+                release(id);
+            for (FrameResource id : pass.writes)
+                release(id);
+        }
+    }
+
+    BufferHandle FrameGraph::getBuffer(FrameResource _resource) const
+    {
+        const Resource& resource = m_resources[_resource];
+        TIM_ASSERT(resource.type == ResourceType::Buffer && resource.ptr);
+        return { resource.ptr };
+    }
+
+    BufferView FrameGraph::getBufferView(FrameResource _resource) const
+    {
+        return { getBuffer(_resource), 0, m_resources[_resource].size };
+    }
+
+    ImageHandle FrameGraph::getTexture(FrameResource _resource) const
+    {
+        const Resource& resource = m_resources[_resource];
+        TIM_ASSERT(resource.type == ResourceType::Texture && resource.ptr);
+        return { resource.ptr };
+    }
+
+    void FrameGraph::printMemoryReport() const
+    {
+        std::cout << "Frame graph: " << m_report.numPasses - m_report.numCulledPasses << "/" << m_report.numPasses << " passes, "
+                  << m_report.numTransients << " transients in " << m_report.numPhysicalResources << " resources, "
+                  << m_report.transientBytes / 1024 << " KB without aliasing, " << m_report.aliasedBytes / 1024 << " KB with aliasing" << std::endl;
+    }
+
+    FrameResource FrameGraph::addResource(Resource&& _resource)
+    {
+        TIM_ASSERT(!m_compiled);
+        m_resources.push_back(std::move(_resource));
+        return FrameResource(m_resources.size() - 1);
+    }
+
+    u64 FrameGraph::getResourceSize(const Resource& _resource) const
+    {
+        return _resource.type == ResourceType::Buffer ? ResourceAllocator::getBufferSizeClass(_resource.size) : computeImageSize(_resource.imageInfo);
+    }
+
+    bool FrameGraph::canAlias(const Resource& _a, const Resource& _b) const
+    {
+        if (_a.type != _b.type)
+            return false;
+
+        if (_a.type == ResourceType::Texture)
+            return _a.imageInfo == _b.imageInfo;
+
+        return ResourceAllocator::getBufferSizeClass(_a.size) == ResourceAllocator::getBufferSizeClass(_b.size) && _a.bufferUsage == _b.bufferUsage && _a.memType == _b.memType;
+    }
+
+    void FrameGraph::cullPasses()
+    {
+        // Passes writing imported resources or with side effects are the roots, a pass is culled once none of its outputs is read
+        std::vector<u32> passRefs(m_passes.size());
+        std::vector<u32> resourceRefs(m_resources.size());
+        std::vector<FrameResource> unusedResources;
+        std::vector<u32> culledPasses;
+
+        auto isRoot = [this](const Pass& _pass)
+        {
+            if (_pass.sideEffect)
+                return true;
+
+            for (FrameResource id : _pass.writes)
+            {
+                if (m_resources[id].imported)
+                    return true;
+            }
+            return false;
+        };
+
+        for (u32 i = 0; i < m_passes.size(); ++i)
+        {
+            passRefs[i] = u32(m_passes[i].writes.size());
+            if (passRefs[i] == 0 && !isRoot(m_passes[i]))
+                culledPasses.push_back(i);
+        }
+
+        for (u32 i = 0; i < m_resources.size(); ++i)
+        {
+            resourceRefs[i] = m_resources[i].numReaders;
+            if (resourceRefs[i] == 0 && !m_resources[i].imported)
+                unusedResources.push_back(i);
+        }
+
+        while (!unusedResources.empty() || !culledPasses.empty())
+        {
+            if (!culledPasses.empty())
+            {
+                Pass& pass = m_passes[culledPasses.back()];
+                culledPasses.pop_back();
+                pass.culled = true;
+
+                for (FrameResource id : pass.reads)
+                {
+                    if (--resourceRefs[id] == 0 && !m_resources[id].imported)
+                        unusedResources.push_back(id);
+                }
+                continue;
+            }
+
+            const Resource& resource = m_resources[unusedResources.back()];
+            unusedResources.pop_back();
+
+            for (u32 writer : resource.writers)
+            {
+                if (--passRefs[writer] == 0 && !isRoot(m_passes[writer]))
+                    culledPasses.push_back(writer);
+            }
+        }
+    }
+
+    void FrameGraph::computeLifetimes()
+    {
+        for (u32 i = 0; i < m_passes.size(); ++i)
+        {
+            if (m_passes[i].culled)
+                continue;
+
+            for (const auto* list : { &m_passes[i].reads, &m_passes[i].writes })
+            {
+                for (FrameResource id : *list)
+                {
+                    m_resources[id].firstPass = std::min(m_resources[id].firstPass, i);
+                    m_resources[id].lastPass = std::max(m_resources[id].lastPass, i);
+                }
+            }
+        }
+    }
+
+    void FrameGraph::computeMemoryReport()
+    {
+        m_report = {};
+        m_report.numPasses = u32(m_passes.size());
+        for (const Pass& pass : m_passes)
+            m_report.numCulledPasses += pass.culled ? 1 : 0;
+
+        // Replay the pool on the lifetimes: a transient reuses a released resource with the same description
+        struct PhysicalResource
+        {
+            FrameResource desc;
+            bool isFree;
+        };
+        std::vector<PhysicalResource> physicals;
+        std::vector<u32> assignment(m_resources.size(), u32(-1));
+
+        for (u32 i = 0; i < m_passes.size(); ++i)
+        {
+            if (m_passes[i].culled)
+                continue;
+
+            for (FrameResource id : m_passes[i].writes)
+            {
+                const Resource& resource = m_resources[id];
+                if (resource.imported || resource.firstPass != i || assignment[id] != u32(-1))
+                    continue;
+
+                m_report.numTransients++;
+                m_report.transientBytes += getResourceSize(resource);
+
+                for (u32 p = 0; p < physicals.size() && assignment[id] == u32(-1); ++p)
+                {
+                    if (physicals[p].isFree && canAlias(resource, m_resources[physicals[p].desc]))
+                    {
+                        physicals[p].isFree = false;
+                        assignment[id] = p;
+                    }
+                }
+
+                if (assignment[id] == u32(-1))
+                {
+                    assignment[id] = u32(physicals.size());
+                    physicals.push_back({ id, false });
+                    m_report.aliasedBytes += getResourceSize(resource);
+                }
+            }
+
+            for (const auto* list : { &m_passes[i].reads, &m_passes[i].writes })
+            {
+                for (FrameResource id : *list)
+                {
+                    if (!m_resources[id].imported && m_resources[id].lastPass == i && assignment[id] != u32(-1))
+                        physicals[assignment[id]].isFree = true;
+                }
+            }
+        }
+
+        m_report.numPhysicalResources = u32(physicals.size());
+    }
+}
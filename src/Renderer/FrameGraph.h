@@ -0,0 +1,117 @@
+#pragma once
+#include "rtDevice/public/IRenderer.h"
+#include "resourceAllocator.h"
+
+#include <functional>
+#include <vector>
+
+namespace tim
+{
+    using FrameResource = u32;
+
+    struct FrameGraphMemoryReport
+    {
+        u32 numPasses = 0;
+        u32 numCulledPasses = 0;
+        u32 numTransients = 0;
+        u32 numPhysicalResources = 0;
+        u64 transientBytes = 0; // every transient with its own memory
+        u64 aliasedBytes = 0;   // transients with disjoint lifetimes sharing the same resource
+    };
+
+    // Per frame list of passes declaring the virtual resources they read and write. The graph culls the passes
+    // whose outputs are never used, allocates the transients from the pool at their first use and releases
+    // them after their last one so that transients with disjoint lifetimes share the same memory
+    class FrameGraph
+    {
+    public:
+        class PassBuilder
+        {
+        public:
+            // Transients are written by the pass creating them
+            FrameResource createBuffer(const char* _name, u32 _size, BufferUsage _usage, MemoryType _memType = MemoryType::Default);
+            FrameResource createTexture(const char* _name, const ImageCreateInfo& _createInfo);
+
+            FrameResource read(FrameResource _resource);
+            FrameResource write(FrameResource _resource);
+
+            // Keep the pass even when nothing reads its outputs, for passes updating persistent data
+            void setSideEffect();
+
+        private:
+            friend class FrameGraph;
+            PassBuilder(FrameGraph& _graph, u32 _pass) : m_graph{ _graph }, m_pass{ _pass } {}
+
+            FrameGraph& m_graph;
+            u32 m_pass;
+        };
+
+        using SetupFunc = std::function<void(PassBuilder&)>;
+        using ExecuteFunc = std::function<void(const FrameGraph&)>;
+
+        FrameGraph(ResourceAllocator& _allocator);
+        ~FrameGraph();
+
+        // External resources, a pass writing one is never culled
+        FrameResource importBuffer(const char* _name, BufferHandle _buffer, u32 _size);
+        FrameResource importTexture(const char* _name, ImageHandle _image);
+
+        // _setup runs immediately, _execute runs in declaration order during execute()
+        void addPass(const char* _name, const SetupFunc& _setup, ExecuteFunc _execute);
+
+        void compile();
+        // Each pass runs in a scope of _context named after the pass
+        void execute(IRenderContext* _context = nullptr);
+
+        BufferHandle getBuffer(FrameResource _resource) const;
+        BufferView getBufferView(FrameResource _resource) const;
+        ImageHandle getTexture(FrameResource _resource) const;
+
+        const FrameGraphMemoryReport& getMemoryReport() const { return m_report; }
+        void printMemoryReport() const;
+
+    private:
+        enum class ResourceType { Buffer, Texture };
+
+        struct Resource
+        {
+            const char* name;
+            ResourceType type;
+            bool imported;
+            u32 size; // byte range of buffers
+            BufferUsage bufferUsage;
+            MemoryType memType;
+            ImageCreateInfo imageInfo = ImageCreateInfo(ImageFormat::RGBA8, 0, 0);
+
+            void* ptr = nullptr;
+            std::vector<u32> writers;
+            u32 numReaders = 0;
+            u32 firstPass = u32(-1);
+            u32 lastPass = 0;
+        };
+
+        struct Pass
+        {
+            const char* name;
+            ExecuteFunc execute;
+            std::vector<FrameResource> reads;
+            std::vector<FrameResource> writes;
+            bool sideEffect = false;
+            bool culled = false;
+        };
+
+        FrameResource addResource(Resource&& _resource);
+        u64 getResourceSize(const Resource& _resource) const;
+        bool canAlias(const Resource& _a, const Resource& _b) const;
+        void cullPasses();
+        void computeLifetimes();
+        void computeMemoryReport();
+
+    private:
+        ResourceAllocator& m_allocator;
+        std::vector<Resource> m_resources;
+        std::vector<Pass> m_passes;
+        FrameGraphMemoryReport m_report;
+        bool m_compiled = false;
+    };
+}
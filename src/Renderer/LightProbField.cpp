@@ -14,12 +14,12 @@ namespace tim
 
 		for (u32 i = 0; i < 2; ++i)
 		{
-			lightProbFieldR[i] = _renderer->CreateImage(descriptor);
-			lightProbFieldG[i] = _renderer->CreateImage(descriptor);
-			lightProbFieldB[i] = _renderer->CreateImage(descriptor);
+			lightProbFieldR[i] = _renderer->CreateImage(descriptor, MemoryTag::LightProbField);
+			lightProbFieldG[i] = _renderer->CreateImage(descriptor, MemoryTag::LightProbField);
+			lightProbFieldB[i] = _renderer->CreateImage(descriptor, MemoryTag::LightProbField);
 		}
 
-		lightProbFieldY00 = _renderer->CreateImage(descriptor);
+		lightProbFieldY00 = _renderer->CreateImage(descriptor, MemoryTag::LightProbField);
 	}
 
 	void LightProbField::free(IRenderer* _renderer)
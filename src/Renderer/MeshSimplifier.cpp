@@ -0,0 +1,424 @@
+#include "MeshSimplifier.h"
+#include "timCore/Common.h"
+#include "timCore/flat_hash_map.h"
+
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cfloat>
+
+namespace tim
+{
+    namespace
+    {
+        // Subdivisions of the barycentric grid sampling each triangle for the reported error, corners and edge midpoints included
+        constexpr u32 g_ErrorSampleSteps = 4;
+
+        // Sum of the squared distances to a set of planes, weighted by the area of the triangles they come from
+        struct Quadric
+        {
+            double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+            double a11 = 0, a12 = 0, a13 = 0;
+            double a22 = 0, a23 = 0;
+            double a33 = 0;
+            double weight = 0;
+
+            void addPlane(vec3 _n, float _d, double _w)
+            {
+                a00 += _w * _n.x * _n.x; a01 += _w * _n.x * _n.y; a02 += _w * _n.x * _n.z; a03 += _w * _n.x * _d;
+                a11 += _w * _n.y * _n.y; a12 += _w * _n.y * _n.z; a13 += _w * _n.y * _d;
+                a22 += _w * _n.z * _n.z; a23 += _w * _n.z * _d;
+                a33 += _w * _d * _d;
+                weight += _w;
+            }
+
+            void add(const Quadric& _q)
+            {
+                a00 += _q.a00; a01 += _q.a01; a02 += _q.a02; a03 += _q.a03;
+                a11 += _q.a11; a12 += _q.a12; a13 += _q.a13;
+                a22 += _q.a22; a23 += _q.a23;
+                a33 += _q.a33;
+                weight += _q.weight;
+            }
+
+            double evaluate(vec3 _p) const
+            {
+                const double x = _p.x, y = _p.y, z = _p.z;
+                return a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+                     + a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+                     + a22 * z * z + 2 * a23 * z
+                     + a33;
+            }
+        };
+
+        bool samePosition(vec3 _a, vec3 _b)
+        {
+            return _a.x == _b.x && _a.y == _b.y && _a.z == _b.z;
+        }
+
+        u64 edgeKey(u32 _a, u32 _b)
+        {
+            return _a < _b ? (u64(_a) << 32) | _b : (u64(_b) << 32) | _a;
+        }
+
+        // Real-Time Collision Detection, 5.1.5
+        vec3 closestPointOnTriangle(vec3 _p, vec3 _a, vec3 _b, vec3 _c)
+        {
+            const vec3 ab = _b - _a, ac = _c - _a, ap = _p - _a;
+            const float d1 = dot(ab, ap), d2 = dot(ac, ap);
+            if (d1 <= 0 && d2 <= 0)
+                return _a;
+
+            const vec3 bp = _p - _b;
+            const float d3 = dot(ab, bp), d4 = dot(ac, bp);
+            if (d3 >= 0 && d4 <= d3)
+                return _b;
+
+            const float vc = d1 * d4 - d3 * d2;
+            if (vc <= 0 && d1 >= 0 && d3 <= 0)
+                return _a + ab * (d1 / (d1 - d3));
+
+            const vec3 cp = _p - _c;
+            const float d5 = dot(ab, cp), d6 = dot(ac, cp);
+            if (d6 >= 0 && d5 <= d6)
+                return _c;
+
+            const float vb = d5 * d2 - d1 * d6;
+            if (vb <= 0 && d2 >= 0 && d6 <= 0)
+                return _a + ac * (d2 / (d2 - d6));
+
+            const float va = d3 * d6 - d5 * d4;
+            if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+                return _b + (_c - _b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+            const float denom = 1.f / (va + vb + vc);
+            return _a + ab * (vb * denom) + ac * (vc * denom);
+        }
+
+        struct Collapse
+        {
+            u32 from, to;
+            double cost; // mean squared distance
+        };
+    }
+
+    void simplifyMesh(const vec3* _positions, u32 _numVertex, const u32* _indices, const u32* _groups, u32 _numTriangle,
+                      u32 _targetTriangleCount, float _maxError, SimplifiedMesh& _result)
+    {
+        // Collapses work on welded vertices, the vertices sharing a position map to the first of them
+        std::vector<u32> welded(_numVertex);
+        {
+            std::vector<u32> sorted(_numVertex);
+            std::iota(sorted.begin(), sorted.end(), 0);
+            std::sort(sorted.begin(), sorted.end(), [_positions](u32 _a, u32 _b)
+            {
+                const vec3 a = _positions[_a], b = _positions[_b];
+                return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+            });
+
+            for (u32 i = 0; i < _numVertex; ++i)
+                welded[sorted[i]] = (i > 0 && samePosition(_positions[sorted[i]], _positions[sorted[i - 1]])) ? welded[sorted[i - 1]] : sorted[i];
+        }
+
+        auto isDegenerate = [&welded](const u32* _tri)
+        {
+            return welded[_tri[0]] == welded[_tri[1]] || welded[_tri[1]] == welded[_tri[2]] || welded[_tri[0]] == welded[_tri[2]];
+        };
+
+        std::vector<u32>& indices = _result.indices;
+        std::vector<u32>& groups = _result.groups;
+        indices.clear();
+        groups.clear();
+        for (u32 i = 0; i < _numTriangle; ++i)
+        {
+            if (isDegenerate(_indices + i * 3))
+                continue;
+
+            indices.insert(indices.end(), _indices + i * 3, _indices + i * 3 + 3);
+            groups.push_back(_groups[i]);
+        }
+
+        // Seams and group boundaries never move
+        std::vector<ubyte> seamOrBoundary(_numVertex, 0);
+        std::vector<u32> vertexGroup(_numVertex, u32(-1));
+        std::vector<Quadric> quadrics(_numVertex);
+        for (u32 v = 0; v < _numVertex; ++v)
+        {
+            if (welded[v] != v)
+                seamOrBoundary[welded[v]] = 1;
+        }
+
+        for (u32 t = 0; t < groups.size(); ++t)
+        {
+            const u32 w[3] = { welded[indices[t * 3]], welded[indices[t * 3 + 1]], welded[indices[t * 3 + 2]] };
+            for (u32 k = 0; k < 3; ++k)
+            {
+                if (vertexGroup[w[k]] == u32(-1))
+                    vertexGroup[w[k]] = groups[t];
+                else if (vertexGroup[w[k]] != groups[t])
+                    seamOrBoundary[w[k]] = 1;
+            }
+
+            const vec3 p0 = _positions[w[0]], p1 = _positions[w[1]], p2 = _positions[w[2]];
+            vec3 normal = cross(p1 - p0, p2 - p0);
+            const float area2 = length(normal);
+            if (area2 > 0)
+            {
+                normal /= area2;
+                for (u32 k = 0; k < 3; ++k)
+                    quadrics[w[k]].addPlane(normal, -dot(normal, p0), area2 * 0.5);
+            }
+        }
+
+        const double maxCost = double(_maxError) * _maxError;
+
+        std::vector<ubyte> locked;
+        std::vector<ubyte> touched;
+        std::vector<u32> adjacencyOffset;
+        std::vector<u32> adjacency;
+        std::vector<Collapse> collapses;
+        std::vector<u32> remap(_numVertex);
+        std::vector<u32> collapsedInto(_numVertex);
+        std::iota(collapsedInto.begin(), collapsedInto.end(), 0);
+        ska::flat_hash_map<u64, u32> edgeCounts;
+
+        // Triangles around each welded vertex
+        auto buildAdjacency = [&](const std::vector<u32>& _triIndices, std::vector<u32>& _offsets, std::vector<u32>& _triangles)
+        {
+            _offsets.assign(_numVertex + 1, 0);
+            for (u32 index : _triIndices)
+                _offsets[welded[index] + 1]++;
+            std::partial_sum(_offsets.begin(), _offsets.end(), _offsets.begin());
+            _triangles.resize(_triIndices.size());
+            for (u32 i = 0; i < _triIndices.size(); ++i)
+                _triangles[_offsets[welded[_triIndices[i]]]++] = i / 3;
+            for (u32 v = _numVertex; v > 0; --v)
+                _offsets[v] = _offsets[v - 1];
+            _offsets[0] = 0;
+        };
+
+        // Triangles of the source mesh, the distance of the removed vertices is measured on the neighbourhood they had
+        std::vector<u32> sourceIndices = indices;
+        std::vector<u32> sourceAdjacencyOffset, sourceAdjacency;
+        buildAdjacency(sourceIndices, sourceAdjacencyOffset, sourceAdjacency);
+
+        // Each pass applies the cheapest collapses whose neighbourhoods do not overlap
+        u32 numTriangle = u32(groups.size());
+        while (numTriangle > _targetTriangleCount)
+        {
+            // Vertices on open or non manifold edges are locked as well
+            locked = seamOrBoundary;
+            edgeCounts.clear();
+            for (u32 i = 0; i < indices.size(); ++i)
+                edgeCounts[edgeKey(welded[indices[i]], welded[indices[i - i % 3 + (i + 1) % 3]])]++;
+
+            for (const auto& [key, count] : edgeCounts)
+            {
+                if (count != 2)
+                {
+                    locked[u32(key >> 32)] = 1;
+                    locked[u32(key & 0xFFFFFFFF)] = 1;
+                }
+            }
+
+            collapses.clear();
+            for (u32 i = 0; i < indices.size(); ++i)
+            {
+                const u32 from = welded[indices[i]];
+                const u32 to = welded[indices[i - i % 3 + (i + 1) % 3]];
+                for (u32 k = 0; k < 2; ++k)
+                {
+                    const u32 a = k == 0 ? from : to;
+                    const u32 b = k == 0 ? to : from;
+                    if (locked[a])
+                        continue;
+
+                    const double weight = quadrics[a].weight + quadrics[b].weight;
+                    const double error = quadrics[a].evaluate(_positions[b]) + quadrics[b].evaluate(_positions[b]);
+                    collapses.push_back({ a, b, weight > 0 ? std::max(error, 0.0) / weight : 0 });
+                }
+            }
+
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& _a, const Collapse& _b) { return _a.cost < _b.cost; });
+
+            buildAdjacency(indices, adjacencyOffset, adjacency);
+
+            std::iota(remap.begin(), remap.end(), 0);
+            touched.assign(_numVertex, 0);
+            u32 numCollapses = 0;
+
+            for (const Collapse& collapse : collapses)
+            {
+                if (numTriangle <= _targetTriangleCount || collapse.cost > maxCost)
+                    break;
+
+                if (touched[collapse.from] || touched[collapse.to])
+                    continue;
+
+                // Reject collapses flipping a triangle, the triangles sharing the edge are removed
+                const vec3 target = _positions[collapse.to];
+                u32 toVertex = u32(-1);
+                u32 numRemoved = 0;
+                bool flip = false;
+                for (u32 a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1] && !flip; ++a)
+                {
+                    const u32* tri = &indices[adjacency[a] * 3];
+                    vec3 p[3];
+                    u32 fromCorner = 0;
+                    bool hasTo = false;
+                    for (u32 k = 0; k < 3; ++k)
+                    {
+                        const u32 w = welded[tri[k]];
+                        p[k] = _positions[w];
+                        fromCorner = w == collapse.from ? k : fromCorner;
+                        if (w == collapse.to)
+                        {
+                            hasTo = true;
+                            toVertex = tri[k];
+                        }
+                    }
+
+                    if (hasTo)
+                    {
+                        numRemoved++;
+                        continue;
+                    }
+
+                    const vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+                    p[fromCorner] = target;
+                    const vec3 after = cross(p[1] - p[0], p[2] - p[0]);
+                    flip = dot(before, after) <= 0;
+                }
+
+                if (flip || numRemoved == 0)
+                    continue;
+
+                // Unlocked vertices are never on a seam, the collapsed vertex is the only one at its position
+                remap[collapse.from] = toVertex;
+                collapsedInto[collapse.from] = toVertex;
+                quadrics[collapse.to].add(quadrics[collapse.from]);
+                numTriangle -= numRemoved;
+                numCollapses++;
+
+                for (u32 a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1]; ++a)
+                {
+                    const u32* tri = &indices[adjacency[a] * 3];
+                    for (u32 k = 0; k < 3; ++k)
+                        touched[welded[tri[k]]] = 1;
+                }
+            }
+
+            if (numCollapses == 0)
+                break;
+
+            u32 numKept = 0;
+            for (u32 t = 0; t < groups.size(); ++t)
+            {
+                u32 tri[3] = { remap[indices[t * 3]], remap[indices[t * 3 + 1]], remap[indices[t * 3 + 2]] };
+                if (isDegenerate(tri))
+                    continue;
+
+                std::copy(tri, tri + 3, &indices[numKept * 3]);
+                groups[numKept++] = groups[t];
+            }
+            indices.resize(numKept * 3);
+            groups.resize(numKept);
+            TIM_ASSERT(numKept == numTriangle);
+        }
+
+        // The quadric cost is a mean squared distance, the reported error is measured on the result : a two sided Hausdorff distance
+        // sampled on both meshes. A source triangle searches the simplified triangles around the vertices its corners collapsed into,
+        // a simplified triangle the source triangles around the vertices collapsed into its corners, one more ring each. Both are
+        // subsets of the other surface so the sampled distances are upper bounds.
+        buildAdjacency(indices, adjacencyOffset, adjacency);
+
+        for (u32 v = 0; v < _numVertex; ++v)
+        {
+            u32 last = v;
+            while (collapsedInto[last] != last)
+                last = collapsedInto[last];
+            remap[v] = welded[last];
+        }
+
+        // Welded source vertices per remaining vertex
+        std::vector<u32> footprintOffset(_numVertex + 1, 0);
+        std::vector<u32> footprint;
+        for (u32 v = 0; v < _numVertex; ++v)
+        {
+            if (welded[v] == v)
+                footprintOffset[remap[v] + 1]++;
+        }
+        std::partial_sum(footprintOffset.begin(), footprintOffset.end(), footprintOffset.begin());
+        footprint.resize(footprintOffset[_numVertex]);
+        {
+            std::vector<u32> cursor(footprintOffset.begin(), footprintOffset.end() - 1);
+            for (u32 v = 0; v < _numVertex; ++v)
+            {
+                if (welded[v] == v)
+                    footprint[cursor[remap[v]]++] = v;
+            }
+        }
+
+        std::vector<u32> candidates;
+        float maxDistance = 0;
+        auto measureTriangle = [&](const u32* _tri, const std::vector<u32>& _otherIndices, const std::vector<u32>& _otherOffset, const std::vector<u32>& _otherAdjacency)
+        {
+            // One more ring of triangles around the seeds
+            const size_t numSeeds = candidates.size();
+            for (size_t c = 0; c < numSeeds; ++c)
+            {
+                for (u32 k = 0; k < 3; ++k)
+                {
+                    const u32 v = welded[_otherIndices[candidates[c] * 3 + k]];
+                    candidates.insert(candidates.end(), _otherAdjacency.begin() + _otherOffset[v], _otherAdjacency.begin() + _otherOffset[v + 1]);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end());
+            candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+            const vec3 p0 = _positions[_tri[0]], p1 = _positions[_tri[1]], p2 = _positions[_tri[2]];
+            for (u32 i = 0; i <= g_ErrorSampleSteps; ++i)
+            {
+                for (u32 j = 0; i + j <= g_ErrorSampleSteps; ++j)
+                {
+                    const float u = float(i) / g_ErrorSampleSteps, v = float(j) / g_ErrorSampleSteps;
+                    const vec3 p = p0 * (1 - u - v) + p1 * u + p2 * v;
+
+                    // Samples closer than the current maximum cannot raise it
+                    float distance = FLT_MAX;
+                    for (u32 c = 0; c < candidates.size() && distance > maxDistance; ++c)
+                    {
+                        const u32* tri = &_otherIndices[candidates[c] * 3];
+                        distance = std::min(distance, length(p - closestPointOnTriangle(p, _positions[tri[0]], _positions[tri[1]], _positions[tri[2]])));
+                    }
+                    maxDistance = std::max(maxDistance, distance);
+                }
+            }
+        };
+
+        for (u32 t = 0; t * 3 < sourceIndices.size(); ++t)
+        {
+            candidates.clear();
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const u32 v = remap[welded[sourceIndices[t * 3 + k]]];
+                candidates.insert(candidates.end(), adjacency.begin() + adjacencyOffset[v], adjacency.begin() + adjacencyOffset[v + 1]);
+            }
+            measureTriangle(&sourceIndices[t * 3], indices, adjacencyOffset, adjacency);
+        }
+
+        for (u32 t = 0; t < groups.size(); ++t)
+        {
+            candidates.clear();
+            for (u32 k = 0; k < 3; ++k)
+            {
+                const u32 v = welded[indices[t * 3 + k]];
+                for (u32 f = footprintOffset[v]; f < footprintOffset[v + 1]; ++f)
+                    candidates.insert(candidates.end(), sourceAdjacency.begin() + sourceAdjacencyOffset[footprint[f]], sourceAdjacency.begin() + sourceAdjacencyOffset[footprint[f] + 1]);
+            }
+            measureTriangle(&indices[t * 3], sourceIndices, sourceAdjacencyOffset, sourceAdjacency);
+        }
+
+        _result.error = maxDistance;
+    }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "timCore/type.h"
+
+#include <vector>
+
+namespace tim
+{
+    // Quadric edge collapse (Garland & Heckbert). A vertex only collapses onto one of its neighbours so the result indexes
+    // a subset of the input vertices. Open borders, attribute seams (same position, different vertices) and group
+    // boundaries (one group per triangle, the material) are locked.
+    struct SimplifiedMesh
+    {
+        std::vector<u32> indices;
+        std::vector<u32> groups;
+        float error = 0; // world space, sampled two sided Hausdorff distance between the source and the simplified triangles
+    };
+
+    // Collapse until _targetTriangleCount is reached or the next collapse would exceed _maxError
+    void simplifyMesh(const vec3* _positions, u32 _numVertex, const u32* _indices, const u32* _groups, u32 _numTriangle,
+                      u32 _targetTriangleCount, float _maxError, SimplifiedMesh& _result);
+}
@@ -0,0 +1,653 @@
+#include "ObjParser.h"
+#include "timCore/Common.h"
+#include "timCore/MappedFile.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <map>
+
+namespace tim
+{
+    struct ObjParser::Chunk
+    {
+        enum class StatementType { Group, Object, UseMtl, MtlLib };
+
+        // Statements changing the shape or the material, _triangle is the number of triangles of the chunk emitted before them
+        struct Statement
+        {
+            StatementType type;
+            u32 triangle;
+            std::string name;
+        };
+
+        enum RelativeFlags : ubyte
+        {
+            RelativeVertex = 1,
+            RelativeTexcoord = 2,
+            RelativeNormal = 4,
+        };
+
+        const char* begin = nullptr;
+        const char* end = nullptr;
+
+        std::vector<float> vertices;
+        std::vector<float> normals;
+        std::vector<float> texcoords;
+        std::vector<tinyobj::index_t> indices; // 3 per triangle
+        std::vector<ubyte> relativeFlags;      // per index, only filled once the chunk meets a negative index
+        bool hasRelativeIndices = false;
+        std::vector<Statement> statements;
+
+        std::string error;
+        u32 errorLine = 0;
+
+        // Filled by the merge
+        u32 vertexOffset = 0;
+        u32 normalOffset = 0;
+        u32 texcoordOffset = 0;
+        u32 triangleOffset = 0;
+    };
+
+    namespace
+    {
+        inline bool isSpace(char _c) { return _c == ' ' || _c == '\t'; }
+
+        inline const char* skipSpaces(const char* _p, const char* _end)
+        {
+            while (_p < _end && isSpace(*_p))
+                ++_p;
+            return _p;
+        }
+
+        const char* parseFloat(const char* _p, const char* _end, float& _value)
+        {
+            _value = 0;
+            _p = skipSpaces(_p, _end);
+            if (_p < _end && *_p == '+')
+                ++_p;
+
+            std::from_chars_result res = std::from_chars(_p, _end, _value);
+            if (res.ec == std::errc::invalid_argument)
+                return _p;
+
+            return res.ptr;
+        }
+
+        const char* parseInt(const char* _p, const char* _end, int& _value)
+        {
+            bool negative = false;
+            if (_p < _end && (*_p == '-' || *_p == '+'))
+                negative = *_p++ == '-';
+
+            int value = 0;
+            while (_p < _end && *_p >= '0' && *_p <= '9')
+                value = value * 10 + (*_p++ - '0');
+
+            _value = negative ? -value : value;
+            return _p;
+        }
+
+        // OBJ indices are 1 based, negative ones are relative to the current attribute count
+        bool resolveIndex(int _objIndex, u32 _count, int& _index, bool& _relative)
+        {
+            if (_objIndex == 0)
+                return false;
+
+            _relative = _objIndex < 0;
+            _index = _relative ? int(_count) + _objIndex : _objIndex - 1;
+            return true;
+        }
+
+        std::string parseName(const char*& _p, const char* _end)
+        {
+            _p = skipSpaces(_p, _end);
+            const char* start = _p;
+            while (_p < _end && !isSpace(*_p))
+                ++_p;
+            return std::string(start, _p);
+        }
+
+        template<typename Fn>
+        void parallelFor(ThreadPool& _pool, size_t _count, Fn _fn)
+        {
+            if (_count == 1)
+            {
+                _fn(0);
+                return;
+            }
+
+            for (size_t i = 0; i < _count; ++i)
+                _pool.submit([&_fn, i] { _fn(i); });
+            _pool.waitIdle();
+        }
+    }
+
+    static void parseChunk(ObjParser::Chunk& _chunk);
+
+    ObjParser::ObjParser(u32 _numThreads) : m_threadPool{ _numThreads }
+    {
+    }
+
+    bool ObjParser::load(const std::string& _path, const char* _mtlBaseDir, tinyobj::attrib_t& _attrib, std::vector<tinyobj::shape_t>& _shapes,
+                         std::vector<tinyobj::material_t>& _materials, std::string& _warn, std::string& _err)
+    {
+        _attrib = tinyobj::attrib_t();
+        _shapes.clear();
+        m_materialFiles.clear();
+
+        MappedFile file;
+        if (!file.open(_path))
+        {
+            _err = "Cannot open file [" + _path + "]\n";
+            return false;
+        }
+
+        // Split at line boundaries, a few chunks per thread to balance uneven lines
+        const char* fileBegin = reinterpret_cast<const char*>(file.data());
+        const char* fileEnd = fileBegin + file.size();
+
+        const u64 maxChunks = std::max<u64>(1, file.size() / MinChunkSize);
+        const u64 numChunks = std::min<u64>(maxChunks, u64(m_threadPool.getNumThreads()) * 4);
+        const u64 chunkSize = file.size() / numChunks;
+
+        std::vector<Chunk> chunks;
+        chunks.reserve(numChunks);
+        for (const char* p = fileBegin; p < fileEnd; )
+        {
+            const char* end = p + std::min<u64>(chunkSize, u64(fileEnd - p));
+            if (chunks.size() + 1 == numChunks)
+                end = fileEnd;
+
+            const char* lineEnd = (const char*)memchr(end, '\n', fileEnd - end);
+            end = lineEnd ? lineEnd + 1 : fileEnd;
+
+            Chunk& chunk = chunks.emplace_back();
+            chunk.begin = p;
+            chunk.end = end;
+            p = end;
+        }
+
+        parallelFor(m_threadPool, chunks.size(), [&](size_t i) { parseChunk(chunks[i]); });
+
+        u32 lineOffset = 0;
+        for (const Chunk& chunk : chunks)
+        {
+            if (!chunk.error.empty())
+            {
+                std::stringstream ss;
+                ss << chunk.error << " (line " << lineOffset + chunk.errorLine << ".)\n";
+                _err = ss.str();
+                return false;
+            }
+            lineOffset += u32(std::count(chunk.begin, chunk.end, '\n'));
+        }
+
+        // Prefix sums over the attribute and triangle counts
+        u32 numVertices = 0, numNormals = 0, numTexcoords = 0, numTriangles = 0;
+        for (Chunk& chunk : chunks)
+        {
+            chunk.vertexOffset = numVertices;
+            chunk.normalOffset = numNormals;
+            chunk.texcoordOffset = numTexcoords;
+            chunk.triangleOffset = numTriangles;
+
+            numVertices += u32(chunk.vertices.size() / 3);
+            numNormals += u32(chunk.normals.size() / 3);
+            numTexcoords += u32(chunk.texcoords.size() / 2);
+            numTriangles += u32(chunk.indices.size() / 3);
+        }
+
+        _attrib.vertices.resize(size_t(numVertices) * 3);
+        _attrib.normals.resize(size_t(numNormals) * 3);
+        _attrib.texcoords.resize(size_t(numTexcoords) * 2);
+
+        std::vector<uvec4> outOfBounds(chunks.size());
+        parallelFor(m_threadPool, chunks.size(), [&](size_t i)
+        {
+            Chunk& chunk = chunks[i];
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), _attrib.vertices.begin() + size_t(chunk.vertexOffset) * 3);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), _attrib.normals.begin() + size_t(chunk.normalOffset) * 3);
+            std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), _attrib.texcoords.begin() + size_t(chunk.texcoordOffset) * 2);
+
+            for (size_t j = 0; j < chunk.relativeFlags.size(); ++j)
+            {
+                tinyobj::index_t& index = chunk.indices[j];
+                const ubyte flags = chunk.relativeFlags[j];
+                if (flags & Chunk::RelativeVertex)      index.vertex_index += int(chunk.vertexOffset);
+                if (flags & Chunk::RelativeTexcoord)    index.texcoord_index += int(chunk.texcoordOffset);
+                if (flags & Chunk::RelativeNormal)      index.normal_index += int(chunk.normalOffset);
+            }
+
+            for (const tinyobj::index_t& index : chunk.indices)
+            {
+                outOfBounds[i].x |= index.vertex_index < 0 || u32(index.vertex_index) >= numVertices;
+                outOfBounds[i].y |= index.texcoord_index >= int(numTexcoords) || index.texcoord_index < -1;
+                outOfBounds[i].z |= index.normal_index >= int(numNormals) || index.normal_index < -1;
+            }
+        });
+
+        for (const uvec4& oob : outOfBounds)
+        {
+            if (oob.x) _warn += "Vertex indices out of bounds\n";
+            if (oob.y) _warn += "Vertex texcoord indices out of bounds\n";
+            if (oob.z) _warn += "Vertex normal indices out of bounds\n";
+        }
+
+        // Shapes and material runs, in file order
+        struct ShapeRange
+        {
+            std::string name;
+            u32 begin, end;
+        };
+        std::vector<ShapeRange> shapeRanges;
+        std::vector<std::pair<u32, int>> materialRuns = { { 0, -1 } };
+
+        std::string baseDir = _mtlBaseDir ? _mtlBaseDir : "";
+        if (!baseDir.empty() && baseDir.back() != '/' && baseDir.back() != '\\')
+            baseDir += '/';
+        tinyobj::MaterialFileReader materialReader(baseDir);
+        std::map<std::string, int> materialMap;
+
+        std::string curName;
+        u32 shapeBegin = 0;
+        for (const Chunk& chunk : chunks)
+        {
+            for (const Chunk::Statement& statement : chunk.statements)
+            {
+                const u32 triangle = chunk.triangleOffset + statement.triangle;
+                switch (statement.type)
+                {
+                case Chunk::StatementType::Group:
+                case Chunk::StatementType::Object:
+                    if (triangle > shapeBegin)
+                        shapeRanges.push_back({ curName, shapeBegin, triangle });
+                    shapeBegin = triangle;
+                    curName = statement.name;
+                    break;
+
+                case Chunk::StatementType::UseMtl:
+                {
+                    int materialId = -1;
+                    auto it = materialMap.find(statement.name);
+                    if (it != materialMap.end())
+                        materialId = it->second;
+                    else
+                        _warn += "material [ '" + statement.name + "' ] not found in .mtl\n";
+
+                    if (materialId != materialRuns.back().second)
+                    {
+                        if (materialRuns.back().first == triangle)
+                            materialRuns.back().second = materialId;
+                        else
+                            materialRuns.push_back({ triangle, materialId });
+                    }
+                    break;
+                }
+
+                case Chunk::StatementType::MtlLib:
+                {
+                    std::istringstream filenames(statement.name);
+                    std::string filename;
+                    bool found = false;
+                    while (!found && filenames >> filename)
+                        found = materialReader(filename, &_materials, &materialMap, &_warn, &_err);
+
+                    if (found)
+                        m_materialFiles.push_back(baseDir + filename);
+                    else
+                        _warn += "Failed to load material file(s). Use default material.\n";
+                    break;
+                }
+                }
+            }
+        }
+
+        if (numTriangles > shapeBegin)
+            shapeRanges.push_back({ curName, shapeBegin, numTriangles });
+
+        _shapes.resize(shapeRanges.size());
+        parallelFor(m_threadPool, shapeRanges.size(), [&](size_t i)
+        {
+            const ShapeRange& range = shapeRanges[i];
+            tinyobj::shape_t& shape = _shapes[i];
+            const u32 count = range.end - range.begin;
+
+            shape.name = range.name;
+            shape.mesh.indices.resize(size_t(count) * 3);
+            shape.mesh.num_face_vertices.resize(count, 3);
+            shape.mesh.material_ids.resize(count);
+            shape.mesh.smoothing_group_ids.resize(count, 0);
+
+            // Triangles of a shape can span several chunks
+            auto chunkIt = std::upper_bound(chunks.begin(), chunks.end(), range.begin, [](u32 _tri, const Chunk& _chunk) { return _tri < _chunk.triangleOffset; }) - 1;
+            for (u32 tri = range.begin; tri < range.end; )
+            {
+                const u32 chunkTriangles = u32(chunkIt->indices.size() / 3);
+                const u32 first = tri - chunkIt->triangleOffset;
+                const u32 num = std::min(range.end - tri, chunkTriangles - first);
+
+                std::copy_n(chunkIt->indices.begin() + size_t(first) * 3, size_t(num) * 3, shape.mesh.indices.begin() + size_t(tri - range.begin) * 3);
+                tri += num;
+                ++chunkIt;
+            }
+
+            auto runIt = std::upper_bound(materialRuns.begin(), materialRuns.end(), range.begin, [](u32 _tri, const std::pair<u32, int>& _run) { return _tri < _run.first; }) - 1;
+            for (u32 tri = range.begin; tri < range.end; ++tri)
+            {
+                if (runIt + 1 != materialRuns.end() && (runIt + 1)->first <= tri)
+                    ++runIt;
+                shape.mesh.material_ids[tri - range.begin] = runIt->second;
+            }
+        });
+
+        return true;
+    }
+
+    static void parseFace(ObjParser::Chunk& _chunk, const char* _p, const char* _end, std::vector<tinyobj::index_t>& _polygon, std::vector<ubyte>& _polygonFlags)
+    {
+        using Chunk = ObjParser::Chunk;
+
+        _polygon.clear();
+        _polygonFlags.clear();
+
+        const u32 numVertices = u32(_chunk.vertices.size() / 3);
+        const u32 numTexcoords = u32(_chunk.texcoords.size() / 2);
+        const u32 numNormals = u32(_chunk.normals.size() / 3);
+
+        while ((_p = skipSpaces(_p, _end)) < _end)
+        {
+            tinyobj::index_t index = { -1, -1, -1 };
+            ubyte flags = 0;
+            bool relative = false;
+            int objIndex;
+
+            _p = parseInt(_p, _end, objIndex);
+            if (!resolveIndex(objIndex, numVertices, index.vertex_index, relative))
+            {
+                _chunk.error = "Failed parse `f' line(e.g. zero value for face index.";
+                return;
+            }
+            flags |= relative ? Chunk::RelativeVertex : 0;
+
+            if (_p < _end && *_p == '/')
+            {
+                ++_p;
+                if (_p < _end && *_p != '/')
+                {
+                    _p = parseInt(_p, _end, objIndex);
+                    if (!resolveIndex(objIndex, numTexcoords, index.texcoord_index, relative))
+                    {
+                        _chunk.error = "Failed parse `f' line(e.g. zero value for face index.";
+                        return;
+                    }
+                    flags |= relative ? Chunk::RelativeTexcoord : 0;
+                }
+
+                if (_p < _end && *_p == '/')
+                {
+                    _p = parseInt(_p + 1, _end, objIndex);
+                    if (!resolveIndex(objIndex, numNormals, index.normal_index, relative))
+                    {
+                        _chunk.error = "Failed parse `f' line(e.g. zero value for face index.";
+                        return;
+                    }
+                    flags |= relative ? Chunk::RelativeNormal : 0;
+                }
+            }
+
+            // Skip anything left in the token
+            while (_p < _end && !isSpace(*_p))
+                ++_p;
+
+            _polygon.push_back(index);
+            _polygonFlags.push_back(flags);
+        }
+
+        if (_polygon.size() < 3)
+            return;
+
+        // Flags are only stored once the chunk meets its first relative index
+        if (!_chunk.hasRelativeIndices && std::any_of(_polygonFlags.begin(), _polygonFlags.end(), [](ubyte _f) { return _f != 0; }))
+        {
+            _chunk.hasRelativeIndices = true;
+            _chunk.relativeFlags.resize(_chunk.indices.size(), 0);
+        }
+
+        for (size_t k = 1; k + 1 < _polygon.size(); ++k)
+        {
+            const size_t corners[3] = { 0, k, k + 1 };
+            for (size_t c : corners)
+            {
+                _chunk.indices.push_back(_polygon[c]);
+                if (_chunk.hasRelativeIndices)
+                    _chunk.relativeFlags.push_back(_polygonFlags[c]);
+            }
+        }
+    }
+
+    static void parseChunk(ObjParser::Chunk& _chunk)
+    {
+        using Chunk = ObjParser::Chunk;
+
+        std::vector<tinyobj::index_t> polygon;
+        std::vector<ubyte> polygonFlags;
+
+        u32 line = 0;
+        for (const char* p = _chunk.begin; p < _chunk.end; )
+        {
+            const char* lineEnd = (const char*)memchr(p, '\n', _chunk.end - p);
+            const char* next = lineEnd ? lineEnd + 1 : _chunk.end;
+            lineEnd = lineEnd ? lineEnd : _chunk.end;
+            if (lineEnd > p && lineEnd[-1] == '\r')
+                --lineEnd;
+
+            ++line;
+            p = skipSpaces(p, lineEnd);
+            const size_t len = lineEnd - p;
+
+            if (len >= 2 && p[0] == 'v' && isSpace(p[1]))
+            {
+                float v[3];
+                const char* s = p + 2;
+                for (float& f : v)
+                    s = parseFloat(s, lineEnd, f);
+                _chunk.vertices.insert(_chunk.vertices.end(), v, v + 3);
+            }
+            else if (len >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2]))
+            {
+                float n[3];
+                const char* s = p + 3;
+                for (float& f : n)
+                    s = parseFloat(s, lineEnd, f);
+                _chunk.normals.insert(_chunk.normals.end(), n, n + 3);
+            }
+            else if (len >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2]))
+            {
+                float uv[2];
+                const char* s = p + 3;
+                for (float& f : uv)
+                    s = parseFloat(s, lineEnd, f);
+                _chunk.texcoords.insert(_chunk.texcoords.end(), uv, uv + 2);
+            }
+            else if (len >= 2 && p[0] == 'f' && isSpace(p[1]))
+            {
+                parseFace(_chunk, p + 2, lineEnd, polygon, polygonFlags);
+                if (!_chunk.error.empty())
+                {
+                    _chunk.errorLine = line;
+                    return;
+                }
+            }
+            else if (len >= 2 && (p[0] == 'g' || p[0] == 'o') && isSpace(p[1]))
+            {
+                const u32 triangle = u32(_chunk.indices.size() / 3);
+                if (p[0] == 'o')
+                {
+                    _chunk.statements.push_back({ Chunk::StatementType::Object, triangle, std::string(p + 2, lineEnd) });
+                }
+                else
+                {
+                    // Multiple group names are concatenated, as tinyobj does
+                    std::string name;
+                    const char* s = p + 2;
+                    for (std::string str = parseName(s, lineEnd); !str.empty(); str = parseName(s, lineEnd))
+                        name += (name.empty() ? "" : " ") + str;
+                    _chunk.statements.push_back({ Chunk::StatementType::Group, triangle, name });
+                }
+            }
+            else if (len >= 6 && strncmp(p, "usemtl", 6) == 0)
+            {
+                const char* s = p + 6;
+                _chunk.statements.push_back({ Chunk::StatementType::UseMtl, u32(_chunk.indices.size() / 3), parseName(s, lineEnd) });
+            }
+            else if (len >= 7 && strncmp(p, "mtllib", 6) == 0 && isSpace(p[6]))
+            {
+                _chunk.statements.push_back({ Chunk::StatementType::MtlLib, u32(_chunk.indices.size() / 3), std::string(p + 7, lineEnd) });
+            }
+
+            p = next;
+        }
+    }
+
+    namespace
+    {
+        std::string generateSyntheticObj(u32 _numTriangles)
+        {
+            const u32 gridSize = std::max(2u, u32(sqrtf(float(_numTriangles) / 2)) + 1);
+            const u32 quadsPerGroup = std::max(1u, (gridSize - 1) * (gridSize - 1) / 16);
+
+            std::ostringstream obj;
+            obj << std::fixed << std::setprecision(6);
+            obj << "# synthetic benchmark mesh\n";
+
+            for (u32 y = 0; y < gridSize; ++y)
+            {
+                for (u32 x = 0; x < gridSize; ++x)
+                {
+                    const float fx = float(x) / (gridSize - 1), fy = float(y) / (gridSize - 1);
+                    obj << "v " << fx * 10 << " " << fy * 10 << " " << sinf(fx * 20) * cosf(fy * 20) * 0.5f << "\n";
+                    obj << "vn " << 0.f << " " << 0.f << " " << 1.f << "\n";
+                    obj << "vt " << fx << " " << fy << "\n";
+                }
+            }
+
+            // Alternate absolute and relative indices between groups
+            u32 quad = 0;
+            for (u32 y = 0; y + 1 < gridSize; ++y)
+            {
+                for (u32 x = 0; x + 1 < gridSize; ++x, ++quad)
+                {
+                    const u32 group = quad / quadsPerGroup;
+                    if (quad % quadsPerGroup == 0)
+                        obj << "g grid_" << group << "\nusemtl mat_" << group % 4 << "\n";
+
+                    const u32 i0 = y * gridSize + x + 1;
+                    const u32 i[4] = { i0, i0 + 1, i0 + gridSize + 1, i0 + gridSize };
+                    obj << "f";
+                    for (u32 k = 0; k < 4; ++k)
+                    {
+                        const int index = (group & 1) ? int(i[k]) - int(gridSize * gridSize) - 1 : int(i[k]);
+                        obj << " " << index << "/" << index << "/" << index;
+                    }
+                    obj << "\n";
+                }
+            }
+
+            return obj.str();
+        }
+
+        bool compareResults(const tinyobj::attrib_t& _refAttrib, const std::vector<tinyobj::shape_t>& _refShapes,
+                            const tinyobj::attrib_t& _attrib, const std::vector<tinyobj::shape_t>& _shapes)
+        {
+            auto compareFloats = [](const std::vector<float>& _a, const std::vector<float>& _b)
+            {
+                if (_a.size() != _b.size())
+                    return false;
+                for (size_t i = 0; i < _a.size(); ++i)
+                    if (std::abs(_a[i] - _b[i]) > 1e-5f * std::max(1.f, std::abs(_a[i])))
+                        return false;
+                return true;
+            };
+
+            if (!compareFloats(_refAttrib.vertices, _attrib.vertices) || !compareFloats(_refAttrib.normals, _attrib.normals) ||
+                !compareFloats(_refAttrib.texcoords, _attrib.texcoords) || _refShapes.size() != _shapes.size())
+                return false;
+
+            for (size_t i = 0; i < _shapes.size(); ++i)
+            {
+                const tinyobj::mesh_t& ref = _refShapes[i].mesh;
+                const tinyobj::mesh_t& mesh = _shapes[i].mesh;
+                if (_refShapes[i].name != _shapes[i].name || ref.material_ids != mesh.material_ids || ref.indices.size() != mesh.indices.size())
+                    return false;
+
+                for (size_t j = 0; j < ref.indices.size(); ++j)
+                {
+                    if (ref.indices[j].vertex_index != mesh.indices[j].vertex_index || ref.indices[j].normal_index != mesh.indices[j].normal_index ||
+                        ref.indices[j].texcoord_index != mesh.indices[j].texcoord_index)
+                        return false;
+                }
+            }
+
+            return true;
+        }
+    }
+
+    void runObjParserBenchmark(const std::vector<std::string>& _files, u32 _syntheticTriangles)
+    {
+        std::vector<std::string> files;
+        for (const std::string& file : _files)
+        {
+            if (std::filesystem::exists(file))
+                files.push_back(file);
+            else
+                std::cout << "Skipping missing " << file << "\n";
+        }
+
+        const std::filesystem::path syntheticPath = std::filesystem::temp_directory_path() / "tim_synthetic_bench.obj";
+        {
+            std::ofstream synthetic(syntheticPath, std::ios::binary);
+            synthetic << generateSyntheticObj(_syntheticTriangles);
+        }
+        files.push_back(syntheticPath.string());
+
+        ObjParser parser;
+        std::cout << "OBJ parsing benchmark, " << parser.getNumThreads() << " worker threads\n";
+        std::cout << std::setw(40) << "file" << std::setw(12) << "MB" << std::setw(16) << "tinyobj MB/s" << std::setw(16) << "parallel MB/s" << std::setw(10) << "speedup" << std::setw(10) << "match" << "\n";
+
+        for (const std::string& file : files)
+        {
+            std::filesystem::path mtlFolder = file;
+            mtlFolder.remove_filename();
+            const std::string mtlBaseDir = mtlFolder.string();
+            const double sizeMB = double(std::filesystem::file_size(file)) / (1024 * 1024);
+
+            tinyobj::attrib_t refAttrib, attrib;
+            std::vector<tinyobj::shape_t> refShapes, shapes;
+            std::vector<tinyobj::material_t> refMaterials, materials;
+            std::string warn, err;
+
+            auto start = std::chrono::high_resolution_clock::now();
+            bool refLoaded = tinyobj::LoadObj(&refAttrib, &refShapes, &refMaterials, &warn, &err, file.c_str(), mtlBaseDir.c_str());
+            auto end = std::chrono::high_resolution_clock::now();
+            const double refTime = std::chrono::duration<double>(end - start).count();
+
+            start = std::chrono::high_resolution_clock::now();
+            bool loaded = parser.load(file, mtlBaseDir.c_str(), attrib, shapes, materials, warn, err);
+            end = std::chrono::high_resolution_clock::now();
+            const double time = std::chrono::duration<double>(end - start).count();
+
+            const bool match = refLoaded && loaded && compareResults(refAttrib, refShapes, attrib, shapes);
+
+            std::cout << std::setw(40) << std::filesystem::path(file).filename().string() << std::fixed << std::setprecision(2) << std::setw(12) << sizeMB
+                      << std::setw(16) << sizeMB / refTime << std::setw(16) << sizeMB / time << std::setw(9) << refTime / time << "x" << std::setw(10) << (match ? "yes" : "NO") << "\n";
+        }
+
+        std::filesystem::remove(syntheticPath);
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include "timCore/type.h"
+#include "timCore/ThreadPool.h"
+#include "tiny_obj_loader.h"
+
+#include <vector>
+#include <string>
+
+namespace tim
+{
+    // Parallel OBJ loader producing the same attrib_t/shape_t layout than tinyobj::LoadObj (triangulated).
+    // The file is mapped and split at line boundaries, chunks are parsed on the thread pool then merged : vertex attributes
+    // and triangles of each chunk land at their prefix sum offset, relative (negative) face indices are resolved at that point.
+    // Only v/vn/vt/f/g/o/usemtl/mtllib are handled, polygons are fan triangulated, vertex colors and smoothing groups are ignored.
+    class ObjParser
+    {
+    public:
+        ObjParser(u32 _numThreads = 0);
+
+        // Same contract as tinyobj::LoadObj, MTL files are read with tinyobj from _mtlBaseDir
+        bool load(const std::string& _path, const char* _mtlBaseDir, tinyobj::attrib_t& _attrib, std::vector<tinyobj::shape_t>& _shapes,
+                  std::vector<tinyobj::material_t>& _materials, std::string& _warn, std::string& _err);
+
+        // MTL files read by the last load
+        const std::vector<std::string>& getMaterialFiles() const { return m_materialFiles; }
+
+        u32 getNumThreads() const { return m_threadPool.getNumThreads(); }
+
+        static constexpr u64 MinChunkSize = 1024 * 1024;
+
+        struct Chunk;
+
+    private:
+        ThreadPool m_threadPool;
+        std::vector<std::string> m_materialFiles;
+    };
+
+    // Parse throughput of ObjParser against tinyobj::LoadObj on the given files and on a generated OBJ of _syntheticTriangles triangles
+    void runObjParserBenchmark(const std::vector<std::string>& _files, u32 _syntheticTriangles);
+}
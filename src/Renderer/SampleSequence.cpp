@@ -0,0 +1,355 @@
+#include "SampleSequence.h"
+#include "timCore/Common.h"
+
+#include <chrono>
+#include <random>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+namespace tim
+{
+    namespace
+    {
+        constexpr u32 g_HaltonBase[2] = { 2, 3 };
+        // https://extremelearning.com.au/unreasonable-effectiveness-of-quasirandom-sequences/
+        constexpr double g_R2Phi = 1.32471795724474602596;
+        constexpr double g_R2Alpha[2] = { 1.0 / g_R2Phi, 1.0 / (g_R2Phi * g_R2Phi) };
+
+        u32 reverseBits(u32 _x)
+        {
+            _x = ((_x >> 1) & 0x55555555u) | ((_x & 0x55555555u) << 1);
+            _x = ((_x >> 2) & 0x33333333u) | ((_x & 0x33333333u) << 2);
+            _x = ((_x >> 4) & 0x0F0F0F0Fu) | ((_x & 0x0F0F0F0Fu) << 4);
+            _x = ((_x >> 8) & 0x00FF00FFu) | ((_x & 0x00FF00FFu) << 8);
+            return (_x >> 16) | (_x << 16);
+        }
+
+        // First 2 dimensions of the Sobol sequence, as 32 bits fixed point
+        u32 sobolBits(u32 _index, u32 _dim)
+        {
+            if (_dim == 0)
+                return reverseBits(_index);
+
+            u32 res = 0;
+            for (u32 v = 1u << 31; _index; _index >>= 1, v ^= v >> 1)
+            {
+                if (_index & 1)
+                    res ^= v;
+            }
+            return res;
+        }
+
+        // Hash based nested uniform scrambling, "Practical Hash-based Owen Scrambling" (Burley 2020)
+        u32 laineKarrasPermutation(u32 _x, u32 _seed)
+        {
+            _x += _seed;
+            _x ^= _x * 0x6c50b47cu;
+            _x ^= _x * 0xb82f1e52u;
+            _x ^= _x * 0xc7afe638u;
+            _x ^= _x * 0x8d22f6e6u;
+            return _x;
+        }
+
+        u32 owenScramble(u32 _bits, u32 _seed)
+        {
+            return reverseBits(laineKarrasPermutation(reverseBits(_bits), _seed));
+        }
+
+        float radicalInverse(u32 _index, u32 _base)
+        {
+            const double invBase = 1.0 / _base;
+            double invBaseN = invBase;
+            double res = 0;
+            while (_index > 0)
+            {
+                res += (_index % _base) * invBaseN;
+                _index /= _base;
+                invBaseN *= invBase;
+            }
+            return std::min(float(res), 0x1.fffffep-1f);
+        }
+
+        float fract(float _x)
+        {
+            return _x - floorf(_x);
+        }
+    }
+
+    const char* toString(SampleSequenceType _type)
+    {
+        switch (_type)
+        {
+        case SampleSequenceType::Random:        return "Random";
+        case SampleSequenceType::Stratified:    return "Stratified";
+        case SampleSequenceType::Halton:        return "Halton";
+        case SampleSequenceType::Sobol:         return "Sobol";
+        case SampleSequenceType::R2:            return "R2";
+        default:
+            TIM_ASSERT(false);
+            return "Unknown";
+        }
+    }
+
+    u32 pcgHash(u32 _seed)
+    {
+        u32 state = _seed * 747796405u + 2891336453u;
+        u32 word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    float toUnitFloat(u32 _bits)
+    {
+        // keep the 24 most significant bits so the result is exactly representable and < 1
+        return float(_bits >> 8) * (1.f / float(1u << 24));
+    }
+
+    vec2 sampleSequence2D(SampleSequenceType _type, SampleScrambling _scrambling, u32 _index, u32 _count, u32 _seed)
+    {
+        const u32 seed0 = pcgHash(_seed);
+        const u32 seed1 = pcgHash(seed0);
+
+        vec2 res;
+        switch (_type)
+        {
+        case SampleSequenceType::Random:
+            return { toUnitFloat(pcgHash(_index ^ seed0)), toUnitFloat(pcgHash(_index ^ seed1)) };
+
+        case SampleSequenceType::Stratified:
+        {
+            // jittered grid when _count is a square, else stratify rows only
+            const u32 frameIndex = _index % _count;
+            const u32 sqrtCount = u32(sqrtf(float(_count)) + 0.5f);
+            const vec2 jitter = { toUnitFloat(pcgHash(_index ^ seed0)), toUnitFloat(pcgHash(_index ^ seed1)) };
+            if (sqrtCount * sqrtCount == _count)
+                return (vec2(float(frameIndex / sqrtCount), float(frameIndex % sqrtCount)) + jitter) / float(sqrtCount);
+            else
+                return { (float(frameIndex) + jitter.x) / float(_count), jitter.y };
+        }
+
+        case SampleSequenceType::Sobol:
+            if (_scrambling == SampleScrambling::Owen)
+                return { toUnitFloat(owenScramble(sobolBits(_index, 0), seed0)), toUnitFloat(owenScramble(sobolBits(_index, 1), seed1)) };
+
+            res = { toUnitFloat(sobolBits(_index, 0)), toUnitFloat(sobolBits(_index, 1)) };
+            break;
+
+        case SampleSequenceType::Halton:
+            res = { radicalInverse(_index, g_HaltonBase[0]), radicalInverse(_index, g_HaltonBase[1]) };
+            break;
+
+        case SampleSequenceType::R2:
+            res = { float(std::fmod(0.5 + g_R2Alpha[0] * _index, 1.0)), float(std::fmod(0.5 + g_R2Alpha[1] * _index, 1.0)) };
+            break;
+
+        default:
+            TIM_ASSERT(false);
+            return {};
+        }
+
+        // Owen scrambling is only defined on base 2 digits, Halton and R2 fallback to a random toroidal shift
+        if (_scrambling != SampleScrambling::None)
+        {
+            res.x = fract(res.x + toUnitFloat(seed0));
+            res.y = fract(res.y + toUnitFloat(seed1));
+        }
+
+        return res;
+    }
+
+    vec3 squareToUniformSphere(vec2 _uv)
+    {
+        float theta = 2 * TIM_PI * _uv.x;
+        float phi = acosf(1 - 2 * _uv.y);
+
+        return { sinf(phi) * cosf(theta), sinf(phi) * sinf(theta), cosf(phi) };
+    }
+
+    void computeSH9Basis(vec3 N, SH9& _coef)
+    {
+        _coef.w[SH_Y00] = 0.282095f;
+
+        _coef.w[SH_Y11] = 0.488603f * N.x;
+        _coef.w[SH_Y10] = 0.488603f * N.z;
+        _coef.w[SH_Y1_1] = 0.488603f * N.y;
+
+        _coef.w[SH_Y21] = 1.092548f * N.x * N.z;
+        _coef.w[SH_Y2_1] = 1.092548f * N.y * N.z;
+        _coef.w[SH_Y2_2] = 1.092548f * N.x * N.y;
+
+        _coef.w[SH_Y20] = 0.315392f * (3.0f * N.z * N.z - 1.0f);
+        _coef.w[SH_Y22] = 0.546274f * (N.x * N.x - N.y * N.y);
+    }
+
+    SphereSampleSet::SphereSampleSet(SampleSequenceType _type, SampleScrambling _scrambling, u32 _raysPerFrame, u32 _framesPerCycle)
+        : m_type{ _type }, m_scrambling{ _scrambling }, m_raysPerFrame{ _raysPerFrame }, m_framesPerCycle{ _framesPerCycle }
+    {
+        TIM_ASSERT(m_raysPerFrame > 0 && m_framesPerCycle > 0);
+        m_rays.resize(size_t(m_raysPerFrame) * m_framesPerCycle);
+        m_shBasis.resize(size_t(m_raysPerFrame) * m_framesPerCycle);
+        generateCycle();
+    }
+
+    void SphereSampleSet::nextFrame()
+    {
+        if (++m_curFrame == m_framesPerCycle)
+        {
+            m_curFrame = 0;
+            m_cycleIndex++;
+
+            // Without scrambling the cycle would be strictly identical
+            if (m_scrambling != SampleScrambling::None || m_type == SampleSequenceType::Random || m_type == SampleSequenceType::Stratified)
+                generateCycle();
+        }
+    }
+
+    void SphereSampleSet::generateCycle()
+    {
+        const u32 seed = pcgHash(m_cycleIndex);
+        for (u32 i = 0; i < u32(m_rays.size()); ++i)
+        {
+            vec2 uv = sampleSequence2D(m_type, m_scrambling, i, m_raysPerFrame, seed);
+            m_rays[i] = squareToUniformSphere(uv);
+            computeSH9Basis(m_rays[i], m_shBasis[i]);
+        }
+    }
+
+    namespace
+    {
+        // Sky gradient + sharp sun lobe, has energy above the SH9 bands on purpose
+        float benchmarkRadiance(vec3 _dir)
+        {
+            const vec3 sunDir = linalg::normalize(vec3(0.3f, 0.3f, 1));
+            return 0.3f + 0.2f * _dir.z + 4 * powf(std::max(0.f, linalg::dot(_dir, sunDir)), 16);
+        }
+
+        void projectSH(const vec3* _dirs, u32 _count, float _out[9])
+        {
+            std::fill(_out, _out + 9, 0.f);
+            for (u32 i = 0; i < _count; ++i)
+            {
+                SH9 basis;
+                computeSH9Basis(_dirs[i], basis);
+                float L = benchmarkRadiance(_dirs[i]);
+                for (u32 j = 0; j < 9; ++j)
+                    _out[j] += L * basis.w[j];
+            }
+
+            for (u32 j = 0; j < 9; ++j)
+                _out[j] *= 4 * TIM_PI / _count;
+        }
+
+        float relativeSHError(const float _sh[9], const float _ref[9])
+        {
+            float err = 0, norm = 0;
+            for (u32 j = 0; j < 9; ++j)
+            {
+                err += (_sh[j] - _ref[j]) * (_sh[j] - _ref[j]);
+                norm += _ref[j] * _ref[j];
+            }
+            return sqrtf(err / norm);
+        }
+    }
+
+    void runSampleSequenceBenchmark(u32 _raysPerFrame, u32 _numFrames, float _hysteresis)
+    {
+        // Reference projection, midpoint rule on the equal area parametrization
+        const u32 refRes = 1024;
+        std::vector<vec3> refDirs(refRes * refRes);
+        for (u32 i = 0; i < refRes; ++i)
+            for (u32 j = 0; j < refRes; ++j)
+                refDirs[i * refRes + j] = squareToUniformSphere({ (i + 0.5f) / refRes, (j + 0.5f) / refRes });
+
+        float refSH[9];
+        projectSH(refDirs.data(), u32(refDirs.size()), refSH);
+
+        struct Config
+        {
+            SampleSequenceType type;
+            SampleScrambling scrambling;
+            const char* name;
+        };
+
+        const Config configs[] =
+        {
+            { SampleSequenceType::Random,       SampleScrambling::None,             "Random" },
+            { SampleSequenceType::Stratified,   SampleScrambling::None,             "Stratified" },
+            { SampleSequenceType::Halton,       SampleScrambling::CranleyPatterson, "Halton+CP" },
+            { SampleSequenceType::R2,           SampleScrambling::CranleyPatterson, "R2+CP" },
+            { SampleSequenceType::Sobol,        SampleScrambling::CranleyPatterson, "Sobol+CP" },
+            { SampleSequenceType::Sobol,        SampleScrambling::Owen,             "Sobol+Owen" },
+        };
+
+        std::cout << "SH9 convergence benchmark, " << _raysPerFrame << " rays per frame, hysteresis " << _hysteresis << "\n";
+        std::cout << "Relative L2 error (running mean / exponential moving average as in updateLightProbField.comp)\n";
+
+        std::cout << std::setw(12) << "frames";
+        for (const Config& config : configs)
+            std::cout << std::setw(24) << config.name;
+        std::cout << "\n";
+
+        std::vector<std::vector<vec2>> errors(std::size(configs));
+        std::vector<double> generationTime(std::size(configs));
+
+        for (u32 c = 0; c < std::size(configs); ++c)
+        {
+            SphereSampleSet sampleSet(configs[c].type, configs[c].scrambling, _raysPerFrame);
+
+            float meanSH[9] = {}, emaSH[9] = {};
+            for (u32 f = 0; f < _numFrames; ++f)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                sampleSet.nextFrame();
+                auto end = std::chrono::high_resolution_clock::now();
+                generationTime[c] += std::chrono::duration<double, std::micro>(end - start).count();
+
+                float frameSH[9];
+                projectSH(sampleSet.getRays(), _raysPerFrame, frameSH);
+                for (u32 j = 0; j < 9; ++j)
+                {
+                    meanSH[j] += (frameSH[j] - meanSH[j]) / float(f + 1);
+                    emaSH[j] = f == 0 ? frameSH[j] : emaSH[j] + (frameSH[j] - emaSH[j]) * _hysteresis;
+                }
+
+                errors[c].push_back({ relativeSHError(meanSH, refSH), relativeSHError(emaSH, refSH) });
+            }
+        }
+
+        for (u32 f = 1; f <= _numFrames; f *= 2)
+        {
+            std::cout << std::setw(12) << f;
+            for (u32 c = 0; c < std::size(configs); ++c)
+            {
+                std::ostringstream str;
+                str << std::fixed << std::setprecision(5) << errors[c][f - 1].x << " / " << errors[c][f - 1].y;
+                std::cout << std::setw(24) << str.str();
+            }
+            std::cout << "\n";
+        }
+
+        std::cout << std::setw(12) << "us/frame";
+        for (u32 c = 0; c < std::size(configs); ++c)
+            std::cout << std::setw(24) << std::fixed << std::setprecision(3) << generationTime[c] / _numFrames;
+        std::cout << "\n";
+
+        // Former path: stratified jitter drawn from std::random_device every frame
+        {
+            std::random_device rd;
+            std::uniform_real_distribution<float> uniform01(0, 1);
+            std::vector<vec3> rays(_raysPerFrame);
+            std::vector<SH9> basis(_raysPerFrame);
+
+            auto start = std::chrono::high_resolution_clock::now();
+            for (u32 f = 0; f < _numFrames; ++f)
+            {
+                for (u32 i = 0; i < _raysPerFrame; ++i)
+                {
+                    rays[i] = squareToUniformSphere({ uniform01(rd), uniform01(rd) });
+                    computeSH9Basis(rays[i], basis[i]);
+                }
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            std::cout << "std::random_device path: " << std::chrono::duration<double, std::micro>(end - start).count() / _numFrames << " us/frame\n";
+        }
+    }
+}
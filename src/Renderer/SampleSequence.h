@@ -0,0 +1,72 @@
+#pragma once
+#include "timCore/type.h"
+#include <vector>
+
+#include "Shaders/lightprob/lightprob.glsl"
+
+namespace tim
+{
+    enum class SampleSequenceType
+    {
+        Random,
+        Stratified,
+        Halton,
+        Sobol,
+        R2,
+
+        Count
+    };
+
+    enum class SampleScrambling
+    {
+        None,
+        CranleyPatterson,
+        Owen, // only meaningful for Sobol, other sequences fallback to Cranley-Patterson
+    };
+
+    const char* toString(SampleSequenceType _type);
+
+    // Cheap integer hash, used instead of std::random_device to decorrelate frames
+    u32 pcgHash(u32 _seed);
+    float toUnitFloat(u32 _bits);
+
+    // Return the point _index of a 2D sequence in [0,1[^2. _count is the number of points drawn per frame (used by the stratified sequence),
+    // _seed drives the random jitter and the scrambling.
+    vec2 sampleSequence2D(SampleSequenceType _type, SampleScrambling _scrambling, u32 _index, u32 _count, u32 _seed);
+
+    // Equal area mapping of [0,1[^2 on the unit sphere
+    vec3 squareToUniformSphere(vec2 _uv);
+
+    // http://www-graphics.stanford.edu/papers/envmap/envmap.pdf
+    void computeSH9Basis(vec3 _dir, SH9& _coef);
+
+    // Spherical ray set used by the light prob field. Each frame draws the next _raysPerFrame points of a progressive low discrepancy sequence,
+    // rays and SH basis are precomputed for a whole cycle of frames and only regenerated (with a new scrambling seed) when the cycle wraps.
+    class SphereSampleSet
+    {
+    public:
+        SphereSampleSet(SampleSequenceType _type, SampleScrambling _scrambling, u32 _raysPerFrame, u32 _framesPerCycle = 64);
+
+        void nextFrame();
+
+        u32 getRayCount() const { return m_raysPerFrame; }
+        const vec3* getRays() const { return &m_rays[m_curFrame * m_raysPerFrame]; }
+        const SH9* getSHBasis() const { return &m_shBasis[m_curFrame * m_raysPerFrame]; }
+
+    private:
+        void generateCycle();
+
+        SampleSequenceType m_type;
+        SampleScrambling m_scrambling;
+        u32 m_raysPerFrame;
+        u32 m_framesPerCycle;
+        u32 m_curFrame = 0;
+        u32 m_cycleIndex = 0;
+
+        std::vector<vec3> m_rays;
+        std::vector<SH9> m_shBasis;
+    };
+
+    // CPU benchmark : SH projection error of an analytic environment vs number of accumulated frames, for each sequence
+    void runSampleSequenceBenchmark(u32 _raysPerFrame, u32 _numFrames, float _hysteresis);
+}
@@ -1,14 +1,21 @@
 #include "Scene.h"
 #include "timCore/Common.h"
+#include "timCore/Profiler.h"
 #include "BVHData.h"
 #include "BVHBuilder.h"
 #include "BVHGeometry.h"
 #include "TextureManager.h"
+#include "ObjParser.h"
+#include "SceneCache.h"
+#include "Shaders/bvh/bvhBindings_cpp.glsl"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
 #include "timCore/flat_hash_map.h"
+#include <execution>
+#include <numeric>
+#include <cfloat>
 
 namespace tim
 {
@@ -33,8 +40,12 @@ namespace std
 
 namespace tim
 {
+    static const char* g_sceneCacheFolder = "./data/cache/scene/";
+
     Scene::Scene(IRenderer* _renderer, TextureManager& _texManager) : m_renderer{ _renderer }, m_texManager { _texManager }
     {
+        m_objParser = std::make_unique<ObjParser>();
+        m_bvhCache = std::make_unique<BVHCache>("./data/cache/bvh/", 1024ull * 1024 * 1024);
         m_lightProbField.allocate(m_renderer, { 12, 12, 12 });
     }
 
@@ -45,23 +56,29 @@ namespace tim
 
     void Scene::fillGeometryBufferBindings(std::vector<BufferBinding>& _bindings) const
     {
-        BufferBinding geometryPos, geometryNormals, geometryTexcoords;
-        m_geometryBuffer->generateGeometryBufferBindings(geometryPos, geometryNormals, geometryTexcoords);
-        _bindings.push_back(geometryPos);
-        _bindings.push_back(geometryNormals);
-        _bindings.push_back(geometryTexcoords);
+        m_geometryBuffer->generateGeometryBufferBindings(_bindings);
+    }
+
+    void Scene::updateBindingTable()
+    {
+        std::vector<BufferBinding> bufBinds;
+        std::vector<ImageBinding> imgBinds;
+        fillGeometryBufferBindings(bufBinds);
+        m_bvhData->fillBvhBindings(bufBinds);
+        m_lightProbField.fillBindings(imgBinds, g_lpfTextures_bind);
+        m_bindingTable = BindingTable(std::move(bufBinds), std::move(imgBinds));
     }
 
-    u32 Scene::getPrimitivesCount() const { return m_bvh->getPrimitivesCount(); }
-    u32 Scene::getTrianglesCount() const { return m_bvh->getTrianglesCount(); }
-    u32 Scene::getBlasInstancesCount() const { return m_bvh->getBlasInstancesCount(); }
-    u32 Scene::getLightsCount() const { return m_bvh->getLightsCount(); }
-    u32 Scene::getNodesCount() const { return m_bvh->getNodesCount(); }
+    u32 Scene::getPrimitivesCount() const { return m_stats.numPrimitives; }
+    u32 Scene::getTrianglesCount() const { return m_stats.numTriangles; }
+    u32 Scene::getBlasInstancesCount() const { return m_stats.numBlasInstances; }
+    u32 Scene::getLightsCount() const { return m_stats.numLights; }
+    u32 Scene::getNodesCount() const { return m_stats.numNodes; }
     bool Scene::useTlas() const { return m_useTlas; }
 
     Box Scene::getAABB() const
     {
-        return m_bvh->getAABB();
+        return m_stats.aabb;
     }
 
     
@@ -71,6 +88,8 @@ namespace tim
         m_renderer->WaitForIdle();
         m_lightProbField.free(m_renderer);
         m_lightProbField.allocate(m_renderer, _res);
+        if (m_bvhData)
+            updateBindingTable();
     }
 
     namespace
@@ -117,7 +136,7 @@ namespace tim
                 {
                     std::filesystem::path texPath = _path;
                     texPath.replace_filename(mtlMaterials[i].diffuse_texname);
-                    u32 texId = _texManager.loadTexture((const char*)texPath.u8string().c_str());
+                    u32 texId = _texManager.loadTextureAsync((const char*)texPath.u8string().c_str());
                     TIM_ASSERT(texId != u32(-1));
                     BVHBuilder::setTextureMaterial(mat, texId, 0);
                     texToId[mtlMaterials[i].diffuse_texname] = texId;
@@ -131,59 +150,260 @@ namespace tim
         return materials;
     }
 
-    struct ObjData
+    // Deduplicated shape of an OBJ file, its vertices live in the geometry buffer at vertexOffset
+    struct ObjShape
     {
-        std::vector<vec3> vertexData;
-        std::vector<vec3> normalData;
-        std::vector<vec2> texcoordData;
+        std::vector<ObjVertexKey> vertexKeys;
         std::vector<u32> indexData;
+        u32 vertexOffset = 0;
+        u32 numVertices = 0;
+        u32 meshId = 0;
         int materialId = -1;
     };
 
-    static ObjData loadObj(const tinyobj::attrib_t& attrib, const tinyobj::shape_t& curMesh, 
-                           vec3 _pos, vec3 _scale, bool _swapYZ)
-    {
-        ObjData data;
+    // Triangle indices are 16 bits relative to the vertexOffset of their cluster
+    static constexpr u32 g_maxClusterVertices = 0xFFFF;
 
-        for (ubyte numV : curMesh.mesh.num_face_vertices)
+    static void dedupObjShape(const tinyobj::shape_t& _curMesh, ObjShape& _shape)
+    {
+        for (ubyte numV : _curMesh.mesh.num_face_vertices)
             TIM_ASSERT(numV == 3);
 
-        ska::flat_hash_map<ObjVertexKey, u32> vertexHasher;
-        for (u32 i = 0; i < curMesh.mesh.indices.size(); ++i)
+        const u32 numIndices = (u32)_curMesh.mesh.indices.size();
+        _shape.indexData.resize(numIndices);
+        _shape.vertexKeys.reserve(numIndices);
+
+        // Open addressing table sized for every index to be unique, slots store an index in vertexKeys
+        u32 tableMask = 16;
+        while (tableMask < numIndices * 2)
+            tableMask <<= 1;
+        std::vector<u32> table(tableMask, u32(-1));
+        tableMask -= 1;
+
+        const std::hash<ObjVertexKey> hasher;
+        for (u32 i = 0; i < numIndices; ++i)
         {
-            TIM_ASSERT(data.materialId == curMesh.mesh.material_ids[i / 3] || data.materialId == -1);
-            data.materialId = curMesh.mesh.material_ids[i / 3];
+            TIM_ASSERT(_shape.materialId == _curMesh.mesh.material_ids[i / 3] || _shape.materialId == -1);
+            _shape.materialId = _curMesh.mesh.material_ids[i / 3];
+
+            const tinyobj::index_t& index = _curMesh.mesh.indices[i];
+            const ObjVertexKey key{ (u32)index.vertex_index, (u32)index.normal_index, (u32)index.texcoord_index };
 
-            ObjVertexKey key{ (u32)curMesh.mesh.indices[i].vertex_index, (u32)curMesh.mesh.indices[i].normal_index, (u32)curMesh.mesh.indices[i].texcoord_index };
-            auto it = vertexHasher.find(key);
-            if (it == vertexHasher.end())
+            u32 slot = u32(hasher(key)) & tableMask;
+            while (table[slot] != u32(-1) && _shape.vertexKeys[table[slot]] != key)
+                slot = (slot + 1) & tableMask;
+
+            if (table[slot] == u32(-1))
             {
-                u32 index = (u32)data.vertexData.size();
-                data.vertexData.push_back({ attrib.vertices[key.posIndex * 3], attrib.vertices[key.posIndex * 3 + 1], attrib.vertices[key.posIndex * 3 + 2] });
-                transformVertex(data.vertexData.back(), _pos, _scale, _swapYZ);
+                table[slot] = (u32)_shape.vertexKeys.size();
+                _shape.vertexKeys.push_back(key);
+            }
+            _shape.indexData[i] = table[slot];
+        }
+    }
 
-                data.normalData.push_back({ attrib.normals[key.normalIndex * 3], attrib.normals[key.normalIndex * 3 + 1], attrib.normals[key.normalIndex * 3 + 2] });
-                transformNormal(data.normalData.back(), _pos, _scale, _swapYZ);
+    static u32 expandMortonBits(u32 _v)
+    {
+        _v = (_v * 0x00010001u) & 0xFF0000FFu;
+        _v = (_v * 0x00000101u) & 0x0F00F00Fu;
+        _v = (_v * 0x00000011u) & 0xC30C30C3u;
+        _v = (_v * 0x00000005u) & 0x49249249u;
+        return _v;
+    }
 
-                if (key.texcoordIndex < attrib.texcoords.size())
-                    data.texcoordData.push_back({ attrib.texcoords[key.texcoordIndex * 2], attrib.texcoords[key.texcoordIndex * 2 + 1] });
-                else
-                    data.texcoordData.push_back({ 0,0 });
+    // Split a shape in clusters of at most _maxVertices vertices. Triangles are walked along a Morton curve so each cluster is spatially
+    // coherent, cluster vertices are numbered in order of first use to keep the fetches of neighbour triangles close.
+    // A small _maxVertices gives meshlet sized clusters.
+    static void clusterObjShape(const tinyobj::attrib_t& _attrib, const ObjShape& _shape, u32 _maxVertices, std::vector<ObjShape>& _clusters)
+    {
+        TIM_ASSERT(_maxVertices >= 3);
+        const u32 numTriangles = (u32)_shape.indexData.size() / 3;
 
-                vertexHasher[key] = index;
-                data.indexData.push_back(index);
+        auto getPosition = [&](u32 _vertex)
+        {
+            const u32 posIndex = _shape.vertexKeys[_vertex].posIndex;
+            return vec3{ _attrib.vertices[posIndex * 3], _attrib.vertices[posIndex * 3 + 1], _attrib.vertices[posIndex * 3 + 2] };
+        };
+
+        std::vector<vec3> centroids(numTriangles);
+        Box bounds = { vec3(FLT_MAX), vec3(-FLT_MAX) };
+        for (u32 i = 0; i < numTriangles; ++i)
+        {
+            centroids[i] = (getPosition(_shape.indexData[i * 3]) + getPosition(_shape.indexData[i * 3 + 1]) + getPosition(_shape.indexData[i * 3 + 2])) / 3.f;
+            bounds.minExtent = linalg::min_(bounds.minExtent, centroids[i]);
+            bounds.maxExtent = linalg::max_(bounds.maxExtent, centroids[i]);
+        }
+
+        const vec3 extent = linalg::max_(bounds.maxExtent - bounds.minExtent, vec3(1e-6f));
+        std::vector<std::pair<u32, u32>> sortedTriangles(numTriangles); // morton code, triangle
+        for (u32 i = 0; i < numTriangles; ++i)
+        {
+            const vec3 p = (centroids[i] - bounds.minExtent) / extent * 1023.f;
+            sortedTriangles[i] = { (expandMortonBits(u32(p.x)) << 2) | (expandMortonBits(u32(p.y)) << 1) | expandMortonBits(u32(p.z)), i };
+        }
+        std::sort(sortedTriangles.begin(), sortedTriangles.end());
+
+        std::vector<u32> localIndex(_shape.vertexKeys.size(), u32(-1));
+        std::vector<u32> clusterVertices; // shape indices of the cluster vertices
+        ObjShape* cluster = nullptr;
+        for (const auto& [code, tri] : sortedTriangles)
+        {
+            const u32* indices = &_shape.indexData[tri * 3];
+
+            u32 numNewVertices = 0;
+            for (u32 i = 0; i < 3; ++i)
+                numNewVertices += (!cluster || localIndex[indices[i]] == u32(-1)) ? 1 : 0;
+
+            if (!cluster || cluster->vertexKeys.size() + numNewVertices > _maxVertices)
+            {
+                for (u32 vertex : clusterVertices)
+                    localIndex[vertex] = u32(-1);
+                clusterVertices.clear();
+
+                cluster = &_clusters.emplace_back();
+                cluster->meshId = _shape.meshId;
+                cluster->materialId = _shape.materialId;
+            }
+
+            for (u32 i = 0; i < 3; ++i)
+            {
+                u32& local = localIndex[indices[i]];
+                if (local == u32(-1))
+                {
+                    local = (u32)cluster->vertexKeys.size();
+                    cluster->vertexKeys.push_back(_shape.vertexKeys[indices[i]]);
+                    clusterVertices.push_back(indices[i]);
+                }
+                cluster->indexData.push_back(local);
             }
+        }
+    }
+
+    static void writeObjVertices(const tinyobj::attrib_t& _attrib, const ObjShape& _shape, vec3* _positions, vec3* _normals, vec2* _texCoords,
+                                 vec3 _pos, vec3 _scale, bool _swapYZ)
+    {
+        for (size_t i = 0; i < _shape.vertexKeys.size(); ++i)
+        {
+            const ObjVertexKey& key = _shape.vertexKeys[i];
+            _positions[i] = { _attrib.vertices[key.posIndex * 3], _attrib.vertices[key.posIndex * 3 + 1], _attrib.vertices[key.posIndex * 3 + 2] };
+            transformVertex(_positions[i], _pos, _scale, _swapYZ);
+
+            _normals[i] = { _attrib.normals[key.normalIndex * 3], _attrib.normals[key.normalIndex * 3 + 1], _attrib.normals[key.normalIndex * 3 + 2] };
+            transformNormal(_normals[i], _pos, _scale, _swapYZ);
+
+            if (size_t(key.texcoordIndex) * 2 + 1 < _attrib.texcoords.size())
+                _texCoords[i] = { _attrib.texcoords[key.texcoordIndex * 2], _attrib.texcoords[key.texcoordIndex * 2 + 1] };
             else
+                _texCoords[i] = { 0,0 };
+        }
+    }
+
+    // Shapes are deduplicated concurrently, then written straight into their own range of the geometry buffer.
+    // Shapes too large for 16 bits indices are split in clusters, meshId gives the shape of each cluster.
+    static std::vector<ObjShape> loadObjShapes(const tinyobj::attrib_t& _attrib, const std::vector<tinyobj::shape_t>& _meshes, BVHGeometry& _geometry,
+                                               vec3 _pos, vec3 _scale, bool _swapYZ)
+    {
+        std::vector<std::vector<ObjShape>> meshClusters(_meshes.size());
+        std::vector<u32> meshIds(_meshes.size());
+        std::iota(meshIds.begin(), meshIds.end(), 0);
+
+        std::for_each(std::execution::par, meshIds.begin(), meshIds.end(), [&](u32 _id)
+        {
+            ObjShape shape;
+            shape.meshId = _id;
+            dedupObjShape(_meshes[_id], shape);
+
+            if (shape.vertexKeys.size() > g_maxClusterVertices)
+                clusterObjShape(_attrib, shape, g_maxClusterVertices, meshClusters[_id]);
+            else if (shape.vertexKeys.size() > 0)
+                meshClusters[_id].push_back(std::move(shape));
+        });
+
+        std::vector<ObjShape> shapes;
+        for (u32 i = 0; i < meshClusters.size(); ++i)
+        {
+            if (meshClusters[i].size() > 1)
+                std::cout << "Mesh " << _meshes[i].name << " split in " << meshClusters[i].size() << " clusters\n";
+
+            for (ObjShape& cluster : meshClusters[i])
             {
-                data.indexData.push_back(it->second);
+                cluster.numVertices = (u32)cluster.vertexKeys.size();
+                cluster.vertexOffset = _geometry.allocateVertices(cluster.numVertices);
+                shapes.push_back(std::move(cluster));
             }
         }
 
-        return data;
+        std::vector<u32> shapeIds(shapes.size());
+        std::iota(shapeIds.begin(), shapeIds.end(), 0);
+        std::for_each(std::execution::par, shapeIds.begin(), shapeIds.end(), [&](u32 _id)
+        {
+            vec3* positions;
+            vec3* normals;
+            vec2* texCoords;
+            _geometry.getVertexStreams(shapes[_id].vertexOffset, positions, normals, texCoords);
+            writeObjVertices(_attrib, shapes[_id], positions, normals, texCoords, _pos, _scale, _swapYZ);
+        });
+
+        for (ObjShape& shape : shapes)
+            shape.vertexKeys = {};
+
+        return shapes;
+    }
+
+    // Mesh bounds and texel density, used to drive the virtual texture residency
+    static bool computeTextureUsage(const ObjShape& _shape, const BVHGeometry& _geometry, const Material& _mat, SceneTextureUsage& _usage)
+    {
+        const u32 texId = _mat.type_ids.y & 0xFFFF;
+        if (texId == 0xFFFF || (texId & VT_TEXTURE_BIT) == 0)
+            return false;
+
+        const vec3* positions = _geometry.getPositions() + _shape.vertexOffset;
+        const vec2* texCoords = _geometry.getTexCoords() + _shape.vertexOffset;
+
+        Box bounds = { positions[0], positions[0] };
+        for (u32 i = 0; i < _shape.numVertices; ++i)
+        {
+            const vec3& v = positions[i];
+            bounds.minExtent = linalg::min_(bounds.minExtent, v);
+            bounds.maxExtent = linalg::max_(bounds.maxExtent, v);
+        }
+
+        float worldArea = 0, uvArea = 0;
+        for (size_t i = 0; i + 2 < _shape.indexData.size(); i += 3)
+        {
+            const u32 i0 = _shape.indexData[i], i1 = _shape.indexData[i + 1], i2 = _shape.indexData[i + 2];
+            worldArea += linalg::length(linalg::cross(positions[i1] - positions[i0], positions[i2] - positions[i0])) * 0.5f;
+            uvArea += std::abs(linalg::cross(texCoords[i1] - texCoords[i0], texCoords[i2] - texCoords[i0])) * 0.5f;
+        }
+
+        if (worldArea <= 0 || uvArea <= 0)
+            return false;
+
+        _usage = { texId, bounds, sqrtf(worldArea / uvArea) };
+        return true;
+    }
+
+    void Scene::addTextureUsage(const SceneTextureUsage& _usage)
+    {
+        m_textureUsages.push_back(_usage);
+        m_texManager.addTextureUsage(_usage.texId, _usage.bounds, _usage.worldSizePerUv);
+    }
+
+    void Scene::addSourceFiles(const fs::path& _objPath)
+    {
+        std::vector<std::string> files = m_objParser->getMaterialFiles();
+        files.push_back((const char*)_objPath.u8string().c_str());
+
+        for (const std::string& file : files)
+        {
+            if (std::find(m_sourceFiles.begin(), m_sourceFiles.end(), file) == m_sourceFiles.end())
+                m_sourceFiles.push_back(file);
+        }
     }
 
     void Scene::addOBJInner(const fs::path& _path, vec3 _pos, vec3 _scale, BVHBuilder* _builder, const Material* _mat, bool _swapYZ)
     {
+        TIM_PROFILE_SCOPE("Scene load obj");
         tinyobj::attrib_t attrib;
         std::vector<tinyobj::shape_t> shapes;
         std::vector<tinyobj::material_t> mtlMaterials;
@@ -195,7 +415,8 @@ namespace tim
         std::u8string mtlFolderStr{ mtlFolder.u8string() };
         mtlFolderStr.erase(mtlFolderStr.end() - 1);
 
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &mtlMaterials, &warn, &err, (const  char*)_path.u8string().c_str(), _mat ? nullptr : (const  char*)mtlFolderStr.c_str());
+        bool ret = m_objParser->load((const char*)_path.u8string().c_str(), _mat ? nullptr : (const char*)mtlFolderStr.c_str(), attrib, shapes, mtlMaterials, warn, err);
+        addSourceFiles(_path);
         if (ret)
         {
             std::cout << "Warning loading  " << _path << ": " << warn << std::endl;
@@ -204,20 +425,15 @@ namespace tim
             if (!_mat)
                 materials = loadMtl(m_texManager, _path, mtlMaterials);
 
-            for (u32 objId = 0; objId < shapes.size(); ++objId)
+            const std::vector<ObjShape> objShapes = loadObjShapes(attrib, shapes, *m_geometryBuffer, _pos, _scale, _swapYZ);
+            for (const ObjShape& shape : objShapes)
             {
-                ObjData data = loadObj(attrib, shapes[objId], _pos, _scale, _swapYZ);
+                TIM_ASSERT(shape.indexData.size() % 3 == 0);
+                _builder->addTriangleList(shape.vertexOffset, (u32)shape.indexData.size() / 3, &shape.indexData[0], _mat ? *_mat : materials[shape.materialId]);
 
-                if (data.vertexData.size() < (1u << 16))
-                {
-                    u32 vertexOffset = m_geometryBuffer->addTriangleList((u32)data.vertexData.size(), &data.vertexData[0], &data.normalData[0], &data.texcoordData[0]);
-                    TIM_ASSERT(data.indexData.size() % 3 == 0);
-                    _builder->addTriangleList(vertexOffset, (u32)data.indexData.size() / 3, &data.indexData[0], _mat ? *_mat : materials[data.materialId]);
-                }
-                else
-                {
-                    std::cout << "Mesh " << shapes[objId].name << " has to many vertices (" << data.vertexData.size() << ")\n";
-                }
+                SceneTextureUsage usage;
+                if (computeTextureUsage(shape, *m_geometryBuffer, _mat ? *_mat : materials[shape.materialId], usage))
+                    addTextureUsage(usage);
             }
         }
         else
@@ -239,7 +455,8 @@ namespace tim
         std::u8string mtlFolderStr{ mtlFolder.u8string() };
         mtlFolderStr.erase(mtlFolderStr.end() - 1);
 
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &mtlMaterials, &warn, &err, (const  char*)_path.u8string().c_str(), _mat ? nullptr : (const  char*)mtlFolderStr.c_str());
+        bool ret = m_objParser->load((const char*)_path.u8string().c_str(), _mat ? nullptr : (const char*)mtlFolderStr.c_str(), attrib, shapes, mtlMaterials, warn, err);
+        addSourceFiles(_path);
         if (ret)
         {
             std::cout << "Warning loading  " << _path << ": " << warn << std::endl;
@@ -248,23 +465,22 @@ namespace tim
             if (!_mat)
                 materials = loadMtl(m_texManager, _path, mtlMaterials);
 
-            for (u32 objId = 0; objId < shapes.size(); ++objId)
+            const std::vector<ObjShape> objShapes = loadObjShapes(attrib, shapes, *m_geometryBuffer, _pos, _scale, _swapYZ);
+            for (u32 i = 0; i < objShapes.size(); ++i)
             {
-                ObjData data = loadObj(attrib, shapes[objId], _pos, _scale, _swapYZ);
+                const ObjShape& shape = objShapes[i];
+                Material blasMaterial = _mat ? *_mat : (shape.materialId >= 0 ? materials[shape.materialId] : BVHBuilder::createLambertianMaterial({ 0.9f, 0.9f, 0.9f }));
 
-                if (data.vertexData.size() < (1u << 16))
-                {
-                    Material blasMaterial = _mat ? *_mat : (data.materialId >= 0 ? materials[data.materialId] : BVHBuilder::createLambertianMaterial({ 0.9f, 0.9f, 0.9f }));
-                    _blas.emplace_back() = std::make_unique<BVHBuilder>(shapes[objId].name, *m_geometryBuffer, false);
-                   
-                    u32 vertexOffset = m_geometryBuffer->addTriangleList((u32)data.vertexData.size(), &data.vertexData[0], &data.normalData[0], &data.texcoordData[0]);
-                    TIM_ASSERT(data.indexData.size() % 3 == 0);
-                    _blas.back()->addTriangleList(vertexOffset, (u32)data.indexData.size() / 3, &data.indexData[0], blasMaterial);
-                }
-                else
-                {
-                    std::cout << "Mesh " << shapes[objId].name << " has to many vertices (" << data.vertexData.size() << ")\n";
-                }
+                // All the clusters of a shape go in the same blas
+                if (i == 0 || objShapes[i - 1].meshId != shape.meshId)
+                    _blas.emplace_back() = std::make_unique<BVHBuilder>(shapes[shape.meshId].name, *m_geometryBuffer, false);
+
+                TIM_ASSERT(shape.indexData.size() % 3 == 0);
+                _blas.back()->addTriangleList(shape.vertexOffset, (u32)shape.indexData.size() / 3, &shape.indexData[0], blasMaterial);
+
+                SceneTextureUsage usage;
+                if (computeTextureUsage(shape, *m_geometryBuffer, blasMaterial, usage))
+                    addTextureUsage(usage);
             }
         }
         else
@@ -273,109 +489,285 @@ namespace tim
         }
     }
 
-    void Scene::build(const BVHBuildParameters& _bvhParams, const BVHBuildParameters& _tlasParams, bool _useTlasBlas)
+    u64 SceneDescription::computeHash() const
+    {
+        auto hashString = [](const std::string& _str, u64 _hash)
+        {
+            const u64 size = _str.size();
+            _hash = hash_64_fnv1a(&size, sizeof(size), _hash);
+            return hash_64_fnv1a(_str.data(), _str.size(), _hash);
+        };
+
+        u64 hash = hash_64_fnv1a(spheres.data(), spheres.size() * sizeof(SphereObject));
+        hash = hash_64_fnv1a(sphereLights.data(), sphereLights.size() * sizeof(SphereLight), hash);
+
+        for (const std::string& texture : textures)
+            hash = hashString(texture, hash);
+
+        for (const Object& object : objects)
+        {
+            hash = hashString(object.path, hash);
+            const Material material = object.material.value_or(Material{});
+            const u32 flags[] = { object.material ? 1u : 0u, object.swapYZ ? 1u : 0u, object.mergeShapes ? 1u : 0u };
+            hash = hash_64_fnv1a(&object.pos, sizeof(vec3), hash);
+            hash = hash_64_fnv1a(&object.scale, sizeof(vec3), hash);
+            hash = hash_64_fnv1a(&material, sizeof(Material), hash);
+            hash = hash_64_fnv1a(flags, sizeof(flags), hash);
+        }
+
+        const u64 counts[] = { spheres.size(), sphereLights.size(), textures.size(), objects.size() };
+        return hash_64_fnv1a(counts, sizeof(counts), hash);
+    }
+
+    SceneDescription Scene::describe(bool _useTlas) const
     {
         constexpr bool useSponza = true;
         constexpr bool useRoom = false;
 
-        m_renderer->WaitForIdle();
-        m_geometryBuffer = std::make_unique<BVHGeometry>(m_renderer, 1024 * 1024);
-        m_bvh = std::make_unique<BVHBuilder>("BVHData", *m_geometryBuffer, _useTlasBlas);
-        m_bvhData = std::make_unique<BVHData>(m_renderer, *m_geometryBuffer);
-
-        const float DIMXY = 3.1f;
-        const float DIMZ = 2;
+        SceneDescription desc;
 
         auto glassMat = BVHBuilder::createTransparentMaterial({ 0.8f,0.8f,0.8f }, 1.1f, 0.2f);
         auto redGlassMat = BVHBuilder::createTransparentMaterial({ 1,0.5,0.5 }, 1.05f, 0.1f);
 
         Material suzanneMat = BVHBuilder::createPbrMaterial({ 1, 0.2f, 0.2f }, 1);
-        Material roomMat = BVHBuilder::createLambertianMaterial({ 0.9f, 0.9f, 0.9f });
-        Material redMat = BVHBuilder::createLambertianMaterial({ 0.9f, 0.2f, 0.2f });
-        Material blueMat = BVHBuilder::createLambertianMaterial({ 0.2f, 0.2f, 0.9f });
         Material pbrMat = BVHBuilder::createPbrMaterial({ 0.3f, 0.3f, 0.3f }, 0);
         Material pbrMatMetal = BVHBuilder::createPbrMaterial({ 0.3f, 0.3f, 0.3f }, 1);
 
         if (useSponza)
         {
-            //m_bvh->addSphere({ { 0, 0, 4.1f }, 0.08f }, BVHBuilder::createEmissiveMaterial({ 1, 1, 1 }));
-            //m_bvh->addSphereLight({ { 0, 0, 4.1f }, 30, { 2, 2, 2 }, 0.1f });
+            //desc.spheres.push_back({ { { 0, 0, 4.1f }, 0.08f }, BVHBuilder::createEmissiveMaterial({ 1, 1, 1 }) });
+            //desc.sphereLights.push_back({ { 0, 0, 4.1f }, 30, { 2, 2, 2 }, 0.1f });
 
-            m_bvh->addSphere({ { -9.18164f , 3.32356f , 6.98306f }, 0.05f }, BVHBuilder::createEmissiveMaterial({ 1,0.2f,0.2f }));
-            m_bvh->addSphereLight({ { -9.18164f , 3.32356f , 6.98306f }, 16, { 3,0.5,0.5 }, 0.1f });
+            desc.spheres.push_back({ { { -9.18164f , 3.32356f , 6.98306f }, 0.05f }, BVHBuilder::createEmissiveMaterial({ 1,0.2f,0.2f }) });
+            desc.sphereLights.push_back({ { -9.18164f , 3.32356f , 6.98306f }, 16, { 3,0.5,0.5 }, 0.1f });
 
-            m_bvh->addSphere({ {  2.0f, 0, 1.3f }, 0.2f }, pbrMatMetal);
-            m_bvh->addSphere({ {  0.5f, 0, 1.3f }, 0.2f }, glassMat);
-            m_bvh->addSphere({ { -1.5f, 0, 1.3f }, 0.2f }, redGlassMat);
+            desc.spheres.push_back({ { {  2.0f, 0, 1.3f }, 0.2f }, pbrMatMetal });
+            desc.spheres.push_back({ { {  0.5f, 0, 1.3f }, 0.2f }, glassMat });
+            desc.spheres.push_back({ { { -1.5f, 0, 1.3f }, 0.2f }, redGlassMat });
         }
 
-        u32 texFlame = m_texManager.loadTexture("./data/image/flame.png");
-        u32 texDot = m_texManager.loadTexture("./data/image/tex.png");
+        desc.textures = { "./data/image/flame.png", "./data/image/tex.png" };
 
-        if (!_useTlasBlas)
+        if (!_useTlas)
         {
             if (useSponza)
             {
-                BVHBuilder::setTextureMaterial(suzanneMat, texFlame, 0);
-                addOBJ("./data/suzanne.obj", { -2.5f, 0, 1.3f }, vec3(1), m_bvh.get(), pbrMat);
-                
-                BVHBuilder::setTextureMaterial(suzanneMat, texDot, 0);
-                addOBJ("./data/suzanne.obj", { 3.f, 0, 1.3f }, vec3(1), m_bvh.get(), pbrMatMetal);
-
-
-                addOBJWithMtl("./data/sponza.obj", {}, vec3(0.01f), m_bvh.get(), true);
+                desc.objects.push_back({ "./data/suzanne.obj", { -2.5f, 0, 1.3f }, vec3(1), pbrMat });
+                desc.objects.push_back({ "./data/suzanne.obj", { 3.f, 0, 1.3f }, vec3(1), pbrMatMetal });
+                desc.objects.push_back({ "./data/sponza.obj", {}, vec3(0.01f), std::nullopt, true });
             }
             else if (useRoom)
             {
-                m_bvh->addSphere({ { 0.340643f, 0.879322f, 3.09497f }, 0.08f }, BVHBuilder::createEmissiveMaterial({ 1, 1, 1 }));
-                m_bvh->addSphereLight({ { 0.340643f, 0.879322f, 3.09497f }, 20, { 3, 3, 3 }, 0.1f });
+                desc.spheres.push_back({ { { 0.340643f, 0.879322f, 3.09497f }, 0.08f }, BVHBuilder::createEmissiveMaterial({ 1, 1, 1 }) });
+                desc.sphereLights.push_back({ { 0.340643f, 0.879322f, 3.09497f }, 20, { 3, 3, 3 }, 0.1f });
 
-                addOBJWithMtl("./data/room/room.obj", {}, vec3(2), m_bvh.get());
+                desc.objects.push_back({ "./data/room/room.obj", {}, vec3(2) });
             }
             else
             {
-                // m_bvh.get()->addSphereLight({ { 3.08371f , 0.250811f , 5.16995f }, 25, { 2, 2, 2 }, 0.1f });
-                addOBJWithMtl("./data/cornell.obj", { 0, 0, 0 }, vec3(1), m_bvh.get());
-                // addOBJ("./data/object1.obj", { 2.10406f , -0.641558f , 1.7f }, vec3(1), m_bvh.get(), roomMat);
-                
+                // desc.sphereLights.push_back({ { 3.08371f , 0.250811f , 5.16995f }, 25, { 2, 2, 2 }, 0.1f });
+                desc.objects.push_back({ "./data/cornell.obj", { 0, 0, 0 }, vec3(1) });
             }
         }
         else
         {
-            std::vector<std::unique_ptr<BVHBuilder>> blas;
-            
             if (useSponza)
             {
-                loadBlas("./data/suzanne.obj", { -2.5f, 0, 1.3f }, vec3(1), blas, &suzanneMat);
-                loadBlas("./data/suzanne.obj", { 3.f, 0, 1.3f }, vec3(1), blas, &suzanneMat);
+                desc.objects.push_back({ "./data/suzanne.obj", { -2.5f, 0, 1.3f }, vec3(1), suzanneMat });
+                desc.objects.push_back({ "./data/suzanne.obj", { 3.f, 0, 1.3f }, vec3(1), suzanneMat });
+                desc.objects.push_back({ "./data/sponza.obj", {}, vec3(0.01f), std::nullopt, true, true });
+            }
+            else
+            {
+                desc.sphereLights.push_back({ { 3.08371f , 0.250811f , 5.16995f }, 15, { 0.1f, 0.1f, 0.1f }, 0.1f });
+                desc.objects.push_back({ "./data/cornell.obj", { 0, 0, 0 }, vec3(1), std::nullopt, false, true });
+            }
+        }
 
-                std::vector<std::unique_ptr<BVHBuilder>> sponzaBlas;
-                loadBlas("./data/sponza.obj", {}, vec3(0.01f), sponzaBlas, nullptr, true);
+        return desc;
+    }
 
-                if (!sponzaBlas.empty())
-                {
-                    for (auto it = sponzaBlas.begin() + 1; it != sponzaBlas.end(); ++it)
-                        sponzaBlas[0]->mergeBlas(std::move(*it));
+    void Scene::build(const BVHBuildParameters& _bvhParams, const BVHBuildParameters& _tlasParams, bool _useTlasBlas)
+    {
+        TIM_PROFILE_SCOPE("Scene build");
 
-                    blas.push_back(std::move(sponzaBlas[0]));
-                }
+        m_renderer->WaitForIdle();
+        m_texManager.clearTextureUsages();
+        m_textureUsages.clear();
+        m_sourceFiles.clear();
+        m_bvh.reset();
+        m_bvhData.reset();
+        m_geometryBuffer = std::make_unique<BVHGeometry>(m_renderer);
+        m_bvhData = std::make_unique<BVHData>(m_renderer, *m_geometryBuffer);
+
+        const SceneDescription desc = describe(_useTlasBlas);
+        const u64 cacheKey = SceneCache::computeKey(_bvhParams, _tlasParams, _useTlasBlas, desc.computeHash());
+        if (loadFromCache(cacheKey))
+        {
+            updateBindingTable();
+            MemoryTracker::get().printReport("scene build");
+            return;
+        }
+
+        m_bvh = std::make_unique<BVHBuilder>("BVHData", *m_geometryBuffer, _useTlasBlas);
+
+        for (const SceneDescription::SphereObject& sphere : desc.spheres)
+            m_bvh->addSphere(sphere.sphere, sphere.material);
+        for (const SphereLight& light : desc.sphereLights)
+            m_bvh->addSphereLight(light);
+        for (const std::string& texture : desc.textures)
+            m_texManager.loadTextureAsync(texture);
+
+        if (!_useTlasBlas)
+        {
+            for (const SceneDescription::Object& object : desc.objects)
+            {
+                if (object.material)
+                    addOBJ(object.path, object.pos, object.scale, m_bvh.get(), *object.material, object.swapYZ);
+                else
+                    addOBJWithMtl(object.path, object.pos, object.scale, m_bvh.get(), object.swapYZ);
             }
-            else
+        }
+        else
+        {
+            std::vector<std::unique_ptr<BVHBuilder>> blas;
+            for (const SceneDescription::Object& object : desc.objects)
             {
-                m_bvh.get()->addSphereLight({ { 3.08371f , 0.250811f , 5.16995f }, 15, { 0.1f, 0.1f, 0.1f }, 0.1f });
+                std::vector<std::unique_ptr<BVHBuilder>> objectBlas;
+                loadBlas(object.path, object.pos, object.scale, objectBlas, object.material ? &*object.material : nullptr, object.swapYZ);
 
-                loadBlas("./data/cornell.obj", { 0, 0, 0 }, vec3(1), blas);
-                for (auto it = blas.begin() + 1; it != blas.end(); ++it)
-                    blas[0]->mergeBlas(std::move(*it));
-                blas.resize(1);
+                if (object.mergeShapes && !objectBlas.empty())
+                {
+                    for (auto it = objectBlas.begin() + 1; it != objectBlas.end(); ++it)
+                        objectBlas[0]->mergeBlas(std::move(*it));
+                    objectBlas.resize(1);
+                }
 
-                // loadBlas("./data/object1.obj", { 2.10406f , -0.641558f , 1.7f }, vec3(1), blas);
+                for (auto& b : objectBlas)
+                    blas.push_back(std::move(b));
             }
+
+            // The LODs are simplified from the quantized positions the blas are built from, and cached with them
+            m_geometryBuffer->flush(m_renderer);
             for (auto& b : blas)
+            {
+                b->generateLods(*m_geometryBuffer, _bvhParams, m_bvhCache.get());
                 m_bvh->addBlas(std::move(b));
-        } 
+            }
+        }
+        m_geometryBuffer->flush(m_renderer);
+
+        std::vector<ubyte> packedBvh;
+        m_bvhData->build(*m_bvh, _bvhParams, _tlasParams, _useTlasBlas, m_bvhCache.get(), &packedBvh);
         m_geometryBuffer->flush(m_renderer);
-        m_bvhData->build(*m_bvh, _bvhParams, _tlasParams, _useTlasBlas);
         m_useTlas = _useTlasBlas;
+        m_stats = { m_bvh->getPrimitivesCount(), m_bvh->getTrianglesCount(), m_bvh->getBlasInstancesCount(), m_bvh->getLightsCount(), m_bvh->getNodesCount(), m_bvh->getAABB() };
+        updateBindingTable();
+
+        saveToCache(cacheKey, packedBvh);
+        MemoryTracker::get().printReport("scene build");
+    }
+
+    void Scene::refit()
+    {
+        if (!m_bvh)
+            return;
+
+        m_bvhData->refit(*m_bvh);
+        m_stats = { m_bvh->getPrimitivesCount(), m_bvh->getTrianglesCount(), m_bvh->getBlasInstancesCount(), m_bvh->getLightsCount(), m_bvh->getNodesCount(), m_bvh->getAABB() };
+
+        // Vertices of translated blas
+        m_geometryBuffer->flush(m_renderer);
+
+        // A repack or a grown vertex buffer moves the bound ranges
+        updateBindingTable();
+    }
+
+    bool Scene::loadFromCache(u64 _key)
+    {
+        TIM_PROFILE_SCOPE("Scene load cache");
+        auto start = std::chrono::high_resolution_clock::now();
+
+        SceneCache cache(g_sceneCacheFolder);
+        if (!cache.load(_key))
+            return false;
+
+        const SceneCacheHeader& header = cache.getHeader();
+
+        // Textures are requested again, the ids they get may differ from the ones baked in the materials
+        ska::flat_hash_map<u32, u32> texIdRemap;
+        bool needRemap = false;
+        for (u32 i = 0; i < header.numTextures; ++i)
+        {
+            const SceneTextureRef& texture = cache.getTextures()[i];
+            const u32 id = m_texManager.loadTextureAsync(texture.path, (texture.id & VT_TEXTURE_BIT) != 0);
+            texIdRemap[texture.id] = id;
+            needRemap |= id != texture.id;
+        }
+
+        auto remapTexId = [&texIdRemap](u32 _id)
+        {
+            auto it = texIdRemap.find(_id);
+            return it != texIdRemap.end() ? it->second : _id;
+        };
+
+        // The streams are already quantized, uploaded as they are at the offsets they had
+        m_geometryBuffer->restoreGpuStreams(cache.getVertexStreams(), cache.getVertexRanges(), header.numVertexRanges);
+        m_geometryBuffer->flush(m_renderer);
+        m_bvhData->upload(cache.getBvhData(), header.bvhSize, header.bvhRanges);
+
+        if (needRemap)
+        {
+            const uvec2 range = header.bvhRanges.material;
+            std::vector<Material> materials(range.y / sizeof(Material));
+            memcpy(materials.data(), cache.getBvhData() + range.x, materials.size() * sizeof(Material));
+
+            for (Material& mat : materials)
+                mat.type_ids.y = remapTexId(mat.type_ids.y & 0xFFFF) | (remapTexId(mat.type_ids.y >> 16) << 16);
+
+            m_renderer->UploadBuffer(m_bvhData->getBuffer(), range.x, materials.data(), u32(materials.size() * sizeof(Material)));
+        }
+
+        for (u32 i = 0; i < header.numTextureUsages; ++i)
+        {
+            SceneTextureUsage usage = cache.getTextureUsages()[i];
+            usage.texId = remapTexId(usage.texId);
+            addTextureUsage(usage);
+        }
+
+        m_stats = header.stats;
+        m_useTlas = header.useTlas != 0;
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::cout << "Scene loaded from cache in " << std::chrono::duration<double, std::milli>(end - start).count() << "ms\n";
+        return true;
+    }
+
+    void Scene::saveToCache(u64 _key, const std::vector<ubyte>& _packedBvh) const
+    {
+        SceneCacheData data;
+        data.useTlas = m_useTlas;
+        data.stats = m_stats;
+        data.textureUsages = m_textureUsages;
+
+        for (const std::string& file : m_sourceFiles)
+            data.sources.push_back(SceneCache::makeSourceFile(file));
+
+        for (const auto& [path, id] : m_texManager.getLoadedTextures())
+        {
+            SceneTextureRef texture = {};
+            strncpy(texture.path, path.c_str(), SceneCacheHeader::MaxPath - 1);
+            texture.id = id;
+            data.textures.push_back(texture);
+        }
+
+        data.vertexStreams = m_geometryBuffer->getGpuStreams();
+        m_geometryBuffer->getRanges(data.vertexRanges);
+        data.bvhData = &_packedBvh;
+        data.bvhRanges = m_bvhData->getOffsetRanges();
+
+        SceneCache cache(g_sceneCacheFolder);
+        if (!cache.save(_key, data))
+            std::cout << "Failed to write the scene cache" << std::endl;
     }
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 #include "rtDevice/public/IRenderer.h"
 #include "LightProbField.h"
+#include "SceneCache.h"
 #include "Shaders/core/primitive_cpp.glsl"
 #include <filesystem>
+#include <optional>
 
 struct Material;
 
@@ -14,6 +16,8 @@ namespace tim
     class BVHGeometry;
     class BVHData;
     class TextureManager;
+    class ObjParser;
+    class BVHCache;
     struct BufferBinding;
     struct BVHBuildParameters;
 
@@ -23,6 +27,33 @@ namespace tim
         vec3 sunColor = vec3(3, 3, 3);
     };
 
+    // Everything Scene::build adds, described before anything is loaded so that the scene cache key covers it
+    struct SceneDescription
+    {
+        struct Object
+        {
+            std::string path;
+            vec3 pos = vec3(0.f);
+            vec3 scale = vec3(1.f);
+            std::optional<Material> material; // the materials of the .mtl otherwise
+            bool swapYZ = false;
+            bool mergeShapes = false; // with a tlas, all the shapes go in a single blas
+        };
+
+        struct SphereObject
+        {
+            Sphere sphere;
+            Material material;
+        };
+
+        std::vector<SphereObject> spheres;
+        std::vector<SphereLight> sphereLights;
+        std::vector<std::string> textures; // loaded in this order before the objects
+        std::vector<Object> objects;
+
+        u64 computeHash() const;
+    };
+
     class Scene
     {
     public:
@@ -35,7 +66,13 @@ namespace tim
         void setSunData(const SunData& _data) { m_sunData = _data; }
         const SunData getSunData() const { return m_sunData; }
         const BVHData& getBVH() const { return *m_bvhData; }
+        // Null for a scene loaded from the cache, its items can't move
+        BVHBuilder* getBuilder() { return m_bvh.get(); }
+        // Call after moving, inserting or removing items through the builder
+        void refit();
         const LightProbField& getLPF() const { return m_lightProbField; }
+        // Geometry, BVH and light prob field, rebuilt when the scene is built, refit or its LPF reallocated
+        const BindingTable& getBindingTable() const { return m_bindingTable; }
 
         u32 getPrimitivesCount() const;
         u32 getTrianglesCount() const;
@@ -50,19 +87,37 @@ namespace tim
     private:
         IRenderer* m_renderer;
         TextureManager& m_texManager;
+        std::unique_ptr<ObjParser> m_objParser;
+        std::unique_ptr<BVHCache> m_bvhCache;
         std::unique_ptr<BVHGeometry> m_geometryBuffer;
         std::unique_ptr<BVHBuilder> m_bvh;
         std::unique_ptr<BVHData> m_bvhData;
         bool m_useTlas = false;
+        SceneStats m_stats;
+
+        // Everything the scene cache needs besides the built data
+        std::vector<std::string> m_sourceFiles;
+        std::vector<SceneTextureUsage> m_textureUsages;
 
         SunData m_sunData;
         LightProbField m_lightProbField;
+        BindingTable m_bindingTable;
 
     private:
+        SceneDescription describe(bool _useTlas) const;
+
         void addOBJ(const fs::path& _path, vec3 _pos, vec3 _scale, BVHBuilder* _builder, const Material& _mat, bool _swapYZ = false);
         void addOBJWithMtl(const fs::path& _path, vec3 _pos, vec3 _scale, BVHBuilder* _builder, bool _swapYZ = false);
         void addOBJInner(const fs::path& _path, vec3 _pos, vec3 _scale, BVHBuilder* _builder, const Material* _mat, bool _swapYZ = false);
 
+        void addSourceFiles(const fs::path& _objPath);
+        void updateBindingTable();
+        void addTextureUsage(const SceneTextureUsage& _usage);
+
+        // The whole built scene is cached, keyed by the build parameters and invalidated when a source file changes
+        bool loadFromCache(u64 _key);
+        void saveToCache(u64 _key, const std::vector<ubyte>& _packedBvh) const;
+
         void loadBlas(const fs::path& _path, vec3 _pos, vec3 _scale, std::vector<std::unique_ptr<BVHBuilder>>& _blas, const Material* _mat = nullptr, bool _swapYZ = false);
     };
 }
\ No newline at end of file
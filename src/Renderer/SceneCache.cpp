@@ -0,0 +1,164 @@
+#include "SceneCache.h"
+#include "BVHBuilder.h"
+#include "timCore/Common.h"
+#include "timCore/hash.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+namespace tim
+{
+    namespace
+    {
+        constexpr u32 g_SectionAlignment = 16;
+
+        template<typename T>
+        u32 appendSection(std::vector<ubyte>& _data, const T* _items, u32 _count)
+        {
+            const u32 offset = alignUp<u32>(u32(_data.size()), g_SectionAlignment);
+            _data.resize(offset + size_t(_count) * sizeof(T));
+            if (_count > 0)
+                memcpy(_data.data() + offset, _items, size_t(_count) * sizeof(T));
+            return offset;
+        }
+    }
+
+    SceneCache::SceneCache(const std::string& _cacheFolder) : m_cacheFolder{ _cacheFolder }
+    {
+    }
+
+    u64 SceneCache::computeKey(const BVHBuildParameters& _bvhParams, const BVHBuildParameters& _tlasParams, bool _useTlas, u64 _sceneHash)
+    {
+        const u32 settings[] = { SceneCacheHeader::Version, _useTlas ? 1u : 0u, COMPRESSED_VERTEX_STREAMS };
+        u64 key = hash_64_fnv1a(settings, sizeof(settings));
+        key = hash_64_fnv1a(&_sceneHash, sizeof(_sceneHash), key);
+        key = hash_64_fnv1a(&_bvhParams, sizeof(_bvhParams), key);
+        return hash_64_fnv1a(&_tlasParams, sizeof(_tlasParams), key);
+    }
+
+    SceneSourceFile SceneCache::makeSourceFile(const std::string& _path)
+    {
+        SceneSourceFile source = {};
+        TIM_ASSERT(_path.size() < SceneCacheHeader::MaxPath);
+        strncpy(source.path, _path.c_str(), SceneCacheHeader::MaxPath - 1);
+
+        std::error_code ec;
+        const u64 size = fs::file_size(_path, ec);
+        if (ec)
+            return source;
+
+        const fs::file_time_type writeTime = fs::last_write_time(_path, ec);
+        if (ec)
+            return source;
+
+        source.size = size;
+        source.writeTime = u64(writeTime.time_since_epoch().count());
+        return source;
+    }
+
+    BVHGeometry::GpuStreams SceneCache::getVertexStreams() const
+    {
+        const SceneCacheHeader& header = getHeader();
+
+        BVHGeometry::GpuStreams streams;
+        streams.numVertex = header.numVertices;
+        streams.positions = get<ubyte>(header.positionsOffset);
+        streams.normals = get<ubyte>(header.normalsOffset);
+        streams.texCoords = get<ubyte>(header.texCoordsOffset);
+        streams.blocks = get<ubyte>(header.blocksOffset);
+        streams.positionsSize = header.positionsSize;
+        streams.normalsSize = header.normalsSize;
+        streams.texCoordsSize = header.texCoordsSize;
+        streams.blocksSize = header.blocksSize;
+        return streams;
+    }
+
+    std::string SceneCache::getPath(u64 _key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.timscene", (unsigned long long)_key);
+        return m_cacheFolder + name;
+    }
+
+    bool SceneCache::load(u64 _key)
+    {
+        if (!m_file.open(getPath(_key)))
+            return false;
+
+        const SceneCacheHeader& header = getHeader();
+        bool valid = m_file.size() >= sizeof(SceneCacheHeader) && header.magic == SceneCacheHeader::Magic &&
+                     header.version == SceneCacheHeader::Version && header.key == _key;
+
+        valid = valid && u64(header.bvhOffset) + header.bvhSize <= m_file.size();
+
+        for (u32 i = 0; valid && i < header.numSources; ++i)
+        {
+            const SceneSourceFile& source = getSources()[i];
+            const SceneSourceFile current = makeSourceFile(source.path);
+            if (current.size != source.size || current.writeTime != source.writeTime)
+            {
+                std::cout << "Scene cache is stale, " << source.path << " changed" << std::endl;
+                valid = false;
+            }
+        }
+
+        if (!valid)
+            m_file.close();
+
+        return valid;
+    }
+
+    bool SceneCache::save(u64 _key, const SceneCacheData& _data) const
+    {
+        TIM_ASSERT(_data.bvhData);
+
+        SceneCacheHeader header;
+        header.key = _key;
+        header.useTlas = _data.useTlas ? 1 : 0;
+        header.stats = _data.stats;
+        header.bvhRanges = _data.bvhRanges;
+        header.numSources = u32(_data.sources.size());
+        header.numTextures = u32(_data.textures.size());
+        header.numTextureUsages = u32(_data.textureUsages.size());
+        header.numVertices = _data.vertexStreams.numVertex;
+        header.numVertexRanges = u32(_data.vertexRanges.size());
+        header.positionsSize = _data.vertexStreams.positionsSize;
+        header.normalsSize = _data.vertexStreams.normalsSize;
+        header.texCoordsSize = _data.vertexStreams.texCoordsSize;
+        header.blocksSize = _data.vertexStreams.blocksSize;
+        header.bvhSize = u32(_data.bvhData->size());
+
+        std::vector<ubyte> data(sizeof(SceneCacheHeader));
+        header.sourcesOffset = appendSection(data, _data.sources.data(), header.numSources);
+        header.texturesOffset = appendSection(data, _data.textures.data(), header.numTextures);
+        header.textureUsagesOffset = appendSection(data, _data.textureUsages.data(), header.numTextureUsages);
+        header.positionsOffset = appendSection(data, (const ubyte*)_data.vertexStreams.positions, header.positionsSize);
+        header.normalsOffset = appendSection(data, (const ubyte*)_data.vertexStreams.normals, header.normalsSize);
+        header.texCoordsOffset = appendSection(data, (const ubyte*)_data.vertexStreams.texCoords, header.texCoordsSize);
+        header.blocksOffset = appendSection(data, (const ubyte*)_data.vertexStreams.blocks, header.blocksSize);
+        header.vertexRangesOffset = appendSection(data, _data.vertexRanges.data(), header.numVertexRanges);
+        header.bvhOffset = appendSection(data, _data.bvhData->data(), header.bvhSize);
+        memcpy(data.data(), &header, sizeof(header));
+
+        // Write to a temporary file first so a crash never leaves a truncated entry in the cache
+        const std::string path = getPath(_key);
+        const std::string tmpPath = path + ".tmp";
+
+        std::error_code ec;
+        fs::create_directories(m_cacheFolder, ec);
+        {
+            std::ofstream file(tmpPath, std::ios::binary);
+            if (!file)
+                return false;
+            file.write((const char*)data.data(), data.size());
+            if (!file)
+                return false;
+        }
+
+        fs::rename(tmpPath, path, ec);
+        return !ec;
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "timCore/type.h"
+#include "timCore/MappedFile.h"
+#include "BVHData.h"
+#include "BVHGeometry.h"
+#include "Shaders/core/primitive_cpp.glsl"
+
+#include <vector>
+#include <string>
+
+namespace tim
+{
+    struct BVHBuildParameters;
+
+    struct SceneStats
+    {
+        u32 numPrimitives = 0;
+        u32 numTriangles = 0;
+        u32 numBlasInstances = 0;
+        u32 numLights = 0;
+        u32 numNodes = 0;
+        Box aabb = {};
+    };
+
+    struct SceneCacheHeader
+    {
+        static constexpr u32 Magic = 0x43534D54; // 'TMSC'
+        // Bump when the file or the packed BVH layout changes, the content of the scene is part of the key
+        static constexpr u32 Version = 5;
+        static constexpr u32 MaxPath = 256;
+
+        u32 magic = Magic;
+        u32 version = Version;
+        u64 key = 0;
+        u32 useTlas = 0;
+        SceneStats stats;
+        BVHOffsetRanges bvhRanges = {};
+
+        u32 numSources = 0;
+        u32 numTextures = 0;
+        u32 numTextureUsages = 0;
+        u32 numVertices = 0;
+        u32 numVertexRanges = 0;
+        u32 positionsSize = 0;
+        u32 normalsSize = 0;
+        u32 texCoordsSize = 0;
+        u32 blocksSize = 0;
+        u32 bvhSize = 0;
+
+        u32 sourcesOffset = 0;
+        u32 texturesOffset = 0;
+        u32 textureUsagesOffset = 0;
+        u32 positionsOffset = 0;
+        u32 normalsOffset = 0;
+        u32 texCoordsOffset = 0;
+        u32 blocksOffset = 0;
+        u32 vertexRangesOffset = 0;
+        u32 bvhOffset = 0;
+    };
+
+    // Files the scene was built from, the entry is stale as soon as the size or the write time of one of them changes (both are 0 for a missing file)
+    struct SceneSourceFile
+    {
+        char path[SceneCacheHeader::MaxPath];
+        u64 size;
+        u64 writeTime;
+    };
+
+    // Texture ids baked in the materials, remapped when the textures are loaded again
+    struct SceneTextureRef
+    {
+        char path[SceneCacheHeader::MaxPath];
+        u32 id;
+    };
+
+    struct SceneTextureUsage
+    {
+        u32 texId;
+        Box bounds;
+        float worldSizePerUv;
+    };
+
+    struct SceneCacheData
+    {
+        bool useTlas = false;
+        SceneStats stats;
+        std::vector<SceneSourceFile> sources;
+        std::vector<SceneTextureRef> textures;
+        std::vector<SceneTextureUsage> textureUsages;
+
+        // Geometry streams as uploaded, the ranges (offset, size) keep their own quantization
+        BVHGeometry::GpuStreams vertexStreams;
+        std::vector<uvec2> vertexRanges;
+
+        const std::vector<ubyte>* bvhData = nullptr;
+        BVHOffsetRanges bvhRanges = {};
+    };
+
+    // Built scene (vertex streams, packed BVH, texture references) stored as one .timscene file, mapped and uploaded as is
+    class SceneCache
+    {
+    public:
+        SceneCache(const std::string& _cacheFolder);
+
+        // _sceneHash covers the content of the scene (SceneDescription), the source files are checked at load
+        static u64 computeKey(const BVHBuildParameters& _bvhParams, const BVHBuildParameters& _tlasParams, bool _useTlas, u64 _sceneHash);
+        static SceneSourceFile makeSourceFile(const std::string& _path);
+
+        // Map the entry of _key, fails when missing, corrupted or when a source file changed
+        bool load(u64 _key);
+        bool save(u64 _key, const SceneCacheData& _data) const;
+
+        const SceneCacheHeader& getHeader() const { return *get<SceneCacheHeader>(0); }
+        const SceneSourceFile* getSources() const { return get<SceneSourceFile>(getHeader().sourcesOffset); }
+        const SceneTextureRef* getTextures() const { return get<SceneTextureRef>(getHeader().texturesOffset); }
+        const SceneTextureUsage* getTextureUsages() const { return get<SceneTextureUsage>(getHeader().textureUsagesOffset); }
+        BVHGeometry::GpuStreams getVertexStreams() const;
+        const uvec2* getVertexRanges() const { return get<uvec2>(getHeader().vertexRangesOffset); }
+        const ubyte* getBvhData() const { return get<ubyte>(getHeader().bvhOffset); }
+
+    private:
+        std::string getPath(u64 _key) const;
+
+        template<typename T>
+        const T* get(u32 _offset) const { return reinterpret_cast<const T*>(m_file.data() + _offset); }
+
+        std::string m_cacheFolder;
+        MappedFile m_file;
+    };
+}
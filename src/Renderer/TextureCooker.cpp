@@ -0,0 +1,715 @@
+#include "TextureCooker.h"
+#include "timCore/Common.h"
+#include "timCore/hash.h"
+
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace tim
+{
+    namespace
+    {
+        // Suffix of the temporary files, identical textures may be cooked at the same time by several loader threads
+        std::atomic<u32> g_nextTempFileId = 0;
+
+        struct SrgbTable
+        {
+            SrgbTable()
+            {
+                for (u32 i = 0; i < 256; ++i)
+                {
+                    float c = i / 255.f;
+                    toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+                }
+            }
+            float toLinear[256];
+        };
+
+        float srgbToLinear(ubyte _c)
+        {
+            static const SrgbTable table;
+            return table.toLinear[_c];
+        }
+
+        ubyte linearToSrgb(float _c)
+        {
+            _c = std::clamp(_c, 0.f, 1.f);
+            float c = _c <= 0.0031308f ? _c * 12.92f : 1.055f * powf(_c, 1.f / 2.4f) - 0.055f;
+            return ubyte(c * 255.f + 0.5f);
+        }
+
+        ubyte toUnorm8(float _c)
+        {
+            return ubyte(std::clamp(_c, 0.f, 1.f) * 255.f + 0.5f);
+        }
+
+        // Zeroth order modified Bessel function, for the Kaiser window
+        float besselI0(float _x)
+        {
+            float sum = 1, term = 1;
+            for (u32 k = 1; k < 16; ++k)
+            {
+                term *= (_x / (2 * k)) * (_x / (2 * k));
+                sum += term;
+            }
+            return sum;
+        }
+
+        struct FilterTap
+        {
+            u32 index;
+            float weight;
+        };
+
+        // Taps of a 1D downsample from _srcSize to _dstSize texels, with wrap addressing
+        std::vector<std::vector<FilterTap>> computeFilterTaps(u32 _srcSize, u32 _dstSize, MipFilter _filter)
+        {
+            const float kaiserAlpha = 4.f;
+            const float support = _filter == MipFilter::Box ? 0.5f : 2.f; // in destination texels
+            const float scale = float(_srcSize) / _dstSize;
+
+            std::vector<std::vector<FilterTap>> taps(_dstSize);
+            for (u32 i = 0; i < _dstSize; ++i)
+            {
+                const float center = (i + 0.5f) * scale;
+                const int first = int(floorf(center - support * scale));
+                const int last = int(ceilf(center + support * scale));
+
+                float totalWeight = 0;
+                for (int j = first; j <= last; ++j)
+                {
+                    const float d = (j + 0.5f - center) / scale;
+                    float w = 0;
+                    if (_filter == MipFilter::Box)
+                        w = fabsf(d) < 0.5f ? 1.f : (fabsf(d) == 0.5f ? 0.5f : 0.f);
+                    else if (fabsf(d) < support)
+                    {
+                        const float sinc = d == 0 ? 1.f : sinf(TIM_PI * d) / (TIM_PI * d);
+                        const float x = d / support;
+                        w = sinc * besselI0(kaiserAlpha * sqrtf(1 - x * x)) / besselI0(kaiserAlpha);
+                    }
+
+                    if (w != 0)
+                    {
+                        const u32 index = u32(((j % int(_srcSize)) + int(_srcSize)) % int(_srcSize));
+                        taps[i].push_back({ index, w });
+                        totalWeight += w;
+                    }
+                }
+
+                for (FilterTap& tap : taps[i])
+                    tap.weight /= totalWeight;
+            }
+
+            return taps;
+        }
+
+        void fetchBlock(const ubyte* _rgba, u32 _width, u32 _height, u32 _bx, u32 _by, ubyte _block[16][4])
+        {
+            for (u32 y = 0; y < 4; ++y)
+            {
+                for (u32 x = 0; x < 4; ++x)
+                {
+                    const u32 px = std::min(_bx * 4 + x, _width - 1);
+                    const u32 py = std::min(_by * 4 + y, _height - 1);
+                    memcpy(_block[y * 4 + x], _rgba + (size_t(py) * _width + px) * 4, 4);
+                }
+            }
+        }
+
+        // Principal axis of a set of points by power iteration, returns false if all points are equal
+        template<u32 N>
+        bool computePrincipalAxis(const float _points[16][N], float _mean[N], float _axis[N])
+        {
+            for (u32 c = 0; c < N; ++c)
+            {
+                _mean[c] = 0;
+                for (u32 i = 0; i < 16; ++i)
+                    _mean[c] += _points[i][c];
+                _mean[c] /= 16;
+            }
+
+            float cov[N][N] = {};
+            for (u32 i = 0; i < 16; ++i)
+                for (u32 a = 0; a < N; ++a)
+                    for (u32 b = 0; b < N; ++b)
+                        cov[a][b] += (_points[i][a] - _mean[a]) * (_points[i][b] - _mean[b]);
+
+            for (u32 c = 0; c < N; ++c)
+                _axis[c] = 1;
+
+            for (u32 iter = 0; iter < 8; ++iter)
+            {
+                float v[N] = {};
+                for (u32 a = 0; a < N; ++a)
+                    for (u32 b = 0; b < N; ++b)
+                        v[a] += cov[a][b] * _axis[b];
+
+                float norm = 0;
+                for (u32 c = 0; c < N; ++c)
+                    norm = std::max(norm, fabsf(v[c]));
+
+                if (norm < 1e-6f)
+                    return iter > 0;
+
+                for (u32 c = 0; c < N; ++c)
+                    _axis[c] = v[c] / norm;
+            }
+            return true;
+        }
+
+        // Endpoints minimizing the squared error for fixed interpolation weights, _weights[i] is the weight of endpoint 0
+        template<u32 N>
+        bool leastSquaresEndpoints(const float _points[16][N], const float _weights[16], float _e0[N], float _e1[N])
+        {
+            float A = 0, B = 0, C = 0;
+            float X[N] = {}, Y[N] = {};
+            for (u32 i = 0; i < 16; ++i)
+            {
+                const float a = _weights[i], b = 1 - a;
+                A += a * a; B += a * b; C += b * b;
+                for (u32 c = 0; c < N; ++c)
+                {
+                    X[c] += a * _points[i][c];
+                    Y[c] += b * _points[i][c];
+                }
+            }
+
+            const float det = A * C - B * B;
+            if (fabsf(det) < 1e-6f)
+                return false;
+
+            for (u32 c = 0; c < N; ++c)
+            {
+                _e0[c] = std::clamp((C * X[c] - B * Y[c]) / det, 0.f, 255.f);
+                _e1[c] = std::clamp((A * Y[c] - B * X[c]) / det, 0.f, 255.f);
+            }
+            return true;
+        }
+
+        //////////////////////////////////////////////////////////////////////
+        // BC1
+
+        u16 packRGB565(const float _c[3])
+        {
+            const u32 r = u32(std::clamp(_c[0] * 31.f / 255.f + 0.5f, 0.f, 31.f));
+            const u32 g = u32(std::clamp(_c[1] * 63.f / 255.f + 0.5f, 0.f, 63.f));
+            const u32 b = u32(std::clamp(_c[2] * 31.f / 255.f + 0.5f, 0.f, 31.f));
+            return u16((r << 11) | (g << 5) | b);
+        }
+
+        void unpackRGB565(u16 _c, float _out[3])
+        {
+            const u32 r = (_c >> 11) & 31, g = (_c >> 5) & 63, b = _c & 31;
+            _out[0] = float((r << 3) | (r >> 2));
+            _out[1] = float((g << 2) | (g >> 4));
+            _out[2] = float((b << 3) | (b >> 2));
+        }
+
+        // Opaque 4 colors mode only (c0 > c1), returns the block error
+        float evalBC1(const float _colors[16][3], u16& _c0, u16& _c1, u32 _indices[16])
+        {
+            if (_c0 < _c1)
+                std::swap(_c0, _c1);
+
+            float palette[4][3];
+            unpackRGB565(_c0, palette[0]);
+            unpackRGB565(_c1, palette[1]);
+            for (u32 c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            // c0 == c1 selects the 3 colors mode, index 0 is still c0
+            const u32 numColors = _c0 == _c1 ? 1 : 4;
+
+            float error = 0;
+            for (u32 i = 0; i < 16; ++i)
+            {
+                float bestError = FLT_MAX;
+                for (u32 p = 0; p < numColors; ++p)
+                {
+                    float e = 0;
+                    for (u32 c = 0; c < 3; ++c)
+                        e += (_colors[i][c] - palette[p][c]) * (_colors[i][c] - palette[p][c]);
+                    if (e < bestError)
+                    {
+                        bestError = e;
+                        _indices[i] = p;
+                    }
+                }
+                error += bestError;
+            }
+            return error;
+        }
+
+        void encodeBC1Block(const ubyte _block[16][4], ubyte _out[8])
+        {
+            float colors[16][3];
+            for (u32 i = 0; i < 16; ++i)
+                for (u32 c = 0; c < 3; ++c)
+                    colors[i][c] = _block[i][c];
+
+            float mean[3], axis[3];
+            u16 c0, c1;
+            if (!computePrincipalAxis<3>(colors, mean, axis))
+            {
+                c0 = c1 = packRGB565(mean);
+            }
+            else
+            {
+                float minT = FLT_MAX, maxT = -FLT_MAX;
+                for (u32 i = 0; i < 16; ++i)
+                {
+                    float t = 0;
+                    for (u32 c = 0; c < 3; ++c)
+                        t += (colors[i][c] - mean[c]) * axis[c];
+                    minT = std::min(minT, t);
+                    maxT = std::max(maxT, t);
+                }
+
+                float e0[3], e1[3];
+                for (u32 c = 0; c < 3; ++c)
+                {
+                    e0[c] = mean[c] + axis[c] * maxT;
+                    e1[c] = mean[c] + axis[c] * minT;
+                }
+                c0 = packRGB565(e0);
+                c1 = packRGB565(e1);
+            }
+
+            u32 indices[16];
+            float error = evalBC1(colors, c0, c1, indices);
+
+            // One refinement pass with the endpoints fitted on the selected indices
+            if (c0 != c1)
+            {
+                const float indexWeight[4] = { 1, 0, 2.f / 3, 1.f / 3 };
+                float weights[16];
+                for (u32 i = 0; i < 16; ++i)
+                    weights[i] = indexWeight[indices[i]];
+
+                float e0[3], e1[3];
+                if (leastSquaresEndpoints<3>(colors, weights, e0, e1))
+                {
+                    u16 refined0 = packRGB565(e0), refined1 = packRGB565(e1);
+                    u32 refinedIndices[16];
+                    float refinedError = evalBC1(colors, refined0, refined1, refinedIndices);
+                    if (refinedError < error)
+                    {
+                        c0 = refined0;
+                        c1 = refined1;
+                        memcpy(indices, refinedIndices, sizeof(indices));
+                    }
+                }
+            }
+
+            u32 packedIndices = 0;
+            for (u32 i = 0; i < 16; ++i)
+                packedIndices |= indices[i] << (2 * i);
+
+            memcpy(_out, &c0, 2);
+            memcpy(_out + 2, &c1, 2);
+            memcpy(_out + 4, &packedIndices, 4);
+        }
+
+        //////////////////////////////////////////////////////////////////////
+        // BC7, mode 6 only : 1 subset, RGBA 7.7.7.7 endpoints + unique p-bit, 4 bits indices
+
+        constexpr u32 g_bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        struct BC7Mode6Endpoints
+        {
+            u32 q[2][4]; // 7 bits
+            u32 p[2];
+        };
+
+        float evalBC7Mode6(const float _colors[16][4], const BC7Mode6Endpoints& _ep, u32 _indices[16])
+        {
+            u32 e[2][4];
+            for (u32 s = 0; s < 2; ++s)
+                for (u32 c = 0; c < 4; ++c)
+                    e[s][c] = (_ep.q[s][c] << 1) | _ep.p[s];
+
+            float palette[16][4];
+            for (u32 w = 0; w < 16; ++w)
+                for (u32 c = 0; c < 4; ++c)
+                    palette[w][c] = float(((64 - g_bc7Weights4[w]) * e[0][c] + g_bc7Weights4[w] * e[1][c] + 32) >> 6);
+
+            float error = 0;
+            for (u32 i = 0; i < 16; ++i)
+            {
+                float bestError = FLT_MAX;
+                for (u32 w = 0; w < 16; ++w)
+                {
+                    float err = 0;
+                    for (u32 c = 0; c < 4; ++c)
+                        err += (_colors[i][c] - palette[w][c]) * (_colors[i][c] - palette[w][c]);
+                    if (err < bestError)
+                    {
+                        bestError = err;
+                        _indices[i] = w;
+                    }
+                }
+                error += bestError;
+            }
+            return error;
+        }
+
+        // Try the 4 p-bit combinations for a pair of float endpoints
+        float quantizeBC7Mode6(const float _colors[16][4], const float _e0[4], const float _e1[4], BC7Mode6Endpoints& _best, u32 _bestIndices[16])
+        {
+            float bestError = FLT_MAX;
+            for (u32 pbits = 0; pbits < 4; ++pbits)
+            {
+                BC7Mode6Endpoints ep;
+                ep.p[0] = pbits & 1;
+                ep.p[1] = pbits >> 1;
+                for (u32 c = 0; c < 4; ++c)
+                {
+                    ep.q[0][c] = u32(std::clamp((_e0[c] - ep.p[0]) * 0.5f + 0.5f, 0.f, 127.f));
+                    ep.q[1][c] = u32(std::clamp((_e1[c] - ep.p[1]) * 0.5f + 0.5f, 0.f, 127.f));
+                }
+
+                u32 indices[16];
+                float error = evalBC7Mode6(_colors, ep, indices);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    _best = ep;
+                    memcpy(_bestIndices, indices, sizeof(indices));
+                }
+            }
+            return bestError;
+        }
+
+        struct BitWriter
+        {
+            u64 bits[2] = {};
+            u32 pos = 0;
+
+            void write(u32 _value, u32 _numBits)
+            {
+                for (u32 i = 0; i < _numBits; ++i, ++pos)
+                    bits[pos / 64] |= u64((_value >> i) & 1) << (pos % 64);
+            }
+        };
+
+        void encodeBC7Block(const ubyte _block[16][4], ubyte _out[16])
+        {
+            float colors[16][4];
+            for (u32 i = 0; i < 16; ++i)
+                for (u32 c = 0; c < 4; ++c)
+                    colors[i][c] = _block[i][c];
+
+            float mean[4], axis[4];
+            float e0[4], e1[4];
+            if (!computePrincipalAxis<4>(colors, mean, axis))
+            {
+                memcpy(e0, mean, sizeof(mean));
+                memcpy(e1, mean, sizeof(mean));
+            }
+            else
+            {
+                float minT = FLT_MAX, maxT = -FLT_MAX;
+                for (u32 i = 0; i < 16; ++i)
+                {
+                    float t = 0;
+                    for (u32 c = 0; c < 4; ++c)
+                        t += (colors[i][c] - mean[c]) * axis[c];
+                    minT = std::min(minT, t);
+                    maxT = std::max(maxT, t);
+                }
+
+                for (u32 c = 0; c < 4; ++c)
+                {
+                    e0[c] = std::clamp(mean[c] + axis[c] * minT, 0.f, 255.f);
+                    e1[c] = std::clamp(mean[c] + axis[c] * maxT, 0.f, 255.f);
+                }
+            }
+
+            BC7Mode6Endpoints ep;
+            u32 indices[16];
+            float error = quantizeBC7Mode6(colors, e0, e1, ep, indices);
+
+            float weights[16];
+            for (u32 i = 0; i < 16; ++i)
+                weights[i] = 1 - g_bc7Weights4[indices[i]] / 64.f;
+
+            if (leastSquaresEndpoints<4>(colors, weights, e0, e1))
+            {
+                BC7Mode6Endpoints refinedEp;
+                u32 refinedIndices[16];
+                if (quantizeBC7Mode6(colors, e0, e1, refinedEp, refinedIndices) < error)
+                {
+                    ep = refinedEp;
+                    memcpy(indices, refinedIndices, sizeof(indices));
+                }
+            }
+
+            // The MSB of the anchor index is implicit and must be 0
+            if (indices[0] & 8)
+            {
+                std::swap(ep.q[0], ep.q[1]);
+                std::swap(ep.p[0], ep.p[1]);
+                for (u32 i = 0; i < 16; ++i)
+                    indices[i] = 15 - indices[i];
+            }
+
+            BitWriter writer;
+            writer.write(1 << 6, 7);
+            for (u32 c = 0; c < 4; ++c)
+            {
+                writer.write(ep.q[0][c], 7);
+                writer.write(ep.q[1][c], 7);
+            }
+            writer.write(ep.p[0], 1);
+            writer.write(ep.p[1], 1);
+            writer.write(indices[0], 3);
+            for (u32 i = 1; i < 16; ++i)
+                writer.write(indices[i], 4);
+
+            TIM_ASSERT(writer.pos == 128);
+            memcpy(_out, writer.bits, 16);
+        }
+    }
+
+    bool CookedTexture::load(const std::string& _path, u64 _sourceHash, u32 _downscaleFactor)
+    {
+        if (!m_file.open(_path))
+            return false;
+
+        const CookedTextureHeader* header = reinterpret_cast<const CookedTextureHeader*>(m_file.data());
+        bool valid = m_file.size() >= sizeof(CookedTextureHeader) && header->magic == CookedTextureHeader::Magic && header->version == CookedTextureHeader::Version &&
+                     header->sourceHash == _sourceHash && header->downscaleFactor == _downscaleFactor && header->numMips > 0 && header->numMips <= CookedTextureHeader::MaxMips;
+
+        valid = valid && u64(header->mipOffsets[header->numMips - 1]) + header->mipSizes[header->numMips - 1] <= m_file.size();
+
+        if (!valid)
+        {
+            m_file.close();
+            return false;
+        }
+
+        m_data = m_file.data();
+        return true;
+    }
+
+    TextureCooker::TextureCooker(const std::string& _cacheFolder, TextureCompression _compression, MipFilter _filter)
+        : m_cacheFolder{ _cacheFolder }, m_compression{ _compression }, m_filter{ _filter }
+    {
+    }
+
+    std::string TextureCooker::getCachePath(u64 _sourceHash, u32 _downscaleFactor) const
+    {
+        const u32 settings[] = { CookedTextureHeader::Version, _downscaleFactor, u32(m_compression), u32(m_filter) };
+        const u64 key = hash_64_fnv1a(settings, sizeof(settings), _sourceHash);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.timtex", (unsigned long long)key);
+        return m_cacheFolder + name;
+    }
+
+    u32 TextureCooker::computeNumMips(u32 _width, u32 _height)
+    {
+        u32 numMips = 1;
+        while ((_width | _height) >> numMips)
+            numMips++;
+        return std::min(numMips, CookedTextureHeader::MaxMips);
+    }
+
+    u32 TextureCooker::computeMipSize(ImageFormat _format, u32 _width, u32 _height)
+    {
+        if (isBlockCompressed(_format))
+            return ((_width + 3) / 4) * ((_height + 3) / 4) * getFormatBlockSize(_format);
+        else
+            return _width * _height * getFormatBlockSize(_format);
+    }
+
+    std::vector<std::vector<ubyte>> TextureCooker::generateMipChain(const ubyte* _rgba, u32 _width, u32 _height, MipFilter _filter)
+    {
+        const u32 numMips = computeNumMips(_width, _height);
+        std::vector<std::vector<ubyte>> mips(numMips);
+        mips[0].assign(_rgba, _rgba + size_t(_width) * _height * 4);
+
+        // Filtering is done from the previous level, in linear space for the color channels
+        u32 srcW = _width, srcH = _height;
+        for (u32 mip = 1; mip < numMips; ++mip)
+        {
+            const u32 dstW = std::max(1u, srcW / 2), dstH = std::max(1u, srcH / 2);
+            const std::vector<ubyte>& src = mips[mip - 1];
+
+            std::vector<vec4> srcLinear(size_t(srcW) * srcH);
+            for (size_t i = 0; i < srcLinear.size(); ++i)
+                srcLinear[i] = { srgbToLinear(src[i * 4]), srgbToLinear(src[i * 4 + 1]), srgbToLinear(src[i * 4 + 2]), src[i * 4 + 3] / 255.f };
+
+            const auto tapsX = computeFilterTaps(srcW, dstW, _filter);
+            const auto tapsY = computeFilterTaps(srcH, dstH, _filter);
+
+            std::vector<vec4> horizontal(size_t(dstW) * srcH);
+            for (u32 y = 0; y < srcH; ++y)
+            {
+                for (u32 x = 0; x < dstW; ++x)
+                {
+                    vec4 sum = vec4(0.f);
+                    for (const FilterTap& tap : tapsX[x])
+                        sum += srcLinear[size_t(y) * srcW + tap.index] * tap.weight;
+                    horizontal[size_t(y) * dstW + x] = sum;
+                }
+            }
+
+            std::vector<ubyte>& dst = mips[mip];
+            dst.resize(size_t(dstW) * dstH * 4);
+            for (u32 y = 0; y < dstH; ++y)
+            {
+                for (u32 x = 0; x < dstW; ++x)
+                {
+                    vec4 sum = vec4(0.f);
+                    for (const FilterTap& tap : tapsY[y])
+                        sum += horizontal[size_t(tap.index) * dstW + x] * tap.weight;
+
+                    ubyte* texel = &dst[(size_t(y) * dstW + x) * 4];
+                    texel[0] = linearToSrgb(sum.x);
+                    texel[1] = linearToSrgb(sum.y);
+                    texel[2] = linearToSrgb(sum.z);
+                    texel[3] = toUnorm8(sum.w);
+                }
+            }
+
+            srcW = dstW;
+            srcH = dstH;
+        }
+
+        return mips;
+    }
+
+    void TextureCooker::encodeBC1(const ubyte* _rgba, u32 _width, u32 _height, ubyte* _out)
+    {
+        const u32 numBlocksX = (_width + 3) / 4, numBlocksY = (_height + 3) / 4;
+        for (u32 by = 0; by < numBlocksY; ++by)
+        {
+            for (u32 bx = 0; bx < numBlocksX; ++bx)
+            {
+                ubyte block[16][4];
+                fetchBlock(_rgba, _width, _height, bx, by, block);
+                encodeBC1Block(block, _out + (size_t(by) * numBlocksX + bx) * 8);
+            }
+        }
+    }
+
+    void TextureCooker::encodeBC7(const ubyte* _rgba, u32 _width, u32 _height, ubyte* _out)
+    {
+        const u32 numBlocksX = (_width + 3) / 4, numBlocksY = (_height + 3) / 4;
+        for (u32 by = 0; by < numBlocksY; ++by)
+        {
+            for (u32 bx = 0; bx < numBlocksX; ++bx)
+            {
+                ubyte block[16][4];
+                fetchBlock(_rgba, _width, _height, bx, by, block);
+                encodeBC7Block(block, _out + (size_t(by) * numBlocksX + bx) * 16);
+            }
+        }
+    }
+
+    void TextureCooker::cook(const ubyte* _rgba, u32 _width, u32 _height, u32 _pitch, bool _isBGRA, u64 _sourceHash, u32 _downscaleFactor, CookedTexture& _result) const
+    {
+        std::vector<ubyte> rgba(size_t(_width) * _height * 4);
+        bool isOpaque = true;
+        for (u32 y = 0; y < _height; ++y)
+        {
+            const ubyte* srcRow = _rgba + size_t(y) * _pitch;
+            ubyte* dstRow = &rgba[size_t(y) * _width * 4];
+            for (u32 x = 0; x < _width; ++x)
+            {
+                dstRow[x * 4 + 0] = srcRow[x * 4 + (_isBGRA ? 2 : 0)];
+                dstRow[x * 4 + 1] = srcRow[x * 4 + 1];
+                dstRow[x * 4 + 2] = srcRow[x * 4 + (_isBGRA ? 0 : 2)];
+                dstRow[x * 4 + 3] = srcRow[x * 4 + 3];
+                isOpaque &= dstRow[x * 4 + 3] == 255;
+            }
+        }
+
+        TextureCompression compression = m_compression;
+        if (compression == TextureCompression::Auto)
+            compression = isOpaque ? TextureCompression::BC1 : TextureCompression::BC7;
+
+        CookedTextureHeader header;
+        header.sourceHash = _sourceHash;
+        header.downscaleFactor = _downscaleFactor;
+        header.width = _width;
+        header.height = _height;
+        switch (compression)
+        {
+        case TextureCompression::BC1:   header.format = ImageFormat::BC1_SRGB; break;
+        case TextureCompression::BC7:   header.format = ImageFormat::BC7_SRGB; break;
+        default:                        header.format = ImageFormat::RGBA8_SRGB; break;
+        }
+
+        const std::vector<std::vector<ubyte>> mips = generateMipChain(rgba.data(), _width, _height, m_filter);
+        header.numMips = u32(mips.size());
+
+        u32 offset = sizeof(CookedTextureHeader);
+        for (u32 mip = 0; mip < header.numMips; ++mip)
+        {
+            header.mipOffsets[mip] = offset;
+            header.mipSizes[mip] = computeMipSize(header.format, std::max(1u, _width >> mip), std::max(1u, _height >> mip));
+            offset += (header.mipSizes[mip] + 15) & ~15u;
+        }
+
+        auto& data = _result.m_memory;
+        data.assign(offset, 0);
+        memcpy(data.data(), &header, sizeof(header));
+
+        for (u32 mip = 0; mip < header.numMips; ++mip)
+        {
+            const u32 w = std::max(1u, _width >> mip), h = std::max(1u, _height >> mip);
+            ubyte* dst = &data[header.mipOffsets[mip]];
+            if (header.format == ImageFormat::BC1_SRGB)
+                encodeBC1(mips[mip].data(), w, h, dst);
+            else if (header.format == ImageFormat::BC7_SRGB)
+                encodeBC7(mips[mip].data(), w, h, dst);
+            else
+                memcpy(dst, mips[mip].data(), header.mipSizes[mip]);
+        }
+
+        _result.m_data = data.data();
+
+        // Write to a temporary file first so a crash never leaves a truncated entry in the cache
+        const std::string path = getCachePath(_sourceHash, _downscaleFactor);
+        const std::string tmpPath = path + "." + std::to_string(g_nextTempFileId++) + ".tmp";
+        std::error_code ec;
+        fs::create_directories(m_cacheFolder, ec);
+        {
+            std::ofstream file(tmpPath, std::ios::binary);
+            if (!file)
+                return;
+            file.write((const char*)data.data(), data.size());
+            if (!file)
+                return;
+        }
+
+        fs::rename(tmpPath, path, ec);
+        if (ec)
+        {
+            fs::remove(tmpPath, ec);
+            return;
+        }
+
+        // Upload from the mapped file like a cache hit, the memory copy can go
+        CookedTexture mapped;
+        if (mapped.load(path, _sourceHash, _downscaleFactor))
+        {
+            _result.m_file = std::move(mapped.m_file);
+            _result.m_data = _result.m_file.data();
+            decltype(_result.m_memory)().swap(_result.m_memory);
+        }
+    }
+}
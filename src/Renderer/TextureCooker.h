@@ -0,0 +1,84 @@
+#pragma once
+#include "timCore/type.h"
+#include "timCore/MappedFile.h"
+#include "rtDevice/public/Resource.h"
+
+#include <vector>
+#include <string>
+
+namespace tim
+{
+    enum class TextureCompression
+    {
+        None,   // RGBA8 mip chain
+        BC1,
+        BC7,
+        Auto,   // BC1 for opaque textures, BC7 otherwise
+    };
+
+    enum class MipFilter
+    {
+        Box,
+        Kaiser,
+    };
+
+    struct CookedTextureHeader
+    {
+        static constexpr u32 Magic = 0x58544D54; // 'TMTX'
+        static constexpr u32 Version = 1;
+        static constexpr u32 MaxMips = 16;
+
+        u32 magic = Magic;
+        u32 version = Version;
+        u64 sourceHash = 0;
+        u32 downscaleFactor = 1;
+        ImageFormat format = ImageFormat::RGBA8_SRGB;
+        u32 width = 0, height = 0;
+        u32 numMips = 0;
+        u32 mipOffsets[MaxMips] = {};
+        u32 mipSizes[MaxMips] = {};
+    };
+
+    // Cooked texture, either mapped from the cache or kept in memory when the cache can't be written
+    class CookedTexture
+    {
+    public:
+        bool load(const std::string& _path, u64 _sourceHash, u32 _downscaleFactor);
+
+        const CookedTextureHeader& getHeader() const { return *reinterpret_cast<const CookedTextureHeader*>(m_data); }
+        const ubyte* getMipData(u32 _mip) const { return m_data + getHeader().mipOffsets[_mip]; }
+
+    private:
+        friend class TextureCooker;
+
+        MappedFile m_file;
+        TaggedVector<ubyte, MemoryTag::Textures> m_memory;
+        const ubyte* m_data = nullptr;
+    };
+
+    class TextureCooker
+    {
+    public:
+        TextureCooker(const std::string& _cacheFolder, TextureCompression _compression, MipFilter _filter = MipFilter::Kaiser);
+
+        // Cache file path for a source image, key is the source content hash + cooking settings
+        std::string getCachePath(u64 _sourceHash, u32 _downscaleFactor) const;
+
+        // _rgba is a 32 bits image (RGBA or BGRA order with _isBGRA), colors are assumed to be sRGB
+        void cook(const ubyte* _rgba, u32 _width, u32 _height, u32 _pitch, bool _isBGRA, u64 _sourceHash, u32 _downscaleFactor, CookedTexture& _result) const;
+
+        static u32 computeNumMips(u32 _width, u32 _height);
+        static u32 computeMipSize(ImageFormat _format, u32 _width, u32 _height);
+
+        // Each level is tightly packed RGBA8, level 0 is a copy of _rgba
+        static std::vector<std::vector<ubyte>> generateMipChain(const ubyte* _rgba, u32 _width, u32 _height, MipFilter _filter);
+
+        static void encodeBC1(const ubyte* _rgba, u32 _width, u32 _height, ubyte* _out);
+        static void encodeBC7(const ubyte* _rgba, u32 _width, u32 _height, ubyte* _out);
+
+    private:
+        std::string m_cacheFolder;
+        TextureCompression m_compression;
+        MipFilter m_filter;
+    };
+}
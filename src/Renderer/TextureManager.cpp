@@ -1,14 +1,45 @@
 #include "TextureManager.h"
 #include "Shaders/bvh/bvhBindings_cpp.glsl"
 
+#include "timCore/hash.h"
+#include "timCore/Profiler.h"
+
 #include <FreeImage.h>
+#include <algorithm>
+#include <fstream>
 
 namespace tim
 {
-    TextureManager::TextureManager(IRenderer* _renderer, u32 _downscaleFactor) : m_renderer{ _renderer }, m_downscaleFactor{ _downscaleFactor }
+    namespace
+    {
+        bool readFile(const std::string& _path, std::vector<ubyte>& _data)
+        {
+            std::ifstream file(_path, std::ios::binary | std::ios::ate);
+            if (!file)
+                return false;
+
+            _data.resize(size_t(file.tellg()));
+            file.seekg(0);
+            file.read((char*)_data.data(), _data.size());
+            return bool(file);
+        }
+
+        // Decoded bitmaps wait in the upload queue, they are accounted as texture staging memory
+        void trackBitmap(FIBITMAP* _bitmap, bool _alloc)
+        {
+            const u64 size = u64(FreeImage_GetPitch(_bitmap)) * FreeImage_GetHeight(_bitmap);
+            if (_alloc)
+                MemoryTracker::get().onAlloc(MemoryPool::Cpu, MemoryTag::Textures, size);
+            else
+                MemoryTracker::get().onFree(MemoryPool::Cpu, MemoryTag::Textures, size);
+        }
+    }
+
+    TextureManager::TextureManager(IRenderer* _renderer, u32 _downscaleFactor, TextureCompression _compression, u32 _maxPendingUploads) 
+        : m_renderer{ _renderer }, m_downscaleFactor{ _downscaleFactor }, m_cooker{ "./data/cache/textures/", _compression }, m_vtPool{ _renderer }, m_maxPendingUploads{ std::max(1u, _maxPendingUploads) }
     {
         ImageCreateInfo creationInfo(ImageFormat::RGBA8, 8, 8, 1, 1, ImageType::Image2D, MemoryType::Default, ImageUsage::Sampled | ImageUsage::Transfer);
-        m_defaultTexture = m_renderer->CreateImage(creationInfo);
+        m_defaultTexture = m_renderer->CreateImage(creationInfo, MemoryTag::Textures);
 
         for (u32 i = 0; i < TEXTURE_ARRAY_SIZE; ++i)
             m_samplingMode[i] = SamplerType::Repeat_Linear_MipNearest;
@@ -16,6 +47,23 @@ namespace tim
 
     TextureManager::~TextureManager()
     {
+        // Unblock the workers waiting for room in the upload queue, their images are dropped
+        {
+            std::lock_guard<std::mutex> lock(m_uploadQueueMutex);
+            m_exit = true;
+        }
+        m_uploadQueueNotFull.notify_all();
+        m_threadPool.waitIdle();
+
+        for (DecodedImage& img : m_uploadQueue)
+        {
+            if (img.bitmap)
+            {
+                trackBitmap(img.bitmap, false);
+                FreeImage_Unload(img.bitmap);
+            }
+        }
+
         m_renderer->DestroyImage(m_defaultTexture);
         for (u32 i = 0; i < TEXTURE_ARRAY_SIZE; ++i)
         {
@@ -24,19 +72,116 @@ namespace tim
         }
     }
 
-    u16 TextureManager::loadTexture(const std::string& _path)
+    u16 TextureManager::loadTexture(const std::string& _path, bool _cook)
     {
         auto it = m_texPathToId.find(_path);
         if (it != m_texPathToId.end())
             return it->second;
 
-        auto imgExt = FreeImage_GetFileType(_path.c_str());
-        if (imgExt == FREE_IMAGE_FORMAT::FIF_UNKNOWN)
+        DecodedImage img = decodeTexture(_path, _cook);
+        if (!img.isValid())
             return u16(-1);
 
-        FIBITMAP* img = FreeImage_Load(imgExt, _path.c_str());
+        img.slot = img.cooked ? (VT_TEXTURE_BIT | m_vtPool.reserveTexture()) : allocSlot();
+        uploadTexture(img);
+
+        m_texPathToId[_path] = img.slot;
+        return img.slot;
+    }
+
+    u16 TextureManager::loadTextureAsync(const std::string& _path, bool _cook)
+    {
+        auto it = m_texPathToId.find(_path);
+        if (it != m_texPathToId.end())
+            return it->second;
+
+        const u32 slot = _cook ? (VT_TEXTURE_BIT | m_vtPool.reserveTexture()) : allocSlot();
+        m_texPathToId[_path] = slot;
+        m_numPendingLoads++;
+
+        m_threadPool.submit([this, slot, _path, _cook]()
+        {
+            DecodedImage img = decodeTexture(_path, _cook);
+            img.slot = slot;
+
+            std::unique_lock<std::mutex> lock(m_uploadQueueMutex);
+            m_uploadQueueNotFull.wait(lock, [this] { return m_exit || m_uploadQueue.size() < m_maxPendingUploads; });
+
+            if (m_exit)
+            {
+                if (img.bitmap)
+                {
+                    trackBitmap(img.bitmap, false);
+                    FreeImage_Unload(img.bitmap);
+                }
+                return;
+            }
+
+            m_uploadQueue.push_back(std::move(img));
+        });
+
+        return slot;
+    }
+
+    u32 TextureManager::processPendingUploads(u32 _maxUploads)
+    {
+        u32 numUploads = 0;
+        while (numUploads < _maxUploads)
+        {
+            DecodedImage img;
+            {
+                std::lock_guard<std::mutex> lock(m_uploadQueueMutex);
+                if (m_uploadQueue.empty())
+                    break;
+
+                img = std::move(m_uploadQueue.front());
+                m_uploadQueue.pop_front();
+            }
+            m_uploadQueueNotFull.notify_one();
+
+            if (img.isValid())
+            {
+                uploadTexture(img);
+                numUploads++;
+            }
+            else // the slot keeps the default texture
+                std::cout << "Failed to load texture " << img.path << std::endl;
+
+            m_numPendingLoads--;
+        }
+
+        return numUploads;
+    }
+
+    void TextureManager::flushPendingLoads()
+    {
+        while (hasPendingLoads())
+        {
+            if (processPendingUploads() == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    FIBITMAP* TextureManager::loadBitmap(const std::string& _path, const std::vector<ubyte>* _fileData, ImageFormat& _format) const
+    {
+        FIBITMAP* img = nullptr;
+        if (_fileData)
+        {
+            FIMEMORY* memory = FreeImage_OpenMemory((BYTE*)_fileData->data(), (DWORD)_fileData->size());
+            auto imgExt = FreeImage_GetFileTypeFromMemory(memory);
+            if (imgExt != FREE_IMAGE_FORMAT::FIF_UNKNOWN)
+                img = FreeImage_LoadFromMemory(imgExt, memory);
+            FreeImage_CloseMemory(memory);
+        }
+        else
+        {
+            auto imgExt = FreeImage_GetFileType(_path.c_str());
+            if (imgExt != FREE_IMAGE_FORMAT::FIF_UNKNOWN)
+                img = FreeImage_Load(imgExt, _path.c_str());
+        }
+
         if (!img)
-            return u16(-1);
+            return nullptr;
 
         u32 w = FreeImage_GetWidth(img);
         u32 h = FreeImage_GetHeight(img);
@@ -47,6 +192,7 @@ namespace tim
             h = h / m_downscaleFactor;
             FIBITMAP* prev_img = img;
             img = FreeImage_Rescale(prev_img, w, h, FILTER_BILINEAR);
+            FreeImage_Unload(prev_img);
         }
 
         u32 bpp = FreeImage_GetBPP(img);
@@ -59,25 +205,90 @@ namespace tim
             bpp = FreeImage_GetBPP(img);
         }
 
-        BYTE * data = FreeImage_GetBits(img);
         auto maskR = FreeImage_GetRedMask(img);
         auto maskG = FreeImage_GetGreenMask(img);
         auto maskB = FreeImage_GetBlueMask(img);
 
-        ImageFormat format = ImageFormat::RGBA8_SRGB;
         if (maskR == 0x000000FF && maskG == 0x0000FF00 && maskB == 0x00FF0000)
-            format = ImageFormat::RGBA8_SRGB;
+            _format = ImageFormat::RGBA8_SRGB;
         else if (maskB == 0x000000FF && maskG == 0x0000FF00 && maskR == 0x00FF0000)
-            format = ImageFormat::BGRA8_SRGB;
+            _format = ImageFormat::BGRA8_SRGB;
         else
             TIM_ASSERT(false);
 
-        ImageCreateInfo creationInfo(format, w, h, 1, 1, ImageType::Image2D, MemoryType::Default, ImageUsage::Sampled | ImageUsage::Transfer);
+        return img;
+    }
+
+    TextureManager::DecodedImage TextureManager::decodeTexture(const std::string& _path, bool _cook) const
+    {
+        TIM_PROFILE_SCOPE("Texture decode");
+        DecodedImage result;
+        result.path = _path;
+
+        if (!_cook)
+        {
+            result.bitmap = loadBitmap(_path, nullptr, result.format);
+            if (result.bitmap)
+                trackBitmap(result.bitmap, true);
+            return result;
+        }
+
+        // The cache is keyed on the source content, so edited textures are cooked again
+        std::vector<ubyte> fileData;
+        if (!readFile(_path, fileData))
+            return result;
+
+        const u64 sourceHash = hash_64_fnv1a(fileData.data(), fileData.size());
+
+        std::unique_ptr<CookedTexture> cooked = std::make_unique<CookedTexture>();
+        if (!cooked->load(m_cooker.getCachePath(sourceHash, m_downscaleFactor), sourceHash, m_downscaleFactor))
+        {
+            ImageFormat format;
+            FIBITMAP* img = loadBitmap(_path, &fileData, format);
+            if (!img)
+                return result;
+
+            m_cooker.cook(FreeImage_GetBits(img), FreeImage_GetWidth(img), FreeImage_GetHeight(img), FreeImage_GetPitch(img),
+                          format == ImageFormat::BGRA8_SRGB, sourceHash, m_downscaleFactor, *cooked);
+            FreeImage_Unload(img);
+        }
+
+        result.format = cooked->getHeader().format;
+        result.cooked = std::move(cooked);
+        return result;
+    }
+
+    void TextureManager::uploadTexture(DecodedImage& _image)
+    {
+        if (_image.cooked)
+        {
+            TIM_ASSERT(_image.slot & VT_TEXTURE_BIT);
+            m_vtPool.setTextureData(_image.slot & VT_TEXTURE_ID_MASK, std::move(_image.cooked));
+            return;
+        }
+
+        const u32 w = FreeImage_GetWidth(_image.bitmap);
+        const u32 h = FreeImage_GetHeight(_image.bitmap);
+
+        ImageCreateInfo creationInfo(_image.format, w, h, 1, 1, ImageType::Image2D, MemoryType::Default, ImageUsage::Sampled | ImageUsage::Transfer);
+        m_images[_image.slot] = m_renderer->CreateImage(creationInfo, MemoryTag::Textures);
+        m_imageBindingVersion++;
 
+        BYTE* data = FreeImage_GetBits(_image.bitmap);
+        u32 pitch = FreeImage_GetPitch(_image.bitmap) / 4;
+        m_renderer->UploadImage(m_images[_image.slot], data, pitch, 0);
+
+        trackBitmap(_image.bitmap, false);
+        FreeImage_Unload(_image.bitmap);
+        _image.bitmap = nullptr;
+    }
+
+    u32 TextureManager::allocSlot()
+    {
         u32 freeSlot = u32(-1);
         for (u32 i = 0; i < TEXTURE_ARRAY_SIZE; ++i)
         {
-            if (m_images[i].ptr == 0)
+            if (!m_slotUsed[i])
             {
                 freeSlot = i;
                 break;
@@ -85,20 +296,40 @@ namespace tim
         }
 
         TIM_ASSERT(freeSlot != u32(-1));
-        m_images[freeSlot] = m_renderer->CreateImage(creationInfo);
+        m_slotUsed[freeSlot] = true;
+        return freeSlot;
+    }
 
-        u32 pitch = FreeImage_GetPitch(img) / 4;
-        m_renderer->UploadImage(m_images[freeSlot], data, pitch, 0);
+    void TextureManager::addTextureUsage(u32 _texId, const Box& _bounds, float _worldSizePerUv)
+    {
+        if ((_texId & VT_TEXTURE_BIT) == 0 || _texId == 0xFFFF || _worldSizePerUv <= 0)
+            return;
 
-        FreeImage_Unload(img);
+        m_textureUsages.push_back({ _texId & VT_TEXTURE_ID_MASK, _bounds, _worldSizePerUv });
+    }
 
-        m_texPathToId[_path] = freeSlot;
-        return freeSlot;
+    void TextureManager::updateVirtualTextures(vec3 _cameraPos, float _pixelAngle, u32 _maxPageUploads)
+    {
+        for (const TextureUsage& usage : m_textureUsages)
+        {
+            const vec3 closestPoint = linalg::clamp(_cameraPos, usage.bounds.minExtent, usage.bounds.maxExtent);
+            const float distance = std::max(linalg::distance(_cameraPos, closestPoint), 0.01f);
+
+            const float uvPerPixel = distance * _pixelAngle / usage.worldSizePerUv;
+            m_vtPool.requestTexture(usage.vtId, uvPerPixel, 1.f / distance);
+        }
+
+        m_vtPool.update(_maxPageUploads);
     }
 
     void TextureManager::setSamplingMode(u32 _index, SamplerType _mode)
     {
+        // Virtual textures are always sampled with the pool sampler
+        if (_index & VT_TEXTURE_BIT)
+            return;
+
         m_samplingMode[_index] = _mode;
+        m_imageBindingVersion++;
     }
 
     void TextureManager::fillImageBindings(std::vector<ImageBinding>& _bindings) const
@@ -124,5 +355,26 @@ namespace tim
                 _bindings.push_back(binding);
             }
         }
+
+        m_vtPool.fillImageBindings(_bindings, m_defaultTexture);
+    }
+
+    const BindingTable& TextureManager::getBindingTable() const
+    {
+        const uvec2 version = { m_imageBindingVersion, m_vtPool.getImageBindingVersion() };
+        if (version != m_bindingTableVersion)
+        {
+            std::vector<ImageBinding> imgBinds;
+            fillImageBindings(imgBinds);
+            m_bindingTable = BindingTable({}, std::move(imgBinds));
+            m_bindingTableVersion = version;
+        }
+
+        return m_bindingTable;
+    }
+
+    void TextureManager::fillBufferBindings(std::vector<BufferBinding>& _bindings) const
+    {
+        m_vtPool.fillBufferBindings(_bindings);
     }
-}
\ No newline at end of file
+}
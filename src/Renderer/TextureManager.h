@@ -2,27 +2,99 @@
 
 #include "timCore/Common.h"
 #include "timCore/flat_hash_map.h"
+#include "timCore/ThreadPool.h"
 #include "rtDevice/public/IRenderer.h"
+#include "TextureCooker.h"
+#include "VirtualTexturePool.h"
 #include "Shaders/struct_cpp.glsl"
+#include "Shaders/core/primitive_cpp.glsl"
+
+#include <deque>
+#include <atomic>
+#include <memory>
+
+struct FIBITMAP;
 
 namespace tim
 {
     class TextureManager
     {
     public: 
-        TextureManager(IRenderer * _renderer, u32 _downscaleFactor);
+        TextureManager(IRenderer * _renderer, u32 _downscaleFactor, TextureCompression _compression = TextureCompression::Auto, u32 _maxPendingUploads = 8);
         ~TextureManager();
 
-        u16 loadTexture(const std::string& _path);
+        // Cooked textures have a full mip chain and are block compressed, they are cached in data/cache/textures and
+        // streamed page by page from the mapped cache file through the virtual texture pool, their id has VT_TEXTURE_BIT set.
+        // Non cooked textures are single mip RGBA8 images bound in g_dataTextures, TEXTURE_ARRAY_SIZE at most.
+        u16 loadTexture(const std::string& _path, bool _cook = true);
+
+        // Decode/convert/downscale happen on the thread pool, the returned id samples the default texture until
+        // processPendingUploads picks it up. At most _maxPendingUploads decoded images are kept in memory waiting for upload.
+        u16 loadTextureAsync(const std::string& _path, bool _cook = true);
+        u32 processPendingUploads(u32 _maxUploads = u32(-1));
+        void flushPendingLoads();
+        bool hasPendingLoads() const { return m_numPendingLoads > 0; }
+        const ska::flat_hash_map<std::string, u32>& getLoadedTextures() const { return m_texPathToId; }
+
+        // Residency feedback : surfaces using a virtual texture are registered by the scene, every frame the mip needed
+        // by each surface is estimated from its distance to the camera and the missing pages are streamed in.
+        void addTextureUsage(u32 _texId, const Box& _bounds, float _worldSizePerUv);
+        void clearTextureUsages() { m_textureUsages.clear(); }
+        void updateVirtualTextures(vec3 _cameraPos, float _pixelAngle, u32 _maxPageUploads = 16);
+
         void setSamplingMode(u32 _index, SamplerType _mode);
         void fillImageBindings(std::vector<ImageBinding>& _bindings) const;
+        // The page tables are rewritten each frame, they are not part of the binding table
+        void fillBufferBindings(std::vector<BufferBinding>& _bindings) const;
+        // Texture array and virtual texture atlases, rebuilt when a texture or an atlas is added
+        const BindingTable& getBindingTable() const;
+
+    private:
+        struct DecodedImage
+        {
+            u32 slot = u32(-1);
+            FIBITMAP* bitmap = nullptr;
+            ImageFormat format = ImageFormat::RGBA8_SRGB;
+            std::unique_ptr<CookedTexture> cooked;
+            std::string path;
+
+            bool isValid() const { return bitmap || cooked; }
+        };
+
+        FIBITMAP* loadBitmap(const std::string& _path, const std::vector<ubyte>* _fileData, ImageFormat& _format) const;
+        DecodedImage decodeTexture(const std::string& _path, bool _cook) const;
+        void uploadTexture(DecodedImage& _image);
+        u32 allocSlot();
 
     private:
         IRenderer * m_renderer;
         const u32 m_downscaleFactor;
         ImageHandle m_images[TEXTURE_ARRAY_SIZE];
         SamplerType m_samplingMode[TEXTURE_ARRAY_SIZE];
+        bool m_slotUsed[TEXTURE_ARRAY_SIZE] = {};
         ImageHandle m_defaultTexture;
+        u32 m_imageBindingVersion = 0;
+        mutable BindingTable m_bindingTable;
+        mutable uvec2 m_bindingTableVersion = { u32(-1), u32(-1) }; // image binding versions of the manager and of the pool
         ska::flat_hash_map<std::string, u32> m_texPathToId;
+        TextureCooker m_cooker;
+
+        struct TextureUsage
+        {
+            u32 vtId;
+            Box bounds;
+            float worldSizePerUv;
+        };
+        VirtualTexturePool m_vtPool;
+        std::vector<TextureUsage> m_textureUsages;
+
+        // Async loading
+        const u32 m_maxPendingUploads;
+        std::atomic<u32> m_numPendingLoads = 0;
+        std::mutex m_uploadQueueMutex;
+        std::condition_variable m_uploadQueueNotFull;
+        std::deque<DecodedImage> m_uploadQueue;
+        bool m_exit = false;
+        ThreadPool m_threadPool;
     };
-}
\ No newline at end of file
+}
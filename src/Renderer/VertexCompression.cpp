@@ -0,0 +1,216 @@
+#include "VertexCompression.h"
+#include "timCore/Common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace tim
+{
+    VertexBlockHeader computeVertexBlockHeader(const vec3* _positions, u32 _numVertex)
+    {
+        TIM_ASSERT(_numVertex > 0);
+
+        vec3 minExtent = _positions[0], maxExtent = _positions[0];
+        for (u32 i = 1; i < _numVertex; ++i)
+        {
+            minExtent = linalg::min_(minExtent, _positions[i]);
+            maxExtent = linalg::max_(maxExtent, _positions[i]);
+        }
+
+        const vec3 extent = maxExtent - minExtent;
+        const float maxDim = std::max(extent.x, std::max(extent.y, extent.z));
+
+        // Smallest power of 2 scale covering the block, flooring the origin on the scale may need one more step
+        int exponent = maxDim > 0 ? int(std::ceil(std::log2(maxDim / VERTEX_POSITION_MASK))) : 0;
+        float scale, maxQuantized;
+        vec3 origin;
+        do
+        {
+            scale = std::ldexp(1.f, exponent++);
+            origin = { std::floor(minExtent.x / scale) * scale, std::floor(minExtent.y / scale) * scale, std::floor(minExtent.z / scale) * scale };
+
+            const vec3 range = (maxExtent - origin) / scale;
+            maxQuantized = std::max(range.x, std::max(range.y, range.z));
+        } 
+        while (maxQuantized > float(VERTEX_POSITION_MASK));
+
+        return { vec4(origin, scale), vec4(0.f) };
+    }
+
+    uvec2 encodePosition(const VertexBlockHeader& _header, vec3 _pos)
+    {
+        const vec3 origin = _header.origin_scale.xyz();
+        const vec3 q = linalg::clamp(linalg::round((_pos - origin) / _header.origin_scale.w), vec3(0.f), vec3(float(VERTEX_POSITION_MASK)));
+        const u32 x = u32(q.x), y = u32(q.y), z = u32(q.z);
+        return { x | (y << VERTEX_POSITION_BITS), (y >> 11) | (z << 10) };
+    }
+
+    vec3 decodePosition(const VertexBlockHeader& _header, uvec2 _packed)
+    {
+        const u32 x = _packed.x & VERTEX_POSITION_MASK;
+        const u32 y = (_packed.x >> VERTEX_POSITION_BITS) | ((_packed.y & 0x3FF) << 11);
+        const u32 z = _packed.y >> 10;
+        return _header.origin_scale.xyz() + vec3(float(x), float(y), float(z)) * _header.origin_scale.w;
+    }
+
+    vec2 computeUvOffset(const vec2* _texCoords, u32 _numVertex)
+    {
+        TIM_ASSERT(_numVertex > 0);
+
+        vec2 minUv = _texCoords[0];
+        for (u32 i = 1; i < _numVertex; ++i)
+            minUv = linalg::min_(minUv, _texCoords[i]);
+
+        return { std::floor(minUv.x), std::floor(minUv.y) };
+    }
+
+    u32 encodeTexCoord(const VertexBlockHeader& _header, vec2 _uv)
+    {
+        const vec2 uv = _uv - _header.uvOffset.xy();
+        return u32(floatToHalf(uv.x)) | (u32(floatToHalf(uv.y)) << 16);
+    }
+
+    vec2 decodeTexCoord(const VertexBlockHeader& _header, u32 _packed)
+    {
+        return _header.uvOffset.xy() + vec2(halfToFloat(u16(_packed & 0xFFFF)), halfToFloat(u16(_packed >> 16)));
+    }
+
+    u32 encodeOctahedral(vec3 _normal)
+    {
+        const float sum = std::abs(_normal.x) + std::abs(_normal.y) + std::abs(_normal.z);
+        if (sum == 0)
+            return 0;
+
+        vec3 n = _normal / sum;
+        vec2 e = { n.x, n.y };
+        if (n.z < 0)
+            e = { (1 - std::abs(n.y)) * (n.x >= 0 ? 1.f : -1.f), (1 - std::abs(n.x)) * (n.y >= 0 ? 1.f : -1.f) };
+
+        // Same encoding as packSnorm2x16
+        const i32 x = i32(std::round(std::clamp(e.x, -1.f, 1.f) * 32767.f));
+        const i32 y = i32(std::round(std::clamp(e.y, -1.f, 1.f) * 32767.f));
+        return (u32(x) & 0xFFFF) | (u32(y) << 16);
+    }
+
+    vec3 decodeOctahedral(u32 _packed)
+    {
+        const vec2 e = { std::max(float(int16_t(_packed & 0xFFFF)) / 32767.f, -1.f), std::max(float(int16_t(_packed >> 16)) / 32767.f, -1.f) };
+        vec3 n = { e.x, e.y, 1 - std::abs(e.x) - std::abs(e.y) };
+        if (n.z < 0)
+        {
+            const vec2 xy = { (1 - std::abs(n.y)) * (n.x >= 0 ? 1.f : -1.f), (1 - std::abs(n.x)) * (n.y >= 0 ? 1.f : -1.f) };
+            n.x = xy.x;
+            n.y = xy.y;
+        }
+        return linalg::normalize(n);
+    }
+
+    u16 floatToHalf(float _value)
+    {
+        u32 bits;
+        memcpy(&bits, &_value, sizeof(bits));
+
+        const u32 sign = (bits >> 16) & 0x8000;
+        const i32 exponent = i32((bits >> 23) & 0xFF) - 127 + 15;
+        u32 mantissa = bits & 0x7FFFFF;
+
+        if (((bits >> 23) & 0xFF) == 0xFF) // inf and nan
+            return u16(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+        if (exponent >= 31) // overflow
+            return u16(sign | 0x7C00);
+
+        if (exponent <= 0)
+        {
+            if (exponent < -10) // underflow
+                return u16(sign);
+
+            // Denormal, round to nearest even
+            mantissa |= 0x800000;
+            const u32 shift = u32(14 - exponent);
+            u32 half = mantissa >> shift;
+            const u32 rest = mantissa & ((1u << shift) - 1);
+            const u32 halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                ++half;
+            return u16(sign | half);
+        }
+
+        // Round to nearest even, a carry in the exponent is the right result
+        u32 half = (u32(exponent) << 10) | (mantissa >> 13);
+        const u32 rest = mantissa & 0x1FFF;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            ++half;
+        return u16(sign | half);
+    }
+
+    float halfToFloat(u16 _value)
+    {
+        const u32 sign = u32(_value & 0x8000) << 16;
+        const u32 exponent = (_value >> 10) & 0x1F;
+        const u32 mantissa = _value & 0x3FF;
+
+        float result;
+        if (exponent == 0)
+            result = std::ldexp(float(mantissa), -24);
+        else if (exponent == 31)
+            result = mantissa ? NAN : INFINITY;
+        else
+            result = std::ldexp(float(mantissa | 0x400), i32(exponent) - 25);
+
+        return sign ? -result : result;
+    }
+
+    void compressVertexStreams(u32 _numVertex, const vec3* _positions, const vec3* _normals, const vec2* _texCoords, CompressedVertexStreams& _streams)
+    {
+        _streams.positions.resize(_numVertex);
+        _streams.normals.resize(_numVertex);
+        _streams.texCoords.resize(_numVertex);
+        _streams.blocks.resize((_numVertex + VERTEX_BLOCK_SIZE - 1) / VERTEX_BLOCK_SIZE);
+
+        if (_numVertex == 0)
+            return;
+
+        const VertexBlockHeader header = computeVertexBlockHeader(_positions, _numVertex);
+        for (u32 block = 0; block < u32(_streams.blocks.size()); ++block)
+        {
+            const u32 first = block * VERTEX_BLOCK_SIZE;
+            const vec2 uvOffset = computeUvOffset(_texCoords + first, std::min(_numVertex - first, VERTEX_BLOCK_SIZE));
+            _streams.blocks[block] = { header.origin_scale, vec4(uvOffset, 0.f, 0.f) };
+        }
+
+        for (u32 i = 0; i < _numVertex; ++i)
+        {
+            _streams.positions[i] = encodePosition(header, _positions[i]);
+            _streams.normals[i] = encodeOctahedral(_normals[i]);
+            _streams.texCoords[i] = encodeTexCoord(_streams.blocks[i >> VERTEX_BLOCK_SHIFT], _texCoords[i]);
+        }
+    }
+
+    void decompressVertexStreams(const CompressedVertexStreams& _streams, vec3* _positions, vec3* _normals, vec2* _texCoords)
+    {
+        for (size_t i = 0; i < _streams.positions.size(); ++i)
+        {
+            _positions[i] = decodePosition(_streams.blocks[i >> VERTEX_BLOCK_SHIFT], _streams.positions[i]);
+            _normals[i] = decodeOctahedral(_streams.normals[i]);
+            _texCoords[i] = decodeTexCoord(_streams.blocks[i >> VERTEX_BLOCK_SHIFT], _streams.texCoords[i]);
+        }
+    }
+
+    VertexCompressionError measureVertexCompressionError(const CompressedVertexStreams& _streams, const vec3* _positions, const vec3* _normals, const vec2* _texCoords)
+    {
+        VertexCompressionError error;
+        for (size_t i = 0; i < _streams.positions.size(); ++i)
+        {
+            const vec3 pos = decodePosition(_streams.blocks[i >> VERTEX_BLOCK_SHIFT], _streams.positions[i]);
+            error.position = std::max(error.position, linalg::length(pos - _positions[i]));
+
+            if (linalg::length2(_normals[i]) > 0)
+                error.normal = std::max(error.normal, linalg::length(decodeOctahedral(_streams.normals[i]) - linalg::normalize(_normals[i])));
+
+            const vec2 uv = decodeTexCoord(_streams.blocks[i >> VERTEX_BLOCK_SHIFT], _streams.texCoords[i]);
+            error.texCoord = std::max(error.texCoord, linalg::length(uv - _texCoords[i]));
+        }
+        return error;
+    }
+}
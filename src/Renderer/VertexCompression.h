@@ -0,0 +1,45 @@
+#pragma once
+#include "timCore/type.h"
+#include "Shaders/core/vertexCompression_cpp.glsl"
+
+#include <vector>
+
+namespace tim
+{
+    // CPU side of the compressed geometry layout, the decoding matches loadPosition/loadNormal/loadUv of bvhBindings.glsl
+    struct CompressedVertexStreams
+    {
+        std::vector<uvec2> positions;
+        std::vector<u32> normals;
+        std::vector<u32> texCoords;
+        std::vector<VertexBlockHeader> blocks;
+    };
+
+    struct VertexCompressionError
+    {
+        float position = 0; // absolute distance
+        float normal = 0;   // distance between unit vectors
+        float texCoord = 0; // absolute distance
+    };
+
+    VertexBlockHeader computeVertexBlockHeader(const vec3* _positions, u32 _numVertex);
+    uvec2 encodePosition(const VertexBlockHeader& _header, vec3 _pos);
+    vec3 decodePosition(const VertexBlockHeader& _header, uvec2 _packed);
+
+    vec2 computeUvOffset(const vec2* _texCoords, u32 _numVertex);
+    u32 encodeTexCoord(const VertexBlockHeader& _header, vec2 _uv);
+    vec2 decodeTexCoord(const VertexBlockHeader& _header, u32 _packed);
+
+    u32 encodeOctahedral(vec3 _normal);
+    vec3 decodeOctahedral(u32 _packed);
+
+    u16 floatToHalf(float _value);
+    float halfToFloat(u16 _value);
+
+    // One position quantization for the whole range, reordering vertices inside the range keeps the decoded positions. Uv offsets are per block.
+    void compressVertexStreams(u32 _numVertex, const vec3* _positions, const vec3* _normals, const vec2* _texCoords, CompressedVertexStreams& _streams);
+    void decompressVertexStreams(const CompressedVertexStreams& _streams, vec3* _positions, vec3* _normals, vec2* _texCoords);
+
+    // Max error of _streams against the source data
+    VertexCompressionError measureVertexCompressionError(const CompressedVertexStreams& _streams, const vec3* _positions, const vec3* _normals, const vec2* _texCoords);
+}
@@ -0,0 +1,364 @@
+#include "VirtualTexturePool.h"
+#include "timCore/Common.h"
+#include "Shaders/bvh/bvhBindings_cpp.glsl"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+namespace tim
+{
+    VirtualTexturePool::VirtualTexturePool(IRenderer* _renderer, u32 _maxPagesPerAtlas) : m_renderer{ _renderer }
+    {
+        m_maxPagesPerAtlas = std::clamp(_maxPagesPerAtlas, 1u, u32(VT_ATLAS_PAGES_PER_SIDE * VT_ATLAS_PAGES_PER_SIDE));
+        m_atlases[VT_ATLAS_RGBA8].format = ImageFormat::RGBA8_SRGB;
+        m_atlases[VT_ATLAS_BC1].format = ImageFormat::BC1_SRGB;
+        m_atlases[VT_ATLAS_BC7].format = ImageFormat::BC7_SRGB;
+    }
+
+    VirtualTexturePool::~VirtualTexturePool()
+    {
+        for (Atlas& atlas : m_atlases)
+        {
+            if (atlas.image.ptr)
+                m_renderer->DestroyImage(atlas.image);
+        }
+    }
+
+    u32 VirtualTexturePool::getAtlasIndex(ImageFormat _format)
+    {
+        switch (_format)
+        {
+        case ImageFormat::RGBA8_SRGB:   return VT_ATLAS_RGBA8;
+        case ImageFormat::BC1_SRGB:     return VT_ATLAS_BC1;
+        case ImageFormat::BC7_SRGB:     return VT_ATLAS_BC7;
+        default:
+            TIM_ASSERT(false);
+            return VT_ATLAS_RGBA8;
+        }
+    }
+
+    u32 VirtualTexturePool::getNumPages(const TextureLayout& _layout, u32 _mip, uvec2* _numPages)
+    {
+        const u32 w = std::max(1u, _layout.width >> _mip);
+        const u32 h = std::max(1u, _layout.height >> _mip);
+        const uvec2 numPages = { (w + VT_PAGE_SIZE - 1) / VT_PAGE_SIZE, (h + VT_PAGE_SIZE - 1) / VT_PAGE_SIZE };
+        if (_numPages)
+            *_numPages = numPages;
+        return numPages.x * numPages.y;
+    }
+
+    u32 VirtualTexturePool::getPackedPageSize(ImageFormat _format)
+    {
+        const u32 unitDim = isBlockCompressed(_format) ? 4 : 1;
+        const u32 slotUnits = VT_PAGE_SLOT_SIZE / unitDim;
+        return slotUnits * slotUnits * getFormatBlockSize(_format);
+    }
+
+    void VirtualTexturePool::packPage(const ubyte* _mipData, ImageFormat _format, u32 _mipWidth, u32 _mipHeight, u32 _pageX, u32 _pageY, ubyte* _out)
+    {
+        // Work on 4x4 blocks for compressed formats, so borders and wrapping are block granular
+        const u32 unitDim = isBlockCompressed(_format) ? 4 : 1;
+        const u32 unitSize = getFormatBlockSize(_format);
+        const u32 mipUnitsX = (_mipWidth + unitDim - 1) / unitDim;
+        const u32 mipUnitsY = (_mipHeight + unitDim - 1) / unitDim;
+        const u32 slotUnits = VT_PAGE_SLOT_SIZE / unitDim;
+        const u32 pageUnits = VT_PAGE_SIZE / unitDim;
+        const u32 borderUnits = VT_PAGE_BORDER / unitDim;
+
+        for (u32 y = 0; y < slotUnits; ++y)
+        {
+            const u32 srcY = (_pageY * pageUnits + y + mipUnitsY - borderUnits % mipUnitsY) % mipUnitsY;
+            for (u32 x = 0; x < slotUnits; ++x)
+            {
+                const u32 srcX = (_pageX * pageUnits + x + mipUnitsX - borderUnits % mipUnitsX) % mipUnitsX;
+                memcpy(_out + (size_t(y) * slotUnits + x) * unitSize, _mipData + (size_t(srcY) * mipUnitsX + srcX) * unitSize, unitSize);
+            }
+        }
+    }
+
+    void VirtualTexturePool::buildPageTable(const TextureLayout& _layout, const std::vector<std::vector<u32>>& _residency, u32* _pageTable)
+    {
+        uvec2 numPages0;
+        getNumPages(_layout, 0, &numPages0);
+
+        for (u32 y = 0; y < numPages0.y; ++y)
+        {
+            for (u32 x = 0; x < numPages0.x; ++x)
+            {
+                u32 entry = VT_INVALID_ENTRY;
+                for (u32 mip = 0; mip < _layout.numMips; ++mip)
+                {
+                    uvec2 numPages;
+                    getNumPages(_layout, mip, &numPages);
+
+                    const u32 page = std::min(y >> mip, numPages.y - 1) * numPages.x + std::min(x >> mip, numPages.x - 1);
+                    const u32 physicalPage = _residency[mip][page];
+                    if (physicalPage != u32(-1))
+                    {
+                        entry = physicalPage | (_layout.atlas << VT_ENTRY_ATLAS_SHIFT) | (mip << VT_ENTRY_MIP_SHIFT);
+                        break;
+                    }
+                }
+
+                _pageTable[y * numPages0.x + x] = entry;
+            }
+        }
+    }
+
+    u32 VirtualTexturePool::reserveTexture()
+    {
+        TIM_ASSERT(m_textures.size() < VT_TEXTURE_ID_MASK);
+        m_textures.emplace_back();
+        m_pageTableDirty = true;
+        return u32(m_textures.size() - 1);
+    }
+
+    void VirtualTexturePool::setTextureData(u32 _vtId, std::unique_ptr<CookedTexture> _texture)
+    {
+        const CookedTextureHeader& header = _texture->getHeader();
+
+        VirtualTexture& tex = m_textures[_vtId];
+        tex.layout.width = header.width;
+        tex.layout.height = header.height;
+        tex.layout.numMips = header.numMips;
+        tex.layout.atlas = getAtlasIndex(header.format);
+        tex.data = std::move(_texture);
+
+        tex.residency.resize(tex.layout.numMips);
+        for (u32 mip = 0; mip < tex.layout.numMips; ++mip)
+            tex.residency[mip].assign(getNumPages(tex.layout, mip), u32(-1));
+
+        m_pageTableDirty = true;
+    }
+
+    void VirtualTexturePool::requestTexture(u32 _vtId, float _uvPerPixel, float _priority)
+    {
+        VirtualTexture& tex = m_textures[_vtId];
+        if (!tex.data)
+            return;
+
+        const float texelsPerPixel = _uvPerPixel * std::max(tex.layout.width, tex.layout.height);
+        const u32 mip = texelsPerPixel <= 1 ? 0 : std::min(u32(log2f(texelsPerPixel)), tex.layout.numMips - 1);
+
+        tex.requestedMip = std::min(tex.requestedMip, mip);
+        tex.priority = std::max(tex.priority, _priority);
+    }
+
+    void VirtualTexturePool::allocateAtlas(u32 _atlas)
+    {
+        Atlas& atlas = m_atlases[_atlas];
+        ImageCreateInfo createInfo(atlas.format, VT_ATLAS_SIZE, VT_ATLAS_SIZE, 1, 1, ImageType::Image2D, MemoryType::Default, ImageUsage::Sampled | ImageUsage::Transfer);
+        atlas.image = m_renderer->CreateImage(createInfo, MemoryTag::Textures);
+        m_imageBindingVersion++;
+
+        const u32 numPages = m_maxPagesPerAtlas;
+        atlas.pages.resize(numPages);
+        atlas.freePages.resize(numPages);
+        for (u32 i = 0; i < numPages; ++i)
+            atlas.freePages[i] = numPages - 1 - i;
+    }
+
+    u32 VirtualTexturePool::allocatePage(u32 _atlas, bool _allowEviction)
+    {
+        Atlas& atlas = m_atlases[_atlas];
+        if (!atlas.freePages.empty())
+        {
+            u32 page = atlas.freePages.back();
+            atlas.freePages.pop_back();
+            return page;
+        }
+
+        if (!_allowEviction)
+            return u32(-1);
+
+        // Evict the page requested the longest time ago, pages requested this frame are never evicted
+        u32 lruPage = u32(-1);
+        u64 lruFrame = m_frame;
+        for (u32 i = 0; i < u32(atlas.pages.size()); ++i)
+        {
+            if (atlas.pages[i].vtId != u32(-1) && atlas.pages[i].lastRequestFrame < lruFrame)
+            {
+                lruFrame = atlas.pages[i].lastRequestFrame;
+                lruPage = i;
+            }
+        }
+
+        if (lruPage != u32(-1))
+        {
+            // The page leaves the page tables now, but the uploads are immediate and the page tables of the frames in flight still point to the slot
+            PhysicalPage& evicted = atlas.pages[lruPage];
+            m_textures[evicted.vtId].residency[evicted.mip][evicted.page] = u32(-1);
+            evicted = {};
+            atlas.retiredPages.push_back({ lruPage, m_frame });
+            m_stats.numEvictedPages++;
+            m_pageTableDirty = true;
+        }
+
+        return u32(-1);
+    }
+
+    void VirtualTexturePool::recycleRetiredPages()
+    {
+        for (Atlas& atlas : m_atlases)
+        {
+            auto it = std::remove_if(atlas.retiredPages.begin(), atlas.retiredPages.end(), [&](const RetiredPage& _retired)
+            {
+                if (_retired.frame + TIM_FRAME_LATENCY > m_frame)
+                    return false;
+
+                atlas.freePages.push_back(_retired.page);
+                return true;
+            });
+            atlas.retiredPages.erase(it, atlas.retiredPages.end());
+        }
+    }
+
+    void VirtualTexturePool::update(u32 _maxPageUploads)
+    {
+        m_frame++;
+        m_stats = {};
+        recycleRetiredPages();
+
+        struct PageRequest
+        {
+            float score;
+            u32 vtId, mip, page;
+        };
+        std::vector<PageRequest> missingPages;
+
+        for (u32 vtId = 0; vtId < u32(m_textures.size()); ++vtId)
+        {
+            VirtualTexture& tex = m_textures[vtId];
+            if (!tex.data)
+                continue;
+
+            // The coarsest mip is always requested so every texture has something to sample
+            const u32 coarsestMip = tex.layout.numMips - 1;
+            const u32 finestMip = std::min(tex.requestedMip, coarsestMip);
+
+            for (u32 i = 0; i <= coarsestMip - finestMip; ++i)
+            {
+                const u32 mip = coarsestMip - i;
+                const float score = mip == coarsestMip ? FLT_MAX : tex.priority * float(1u << (mip - finestMip));
+                for (u32 page = 0; page < u32(tex.residency[mip].size()); ++page)
+                {
+                    const u32 physicalPage = tex.residency[mip][page];
+                    if (physicalPage != u32(-1))
+                    {
+                        m_atlases[tex.layout.atlas].pages[physicalPage].lastRequestFrame = m_frame;
+                        m_stats.numResidentPages++;
+                    }
+                    else
+                        missingPages.push_back({ score, vtId, mip, page });
+                }
+            }
+
+            tex.requestedMip = u32(-1);
+            tex.priority = 0;
+        }
+
+        std::stable_sort(missingPages.begin(), missingPages.end(), [](const PageRequest& _a, const PageRequest& _b) { return _a.score > _b.score; });
+        m_stats.numMissingPages = u32(missingPages.size());
+
+        for (const PageRequest& request : missingPages)
+        {
+            if (m_stats.numUploadedPages >= _maxPageUploads)
+                break;
+
+            VirtualTexture& tex = m_textures[request.vtId];
+            const u32 atlasIndex = tex.layout.atlas;
+            Atlas& atlas = m_atlases[atlasIndex];
+            if (!atlas.image.ptr)
+                allocateAtlas(atlasIndex);
+
+            // Evictions are bounded like the uploads, their slots are only usable TIM_FRAME_LATENCY frames later
+            const u32 physicalPage = allocatePage(atlasIndex, m_stats.numEvictedPages < _maxPageUploads);
+            if (physicalPage == u32(-1))
+                continue;
+
+            uvec2 numPages;
+            getNumPages(tex.layout, request.mip, &numPages);
+            const u32 mipWidth = std::max(1u, tex.layout.width >> request.mip);
+            const u32 mipHeight = std::max(1u, tex.layout.height >> request.mip);
+
+            m_packedPage.resize(getPackedPageSize(atlas.format));
+            packPage(tex.data->getMipData(request.mip), atlas.format, mipWidth, mipHeight, request.page % numPages.x, request.page / numPages.x, m_packedPage.data());
+
+            const uvec2 slot = { physicalPage % VT_ATLAS_PAGES_PER_SIDE, physicalPage / VT_ATLAS_PAGES_PER_SIDE };
+            m_renderer->UploadImageRegion(atlas.image, m_packedPage.data(), 0, 0, slot * u32(VT_PAGE_SLOT_SIZE), uvec2(VT_PAGE_SLOT_SIZE, VT_PAGE_SLOT_SIZE));
+
+            atlas.pages[physicalPage] = { request.vtId, request.mip, request.page, m_frame };
+            tex.residency[request.mip][request.page] = physicalPage;
+
+            m_stats.numUploadedPages++;
+            m_pageTableDirty = true;
+        }
+
+        if (m_pageTableDirty)
+            rebuildPageTables();
+
+        // Page tables change every few frames while streaming, they go through the per frame scratch buffer
+        const u32 pageTableSize = u32(std::max<size_t>(1, m_pageTable.size()) * sizeof(u32));
+        ubyte* pageTableData = m_renderer->GetDynamicBuffer(pageTableSize, m_pageTableView);
+        memcpy(pageTableData, m_pageTable.data(), m_pageTable.size() * sizeof(u32));
+
+        const u32 textureInfoSize = u32(std::max<size_t>(1, m_textureInfos.size()) * sizeof(uvec4));
+        ubyte* textureInfoData = m_renderer->GetDynamicBuffer(textureInfoSize, m_textureInfoView);
+        memset(textureInfoData, 0, textureInfoSize);
+        memcpy(textureInfoData, m_textureInfos.data(), m_textureInfos.size() * sizeof(uvec4));
+    }
+
+    void VirtualTexturePool::rebuildPageTables()
+    {
+        u32 pageTableSize = 0;
+        for (VirtualTexture& tex : m_textures)
+        {
+            tex.pageTableOffset = pageTableSize;
+            if (tex.data)
+                pageTableSize += getNumPages(tex.layout, 0);
+        }
+
+        m_pageTable.resize(pageTableSize);
+        m_textureInfos.resize(m_textures.size());
+
+        for (u32 vtId = 0; vtId < u32(m_textures.size()); ++vtId)
+        {
+            const VirtualTexture& tex = m_textures[vtId];
+            if (!tex.data)
+            {
+                m_textureInfos[vtId] = uvec4(0u);
+                continue;
+            }
+
+            uvec2 numPages0;
+            getNumPages(tex.layout, 0, &numPages0);
+            m_textureInfos[vtId] = { tex.pageTableOffset, tex.layout.width, tex.layout.height, numPages0.x | (numPages0.y << 16) };
+
+            buildPageTable(tex.layout, tex.residency, &m_pageTable[tex.pageTableOffset]);
+        }
+
+        m_pageTableDirty = false;
+    }
+
+    void VirtualTexturePool::fillImageBindings(std::vector<ImageBinding>& _bindings, ImageHandle _fallback) const
+    {
+        for (u32 i = 0; i < VT_NUM_ATLASES; ++i)
+        {
+            ImageBinding binding;
+            binding.m_binding = { 0, g_vtAtlases_bind, i };
+            binding.m_viewType = ImageViewType::Sampled;
+            binding.m_image = m_atlases[i].image.ptr ? m_atlases[i].image : _fallback;
+            binding.m_sampler = SamplerType::Clamp_Linear_MipNearest;
+            _bindings.push_back(binding);
+        }
+    }
+
+    void VirtualTexturePool::fillBufferBindings(std::vector<BufferBinding>& _bindings) const
+    {
+        TIM_ASSERT(m_pageTableView.m_buffer.ptr && m_textureInfoView.m_buffer.ptr);
+        _bindings.push_back({ m_pageTableView, { 0, g_vtPageTable_bind } });
+        _bindings.push_back({ m_textureInfoView, { 0, g_vtTextureInfo_bind } });
+    }
+}
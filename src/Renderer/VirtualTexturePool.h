@@ -0,0 +1,125 @@
+#pragma once
+#include "rtDevice/public/IRenderer.h"
+#include "TextureCooker.h"
+
+#include "Shaders/core/virtualTexture_cpp.glsl"
+
+#include <vector>
+#include <memory>
+
+namespace tim
+{
+    // Cooked textures split in VT_PAGE_SIZE pages living in a few physical atlases (one per format).
+    // Residency is driven by the requests of the frame : the finest requested mip and all the coarser ones are kept resident when possible,
+    // pages that weren't requested for the longest time are evicted first.
+    class VirtualTexturePool
+    {
+    public:
+        struct Stats
+        {
+            u32 numResidentPages = 0;
+            u32 numMissingPages = 0;
+            u32 numUploadedPages = 0;
+            u32 numEvictedPages = 0;
+        };
+
+        // _maxPagesPerAtlas bounds the residency of each atlas, the default uses the whole atlas
+        VirtualTexturePool(IRenderer* _renderer, u32 _maxPagesPerAtlas = VT_ATLAS_PAGES_PER_SIDE * VT_ATLAS_PAGES_PER_SIDE);
+        ~VirtualTexturePool();
+
+        // The id is valid right away, the texture samples as white until setTextureData is called
+        u32 reserveTexture();
+        void setTextureData(u32 _vtId, std::unique_ptr<CookedTexture> _texture);
+        u32 getNumTextures() const { return u32(m_textures.size()); }
+
+        // Feedback, _uvPerPixel is the uv footprint of a pixel on the surface using the texture. Multiple requests keep the finest mip and the highest priority.
+        void requestTexture(u32 _vtId, float _uvPerPixel, float _priority);
+
+        // Allocate and upload at most _maxPageUploads missing pages then rebuild the page tables which changed. Must be called after BeginFrame.
+        void update(u32 _maxPageUploads);
+
+        void fillImageBindings(std::vector<ImageBinding>& _bindings, ImageHandle _fallback) const;
+        void fillBufferBindings(std::vector<BufferBinding>& _bindings) const;
+
+        const Stats& getStats() const { return m_stats; }
+        // Incremented when the atlas images bound by fillImageBindings change
+        u32 getImageBindingVersion() const { return m_imageBindingVersion; }
+
+    public:
+        struct TextureLayout
+        {
+            u32 width = 0, height = 0;
+            u32 numMips = 0;
+            u32 atlas = 0;
+        };
+
+        static u32 getAtlasIndex(ImageFormat _format);
+        static u32 getNumPages(const TextureLayout& _layout, u32 _mip, uvec2* _numPages = nullptr);
+
+        // Page of a mip with its wrapped borders, written as a VT_PAGE_SLOT_SIZE^2 region in the atlas format
+        static void packPage(const ubyte* _mipData, ImageFormat _format, u32 _mipWidth, u32 _mipHeight, u32 _pageX, u32 _pageY, ubyte* _out);
+        static u32 getPackedPageSize(ImageFormat _format);
+
+        // One entry per page of mip 0, pointing to the finest resident mip covering it. _residency[mip][page] is the physical page or u32(-1).
+        static void buildPageTable(const TextureLayout& _layout, const std::vector<std::vector<u32>>& _residency, u32* _pageTable);
+
+    private:
+        struct VirtualTexture
+        {
+            TextureLayout layout;
+            std::unique_ptr<CookedTexture> data;
+            std::vector<std::vector<u32>> residency;
+            u32 pageTableOffset = 0;
+
+            u32 requestedMip = u32(-1);
+            float priority = 0;
+        };
+
+        struct PhysicalPage
+        {
+            u32 vtId = u32(-1);
+            u32 mip = 0;
+            u32 page = 0;
+            u64 lastRequestFrame = 0;
+        };
+
+        // Evicted page, its slot may still be sampled by the frames in flight
+        struct RetiredPage
+        {
+            u32 page;
+            u64 frame;
+        };
+
+        struct Atlas
+        {
+            ImageFormat format;
+            ImageHandle image;
+            std::vector<PhysicalPage> pages;
+            std::vector<u32> freePages;
+            std::vector<RetiredPage> retiredPages;
+        };
+
+        IRenderer* m_renderer;
+        u32 m_maxPagesPerAtlas;
+        std::vector<VirtualTexture> m_textures;
+        Atlas m_atlases[VT_NUM_ATLASES];
+
+        std::vector<u32> m_pageTable;
+        std::vector<uvec4> m_textureInfos;
+        bool m_pageTableDirty = true;
+        u32 m_imageBindingVersion = 0;
+
+        u64 m_frame = 0;
+        Stats m_stats;
+        std::vector<ubyte> m_packedPage;
+
+        BufferView m_pageTableView = {};
+        BufferView m_textureInfoView = {};
+
+        void allocateAtlas(u32 _atlas);
+        // Returns u32(-1) when no slot is free, the least recently requested page is then evicted and its slot reused TIM_FRAME_LATENCY frames later
+        u32 allocatePage(u32 _atlas, bool _allowEviction);
+        void recycleRetiredPages();
+        void rebuildPageTables();
+    };
+}
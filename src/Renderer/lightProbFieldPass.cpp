@@ -9,8 +9,9 @@
 
 namespace tim
 {
-	LightProbFieldPass::LightProbFieldPass(IRenderer* _renderer, IRenderContext* _context, ResourceAllocator& _allocator, TextureManager& _texManager) 
-		: m_renderer{ _renderer }, m_context{ _context }, m_resourceAllocator{ _allocator }, m_textureManager{ _texManager }
+	LightProbFieldPass::LightProbFieldPass(IRenderer* _renderer, IRenderContext* _context, TextureManager& _texManager) 
+		: m_renderer{ _renderer }, m_context{ _context }, m_textureManager{ _texManager }
+		, m_sampleSet{ SampleSequenceType::Sobol, SampleScrambling::Owen, NUM_RAYS_PER_PROB }
 	{
 	}
 
@@ -18,7 +19,17 @@ namespace tim
 	{
 	}
 
-	LightProbFieldPass::PassResource LightProbFieldPass::fillPassResources(const Scene& _scene)
+	u32 LightProbFieldPass::getIrradianceBufferSize(const Scene& _scene) const
+	{
+		return sizeof(vec3) * NUM_RAYS_PER_PROB * _scene.getLPF().m_numProbs;
+	}
+
+	u32 LightProbFieldPass::getTracingResultBufferSize(const Scene& _scene) const
+	{
+		return NUM_RAYS_PER_PROB * _scene.getLPF().m_numProbs * sizeof(uvec4) * 2;
+	}
+
+	LightProbFieldPass::PassResource LightProbFieldPass::fillPassResources(const Scene& _scene, BufferView _irradianceField, BufferView _tracingResult)
 	{
 		PassResource resources;
 
@@ -32,46 +43,35 @@ namespace tim
 		SH9* shCoefs = (SH9*)m_renderer->GetDynamicBuffer(sizeof(SH9) * NUM_RAYS_PER_PROB, resources.m_shCoefsBuffer);
 		sampleRays(lpfConstants.rays, shCoefs, NUM_RAYS_PER_PROB);
 
-		const u32 numProbs = _scene.getLPF().m_numProbs;
-		const u32 irradianceBufferSize = sizeof(vec3) * NUM_RAYS_PER_PROB * numProbs;
-		BufferHandle irradianceBuffer = m_resourceAllocator.allocBuffer(irradianceBufferSize, BufferUsage::Storage | BufferUsage::Transfer, MemoryType::Default);
-		resources.m_irradianceField = { irradianceBuffer, 0, irradianceBufferSize };
-
-		const u32 tracingResultBufferSize = NUM_RAYS_PER_PROB * numProbs * sizeof(uvec4) * 2;
-		BufferHandle tracingResultBuffer = m_resourceAllocator.allocBuffer(tracingResultBufferSize, BufferUsage::Storage | BufferUsage::Transfer, MemoryType::Default);
-		resources.m_tracingResult = { tracingResultBuffer, 0, tracingResultBufferSize };
+		resources.m_irradianceField = _irradianceField;
+		resources.m_tracingResult = _tracingResult;
 
 		return resources;
 	}
 
-	void LightProbFieldPass::freePassResources(const PassResource& _resources)
-	{
-		m_resourceAllocator.releaseBuffer(_resources.m_irradianceField.m_buffer);
-		m_resourceAllocator.releaseBuffer(_resources.m_tracingResult.m_buffer);
-	}
-
 	DrawArguments LightProbFieldPass::fillBindings(const Scene& _scene, const PassResource& _resources, PushConstants& _cst, std::vector<BufferBinding>& _bufBinds, std::vector<ImageBinding>& _imgBinds)
 	{
 		DrawArguments arg = {};
 
-		m_textureManager.fillImageBindings(_imgBinds);
-		_scene.getLPF().fillBindings(_imgBinds, g_lpfTextures_bind);
+		// Scene and textures are bound once through their tables, only the per frame buffers are dynamic
+		m_bindingTables = { &_scene.getBindingTable(), &m_textureManager.getBindingTable() };
+		arg.m_bindingTables = m_bindingTables.data();
+		arg.m_numBindingTables = (u32)m_bindingTables.size();
 
 		_bufBinds = {
 			{ _resources.m_irradianceField, { 0, g_outputBuffer_bind } },
 			{ _resources.m_lpfConstants, { 0, g_CstBuffer_bind } },
 			{ _resources.m_tracingResult, { 0, g_tracingResult_bind } }
 		};
-
-		_scene.fillGeometryBufferBindings(_bufBinds);
-		_scene.getBVH().fillBvhBindings(_bufBinds);
+		m_textureManager.fillBufferBindings(_bufBinds);
 
 		arg.m_imageBindings = _imgBinds.data();
 		arg.m_numImageBindings = (u32)_imgBinds.size();
 		arg.m_bufferBindings = _bufBinds.data();
 		arg.m_numBufferBindings = (u32)_bufBinds.size();
 
-		_cst = { _scene.getTrianglesCount(), _scene.getBlasInstancesCount(), _scene.getPrimitivesCount(), _scene.getLightsCount(), _scene.getNodesCount() };
+		_cst = { _scene.getTrianglesCount(), _scene.getBlasInstancesCount(), _scene.getPrimitivesCount(), _scene.getLightsCount(), _scene.getNodesCount(),
+				 float(LOD_PROBE_ERROR_PER_DISTANCE) };
 		arg.m_constants = &_cst;
 		arg.m_constantSize = sizeof(_cst);
 
@@ -150,54 +150,15 @@ namespace tim
 
 	void LightProbFieldPass::sampleRays(vec4 rays[], SH9 shCoef[], u32 _count)
 	{
-		u32 sqrtCount = 0;
-		if (_count == 64)
-			sqrtCount = 8;
-		else if (_count == 256)
-			sqrtCount = 16;
+		TIM_ASSERT(_count == m_sampleSet.getRayCount());
 
-		TIM_ASSERT(sqrtCount* sqrtCount == _count);
+		// Consecutive frames draw consecutive points of the same sequence so the moving average in the update pass keeps converging
+		m_sampleSet.nextFrame();
 
-		u32 test = 0;
-		std::uniform_real_distribution<float> uniform01(0, 1);
-		for (u32 i = 0; i < sqrtCount; i++)
-		{
-			for (u32 j = 0; j < sqrtCount; j++)
-			{
-				vec2 cellStart = { float(i) / sqrtCount, float(j) / sqrtCount };
-				vec2 r = { uniform01(m_rand), uniform01(m_rand) };
-
-				r /= sqrtCount;
-				r += cellStart;
-
-				float theta = 2 * TIM_PI * r.x;
-				float phi = acosf(1 - 2 * r.y);
-
-
-				float x = sinf(phi) * cosf(theta);
-				float y = sinf(phi) * sinf(theta);
-				float z = cosf(phi);
-
-				vec3 N = { x, y, z };
-				const u32 rayIndex = i * sqrtCount + j;
-				rays[rayIndex] = { N,0 };
-				
-				// http://www-graphics.stanford.edu/papers/envmap/envmap.pdf
-				SH9& coef = shCoef[rayIndex];
-
-				coef.w[SH_Y00] = 0.282095f;
-
-				coef.w[SH_Y11] = 0.488603f * N.x;
-				coef.w[SH_Y10] = 0.488603f * N.z;
-				coef.w[SH_Y1_1] = 0.488603f * N.y;
-
-				coef.w[SH_Y21] = 1.092548f * N.x * N.z;
-				coef.w[SH_Y2_1] = 1.092548f * N.y * N.z;
-				coef.w[SH_Y2_2] = 1.092548f * N.x * N.y;
-				
-				coef.w[SH_Y20] = 0.315392f * (3.0f * N.z * N.z - 1.0f);
-				coef.w[SH_Y22] = 0.546274f * (N.x * N.x - N.y * N.y);
-			}
-		}
+		const vec3* dirs = m_sampleSet.getRays();
+		for (u32 i = 0; i < _count; ++i)
+			rays[i] = { dirs[i], 0 };
+
+		memcpy(shCoef, m_sampleSet.getSHBasis(), sizeof(SH9) * _count);
 	}
 }
\ No newline at end of file
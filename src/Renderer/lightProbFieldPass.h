@@ -1,12 +1,12 @@
 #pragma once
 #include "rtDevice/public/IRenderer.h"
 #include "ShaderCompiler/ShaderCompiler.h"
-#include "resourceAllocator.h"
 #include "LightProbField.h"
-#include <random>
+#include "SampleSequence.h"
 
 #include "Shaders/struct_cpp.glsl"
 #include "Shaders/lightprob/lightprob.glsl"
+#include <array>
 
 namespace tim
 {
@@ -25,11 +25,13 @@ namespace tim
             BufferView m_tracingResult;
         };
 
-        LightProbFieldPass(IRenderer* _renderer, IRenderContext* _context, ResourceAllocator& _allocator, TextureManager& _texManager);
+        LightProbFieldPass(IRenderer* _renderer, IRenderContext* _context, TextureManager& _texManager);
         ~LightProbFieldPass();
 
-        PassResource fillPassResources(const Scene& _scene);
-        void freePassResources(const PassResource&);
+        // Transient buffers are allocated by the frame graph
+        u32 getIrradianceBufferSize(const Scene& _scene) const;
+        u32 getTracingResultBufferSize(const Scene& _scene) const;
+        PassResource fillPassResources(const Scene& _scene, BufferView _irradianceField, BufferView _tracingResult);
 
         void traceLightProbField(const Scene& _scene, const PassResource& _resources);
         void updateLightProbField(const Scene& _scene, const PassResource& _resources);
@@ -37,11 +39,11 @@ namespace tim
     private:
         IRenderer* m_renderer = nullptr;
         IRenderContext* m_context = nullptr;
-        ResourceAllocator& m_resourceAllocator;
         TextureManager& m_textureManager;
+        std::array<const BindingTable*, 2> m_bindingTables = {};
 
     private:
-        std::random_device m_rand;
+        SphereSampleSet m_sampleSet;
 
         void sampleRays(vec4 rays[], SH9 shCoef[], u32 _count);
         DrawArguments fillBindings(const Scene& _scene, const PassResource& _resources, PushConstants& _cst, std::vector<BufferBinding>& _bufBinds, std::vector<ImageBinding>& _imgBinds);
@@ -8,9 +8,21 @@
 #include "Shaders/bvh/bvhBindings_cpp.glsl"
 
 #include <iostream>
+#include <cmath>
 
 namespace tim
 {
+    namespace
+    {
+        const float g_fov = 70.f * 3.14f / 180;
+
+        // Size of a pixel at distance 1
+        float computePrimaryLodErrorPerDistance(uvec2 _frameSize)
+        {
+            return float(LOD_PRIMARY_PIXEL_ERROR) * 2 * std::tan(g_fov * 0.5f) / _frameSize.y;
+        }
+    }
+
     RayTracingPass::RayTracingPass(IRenderer* _renderer, IRenderContext* _context, ResourceAllocator& _allocator, TextureManager& _texManager)
         : m_frameSize{ 800,600 }, m_renderer{ _renderer }, m_context{ _context }, m_resourceAllocator{ _allocator }, m_textureManager{ _texManager }
     {
@@ -31,17 +43,20 @@ namespace tim
         m_rayBounceRecursionDepth = _depth;
     }
 
+    u32 RayTracingPass::getTracingResultBufferSize() const
+    {
+        return m_frameSize.x * m_frameSize.y * sizeof(uvec4) * 2;
+    }
+
     u32 RayTracingPass::getRayStorageBufferSize() const
     {
         return m_frameSize.x * m_frameSize.y * sizeof(IndirectLightRay);
     }
 
-    RayTracingPass::PassResource RayTracingPass::fillPassResources(const SimpleCamera& _camera, const Scene& _scene)
+    RayTracingPass::PassResource RayTracingPass::fillPassResources(const SimpleCamera& _camera, const Scene& _scene, BufferView _tracingResult, BufferHandle _reflexionRayBuffer, BufferHandle _refractionRayBuffer)
     {
         PassResource resources;
 
-        const float fov = 70.f * 3.14f / 180;
-
         PassData passData;
         passData.frameSize = { m_frameSize.x, m_frameSize.y };
         passData.invFrameSize = { 1.f / m_frameSize.x, 1.f / m_frameSize.y };
@@ -50,7 +65,7 @@ namespace tim
         passData.sunDir = { normalize(_scene.getSunData().sunDir), 0 };
         passData.sunColor = { _scene.getSunData().sunColor, 0 };
 
-        mat4 projMat = linalg::perspective_matrix<float>(fov, float(m_frameSize.x) / m_frameSize.y, 0.1f, TMAX, linalg::neg_z, linalg::zero_to_one);
+        mat4 projMat = linalg::perspective_matrix<float>(g_fov, float(m_frameSize.x) / m_frameSize.y, 0.1f, TMAX, linalg::neg_z, linalg::zero_to_one);
         mat4 viewProj = linalg::mul(projMat, _camera.getViewMat());
         passData.invProjView = linalg::inverse(viewProj);
 
@@ -69,23 +84,13 @@ namespace tim
         void* passDataPtr = m_renderer->GetDynamicBuffer(sizeof(PassData), resources.m_passData);
         memcpy(passDataPtr, &passData, sizeof(PassData));
 
-        const u32 tracingResultBufferSize = m_frameSize.x * m_frameSize.y * sizeof(uvec4) * 2;
-        BufferHandle tracingResultBuffer = m_resourceAllocator.allocBuffer(tracingResultBufferSize, BufferUsage::Storage | BufferUsage::Transfer, MemoryType::Default);
-        resources.m_tracingResult = { tracingResultBuffer, 0, tracingResultBufferSize };
-    
-        resources.m_reflexionRayBuffer = m_resourceAllocator.allocBuffer(getRayStorageBufferSize(), BufferUsage::Storage | BufferUsage::Transfer, MemoryType::Default);
-        resources.m_refractionRayBuffer = m_resourceAllocator.allocBuffer(getRayStorageBufferSize(), BufferUsage::Storage | BufferUsage::Transfer, MemoryType::Default);
+        resources.m_tracingResult = _tracingResult;
+        resources.m_reflexionRayBuffer = _reflexionRayBuffer;
+        resources.m_refractionRayBuffer = _refractionRayBuffer;
     
         return resources;
     }
 
-    void RayTracingPass::freePassResources(const PassResource& _resources)
-    {
-        m_resourceAllocator.releaseBuffer(_resources.m_tracingResult.m_buffer);
-        m_resourceAllocator.releaseBuffer(_resources.m_reflexionRayBuffer);
-        m_resourceAllocator.releaseBuffer(_resources.m_refractionRayBuffer);
-    }
-
     void RayTracingPass::tracePass(ImageHandle _outputBuffer, const Scene& _scene, const PassResource& _resources)
     {
         PushConstants cst;
@@ -139,9 +144,7 @@ namespace tim
     DrawArguments RayTracingPass::fillBindings(const Scene& _scene, const PassResource& _resources, PushConstants& _cst, std::vector<BufferBinding>& _bufBinds, std::vector<ImageBinding>& _imgBinds)
     {
         DrawArguments arg = {};
-
-        _scene.getLPF().fillBindings(_imgBinds, g_lpfTextures_bind);
-        m_textureManager.fillImageBindings(_imgBinds);
+        fillBindingTables(_scene, arg);
 
         _bufBinds = {
             { _resources.m_passData, { 0, g_PassData_bind } },
@@ -149,11 +152,10 @@ namespace tim
             { { _resources.m_refractionRayBuffer, 0, getRayStorageBufferSize() }, { 0, g_OutRefractionRayBuffer_bind } },
             { _resources.m_tracingResult, { 0, g_tracingResult_bind } }
         };
+        m_textureManager.fillBufferBindings(_bufBinds);
 
-        _scene.fillGeometryBufferBindings(_bufBinds);
-        _scene.getBVH().fillBvhBindings(_bufBinds);
-
-        _cst = { _scene.getTrianglesCount(), _scene.getBlasInstancesCount(), _scene.getPrimitivesCount(), _scene.getLightsCount(), _scene.getNodesCount() };
+        _cst = { _scene.getTrianglesCount(), _scene.getBlasInstancesCount(), _scene.getPrimitivesCount(), _scene.getLightsCount(), _scene.getNodesCount(),
+                 computePrimaryLodErrorPerDistance(m_frameSize) };
         arg.m_constants = &_cst;
         arg.m_constantSize = sizeof(PushConstants);
 
@@ -165,17 +167,23 @@ namespace tim
         return arg;
     }
 
+    void RayTracingPass::fillBindingTables(const Scene& _scene, DrawArguments& _arg)
+    {
+        m_bindingTables = { &_scene.getBindingTable(), &m_textureManager.getBindingTable() };
+        _arg.m_bindingTables = m_bindingTables.data();
+        _arg.m_numBindingTables = (u32)m_bindingTables.size();
+    }
+
     void RayTracingPass::drawBounce(const Scene& _scene, u32 _depth, BufferView _passData, BufferHandle _inputRayBuffer, ImageHandle _curImage)
     {
         ImageHandle mainColorBuffer = _curImage;
 
         DrawArguments arg = {};
+        fillBindingTables(_scene, arg);
         std::vector<ImageBinding> imgBinds = {
             { mainColorBuffer, ImageViewType::Storage, 0, g_outputImage_bind },
             { mainColorBuffer, ImageViewType::Storage, 0, g_inputImage_bind }
         };
-        m_textureManager.fillImageBindings(imgBinds);
-        _scene.getLPF().fillBindings(imgBinds, g_lpfTextures_bind);
 
         std::vector<BufferBinding> bufBinds = {
             { _passData, { 0, g_PassData_bind } },
@@ -196,15 +204,15 @@ namespace tim
         if (_scene.useTlas())
             flags.set(C_USE_TRAVERSE_TLAS);
 
-        _scene.fillGeometryBufferBindings(bufBinds);
-        _scene.getBVH().fillBvhBindings(bufBinds);
+        m_textureManager.fillBufferBindings(bufBinds);
 
         arg.m_imageBindings = &imgBinds[0];
         arg.m_numImageBindings = (u32)imgBinds.size();
         arg.m_bufferBindings = &bufBinds[0];
         arg.m_numBufferBindings = (u32)bufBinds.size();
 
-        PushConstants constants = { _scene.getTrianglesCount(), _scene.getBlasInstancesCount(), _scene.getPrimitivesCount(), _scene.getLightsCount(), _scene.getNodesCount() };
+        PushConstants constants = { _scene.getTrianglesCount(), _scene.getBlasInstancesCount(), _scene.getPrimitivesCount(), _scene.getLightsCount(), _scene.getNodesCount(),
+                                    computePrimaryLodErrorPerDistance(m_frameSize) * float(LOD_BOUNCE_ERROR_FACTOR) };
         arg.m_constants = &constants;
         arg.m_constantSize = sizeof(constants);
         arg.m_key = { TIM_HASH32(rayBouncePass.comp), flags };
@@ -4,6 +4,7 @@
 #include "resourceAllocator.h"
 
 #include "Shaders/struct_cpp.glsl"
+#include <array>
 
 namespace tim
 {
@@ -29,22 +30,25 @@ namespace tim
         void setBounceRecursionDepth(u32 _depth);
         void setFrameBufferSize(uvec2 _res);
 
-        PassResource fillPassResources(const SimpleCamera& _camera, const Scene& _scene);
-        void freePassResources(const PassResource&);
+        // Transient buffers are allocated by the frame graph
+        u32 getTracingResultBufferSize() const;
+        u32 getRayStorageBufferSize() const;
+        PassResource fillPassResources(const SimpleCamera& _camera, const Scene& _scene, BufferView _tracingResult, BufferHandle _reflexionRayBuffer, BufferHandle _refractionRayBuffer);
 
         void tracePass(ImageHandle _outputBuffer, const Scene& _scene, const PassResource& _resources);
         void lightingPass(ImageHandle _outputBuffer, const Scene& _scene, const PassResource& _resources);
 
     private:
         void drawBounce(const Scene& _scene, u32 _depth, BufferView _passData, BufferHandle _inputRayBuffer, ImageHandle _outputImage);
-        u32 getRayStorageBufferSize() const;
         DrawArguments fillBindings(const Scene& _scene, const PassResource& _resources, PushConstants& _cst, std::vector<BufferBinding>& _bufBinds, std::vector<ImageBinding>& _imgBinds);
+        void fillBindingTables(const Scene& _scene, DrawArguments& _arg);
 
     private:
         IRenderer* m_renderer = nullptr;
         IRenderContext* m_context = nullptr;
         ResourceAllocator& m_resourceAllocator;
         TextureManager& m_textureManager;
+        std::array<const BindingTable*, 2> m_bindingTables = {};
 
         u32 m_rayBounceRecursionDepth;
         uvec2 m_frameSize;
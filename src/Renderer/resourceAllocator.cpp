@@ -1,103 +1,217 @@
-#include "resourceAllocator.h"
-#include "timCore/Common.h"
-
-namespace tim
-{
-
-    ResourceAllocator::ResourceAllocator(IRenderer* _renderer) : m_renderer{ _renderer }
-    {
-
-    }
-
-    ResourceAllocator::~ResourceAllocator()
-    {
-        clear();
-    }
-
-    void ResourceAllocator::clear()
-    {
-        for (auto& entry : m_textureEntries)
-        {
-            TIM_ASSERT(entry.isFree);
-            m_renderer->DestroyImage(entry.handle);
-        }
-        m_textureEntries.clear();
-
-        for (auto& entry : m_bufferEntries)
-        {
-            TIM_ASSERT(entry.isFree);
-            m_renderer->DestroyBuffer(entry.handle);
-        }
-        m_bufferEntries.clear();
-    }
-
-    ImageHandle ResourceAllocator::allocTexture(const ImageCreateInfo& _createInfo)
-    {
-        for (auto& entry : m_textureEntries)
-        {
-            if (entry.isFree && entry.createInfo == _createInfo)
-            {
-                entry.isFree = false;
-                return entry.handle;
-            }
-        }
-
-        ImageEntry entry(_createInfo);
-        entry.handle = m_renderer->CreateImage(_createInfo);
-        entry.isFree = false;
-        m_textureEntries.push_back(entry);
-
-        return entry.handle;
-    }
-
-    void ResourceAllocator::releaseTexture(ImageHandle _handle)
-    {
-        for (auto& entry : m_textureEntries)
-        {
-            if (_handle.ptr == entry.handle.ptr)
-            {
-                TIM_ASSERT(!entry.isFree);
-                entry.isFree = true;
-                return;
-            }
-        }
-
-        TIM_ASSERT(false);
-    }
-
-    BufferHandle ResourceAllocator::allocBuffer(u32 _size, BufferUsage _usage, MemoryType _memType)
-    {
-        BufferCreateInfo createInfo{ _size, _memType, _usage };
-        for (auto& entry : m_bufferEntries)
-        {
-            if (entry.isFree && entry.createInfo == createInfo)
-            {
-                entry.isFree = false;
-                return entry.handle;
-            }
-        }
-
-        BufferEntry entry;
-        entry.createInfo = createInfo;
-        entry.handle = m_renderer->CreateBuffer(createInfo.m_size, createInfo.m_memType, createInfo.m_usage);
-        entry.isFree = false;
-        m_bufferEntries.push_back(entry);
-
-        return entry.handle;
-    }
-
-    void ResourceAllocator::releaseBuffer(BufferHandle _handle)
-    {
-        for (auto& entry : m_bufferEntries)
-        {
-            if (_handle.ptr == entry.handle.ptr)
-            {
-                TIM_ASSERT(!entry.isFree);
-                entry.isFree = true;
-                return;
-            }
-        }
-
-        TIM_ASSERT(false);
-    }
-}
\ No newline at end of file
+#include "resourceAllocator.h"
+#include "timCore/Common.h"
+
+namespace tim
+{
+    size_t ResourceAllocator::CreateInfoHasher::operator()(const BufferCreateInfo& _info) const
+    {
+        size_t h = 0;
+        hash_combine(h, _info.m_size, u32(_info.m_memType), u32(_info.m_usage));
+        return h;
+    }
+
+    size_t ResourceAllocator::CreateInfoHasher::operator()(const ImageCreateInfo& _info) const
+    {
+        size_t h = 0;
+        hash_combine(h, u32(_info.type), u32(_info.format), _info.width, _info.height, _info.depth, _info.numMips, u32(_info.memory), u32(_info.usage));
+        return h;
+    }
+
+    ResourceAllocator::ResourceAllocator(IRenderer* _renderer, u64 _memoryBudget, u32 _maxUnusedFrames) 
+        : m_renderer{ _renderer }, m_memoryBudget{ _memoryBudget }, m_maxUnusedFrames{ _maxUnusedFrames }
+    {
+
+    }
+
+    ResourceAllocator::~ResourceAllocator()
+    {
+        clear();
+    }
+
+    void ResourceAllocator::clear()
+    {
+        destroyAll(m_textures);
+        destroyAll(m_buffers);
+        TIM_ASSERT(m_stats.liveBytes == 0 && m_stats.cachedBytes == 0);
+    }
+
+    void ResourceAllocator::nextFrame()
+    {
+        m_frame++;
+
+        // The GPU may still read a resource released during the last TIM_FRAME_LATENCY frames
+        const u64 minAge = std::max<u64>(m_maxUnusedFrames, TIM_FRAME_LATENCY + 1);
+        if (m_frame >= minAge)
+        {
+            evict(m_buffers, m_frame - minAge, 0);
+            evict(m_textures, m_frame - minAge, 0);
+        }
+
+        evictToBudget(0);
+    }
+
+    ImageHandle ResourceAllocator::allocTexture(const ImageCreateInfo& _createInfo)
+    {
+        const u64 byteSize = computeImageSize(_createInfo);
+        if (void* ptr = acquire(m_textures, _createInfo, byteSize))
+            return { ptr };
+
+        evictToBudget(byteSize);
+
+        ImageHandle handle = m_renderer->CreateImage(_createInfo, MemoryTag::Transients);
+        add(m_textures, handle.ptr, _createInfo, byteSize, byteSize);
+        return handle;
+    }
+
+    void ResourceAllocator::releaseTexture(ImageHandle _handle)
+    {
+        release(m_textures, _handle.ptr);
+    }
+
+    BufferHandle ResourceAllocator::allocBuffer(u32 _size, BufferUsage _usage, MemoryType _memType)
+    {
+        BufferCreateInfo createInfo{ getBufferSizeClass(_size), _memType, _usage };
+        if (void* ptr = acquire(m_buffers, createInfo, _size))
+            return { ptr };
+
+        evictToBudget(createInfo.m_size);
+
+        BufferHandle handle = m_renderer->CreateBuffer(createInfo.m_size, createInfo.m_memType, createInfo.m_usage, MemoryTag::Transients);
+        add(m_buffers, handle.ptr, createInfo, createInfo.m_size, _size);
+        return handle;
+    }
+
+    void ResourceAllocator::releaseBuffer(BufferHandle _handle)
+    {
+        release(m_buffers, _handle.ptr);
+    }
+
+    u32 ResourceAllocator::getBufferSizeClass(u32 _size)
+    {
+        // Buffers are pooled in power of two size classes, small ones share the first class
+        const u32 minSize = 256;
+        if (_size <= minSize)
+            return minSize;
+
+        TIM_ASSERT(_size <= (1u << 31));
+        u32 v = _size - 1;
+        v |= v >> 1;
+        v |= v >> 2;
+        v |= v >> 4;
+        v |= v >> 8;
+        v |= v >> 16;
+        return v + 1;
+    }
+
+    template<typename Info>
+    void* ResourceAllocator::acquire(Pool<Info>& _pool, const Info& _createInfo, u64 _requestedBytes)
+    {
+        auto it = _pool.freeLists.find(_createInfo);
+        if (it == _pool.freeLists.end() || it->second.empty())
+        {
+            m_stats.misses++;
+            return nullptr;
+        }
+
+        // The most recently released resource is the most likely to still be in cache
+        void* ptr = it->second.back().ptr;
+        it->second.pop_back();
+
+        Entry<Info>& entry = _pool.entries.at(ptr);
+        entry.isFree = false;
+        entry.requestedBytes = _requestedBytes;
+        m_stats.hits++;
+        m_stats.cachedBytes -= entry.byteSize;
+        m_stats.liveBytes += entry.byteSize;
+        m_stats.requestedBytes += _requestedBytes;
+        return ptr;
+    }
+
+    template<typename Info>
+    void ResourceAllocator::add(Pool<Info>& _pool, void* _ptr, const Info& _createInfo, u64 _byteSize, u64 _requestedBytes)
+    {
+        _pool.entries.emplace(_ptr, Entry<Info>{ _createInfo, _byteSize, _requestedBytes, false });
+        m_stats.liveBytes += _byteSize;
+        m_stats.requestedBytes += _requestedBytes;
+    }
+
+    template<typename Info>
+    void ResourceAllocator::release(Pool<Info>& _pool, void* _ptr)
+    {
+        auto it = _pool.entries.find(_ptr);
+        TIM_ASSERT(it != _pool.entries.end() && !it->second.isFree);
+
+        it->second.isFree = true;
+        auto itList = _pool.freeLists.find(it->second.createInfo);
+        if (itList == _pool.freeLists.end())
+            itList = _pool.freeLists.emplace(it->second.createInfo, std::vector<FreeEntry>{}).first;
+        itList->second.push_back({ _ptr, m_frame });
+        m_stats.liveBytes -= it->second.byteSize;
+        m_stats.requestedBytes -= it->second.requestedBytes;
+        m_stats.cachedBytes += it->second.byteSize;
+    }
+
+    template<typename Info>
+    void ResourceAllocator::evict(Pool<Info>& _pool, u64 _maxReleaseFrame, u64 _cachedBytesTarget)
+    {
+        for (auto it = _pool.freeLists.begin(); it != _pool.freeLists.end() && m_stats.cachedBytes > _cachedBytesTarget;)
+        {
+            std::vector<FreeEntry>& freeList = it->second;
+
+            u32 numEvicted = 0;
+            while (numEvicted < freeList.size() && freeList[numEvicted].releaseFrame <= _maxReleaseFrame && m_stats.cachedBytes > _cachedBytesTarget)
+            {
+                void* ptr = freeList[numEvicted++].ptr;
+                auto itEntry = _pool.entries.find(ptr);
+                m_stats.cachedBytes -= itEntry->second.byteSize;
+                m_stats.evictions++;
+                destroy(it->first, ptr);
+                _pool.entries.erase(itEntry);
+            }
+            freeList.erase(freeList.begin(), freeList.begin() + numEvicted);
+
+            // Drop the classes nobody asks for anymore, like the frame buffers of a previous resolution
+            if (freeList.empty())
+                it = _pool.freeLists.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    template<typename Info>
+    void ResourceAllocator::destroyAll(Pool<Info>& _pool)
+    {
+        for (auto& [ptr, entry] : _pool.entries)
+        {
+            TIM_ASSERT(entry.isFree);
+            destroy(entry.createInfo, ptr);
+            m_stats.cachedBytes -= entry.byteSize;
+        }
+        _pool.entries.clear();
+        _pool.freeLists.clear();
+    }
+
+    void ResourceAllocator::destroy(const BufferCreateInfo&, void* _ptr)
+    {
+        BufferHandle handle{ _ptr };
+        m_renderer->DestroyBuffer(handle);
+    }
+
+    void ResourceAllocator::destroy(const ImageCreateInfo&, void* _ptr)
+    {
+        ImageHandle handle{ _ptr };
+        m_renderer->DestroyImage(handle);
+    }
+
+    void ResourceAllocator::evictToBudget(u64 _incomingBytes)
+    {
+        const u64 usedBytes = m_stats.liveBytes + m_stats.cachedBytes + _incomingBytes;
+        if (usedBytes <= m_memoryBudget || m_frame <= TIM_FRAME_LATENCY)
+            return;
+
+        // Live resources are never evicted, the budget can only be met by emptying the cache
+        const u64 target = m_stats.cachedBytes > usedBytes - m_memoryBudget ? m_stats.cachedBytes - (usedBytes - m_memoryBudget) : 0;
+        evict(m_buffers, m_frame - TIM_FRAME_LATENCY - 1, target);
+        evict(m_textures, m_frame - TIM_FRAME_LATENCY - 1, target);
+    }
+}
@@ -1,35 +1,51 @@
 #pragma once
 #include "rtDevice/public/IRenderer.h"
+#include "timCore/hash.h"
+#include <unordered_map>
+#include <vector>
 
 namespace tim
 {
+    struct ResourceAllocatorStats
+    {
+        u32 hits = 0;
+        u32 misses = 0;
+        u32 evictions = 0;
+        u64 liveBytes = 0;
+        u64 requestedBytes = 0; // asked for by the live allocations, liveBytes - requestedBytes is lost to the buffer size classes
+        u64 cachedBytes = 0; // released resources kept for reuse
+    };
+
+    // Pool of transient buffers and textures, released resources are kept in free lists hashed by create info
+    // and destroyed once unused for a number of frames or when the pool goes over its memory budget
     class ResourceAllocator
     {
     public:
-        ResourceAllocator(IRenderer* _renderer);
+        static constexpr u64 DefaultMemoryBudget = 1024ull * 1024 * 1024;
+        static constexpr u32 DefaultMaxUnusedFrames = 120;
+
+        ResourceAllocator(IRenderer* _renderer, u64 _memoryBudget = DefaultMemoryBudget, u32 _maxUnusedFrames = DefaultMaxUnusedFrames);
         ~ResourceAllocator();
 
         void clear();
 
+        // Evict the resources unused for too long, call once per frame
+        void nextFrame();
+
+        void setMemoryBudget(u64 _budget) { m_memoryBudget = _budget; }
+        const ResourceAllocatorStats& getStats() const { return m_stats; }
+
         ImageHandle allocTexture(const ImageCreateInfo&);
         void releaseTexture(ImageHandle);
 
+        // The buffer is rounded up to a power of two size class, bind it with an explicit range
         BufferHandle allocBuffer(u32 _size, BufferUsage _usage, MemoryType _memType = MemoryType::Default);
         void releaseBuffer(BufferHandle);
 
-    private:
-        IRenderer* m_renderer = nullptr;
-
-        struct ImageEntry
-        {
-            ImageEntry(const ImageCreateInfo& _createInfo) : createInfo{ _createInfo } {}
-
-            ImageCreateInfo createInfo;
-            ImageHandle handle;
-            bool isFree = true;
-        };
-        std::vector<ImageEntry> m_textureEntries;
+        // Memory actually used by a buffer allocated from the pool
+        static u32 getBufferSizeClass(u32 _size);
 
+    private:
         struct BufferCreateInfo
         {
             u32 m_size;
@@ -39,12 +55,60 @@ namespace tim
             bool operator==(const BufferCreateInfo&) const = default;
         };
 
-        struct BufferEntry
+        struct CreateInfoHasher
+        {
+            size_t operator()(const BufferCreateInfo& _info) const;
+            size_t operator()(const ImageCreateInfo& _info) const;
+        };
+
+        template<typename Info>
+        struct Entry
+        {
+            Info createInfo;
+            u64 byteSize;
+            u64 requestedBytes;
+            bool isFree;
+        };
+
+        // Released resources are pushed at the back of their free list, the front holds the oldest ones
+        struct FreeEntry
+        {
+            void* ptr;
+            u64 releaseFrame;
+        };
+
+        template<typename Info>
+        struct Pool
         {
-            BufferCreateInfo createInfo;
-            BufferHandle handle;
-            bool isFree = true;
+            // Node based maps, ImageCreateInfo is not default constructible
+            std::unordered_map<Info, std::vector<FreeEntry>, CreateInfoHasher> freeLists;
+            std::unordered_map<void*, Entry<Info>> entries;
         };
-        std::vector<BufferEntry> m_bufferEntries;
+
+        template<typename Info>
+        void* acquire(Pool<Info>&, const Info&, u64 _requestedBytes);
+        template<typename Info>
+        void add(Pool<Info>&, void* _ptr, const Info&, u64 _byteSize, u64 _requestedBytes);
+        template<typename Info>
+        void release(Pool<Info>&, void* _ptr);
+        // Destroy the oldest free resources released up to _maxReleaseFrame until the cache is at most _cachedBytesTarget
+        template<typename Info>
+        void evict(Pool<Info>&, u64 _maxReleaseFrame, u64 _cachedBytesTarget);
+        template<typename Info>
+        void destroyAll(Pool<Info>&);
+
+        void destroy(const BufferCreateInfo&, void* _ptr);
+        void destroy(const ImageCreateInfo&, void* _ptr);
+        void evictToBudget(u64 _incomingBytes);
+
+    private:
+        IRenderer* m_renderer = nullptr;
+        u64 m_memoryBudget;
+        u32 m_maxUnusedFrames;
+        u64 m_frame = 0;
+        ResourceAllocatorStats m_stats;
+
+        Pool<BufferCreateInfo> m_buffers;
+        Pool<ImageCreateInfo> m_textures;
     };
-}
\ No newline at end of file
+}
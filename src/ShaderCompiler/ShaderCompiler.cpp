@@ -2,16 +2,64 @@
 #include "timCore/hash.h"
 #include "timCore/Common.h"
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <windows.h>
 
 namespace tim
 {
+    namespace
+    {
+        bool readFile(const std::filesystem::path& _path, Blob& _content)
+        {
+            std::error_code ec;
+            const u64 size = std::filesystem::file_size(_path, ec);
+            if (ec)
+                return false;
+
+            _content.resize(size);
+            std::ifstream file(_path, std::ios::binary);
+            return file && file.read((char*)_content.data(), size);
+        }
+
+        std::string quote(const std::string& _path)
+        {
+            return "\"" + _path + "\"";
+        }
+
+        // cmd.exe strips the first and the last quote of the command line, the paths keep theirs
+        std::string shellCommand(const std::string& _command)
+        {
+            return quote(_command);
+        }
+    }
+
     ShaderCompiler::ShaderCompiler(const char* _folder, const std::array<const char*, 64>& _macros) : m_folder{ _folder }, m_macros { _macros }
     {
         namespace fs = std::filesystem;
 
         fs::create_directory(m_folder + "cache");
 
+        m_compilerPath = "C:\\VulkanSDK\\1.3.224.1\\Bin\\glslc.exe";
+        if (!fs::exists(m_compilerPath))
+            std::cout << m_compilerPath << " does not exist." << std::endl;
+
+        // A compiler update invalidates every cached bytecode
+        std::string version;
+        if (FILE* pipe = _popen(shellCommand(quote(m_compilerPath) + " --version").c_str(), "r"))
+        {
+            char buffer[256];
+            while (fgets(buffer, sizeof(buffer), pipe))
+                version += buffer;
+            _pclose(pipe);
+        }
+        m_compilerVersionHash = hash_64_fnv1a(version.data(), version.size(), hash_64_fnv1a(m_compilerPath.data(), m_compilerPath.size()));
+
         for (const auto& entry : fs::directory_iterator(_folder))
         {
             if (entry.is_regular_file() && entry.path().has_extension())
@@ -27,8 +75,15 @@ namespace tim
 
     void ShaderCompiler::clearCache()
     {
+        // Only the in memory bytecode is dropped, entries on disk are keyed by content and stay valid
         for (auto& fxFile : m_shaders)
+        {
+            for (auto& [flags, bytecode] : fxFile.second.m_bytecode)
+                fxFile.second.m_lastValidBytecode[flags] = std::move(bytecode);
+
             fxFile.second.m_bytecode.clear();
+            fxFile.second.m_sourceHash = 0;
+        }
     }
 
     const Blob& ShaderCompiler::getShaderMicrocode(FxNameHash _fx, ShaderFlags _flags)
@@ -37,52 +92,336 @@ namespace tim
 
         auto itFx = m_shaders.find(_fx);
         TIM_ASSERT(itFx != m_shaders.end());
+        FXFile& fxFile = itFx->second;
 
-        auto it = itFx->second.m_bytecode.find(_flags.m_flags);
-        if (it != itFx->second.m_bytecode.end())
-            return it->second;
-        else
+        if (!loadCachedVariant(fxFile, _flags))
         {
-            std::string outputFile = m_folder + "cache/" + buildShaderKeyString(_fx, _flags);
-            std::string cmdArg = std::string((const char *)itFx->second.m_fxName.u8string().c_str()) + " " + buildDefineCommand(_flags) + " -Isrc/Shaders/ -Isrc -O -o " + outputFile;
+            std::cout << "\nCompiling " << fxFile.m_fxName << ".\n";
 
-            fs::remove(outputFile);
+            fs::remove(getTempPath(_fx, _flags, ".tmp"));
+            const bool processSucceeded = system(buildCompileCommand(fxFile, _fx, _flags).c_str()) == 0;
+            if (!finishCompilation(fxFile, _fx, _flags, fxFile.m_sourceHash, processSucceeded))
+            {
+                // Keep running on the previous bytecode, the next reload will try again
+                auto itLast = fxFile.m_lastValidBytecode.find(_flags.m_flags);
+                if (itLast != fxFile.m_lastValidBytecode.end() && !itLast->second.empty())
+                {
+                    std::cout << "Using the previous version of " << fxFile.m_fxName << ".\n";
+                    return itLast->second;
+                }
 
-            std::cout << "\nCompiling " << itFx->second.m_fxName << ".\n";
+                // The empty bytecode marks the variant as failed, it is compiled again when its sources change
+                std::cout << "No previous version of " << fxFile.m_fxName << ", the variant is skipped until its sources change.\n";
+                fxFile.m_bytecode[_flags.m_flags] = {};
+            }
+        }
 
-            bool retry = false;
-            do
+        return fxFile.m_bytecode.at(_flags.m_flags);
+    }
+
+    bool ShaderCompiler::hasShaderMicrocode(FxNameHash _fx, ShaderFlags _flags) const
+    {
+        auto itFx = m_shaders.find(_fx);
+        if (itFx == m_shaders.end())
+            return false;
+
+        auto itBytecode = itFx->second.m_bytecode.find(_flags.m_flags);
+        return itBytecode != itFx->second.m_bytecode.end() && !itBytecode->second.empty();
+    }
+
+    u32 ShaderCompiler::precompile(const std::vector<ShaderKey>& _variants, u32 _maxJobs)
+    {
+        namespace fs = std::filesystem;
+
+        struct PendingVariant
+        {
+            FXFile* fxFile;
+            ShaderKey key;
+            std::string command;
+            bool processSucceeded = false;
+        };
+
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<PendingVariant> pending;
+        ska::flat_hash_set<ShaderKey> visited;
+        for (const ShaderKey& key : _variants)
+        {
+            auto itFx = m_shaders.find(key.fx);
+            if (itFx == m_shaders.end() || !visited.insert(key).second || loadCachedVariant(itFx->second, key.flags))
+                continue;
+
+            fs::remove(getTempPath(key.fx, key.flags, ".tmp"));
+            pending.push_back({ &itFx->second, key, buildCompileCommand(itFx->second, key.fx, key.flags) });
+        }
+
+        if (pending.empty())
+            return 0;
+
+        u32 numJobs = _maxJobs > 0 ? _maxJobs : std::max(1u, std::thread::hardware_concurrency());
+        numJobs = std::min(numJobs, u32(pending.size()));
+        std::cout << "Compiling " << pending.size() << " shader variants with " << numJobs << " jobs.\n";
+
+        // Each worker blocks on one compiler process at a time
+        std::atomic<u32> nextVariant = 0;
+        std::mutex logMutex;
+        u32 numDone = 0;
+        auto worker = [&]()
+        {
+            for (u32 i = nextVariant++; i < pending.size(); i = nextVariant++)
             {
-                std::string compilerPath = "C:\\VulkanSDK\\1.3.224.1\\Bin\\glslc.exe";
-                if (!fs::exists(compilerPath))
-                    std::cout << compilerPath << " does not exist." << std::endl;
+                pending[i].processSucceeded = system(pending[i].command.c_str()) == 0;
 
-                system((compilerPath + " " + cmdArg).c_str());
-                if (!fs::exists(outputFile))
-                {
-                    std::cout << "\nCompilation failed, would you retry ?\n";
-                    std::cin >> retry;
-                    std::cin.clear();
-                }
-                else
-                    retry = false;
+                std::lock_guard<std::mutex> lock(logMutex);
+                std::cout << "[" << ++numDone << "/" << pending.size() << "] " << pending[i].fxFile->m_fxName.filename() << " " << std::hex << pending[i].key.flags.m_flags << std::dec << "\n";
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (u32 i = 0; i < numJobs; ++i)
+            workers.emplace_back(worker);
+        for (std::thread& thread : workers)
+            thread.join();
+
+        u32 numFailed = 0;
+        for (PendingVariant& variant : pending)
+        {
+            if (!finishCompilation(*variant.fxFile, variant.key.fx, variant.key.flags, variant.fxFile->m_sourceHash, variant.processSucceeded))
+                numFailed++;
+        }
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Compiled " << pending.size() - numFailed << " shader variants in " << seconds << "s, " << numFailed << " failed.\n";
+        return numFailed;
+    }
+
+    void ShaderCompiler::checkForChanges()
+    {
+        for (auto& [fx, fxFile] : m_shaders)
+        {
+            if (fxFile.m_sourceHash == 0)
+                continue;
+
+            bool touched = false;
+            for (const auto& [file, time] : fxFile.m_dependencies)
+            {
+                std::error_code ec;
+                touched |= std::filesystem::last_write_time(file, ec) != time;
+            }
+
+            // Saving a file without modifying it keeps the variants
+            const u64 sourceHash = touched ? hashSourceTree(fxFile) : fxFile.m_sourceHash;
+            if (sourceHash == fxFile.m_sourceHash)
+                continue;
+
+            std::cout << "Reloading " << fxFile.m_fxName << ".\n";
+            fxFile.m_sourceHash = sourceHash;
+            for (const auto& [flags, bytecode] : fxFile.m_bytecode)
+            {
+                const ShaderKey key = { fx, ShaderFlags{ flags } };
+                if (std::find(m_reloadQueue.begin(), m_reloadQueue.end(), key) == m_reloadQueue.end())
+                    m_reloadQueue.push_back(key);
+            }
+        }
+    }
+
+    void ShaderCompiler::collectReloadedShaders(std::vector<ShaderKey>& _reloaded)
+    {
+        namespace fs = std::filesystem;
 
-            } while (retry);
+        auto isCompiling = [this](const ShaderKey& _key)
+        {
+            return std::find_if(m_reloadJobs.begin(), m_reloadJobs.end(), [&_key](const ReloadJob& _job) { return _job.key == _key; }) != m_reloadJobs.end();
+        };
 
-            TIM_ASSERT(fs::exists(outputFile));
+        for (u32 i = 0; i < m_reloadJobs.size();)
+        {
+            ReloadJob& job = m_reloadJobs[i];
+            if (job.result.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++i;
+                continue;
+            }
 
-            u64 size = fs::file_size(outputFile);
-            Blob fileContent(size);
+            FXFile& fxFile = m_shaders.at(job.key.fx);
+            const bool processSucceeded = job.result.get();
+            if (job.sourceHash != fxFile.m_sourceHash)
+            {
+                // The sources changed again during the compilation, the variant is already queued again
+                std::error_code ec;
+                fs::remove(getTempPath(job.key.fx, job.key.flags, ".tmp"), ec);
+                fs::remove(getTempPath(job.key.fx, job.key.flags, ".log"), ec);
+            }
+            else if (finishCompilation(fxFile, job.key.fx, job.key.flags, job.sourceHash, processSucceeded))
+                _reloaded.push_back(job.key);
+            else
+            {
+                // Keep running on the snapshot taken before the compilation, empty for a variant which never compiled
+                const Blob& snapshot = fxFile.m_lastValidBytecode.at(job.key.flags.m_flags);
+                fxFile.m_bytecode[job.key.flags.m_flags] = snapshot;
+                if (!snapshot.empty())
+                    std::cout << "Using the previous version of " << fxFile.m_fxName << ".\n";
+            }
+
+            if (i + 1 < m_reloadJobs.size())
+                job = std::move(m_reloadJobs.back());
+            m_reloadJobs.pop_back();
+        }
+
+        const u32 maxJobs = std::max(1u, std::thread::hardware_concurrency());
+        for (u32 i = 0; i < m_reloadQueue.size() && m_reloadJobs.size() < maxJobs;)
+        {
+            // A variant compiles in a single process at a time, they share the temporary files
+            const ShaderKey key = m_reloadQueue[i];
+            if (isCompiling(key))
+            {
+                ++i;
+                continue;
+            }
+            m_reloadQueue.erase(m_reloadQueue.begin() + i);
 
-            FILE * filp = fopen(outputFile.c_str(), "rb");
-            TIM_ASSERT(filp != nullptr);
-            size_t bytes_read = fread(fileContent.data(), sizeof(char), size, filp);
-            TIM_ASSERT(size == bytes_read);
-            fclose(filp); 
+            FXFile& fxFile = m_shaders.at(key.fx);
+            Blob fileContent;
+            if (readFile(getCachePath(computeShaderKey(fxFile.m_sourceHash, key.flags)), fileContent))
+            {
+                fxFile.m_bytecode[key.flags.m_flags] = std::move(fileContent);
+                _reloaded.push_back(key);
+                continue;
+            }
 
-            itFx->second.m_bytecode.emplace(_flags.m_flags, std::move(fileContent));
+            // Snapshot of the running bytecode, used until a compilation of the new sources succeeds
+            auto itBytecode = fxFile.m_bytecode.find(key.flags.m_flags);
+            if (itBytecode != fxFile.m_bytecode.end())
+                fxFile.m_lastValidBytecode[key.flags.m_flags] = itBytecode->second;
 
-            return itFx->second.m_bytecode.at(_flags.m_flags);
+            fs::remove(getTempPath(key.fx, key.flags, ".tmp"));
+            const std::string command = buildCompileCommand(fxFile, key.fx, key.flags);
+            m_reloadJobs.push_back({ key, fxFile.m_sourceHash, std::async(std::launch::async, [command]() { return system(command.c_str()) == 0; }) });
+        }
+    }
+
+    bool ShaderCompiler::loadCachedVariant(FXFile& _fxFile, ShaderFlags _flags)
+    {
+        if (_fxFile.m_bytecode.count(_flags.m_flags) > 0)
+            return true;
+
+        if (_fxFile.m_sourceHash == 0)
+            _fxFile.m_sourceHash = hashSourceTree(_fxFile);
+
+        Blob fileContent;
+        if (!readFile(getCachePath(computeShaderKey(_fxFile.m_sourceHash, _flags)), fileContent))
+            return false;
+
+        _fxFile.m_bytecode.emplace(_flags.m_flags, std::move(fileContent));
+        return true;
+    }
+
+    std::string ShaderCompiler::buildCompileCommand(const FXFile& _fxFile, FxNameHash _fx, ShaderFlags _flags) const
+    {
+        // Compile in a temporary file renamed once complete, a killed compilation never leaves a truncated entry
+        std::string cmd = quote(m_compilerPath) + " " + quote((const char*)_fxFile.m_fxName.u8string().c_str()) + " " + buildDefineCommand(_flags);
+        for (const char* folder : m_includeFolders)
+            cmd += std::string(" -I") + quote(folder);
+        return shellCommand(cmd + " -O -o " + quote(getTempPath(_fx, _flags, ".tmp")) + " > " + quote(getTempPath(_fx, _flags, ".log")) + " 2>&1");
+    }
+
+    bool ShaderCompiler::finishCompilation(FXFile& _fxFile, FxNameHash _fx, ShaderFlags _flags, u64 _sourceHash, bool _processSucceeded)
+    {
+        namespace fs = std::filesystem;
+
+        const std::string tmpFile = getTempPath(_fx, _flags, ".tmp");
+        const std::string logFile = getTempPath(_fx, _flags, ".log");
+
+        Blob fileContent;
+        bool success = _processSucceeded && fs::exists(tmpFile);
+        if (success)
+        {
+            std::error_code ec;
+            const std::string outputFile = getCachePath(computeShaderKey(_sourceHash, _flags));
+            fs::rename(tmpFile, outputFile, ec);
+            success = readFile(ec ? fs::path(tmpFile) : fs::path(outputFile), fileContent);
+        }
+
+        if (success)
+            _fxFile.m_bytecode[_flags.m_flags] = std::move(fileContent);
+        else
+        {
+            Blob log;
+            readFile(logFile, log);
+            std::cout << "\nCompilation of " << _fxFile.m_fxName << " failed (" << buildDefineCommand(_flags) << " ):\n" << std::string(log.begin(), log.end()) << "\n";
+        }
+
+        std::error_code ec;
+        fs::remove(tmpFile, ec);
+        fs::remove(logFile, ec);
+        return success;
+    }
+
+    u64 ShaderCompiler::computeShaderKey(u64 _sourceHash, ShaderFlags _flags) const
+    {
+        const std::string defines = buildDefineCommand(_flags);
+        u64 key = hash_64_fnv1a(&_sourceHash, sizeof(_sourceHash), m_compilerVersionHash);
+        return hash_64_fnv1a(defines.data(), defines.size(), key);
+    }
+
+    u64 ShaderCompiler::hashSourceTree(FXFile& _fxFile) const
+    {
+        u64 hash = detail::val_64_const;
+        ska::flat_hash_set<std::string> visited;
+        hashSourceFile(_fxFile.m_fxName, hash, visited);
+
+        // Timestamps of the include graph, a change triggers a new hash of the sources
+        _fxFile.m_dependencies.clear();
+        for (const std::string& file : visited)
+        {
+            std::error_code ec;
+            _fxFile.m_dependencies.push_back({ std::filesystem::u8path(file), std::filesystem::last_write_time(std::filesystem::u8path(file), ec) });
+        }
+
+        return hash;
+    }
+
+    void ShaderCompiler::hashSourceFile(const std::filesystem::path& _file, u64& _hash, ska::flat_hash_set<std::string>& _visited) const
+    {
+        namespace fs = std::filesystem;
+
+        // Included files are hashed once, in the order they are first reached
+        std::error_code ec;
+        const fs::path canonical = fs::weakly_canonical(_file, ec);
+        const std::string name = (const char*)canonical.u8string().c_str();
+        if (!_visited.insert(name).second)
+            return;
+
+        Blob content;
+        if (!readFile(canonical, content))
+        {
+            // A missing include still changes the key so the variant is compiled and the error reported
+            _hash = hash_64_fnv1a(name.data(), name.size(), _hash);
+            return;
+        }
+        _hash = hash_64_fnv1a(content.data(), content.size(), _hash);
+
+        const std::string source(content.begin(), content.end());
+        size_t pos = 0;
+        while ((pos = source.find("#include", pos)) != std::string::npos)
+        {
+            pos += 8;
+            const size_t lineEnd = source.find('\n', pos);
+            const size_t open = source.find_first_of("\"<", pos);
+            if (open == std::string::npos || open > lineEnd)
+                continue;
+
+            const size_t close = source.find_first_of("\">", open + 1);
+            if (close == std::string::npos || close > lineEnd)
+                continue;
+
+            // Same lookup order as glslc: next to the including file, then the include folders
+            const std::string include = source.substr(open + 1, close - open - 1);
+            fs::path includePath = _file.parent_path() / include;
+            for (u32 i = 0; i < m_includeFolders.size() && !fs::exists(includePath); ++i)
+                includePath = fs::path(m_includeFolders[i]) / include;
+
+            hashSourceFile(includePath, _hash, _visited);
         }
     }
 
@@ -98,10 +437,15 @@ namespace tim
         return res;
     }
 
-    std::string ShaderCompiler::buildShaderKeyString(FxNameHash _fx, ShaderFlags _flags) const
+    std::string ShaderCompiler::getTempPath(FxNameHash _fx, ShaderFlags _flags, const char* _extension) const
+    {
+        return m_folder + "cache/" + std::to_string(_fx) + "_" + std::to_string(_flags.m_flags) + _extension;
+    }
+
+    std::string ShaderCompiler::getCachePath(u64 _key) const
     {
-        char buffer[64];
-        sprintf_s(buffer, "%u_%llu.bin", _fx, _flags.m_flags);
-        return std::string(buffer);
+        char buffer[32];
+        sprintf_s(buffer, "%016llx.spv", (unsigned long long)_key);
+        return m_folder + "cache/" + buffer;
     }
 }
\ No newline at end of file
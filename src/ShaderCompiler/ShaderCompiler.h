@@ -2,13 +2,16 @@
 #include "timCore/type.h"
 #include "timCore/hash.h"
 #include "timCore/flat_hash_map.h"
+#include "timCore/MemoryTracker.h"
 #include "ShaderFlags.h"
 #include <array>
 #include <filesystem>
+#include <future>
+#include <vector>
 
 namespace tim
 {
-    using Blob = ::std::vector<ubyte>;
+    using Blob = TaggedVector<ubyte, MemoryTag::Shaders>;
 
     class ShaderCompiler
     {
@@ -18,21 +21,61 @@ namespace tim
 
         void clearCache();
 
+        // A failed compilation falls back on the last valid bytecode. Without one the returned blob is empty, the variant
+        // is compiled again by the reload once its sources change.
         const Blob& getShaderMicrocode(FxNameHash, ShaderFlags);
+        bool hasShaderMicrocode(FxNameHash, ShaderFlags) const;
+        std::string getCacheFolder() const { return m_folder + "cache/"; }
+
+        // Compile the missing variants concurrently, at most _maxJobs compiler processes at once (0 for one per core)
+        // Returns the number of variants that failed to compile
+        u32 precompile(const std::vector<ShaderKey>& _variants, u32 _maxJobs = 0);
+
+        // Queue a background compilation of the loaded variants whose source or includes changed
+        void checkForChanges();
+        // Finish the background compilations and start the queued ones, _reloaded receives the variants with a new bytecode
+        void collectReloadedShaders(std::vector<ShaderKey>& _reloaded);
 
     private:
         std::string buildDefineCommand(ShaderFlags) const;
-        std::string buildShaderKeyString(FxNameHash, ShaderFlags) const;
+        std::string getCachePath(u64 _key) const;
+        std::string getTempPath(FxNameHash, ShaderFlags, const char* _extension) const;
+
+        // Content key of a variant: source and its whole include graph, defines and compiler version
+        u64 computeShaderKey(u64 _sourceHash, ShaderFlags) const;
+        struct FXFile;
+        u64 hashSourceTree(FXFile&) const;
+        void hashSourceFile(const std::filesystem::path& _file, u64& _hash, ska::flat_hash_set<std::string>& _visited) const;
+
+        bool loadCachedVariant(FXFile&, ShaderFlags);
+        std::string buildCompileCommand(const FXFile&, FxNameHash, ShaderFlags) const;
+        // Move the compiler output in the cache and load it, the compiler log is printed on failure
+        bool finishCompilation(FXFile&, FxNameHash, ShaderFlags, u64 _sourceHash, bool _processSucceeded);
 
     private:
         std::string m_folder;
         std::array<const char*, 64> m_macros = { { nullptr } };
-        
+        std::string m_compilerPath;
+        u64 m_compilerVersionHash = 0;
+        std::array<const char*, 2> m_includeFolders = { { "src/Shaders/", "src/" } };
+
         struct FXFile
         {
             std::filesystem::path m_fxName;
             ska::flat_hash_map<u64, Blob> m_bytecode;
+            ska::flat_hash_map<u64, Blob> m_lastValidBytecode; // used when a reloaded variant fails to compile
+            u64 m_sourceHash = 0; // 0 until the include graph is hashed, reset with the bytecode
+            std::vector<std::pair<std::filesystem::path, std::filesystem::file_time_type>> m_dependencies;
         };
         ska::flat_hash_map<FxNameHash, FXFile> m_shaders;
+
+        struct ReloadJob
+        {
+            ShaderKey key;
+            u64 sourceHash;
+            std::future<bool> result;
+        };
+        std::vector<ShaderKey> m_reloadQueue;
+        std::vector<ReloadJob> m_reloadJobs;
     };
 }
\ No newline at end of file
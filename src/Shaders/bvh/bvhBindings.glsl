@@ -4,6 +4,8 @@
 #include "bvhBindings_cpp.glsl"
 #include "core/primitive_cpp.glsl"
 #include "core/collision.glsl"
+#include "core/virtualTexture_cpp.glsl"
+#include "core/vertexCompression_cpp.glsl"
 
 layout(std430, set = 0, binding = g_BvhPrimitives_bind) buffer BvhPrimitives
 {
@@ -41,6 +43,46 @@ layout(std430, set = 0, binding = g_BvhLeafData_bind) buffer BvhLeafData
 };
 
 // Geometry data
+#if COMPRESSED_VERTEX_STREAMS
+layout(std430, set = 1, binding = 0) buffer GeometryData_Position
+{
+	uvec2 g_positionData[];
+};
+layout(std430, set = 1, binding = 1) buffer GeometryData_Normal
+{
+	uint g_normalData[];
+};
+layout(std430, set = 1, binding = 2) buffer GeometryData_TexCoord
+{
+	uint g_texCoordData[];
+};
+layout(std430, set = 1, binding = 3) buffer GeometryData_VertexBlocks
+{
+	VertexBlockHeader g_vertexBlockData[];
+};
+
+vec3 loadPosition(uint _index)
+{
+	uvec2 packedPos = g_positionData[_index];
+	uvec3 q = uvec3(packedPos.x & VERTEX_POSITION_MASK, (packedPos.x >> VERTEX_POSITION_BITS) | ((packedPos.y & 0x3FF) << 11), packedPos.y >> 10);
+	vec4 header = g_vertexBlockData[_index >> VERTEX_BLOCK_SHIFT].origin_scale;
+	return header.xyz + vec3(q) * header.w;
+}
+
+vec3 loadNormal(uint _index)
+{
+	vec2 e = unpackSnorm2x16(g_normalData[_index]);
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0 ? 1.0 : -1.0, n.y >= 0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+vec2 loadUv(uint _index)
+{
+	return g_vertexBlockData[_index >> VERTEX_BLOCK_SHIFT].uvOffset.xy + unpackHalf2x16(g_texCoordData[_index]);
+}
+#else
 layout(std430, set = 1, binding = 0) buffer GeometryData_Position
 {
 	float g_positionData[];
@@ -54,29 +96,86 @@ layout(std430, set = 1, binding = 2) buffer GeometryData_TexCoord
 	float g_texCoordData[];
 };
 
+vec3 loadPosition(uint _index)
+{
+	return vec3(g_positionData[_index * 3], g_positionData[_index * 3 + 1], g_positionData[_index * 3 + 2]);
+}
+
+vec3 loadNormal(uint _index)
+{
+	return vec3(g_normalData[_index * 3], g_normalData[_index * 3 + 1], g_normalData[_index * 3 + 2]);
+}
+
+vec2 loadUv(uint _index)
+{
+	return vec2(g_texCoordData[_index * 2], g_texCoordData[_index * 2 + 1]);
+}
+#endif
+
 void loadTriangleVertices(out vec3 p0, out vec3 p1, out vec3 p2, uint index0, uint index1, uint index2)
 {
-	p0 = vec3(g_positionData[index0 * 3], g_positionData[index0 * 3 + 1], g_positionData[index0 * 3 + 2]);
-	p1 = vec3(g_positionData[index1 * 3], g_positionData[index1 * 3 + 1], g_positionData[index1 * 3 + 2]);
-	p2 = vec3(g_positionData[index2 * 3], g_positionData[index2 * 3 + 1], g_positionData[index2 * 3 + 2]);
+	p0 = loadPosition(index0);
+	p1 = loadPosition(index1);
+	p2 = loadPosition(index2);
 }
 
 void loadNormalVertices(out vec3 n0, out vec3 n1, out vec3 n2, uint index0, uint index1, uint index2)
 {
-	n0 = vec3(g_normalData[index0 * 3], g_normalData[index0 * 3 + 1], g_normalData[index0 * 3 + 2]);
-	n1 = vec3(g_normalData[index1 * 3], g_normalData[index1 * 3 + 1], g_normalData[index1 * 3 + 2]);
-	n2 = vec3(g_normalData[index2 * 3], g_normalData[index2 * 3 + 1], g_normalData[index2 * 3 + 2]);
+	n0 = loadNormal(index0);
+	n1 = loadNormal(index1);
+	n2 = loadNormal(index2);
 }
 
 void loadUvVertices(out vec2 uv0, out vec2 uv1, out vec2 uv2, uint index0, uint index1, uint index2)
 {
-	uv0 = vec2(g_texCoordData[index0 * 2], g_texCoordData[index0 * 2 + 1]);
-	uv1 = vec2(g_texCoordData[index1 * 2], g_texCoordData[index1 * 2 + 1]);
-	uv2 = vec2(g_texCoordData[index2 * 2], g_texCoordData[index2 * 2 + 1]);
+	uv0 = loadUv(index0);
+	uv1 = loadUv(index1);
+	uv2 = loadUv(index2);
 }
 
 layout(set = 0, binding = g_dataTextures_bind) uniform sampler2D g_dataTextures[TEXTURE_ARRAY_SIZE];
 
+// Virtual texture pool
+layout(set = 0, binding = g_vtAtlases_bind) uniform sampler2D g_vtAtlases[VT_NUM_ATLASES];
+
+layout(std430, set = 0, binding = g_vtPageTable_bind) buffer VtPageTable
+{
+	uint g_vtPageTable[];
+};
+
+layout(std430, set = 0, binding = g_vtTextureInfo_bind) buffer VtTextureInfo
+{
+	VirtualTextureInfo g_vtTextureInfo[];
+};
+
+vec4 sampleVirtualTexture(uint _vtId, vec2 _uv)
+{
+	uvec4 info = g_vtTextureInfo[_vtId].data;
+	if (info.w == 0)
+		return vec4(1, 1, 1, 1);
+
+	uvec2 numPages = uvec2(info.w & 0xFFFF, info.w >> 16);
+	vec2 uv = fract(_uv);
+	uvec2 page = min(uvec2(uv * vec2(info.yz)) / VT_PAGE_SIZE, numPages - 1);
+
+	uint entry = g_vtPageTable[info.x + page.y * numPages.x + page.x];
+	if (entry == VT_INVALID_ENTRY)
+		return vec4(1, 1, 1, 1);
+
+	uint physicalPage = entry & VT_ENTRY_PAGE_MASK;
+	uint atlas = (entry >> VT_ENTRY_ATLAS_SHIFT) & 0xFF;
+	uint mip = entry >> VT_ENTRY_MIP_SHIFT;
+
+	vec2 mipSize = vec2(max(info.yz >> mip, uvec2(1, 1)));
+	vec2 texel = uv * mipSize;
+	vec2 inPage = texel - floor(texel / VT_PAGE_SIZE) * VT_PAGE_SIZE;
+
+	uvec2 slot = uvec2(physicalPage % VT_ATLAS_PAGES_PER_SIDE, physicalPage / VT_ATLAS_PAGES_PER_SIDE);
+	vec2 atlasTexel = vec2(slot * VT_PAGE_SLOT_SIZE + VT_PAGE_BORDER) + inPage;
+
+	return textureLod(g_vtAtlases[nonuniformEXT(atlas)], atlasTexel / VT_ATLAS_SIZE, 0);
+}
+
 // CLosest hit shared memory interface
 #if USE_SHARED_MEM
 shared uvec4 g_hitData[NUM_THREADS_PER_GROUP];
@@ -21,5 +21,8 @@
 #define g_inputBuffer_bind 14
 #define g_dataTextures_bind 15
 #define g_lpfTextures_bind 16
+#define g_vtAtlases_bind 17
+#define g_vtPageTable_bind 18
+#define g_vtTextureInfo_bind 19
 
 #endif
\ No newline at end of file
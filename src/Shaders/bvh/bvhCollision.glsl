@@ -284,6 +284,17 @@ bool bvh_collide_fast(uint _nid, Ray _ray, float tmax)
 }
 
 #ifdef USE_TRAVERSE_TLAS
+// Root of the coarsest level whose error is tolerated at the distance the ray enters the blas
+uint selectBlasLodRoot(uint _blasIndex, float _distance, float _errorPerDistance)
+{
+	float maxError = _distance * _errorPerDistance;
+	uint lod = 0;
+	for (uint i = 1; i < BLAS_LOD_COUNT; ++i)
+		lod = g_blasHeader[_blasIndex].lodError[i] <= maxError ? i : lod;
+
+	return g_blasHeader[_blasIndex].lodRootIndex[lod];
+}
+
 uint tlas_collide(uint _nid, Ray _ray, inout ClosestHit closestHit)
 {
 	_nid = _nid & NID_MASK;
@@ -302,13 +313,12 @@ uint tlas_collide(uint _nid, Ray _ray, inout ClosestHit closestHit)
 	{
 		uint blasIndex = g_BvhLeafData[1 + leafDataOffset + triangleOffset + i];
 	
-		Hit hit;
 		Box box = { g_blasHeader[blasIndex].minExtent, g_blasHeader[blasIndex].maxExtent };
-		if (HitBox(_ray, box, closestHit.t, hit))
+		float t = CollideBox(_ray, box, closestHit.t, true);
+		if (t >= 0)
 		{
-			uint prevNid = closestHit.nid;
-			numTraversal += traverseBvh(_ray, g_blasHeader[blasIndex].rootIndex, closestHit);
-				
+			uint rootIndex = selectBlasLodRoot(blasIndex, t, g_Constants.lodErrorPerDistance);
+			numTraversal += traverseBvh(_ray, rootIndex, closestHit);
 		}
 	}
 
@@ -337,9 +347,11 @@ bool tlas_collide_fast(uint _nid, Ray _ray, float tmax)
 		uint blasIndex = g_BvhLeafData[1 + leafDataOffset + triangleOffset + i];
 	
 		Box box = { g_blasHeader[blasIndex].minExtent, g_blasHeader[blasIndex].maxExtent };	
-		if (CollideBox(_ray, box, tmax, true) > 0)
+		float t = CollideBox(_ray, box, tmax, true);
+		if (t > 0)
 		{
-			if(traverseBvhFast(_ray, g_blasHeader[blasIndex].rootIndex, tmax))
+			uint rootIndex = selectBlasLodRoot(blasIndex, t, g_Constants.lodErrorPerDistance * LOD_SHADOW_ERROR_FACTOR);
+			if(traverseBvhFast(_ray, rootIndex, tmax))
 				return true;
 		}
 	}
@@ -48,7 +48,12 @@ vec3 computeLighting(uint _rootId, in SunDirColor _sun, in LightProbFieldHeader
 #elif DYNAMIC_TEXTURE_INDEXING
 	uint diffuseMap = g_BvhMaterialData[_matId].type_ids.y & 0xFFFF;
 	if (diffuseMap < 0xFFFF)
-		texColor *= texture(g_dataTextures[nonuniformEXT(diffuseMap)], _uv).xyz;
+	{
+		if ((diffuseMap & VT_TEXTURE_BIT) != 0)
+			texColor *= sampleVirtualTexture(diffuseMap & VT_TEXTURE_ID_MASK, _uv).xyz;
+		else
+			texColor *= texture(g_dataTextures[nonuniformEXT(diffuseMap)], _uv).xyz;
+	}
 #endif
 
 	//uint leafDataOffset = g_BvhNodeData[_hit.nid].nid.w;
@@ -1,6 +1,7 @@
 #ifndef H_PRIMITIVE_FXH_
 #define H_PRIMITIVE_FXH_
 
+#define Primitive_Removed	0 // tombstone left by an incremental removal, skipped by the shaders
 #define Primitive_Sphere	1
 #define Primitive_AABB		2
 #define Primitive_OBB		3
@@ -25,6 +26,9 @@
 #define LightBitMask		((1u << LightBitCount) - 1)
 #define BlasBitMask			((1u << BlasBitCount) - 1)
 
+// Level 0 is the full resolution blas
+#define BLAS_LOD_COUNT 4
+
 struct Ray
 {
     vec3 from;
@@ -91,6 +95,8 @@ struct BlasHeader
 	uint matId;
 	vec3 maxExtent;
 	uint rootIndex; // Node index in PackedBVHNode list
+	uvec4 lodRootIndex; // x is rootIndex, the coarsest level is repeated when the blas has fewer levels
+	vec4 lodError; // world space error of each level
 };
 
 struct SphereLight
@@ -0,0 +1,23 @@
+#ifndef H_VERTEXCOMPRESSION_CPP_FXH_
+#define H_VERTEXCOMPRESSION_CPP_FXH_
+
+// 0 : vec3 positions, vec3 normals, vec2 uvs (32 bytes per vertex)
+// 1 : quantized positions, octahedral normals, half uvs (16 bytes per vertex)
+#define COMPRESSED_VERTEX_STREAMS 1
+
+// Positions are quantized relative to their vertex range (21 bits per axis packed in an uvec2). Ranges are aligned on blocks of
+// VERTEX_BLOCK_SIZE vertices holding a copy of the range header so it is found from the vertex index.
+#define VERTEX_BLOCK_SHIFT		8
+#define VERTEX_BLOCK_SIZE		(1u << VERTEX_BLOCK_SHIFT)
+#define VERTEX_POSITION_BITS	21
+#define VERTEX_POSITION_MASK	((1u << VERTEX_POSITION_BITS) - 1)
+
+// position = origin_scale.xyz + quantized * origin_scale.w, the scale is a power of 2 so the decoding is exact
+// uv = uvOffset.xy + half uv, the offset is the integer floor of the block uvs so tiled uvs keep the half precision near 0
+struct VertexBlockHeader
+{
+	vec4 origin_scale;
+	vec4 uvOffset;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef H_VIRTUALTEXTURE_CPP_FXH_
+#define H_VIRTUALTEXTURE_CPP_FXH_
+
+// Material texture ids with this bit set index the virtual texture pool instead of g_dataTextures
+#define VT_TEXTURE_BIT			0x8000
+#define VT_TEXTURE_ID_MASK		0x7FFF
+
+#define VT_PAGE_SIZE			128
+#define VT_PAGE_BORDER			4
+#define VT_PAGE_SLOT_SIZE		(VT_PAGE_SIZE + 2 * VT_PAGE_BORDER)
+#define VT_ATLAS_PAGES_PER_SIDE	30
+#define VT_ATLAS_SIZE			(VT_PAGE_SLOT_SIZE * VT_ATLAS_PAGES_PER_SIDE)
+
+// One physical atlas per format
+#define VT_ATLAS_RGBA8			0
+#define VT_ATLAS_BC1			1
+#define VT_ATLAS_BC7			2
+#define VT_NUM_ATLASES			3
+
+// Page table entry : physical page (16 bits) | atlas (8 bits) | mip (8 bits)
+#define VT_INVALID_ENTRY		0xFFFFFFFF
+#define VT_ENTRY_PAGE_MASK		0xFFFF
+#define VT_ENTRY_ATLAS_SHIFT	16
+#define VT_ENTRY_MIP_SHIFT		24
+
+// x : offset in the page table, y : width, z : height, w : number of pages in x (16 bits) | y (16 bits) of mip 0
+// The page table has one entry per page of mip 0, pointing to the finest resident mip covering it.
+struct VirtualTextureInfo
+{
+	uvec4 data;
+};
+
+#endif
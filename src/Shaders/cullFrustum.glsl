@@ -23,6 +23,8 @@ bool primitiveFrustumCollision(uint objIndex, in vec4 _plans[4])
 		case Primitive_AABB: 
 		return boxFrustum4Collision(loadBox(objIndex), _plans);
 
+		// Primitive_Removed and the reserved slots never collide
+
 		//case Primitive_Triangle: 
 		//vec3 p0, p1, p2;
 		//loadTriangleVertices(p0, p1, p2, loadTriangle(objIndex));
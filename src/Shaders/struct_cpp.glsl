@@ -3,10 +3,17 @@
 
 #define LOCAL_SIZE 16
 #define TMAX 100
-#define TEXTURE_ARRAY_SIZE 64
+// Uncooked textures only (BRDF LUT), cooked ones live in the virtual texture pool. Every slot gets a descriptor, a fallback image when unused, so the array is kept small
+#define TEXTURE_ARRAY_SIZE 8
 
 #define g_TextureBrdf 0
 
+// Blas LOD selection, a level is traced when its error is below the distance to the blas times the tolerance of the ray class
+#define LOD_PRIMARY_PIXEL_ERROR 1.0			// pixels
+#define LOD_BOUNCE_ERROR_FACTOR 8.0			// relative to the primary rays
+#define LOD_SHADOW_ERROR_FACTOR 4.0			// relative to the rays of the pass
+#define LOD_PROBE_ERROR_PER_DISTANCE 0.05
+
 struct PassData
 {
 	uvec2 frameSize;
@@ -34,6 +41,7 @@ struct PushConstants
 	uint numPrimitives;
 	uint numLights;
 	uint numNodes;
+	float lodErrorPerDistance;
 };
 
 struct IndirectLightRay
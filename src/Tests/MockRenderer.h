@@ -0,0 +1,162 @@
+#pragma once
+#include "rtDevice/public/IRenderer.h"
+#include "rtDevice/public/IRenderContext.h"
+#include "timCore/Profiler.h"
+
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+namespace tim
+{
+    // Headless IRenderContext, nothing is recorded and the scopes are timed by the CPU fallback of ContextScopeTracker
+    class MockRenderContext : public IRenderContext
+    {
+    public:
+        MockRenderContext(const u64& _frame) : m_frame{ _frame } {}
+
+        void BeginRender() override { m_scopes.beginFrame(u32(m_frame % TIM_FRAME_LATENCY), nullptr, 0); }
+        void EndRender() override { m_scopes.endFrame(); }
+
+        void ClearBuffer(BufferHandle, u32) override {}
+        void ClearImage(ImageHandle, const Color&) override {}
+        void ClearImage(ImageHandle, const ColorInteger&) override {}
+
+        void Dispatch(const DrawArguments&, u32, u32, u32) override { m_stats.numDispatches++; }
+
+        const RenderContextStats& GetStats() const override { return m_stats; }
+        void ResetStats() override { m_stats = {}; }
+
+        void BeginScope(const char* _name) override { m_scopes.beginScope(_name); }
+        void EndScope() override { m_scopes.endScope(); }
+
+        u32 getNumOpenScopes() const { return m_scopes.getNumOpenScopes(); }
+
+    private:
+        const u64& m_frame;
+        ContextScopeTracker m_scopes{ false, 0 };
+        RenderContextStats m_stats;
+    };
+
+    // Headless IRenderer for the tests : resources are fake handles and the calls are recorded for the checks
+    class MockRenderer : public IRenderer
+    {
+    public:
+        struct Stats
+        {
+            u32 numCreatedBuffers = 0;
+            u32 numDestroyedBuffers = 0;
+            u32 numCreatedImages = 0;
+            u32 numDestroyedImages = 0;
+            u32 numWaitForIdle = 0;
+            u32 numInvalidDestroys = 0; // destruction of a handle which isn't alive
+        };
+
+        struct ImageUpload
+        {
+            ImageHandle image;
+            u32 mip;
+            uvec2 offset;
+            uvec2 extent;
+        };
+
+        void Init(ShaderCompiler&, void*, u32, u32, bool) override {}
+        void Deinit() override {}
+        void Resize(u32, u32) override {}
+        void InvalidateShaders() override {}
+
+        void WaitForIdle() override { m_stats.numWaitForIdle++; }
+        void BeginFrame() override
+        {
+            m_frame++;
+            m_dynamicBuffers.clear();
+            m_imageUploads.clear();
+        }
+        void EndFrame() override {}
+        void Execute(IRenderContext*) override {}
+        void Present() override {}
+
+        ImageHandle GetBackBuffer() const override { return {}; }
+
+        BufferHandle CreateBuffer(u32, MemoryType, BufferUsage, MemoryTag) override
+        {
+            m_stats.numCreatedBuffers++;
+            return { createHandle() };
+        }
+
+        void DestroyBuffer(BufferHandle& _buffer) override
+        {
+            m_stats.numDestroyedBuffers++;
+            destroyHandle(_buffer.ptr);
+            _buffer = {};
+        }
+
+        void UploadBuffer(BufferHandle, void*, u32) override {}
+        void UploadBuffer(BufferHandle, u32, void*, u32) override {}
+
+        void UploadImage(ImageHandle, void*, u32, u32) override {}
+        void UploadImageRegion(ImageHandle _handle, void*, u32, u32 _mipIndex, uvec2 _offset, uvec2 _extent) override
+        {
+            m_imageUploads.push_back({ _handle, _mipIndex, _offset, _extent });
+        }
+
+        ubyte* GetDynamicBuffer(u32 _size, BufferView& _buffer) override
+        {
+            m_dynamicBuffers.emplace_back(_size);
+            _buffer = { { reinterpret_cast<void*>(uintptr_t(++m_lastHandle)) }, 0, _size };
+            return m_dynamicBuffers.back().data();
+        }
+
+        ImageHandle CreateImage(const ImageCreateInfo&, MemoryTag) override
+        {
+            m_stats.numCreatedImages++;
+            return { createHandle() };
+        }
+
+        void DestroyImage(ImageHandle& _image) override
+        {
+            m_stats.numDestroyedImages++;
+            destroyHandle(_image.ptr);
+            _image = {};
+        }
+
+        IRenderContext* CreateRenderContext(RenderContextType, u32) override
+        {
+            m_contexts.push_back(std::make_unique<MockRenderContext>(m_frame));
+            return m_contexts.back().get();
+        }
+
+        const Stats& getStats() const { return m_stats; }
+        u32 getNumLiveResources() const { return u32(m_liveHandles.size()); }
+        bool isAlive(const void* _handle) const { return m_liveHandles.count(const_cast<void*>(_handle)) > 0; }
+        u64 getFrame() const { return m_frame; }
+
+        // Calls of the current frame, reset by BeginFrame
+        const std::deque<std::vector<ubyte>>& getDynamicBuffers() const { return m_dynamicBuffers; }
+        const std::vector<ImageUpload>& getImageUploads() const { return m_imageUploads; }
+
+    private:
+        void* createHandle()
+        {
+            void* handle = reinterpret_cast<void*>(uintptr_t(++m_lastHandle));
+            m_liveHandles.insert(handle);
+            return handle;
+        }
+
+        void destroyHandle(void* _handle)
+        {
+            if (m_liveHandles.erase(_handle) == 0)
+                m_stats.numInvalidDestroys++;
+        }
+
+    private:
+        Stats m_stats;
+        u64 m_frame = 0;
+        u64 m_lastHandle = 0;
+        std::unordered_set<void*> m_liveHandles;
+        std::deque<std::vector<ubyte>> m_dynamicBuffers;
+        std::vector<ImageUpload> m_imageUploads;
+        std::vector<std::unique_ptr<MockRenderContext>> m_contexts;
+    };
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "timCore/type.h"
+
+namespace tim
+{
+    using TestFunc = void(*)();
+
+    // Registers a test at static initialization, run by the main of the Tests executable
+    struct TestRegistrar
+    {
+        TestRegistrar(const char* _name, TestFunc _func);
+    };
+
+    void reportTestFailure(const char* _expr, const char* _file, int _line);
+}
+
+#define TIM_TEST(name) \
+    static void name(); \
+    static ::tim::TestRegistrar s_register_##name(#name, &name); \
+    static void name()
+
+// Unlike TIM_ASSERT, checks are active in every configuration and keep the test running
+#define TIM_CHECK(cond) \
+    do { if (!(cond)) ::tim::reportTestFailure(#cond, __FILE__, __LINE__); } while (0)
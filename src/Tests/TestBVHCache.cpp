@@ -0,0 +1,136 @@
+#include "Test.h"
+#include "MockRenderer.h"
+#include "Renderer/BVHBuilder.h"
+#include "Renderer/BVHGeometry.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace tim
+{
+    namespace
+    {
+        u32 addGrid(BVHGeometry& _geometry, u32 _size, float _bumpHeight = 0)
+        {
+            std::vector<vec3> positions, normals;
+            for (u32 i = 0; i < _size * _size; ++i)
+            {
+                positions.push_back(vec3(float(i % _size), _bumpHeight * std::sin((i % _size) * 0.5f) * std::cos((i / _size) * 0.4f), float(i / _size)));
+                normals.push_back({ 0, 1, 0 });
+            }
+            return _geometry.addTriangleList(_size * _size, positions.data(), normals.data());
+        }
+
+        std::unique_ptr<BVHBuilder> createBlas(const BVHGeometry& _geometry, u32 _vertexOffset, u32 _size)
+        {
+            std::vector<u32> indices;
+            for (u32 y = 0; y + 1 < _size; ++y)
+            {
+                for (u32 x = 0; x + 1 < _size; ++x)
+                {
+                    const u32 i = y * _size + x;
+                    indices.insert(indices.end(), { i, i + 1, i + _size, i + 1, i + _size + 1, i + _size });
+                }
+            }
+
+            std::unique_ptr<BVHBuilder> blas = std::make_unique<BVHBuilder>("blas", _geometry, false);
+            blas->addTriangleList(_vertexOffset, u32(indices.size() / 3), indices.data());
+            return blas;
+        }
+
+        std::vector<ubyte> packBlas(BVHBuilder& _blas)
+        {
+            std::vector<ubyte> data(_blas.getBvhGpuSize());
+            uvec2 triangleRange, primitiveRange, materialRange, lightRange, nodeRange, leafDataRange, blasRange;
+            _blas.fillGpuBuffer(data.data(), triangleRange, primitiveRange, materialRange, lightRange, nodeRange, leafDataRange, blasRange);
+            return data;
+        }
+
+        size_t countEntries(const fs::path& _folder)
+        {
+            return size_t(std::distance(fs::directory_iterator(_folder), fs::directory_iterator()));
+        }
+    }
+
+    TIM_TEST(BVHCache_EntryFollowsTheMeshInTheGeometryBuffer)
+    {
+        const fs::path folder = fs::temp_directory_path() / "tim_test_bvhcache";
+        fs::remove_all(folder);
+        fs::create_directories(folder);
+        BVHCache cache(folder.string() + "/", u64(1) << 30);
+
+        MockRenderer renderer;
+        const u32 gridSize = 16;
+
+        BVHGeometry geometry(&renderer);
+        std::unique_ptr<BVHBuilder> blas = createBlas(geometry, addGrid(geometry, gridSize), gridSize);
+        blas->build(false, &cache);
+        TIM_CHECK(countEntries(folder) == 1);
+
+        // The same mesh after another one, its vertices start further in the buffer
+        BVHGeometry movedGeometry(&renderer);
+        addGrid(movedGeometry, 5);
+        const u32 vertexOffset = addGrid(movedGeometry, gridSize);
+        TIM_CHECK(vertexOffset > 0);
+
+        std::unique_ptr<BVHBuilder> cached = createBlas(movedGeometry, vertexOffset, gridSize);
+        cached->build(false, &cache);
+        TIM_CHECK(countEntries(folder) == 1);
+
+        // The strips of the cached entry are rebased, the packed leaves match a fresh build
+        std::unique_ptr<BVHBuilder> rebuilt = createBlas(movedGeometry, vertexOffset, gridSize);
+        rebuilt->build(false);
+        TIM_CHECK(cached->getNodesCount() == rebuilt->getNodesCount());
+
+        const std::vector<ubyte> cachedData = packBlas(*cached);
+        const std::vector<ubyte> rebuiltData = packBlas(*rebuilt);
+        TIM_CHECK(cachedData.size() == rebuiltData.size() && memcmp(cachedData.data(), rebuiltData.data(), cachedData.size()) == 0);
+
+        fs::remove_all(folder);
+    }
+
+    TIM_TEST(BVHCache_LodsAreStoredWithTheBlasEntry)
+    {
+        const fs::path folder = fs::temp_directory_path() / "tim_test_bvhcache_lods";
+        fs::remove_all(folder);
+        fs::create_directories(folder);
+        BVHCache cache(folder.string() + "/", u64(1) << 30);
+
+        MockRenderer renderer;
+        const u32 gridSize = 32;
+        const BVHBuildParameters params;
+
+        BVHGeometry geometry(&renderer);
+        std::unique_ptr<BVHBuilder> blas = createBlas(geometry, addGrid(geometry, gridSize, 2.f), gridSize);
+        blas->generateLods(geometry, params, &cache);
+        blas->build(false, &cache);
+        TIM_CHECK(blas->getLodCount() > 0);
+        TIM_CHECK(countEntries(folder) == 1);
+
+        // One simplification per vertex range and level, stored after the tree
+        BVHCacheHeader header;
+        std::ifstream(fs::directory_iterator(folder)->path(), std::ios::binary).read(reinterpret_cast<char*>(&header), sizeof(header));
+        TIM_CHECK(header.numLodMeshes == BLAS_LOD_COUNT - 1);
+        TIM_CHECK(header.numLodItems > 0);
+
+        // The same blas loads its LODs and its tree from the entry
+        BVHGeometry otherGeometry(&renderer);
+        std::unique_ptr<BVHBuilder> cached = createBlas(otherGeometry, addGrid(otherGeometry, gridSize, 2.f), gridSize);
+        cached->generateLods(otherGeometry, params, &cache);
+        cached->build(false, &cache);
+        TIM_CHECK(countEntries(folder) == 1);
+
+        TIM_CHECK(cached->getLodCount() == blas->getLodCount());
+        for (u32 level = 0; level < std::min(cached->getLodCount(), blas->getLodCount()); ++level)
+        {
+            TIM_CHECK(cached->getLod(level).getTrianglesCount() == blas->getLod(level).getTrianglesCount());
+            TIM_CHECK(cached->getLodError(level) == blas->getLodError(level));
+        }
+
+        fs::remove_all(folder);
+    }
+}
@@ -0,0 +1,122 @@
+#include "Test.h"
+#include "MockRenderer.h"
+#include "Renderer/BVHData.h"
+#include "Renderer/BVHGeometry.h"
+
+#include <algorithm>
+
+namespace tim
+{
+    namespace
+    {
+        std::unique_ptr<BVHBuilder> createBlas(BVHGeometry& _geometry, vec3 _offset, u32 _gridSize)
+        {
+            std::unique_ptr<BVHBuilder> blas = std::make_unique<BVHBuilder>("blas", _geometry, false);
+            for (u32 y = 0; y < _gridSize; ++y)
+            {
+                for (u32 x = 0; x < _gridSize; ++x)
+                {
+                    const vec3 p = _offset + vec3(float(x), 0, float(y));
+                    blas->addTriangle(_geometry.addTriangle(p, p + vec3(1, 0, 0), p + vec3(0, 0, 1)));
+                    blas->addTriangle(_geometry.addTriangle(p + vec3(1, 0, 0), p + vec3(1, 0, 1), p + vec3(0, 0, 1)));
+                }
+            }
+            return blas;
+        }
+    }
+
+    TIM_TEST(BVHEdits_InsertThenRemove)
+    {
+        MockRenderer renderer;
+        BVHGeometry geometry(&renderer);
+        BVHData data(&renderer, geometry);
+
+        BVHBuilder tlas("tlas", geometry, true);
+        tlas.addBlas(createBlas(geometry, { -8, 0, -8 }, 4));
+        for (u32 i = 0; i < 32; ++i)
+            tlas.addSphere({ { float(i % 8) * 2.f, 2.f, float(i / 8) * 2.f }, 0.5f });
+        data.build(tlas, {}, {}, true);
+
+        const u32 numBuffers = renderer.getStats().numCreatedBuffers;
+        const u32 numPrimitives = tlas.getPrimitivesCount();
+        const Box queryBox = { { 2.6f, 4.6f, 2.6f }, { 3.4f, 5.4f, 3.4f } };
+        std::vector<u32> result;
+
+        // The inserted sphere goes in a reserved slot
+        const u32 sphere = tlas.insertSphere({ { 3.f, 5.f, 3.f }, 0.5f });
+        TIM_CHECK(sphere == numPrimitives);
+        TIM_CHECK(!tlas.needsRepack());
+        TIM_CHECK(!data.refit(tlas));
+        tlas.queryPrimitives(queryBox, result);
+        TIM_CHECK(result.size() == 1 && result[0] == sphere);
+
+        // The removed one is left as a tombstone, still counted but skipped by the queries and the shaders
+        tlas.removePrimitive(sphere);
+        TIM_CHECK(tlas.getPrimitivesCount() == numPrimitives + 1);
+        tlas.queryPrimitives(queryBox, result);
+        TIM_CHECK(result.empty());
+
+        BVHRefitData patches;
+        tlas.refit();
+        tlas.packRefitData(patches);
+        TIM_CHECK(patches.primitives.size() == 1);
+        TIM_CHECK(patches.primitives[0].first == sphere && patches.primitives[0].second.iparam == Primitive_Removed);
+
+        // The blas, its nodes, triangles, leaf data and materials go in the room reserved for blas
+        const u32 blasTriangles = 2 * 3 * 3;
+        const u32 instance = tlas.insertBlas(createBlas(geometry, { 2, 0, 1 }, 3), {});
+        TIM_CHECK(instance == 1);
+        TIM_CHECK(!tlas.needsRepack());
+
+        tlas.refit();
+        tlas.packRefitData(patches);
+        TIM_CHECK(patches.triangles.size() == blasTriangles);
+        TIM_CHECK(patches.blasHeaders.size() == 1 && patches.blasHeaders[0].first == instance);
+        TIM_CHECK(!patches.materials.empty());
+
+        const BlasHeader& header = patches.blasHeaders[0].second;
+        TIM_CHECK(header.minExtent.x > 1.9f && header.maxExtent.x < 5.1f);
+        TIM_CHECK(std::any_of(patches.nodes.begin(), patches.nodes.end(), [&](const auto& _node) { return _node.first == header.rootIndex; }));
+
+        // The leaves of the blas inline its triangles
+        size_t leafDataSize = 0;
+        for (const auto& [offset, leafData] : patches.leafData)
+            leafDataSize += leafData.size() * sizeof(u32);
+        TIM_CHECK(leafDataSize >= blasTriangles * sizeof(Triangle));
+
+        // Removing the instance only patches the top level tree
+        tlas.removeBlasInstance(instance);
+        TIM_CHECK(!data.refit(tlas));
+        TIM_CHECK(renderer.getStats().numCreatedBuffers == numBuffers);
+
+        // A blas bigger than the reserved room repacks the whole buffer, the tombstone stays
+        tlas.insertBlas(createBlas(geometry, { 20, 0, 20 }, 100), {});
+        TIM_CHECK(tlas.needsRepack());
+        TIM_CHECK(data.refit(tlas));
+        TIM_CHECK(renderer.getStats().numCreatedBuffers == numBuffers + 1);
+        tlas.queryPrimitives(queryBox, result);
+        TIM_CHECK(result.empty());
+    }
+
+    TIM_TEST(BVHEdits_SplitsLeavesOverThePackedCount)
+    {
+        MockRenderer renderer;
+        BVHGeometry geometry(&renderer);
+
+        // A single leaf would hold twice the triangles its packed count can address
+        const u32 gridSize = 64;
+        const u32 numTriangles = 2 * gridSize * gridSize;
+        std::unique_ptr<BVHBuilder> blas = createBlas(geometry, { 0, 0, 0 }, gridSize);
+        BVHBuildParameters params;
+        params.maxDepth = 0;
+        blas->setParameters(params);
+        blas->build(false);
+        TIM_CHECK(blas->getNodesCount() > 1);
+
+        // Every triangle is inlined in a leaf, none is dropped
+        std::vector<ubyte> data(blas->getBvhGpuSize());
+        uvec2 triangleRange, primitiveRange, materialRange, lightRange, nodeRange, leafDataRange, blasRange;
+        blas->fillGpuBuffer(data.data(), triangleRange, primitiveRange, materialRange, lightRange, nodeRange, leafDataRange, blasRange);
+        TIM_CHECK(leafDataRange.y >= numTriangles * sizeof(Triangle));
+    }
+}
@@ -0,0 +1,90 @@
+#include "Test.h"
+#include "MockRenderer.h"
+#include "Renderer/BVHGeometry.h"
+
+#include <cstring>
+
+namespace tim
+{
+    namespace
+    {
+        u32 addGrid(BVHGeometry& _geometry, vec3 _origin, float _spacing, u32 _size)
+        {
+            std::vector<vec3> positions, normals;
+            for (u32 i = 0; i < _size * _size; ++i)
+            {
+                positions.push_back(_origin + vec3(float(i % _size), 0.f, float(i / _size)) * _spacing);
+                normals.push_back({ 0, 1, 0 });
+            }
+            return _geometry.addTriangleList(_size * _size, positions.data(), normals.data());
+        }
+
+        float maxPositionError(const BVHGeometry& _geometry, u32 _vertexOffset, vec3 _origin, float _spacing, u32 _size)
+        {
+            float error = 0;
+            for (u32 i = 0; i < _size * _size; ++i)
+            {
+                const vec3 expected = _origin + vec3(float(i % _size), 0.f, float(i / _size)) * _spacing;
+                error = std::max(error, linalg::length(_geometry.getVertexPosition(_vertexOffset, i) - expected));
+            }
+            return error;
+        }
+    }
+
+    TIM_TEST(BVHGeometry_RangesKeepTheirOwnQuantization)
+    {
+        MockRenderer renderer;
+        BVHGeometry geometry(&renderer);
+
+        // A millimeter sized mesh next to a kilometer sized one, the first flush creates the GPU buffer
+        const u32 large = addGrid(geometry, { -500, 0, -500 }, 100.f, 11);
+        const u32 small = addGrid(geometry, { 1, 2, 3 }, 1e-4f, 11);
+        geometry.flush(&renderer);
+
+        TIM_CHECK(maxPositionError(geometry, large, { -500, 0, -500 }, 100.f, 11) < 1e-2f);
+        TIM_CHECK(maxPositionError(geometry, small, { 1, 2, 3 }, 1e-4f, 11) < 1e-6f);
+
+        // Growing the GPU buffer uploads the other ranges again without quantizing their decoded data twice
+        std::vector<vec3> positions(geometry.getPositions(), geometry.getPositions() + geometry.getVertexCount());
+        const u32 numBuffers = renderer.getStats().numCreatedBuffers;
+        geometry.freeVertices(large);
+        addGrid(geometry, { 0, 0, 0 }, 1.f, 40);
+        geometry.flush(&renderer);
+
+        TIM_CHECK(renderer.getStats().numCreatedBuffers == numBuffers + 1);
+        TIM_CHECK(memcmp(geometry.getPositions() + small, positions.data() + small, 11 * 11 * sizeof(vec3)) == 0);
+    }
+
+    TIM_TEST(BVHGeometry_RestoredStreamsMatchTheSavedOnes)
+    {
+        MockRenderer renderer;
+        BVHGeometry geometry(&renderer);
+
+        const u32 first = addGrid(geometry, { -500, 0, -500 }, 100.f, 11);
+        const u32 hole = addGrid(geometry, { 0, 0, 0 }, 1.f, 4);
+        const u32 last = addGrid(geometry, { 1, 2, 3 }, 1e-4f, 11);
+        geometry.freeVertices(hole);
+        geometry.flush(&renderer);
+
+        std::vector<uvec2> ranges;
+        geometry.getRanges(ranges);
+        const BVHGeometry::GpuStreams streams = geometry.getGpuStreams();
+
+        BVHGeometry restored(&renderer);
+        restored.restoreGpuStreams(streams, ranges.data(), u32(ranges.size()));
+        restored.flush(&renderer);
+
+        // Same ranges and the same bytes, the decoded vertices are not quantized a second time
+        std::vector<uvec2> restoredRanges;
+        restored.getRanges(restoredRanges);
+        TIM_CHECK(restoredRanges == ranges);
+
+        const BVHGeometry::GpuStreams restoredStreams = restored.getGpuStreams();
+        TIM_CHECK(restoredStreams.numVertex == streams.numVertex && restoredStreams.positionsSize == streams.positionsSize && restoredStreams.blocksSize == streams.blocksSize);
+        TIM_CHECK(memcmp(restoredStreams.positions, streams.positions, streams.positionsSize) == 0);
+        TIM_CHECK(memcmp(restoredStreams.blocks, streams.blocks, streams.blocksSize) == 0);
+
+        for (u32 offset : { first, last })
+            TIM_CHECK(memcmp(restored.getPositions() + offset, geometry.getPositions() + offset, geometry.getRangeSize(offset) * sizeof(vec3)) == 0);
+    }
+}
@@ -0,0 +1,97 @@
+#include "Test.h"
+#include "MockRenderer.h"
+#include "Renderer/BVHData.h"
+#include "Renderer/BVHGeometry.h"
+
+#include <random>
+
+namespace tim
+{
+    namespace
+    {
+        std::vector<u32> queryBruteForce(const std::vector<Sphere>& _spheres, const Box& _box)
+        {
+            std::vector<u32> result;
+            for (u32 i = 0; i < _spheres.size(); ++i)
+            {
+                const vec3 closest = linalg::clamp(_spheres[i].center, _box.minExtent, _box.maxExtent);
+                if (linalg::length2(closest - _spheres[i].center) < _spheres[i].radius * _spheres[i].radius)
+                    result.push_back(i);
+            }
+            return result;
+        }
+
+        Box randomBox(std::mt19937& _rng)
+        {
+            std::uniform_real_distribution<float> position(-12.f, 12.f), size(0.1f, 3.f);
+            const vec3 minExtent = { position(_rng), position(_rng), position(_rng) };
+            return { minExtent, minExtent + vec3(size(_rng), size(_rng), size(_rng)) };
+        }
+    }
+
+    TIM_TEST(BVHRefit_MatchesRebuild)
+    {
+        MockRenderer renderer;
+        BVHGeometry geometry(&renderer);
+        BVHData data(&renderer, geometry);
+
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> position(-10.f, 10.f), radius(0.2f, 1.f), offset(-2.f, 2.f);
+
+        std::vector<Sphere> spheres(200);
+        BVHBuilder refitted("refit", geometry, false);
+        for (Sphere& sphere : spheres)
+        {
+            sphere = { { position(rng), position(rng), position(rng) }, radius(rng) };
+            refitted.addSphere(sphere);
+        }
+        data.build(refitted, {}, {}, false);
+        const u32 numBuffers = renderer.getStats().numCreatedBuffers;
+
+        // A few frames of moving spheres, patched in place
+        for (u32 frame = 0; frame < 3; ++frame)
+        {
+            for (u32 i = frame; i < spheres.size(); i += 7)
+            {
+                spheres[i].center += vec3(offset(rng), offset(rng), offset(rng));
+                refitted.updatePrimitive(i, spheres[i]);
+            }
+            TIM_CHECK(!data.refit(refitted));
+        }
+        TIM_CHECK(renderer.getStats().numCreatedBuffers == numBuffers);
+        TIM_CHECK(refitted.getRefitCostRatio() >= 1.f);
+
+        BVHBuilder rebuilt("rebuild", geometry, false);
+        for (const Sphere& sphere : spheres)
+            rebuilt.addSphere(sphere);
+        rebuilt.build(false);
+
+        std::vector<u32> refitResult, rebuildResult;
+        u32 numMismatches = 0, numHits = 0;
+        for (u32 i = 0; i < 500; ++i)
+        {
+            const Box box = randomBox(rng);
+            refitted.queryPrimitives(box, refitResult);
+            rebuilt.queryPrimitives(box, rebuildResult);
+
+            const std::vector<u32> expected = queryBruteForce(spheres, box);
+            numMismatches += refitResult != expected || rebuildResult != expected ? 1 : 0;
+            numHits += u32(expected.size());
+        }
+
+        TIM_CHECK(numHits > 0);
+        TIM_CHECK(numMismatches == 0);
+
+        // Scattering every sphere makes the refit tree too slow, the rebuild replaces the buffer once the GPU is idle
+        for (u32 i = 0; i < spheres.size(); ++i)
+        {
+            spheres[i].center = { position(rng), position(rng), position(rng) };
+            refitted.updatePrimitive(i, spheres[i]);
+        }
+
+        const u32 numWaitForIdle = renderer.getStats().numWaitForIdle;
+        TIM_CHECK(data.refit(refitted));
+        TIM_CHECK(renderer.getStats().numWaitForIdle > numWaitForIdle);
+        TIM_CHECK(renderer.getStats().numInvalidDestroys == 0);
+    }
+}
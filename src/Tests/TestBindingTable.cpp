@@ -0,0 +1,61 @@
+#include "Test.h"
+#include "rtDevice/public/IRenderContext.h"
+
+namespace tim
+{
+    namespace
+    {
+        BufferBinding bufferBinding(u16 _set, u16 _slot, uintptr_t _handle)
+        {
+            return { { { reinterpret_cast<void*>(_handle) }, 0, 256 }, { _set, _slot } };
+        }
+    }
+
+    TIM_TEST(BindingTable_SkipsTablesStillBound)
+    {
+        const BindingTable scene({ bufferBinding(0, 1, 1), bufferBinding(0, 2, 2) }, {});
+        const BindingTable textures({ bufferBinding(0, 8, 3) }, {});
+
+        BoundBindingTables bound;
+        TIM_CHECK(bound.bind(scene));
+        TIM_CHECK(bound.bind(textures));
+        TIM_CHECK(!bound.bind(scene) && !bound.bind(textures));
+
+        // A dynamic binding in a slot of the scene table only forgets that table
+        bound.invalidate({ 0, 2 });
+        TIM_CHECK(bound.bind(scene));
+        TIM_CHECK(!bound.bind(textures));
+
+        // A slot outside of the tables keeps them
+        bound.invalidate({ 1, 2 });
+        TIM_CHECK(!bound.bind(scene) && !bound.bind(textures));
+
+        bound.clear();
+        TIM_CHECK(bound.bind(scene));
+    }
+
+    TIM_TEST(BindingTable_RebindsOverriddenAndRebuiltTables)
+    {
+        const BindingTable scene({ bufferBinding(0, 1, 1), bufferBinding(0, 2, 2) }, {});
+        const BindingTable other({ bufferBinding(0, 2, 4) }, {});
+        BindingTable textures({ bufferBinding(0, 8, 3) }, {});
+
+        BoundBindingTables bound;
+        bound.bind(scene);
+        bound.bind(textures);
+
+        // Sharing a slot, the other table overrides the scene one
+        TIM_CHECK(bound.bind(other));
+        TIM_CHECK(bound.bind(scene));
+        TIM_CHECK(bound.bind(other));
+
+        // Rebuilding a table in place changes its hash, the same pointer is bound again
+        textures = BindingTable({ bufferBinding(0, 8, 5) }, {});
+        TIM_CHECK(bound.bind(textures));
+        TIM_CHECK(!bound.bind(textures));
+
+        // Same content, same hash
+        textures = BindingTable({ bufferBinding(0, 8, 5) }, {});
+        TIM_CHECK(!bound.bind(textures));
+    }
+}
@@ -0,0 +1,96 @@
+#include "Test.h"
+#include "MockRenderer.h"
+#include "Renderer/FrameGraph.h"
+
+#include <string>
+
+namespace tim
+{
+    TIM_TEST(FrameGraph_CullsPassesWithUnusedOutputs)
+    {
+        MockRenderer renderer;
+        ResourceAllocator allocator(&renderer);
+        BufferHandle output = renderer.CreateBuffer(1024, MemoryType::Default, BufferUsage::Storage, MemoryTag::Untracked);
+
+        std::string executed;
+        FrameGraph graph(allocator);
+        const FrameResource imported = graph.importBuffer("output", output, 1024);
+
+        FrameResource a = 0, b = 0;
+        graph.addPass("A", [&](FrameGraph::PassBuilder& _builder) { a = _builder.createBuffer("a", 1024, BufferUsage::Storage); },
+                      [&](const FrameGraph&) { executed += "A"; });
+        // B and C only feed each other, nothing reads the output of C
+        graph.addPass("B", [&](FrameGraph::PassBuilder& _builder) { _builder.read(a); b = _builder.createBuffer("b", 1024, BufferUsage::Storage); },
+                      [&](const FrameGraph&) { executed += "B"; });
+        graph.addPass("C", [&](FrameGraph::PassBuilder& _builder) { _builder.read(b); _builder.createBuffer("c", 1024, BufferUsage::Storage); },
+                      [&](const FrameGraph&) { executed += "C"; });
+        graph.addPass("D", [&](FrameGraph::PassBuilder& _builder) { _builder.read(a); _builder.write(imported); },
+                      [&](const FrameGraph&) { executed += "D"; });
+        graph.addPass("E", [&](FrameGraph::PassBuilder& _builder) { _builder.setSideEffect(); },
+                      [&](const FrameGraph&) { executed += "E"; });
+
+        graph.compile();
+        const FrameGraphMemoryReport& report = graph.getMemoryReport();
+        TIM_CHECK(report.numPasses == 5 && report.numCulledPasses == 2);
+        TIM_CHECK(report.numTransients == 1 && report.numPhysicalResources == 1);
+
+        graph.execute();
+        TIM_CHECK(executed == "ADE");
+        TIM_CHECK(allocator.getStats().liveBytes == 0);
+
+        allocator.clear();
+        renderer.DestroyBuffer(output);
+        TIM_CHECK(renderer.getNumLiveResources() == 0);
+    }
+
+    TIM_TEST(FrameGraph_AliasesDisjointLifetimes)
+    {
+        MockRenderer renderer;
+        ResourceAllocator allocator(&renderer);
+        BufferHandle output = renderer.CreateBuffer(4096, MemoryType::Default, BufferUsage::Storage, MemoryTag::Untracked);
+
+        // A chain of transients, each one only lives during the pass writing it and the next one
+        FrameGraph graph(allocator);
+        const FrameResource imported = graph.importBuffer("output", output, 4096);
+
+        const u32 numTransients = 4;
+        FrameResource transients[numTransients] = {};
+        void* ptrs[numTransients] = {};
+        for (u32 i = 0; i < numTransients; ++i)
+        {
+            graph.addPass("chain",
+                [&, i](FrameGraph::PassBuilder& _builder)
+                {
+                    if (i > 0)
+                        _builder.read(transients[i - 1]);
+                    transients[i] = _builder.createBuffer("transient", 3000, BufferUsage::Storage);
+                },
+                [&, i](const FrameGraph& _graph)
+                {
+                    if (i > 0)
+                        TIM_CHECK(_graph.getBuffer(transients[i - 1]).ptr == ptrs[i - 1]);
+                    ptrs[i] = _graph.getBuffer(transients[i]).ptr;
+                });
+        }
+        graph.addPass("resolve", [&](FrameGraph::PassBuilder& _builder) { _builder.read(transients[numTransients - 1]); _builder.write(imported); },
+                      [&](const FrameGraph& _graph) { TIM_CHECK(_graph.getBuffer(imported).ptr == output.ptr); });
+
+        graph.compile();
+        const FrameGraphMemoryReport& report = graph.getMemoryReport();
+        TIM_CHECK(report.numCulledPasses == 0);
+        TIM_CHECK(report.numTransients == numTransients && report.numPhysicalResources == 2);
+        TIM_CHECK(report.transientBytes == numTransients * 4096 && report.aliasedBytes == 2 * 4096);
+
+        // The pool replays the report: every other transient shares the same buffer
+        const u32 numBuffers = renderer.getStats().numCreatedBuffers;
+        graph.execute();
+        TIM_CHECK(renderer.getStats().numCreatedBuffers == numBuffers + report.numPhysicalResources);
+        TIM_CHECK(ptrs[0] == ptrs[2] && ptrs[1] == ptrs[3] && ptrs[0] != ptrs[1]);
+        TIM_CHECK(allocator.getStats().liveBytes == 0 && allocator.getStats().cachedBytes == report.aliasedBytes);
+
+        allocator.clear();
+        renderer.DestroyBuffer(output);
+        TIM_CHECK(renderer.getNumLiveResources() == 0);
+        TIM_CHECK(renderer.getStats().numInvalidDestroys == 0);
+    }
+}
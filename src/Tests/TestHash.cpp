@@ -0,0 +1,46 @@
+#include "Test.h"
+#include "timCore/hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace tim
+{
+    TIM_TEST(Hash128_MatchesReferenceMurmur3)
+    {
+        const char* text = "The quick brown fox jumps over the lazy dog";
+
+        u64 hash[2];
+        Hash128 hasher;
+        hasher.add(text, strlen(text));
+        hasher.get(hash);
+        TIM_CHECK(hash[0] == 0xe34bbc7bbc071b6cull && hash[1] == 0x7a433ca9c49a9347ull);
+
+        Hash128 empty;
+        empty.get(hash);
+        TIM_CHECK(hash[0] == 0 && hash[1] == 0);
+    }
+
+    TIM_TEST(Hash128_StreamingDoesNotDependOnSplit)
+    {
+        ubyte data[100];
+        for (u32 i = 0; i < 100; ++i)
+            data[i] = ubyte(i * 7 + 3);
+
+        u64 reference[2];
+        Hash128 whole;
+        whole.add(data, sizeof(data));
+        whole.get(reference);
+
+        for (u32 chunk = 1; chunk < 20; ++chunk)
+        {
+            Hash128 streamed;
+            for (u32 i = 0; i < sizeof(data); i += chunk)
+                streamed.add(data + i, std::min<size_t>(chunk, sizeof(data) - i));
+
+            u64 hash[2];
+            streamed.get(hash);
+            TIM_CHECK(hash[0] == reference[0] && hash[1] == reference[1]);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#include "Test.h"
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace tim
+{
+    namespace
+    {
+        struct TestEntry
+        {
+            const char* name;
+            TestFunc func;
+        };
+
+        std::vector<TestEntry>& getTests()
+        {
+            static std::vector<TestEntry> s_tests;
+            return s_tests;
+        }
+
+        u32 g_numFailures = 0;
+    }
+
+    TestRegistrar::TestRegistrar(const char* _name, TestFunc _func)
+    {
+        getTests().push_back({ _name, _func });
+    }
+
+    void reportTestFailure(const char* _expr, const char* _file, int _line)
+    {
+        std::cout << _file << "(" << _line << "): check failed: " << _expr << std::endl;
+        g_numFailures++;
+    }
+}
+
+// Runs every test, or the ones whose name contains argv[1]
+int main(int argc, char* argv[])
+{
+    using namespace tim;
+
+    u32 numFailedTests = 0, numRunTests = 0;
+    for (const TestEntry& test : getTests())
+    {
+        if (argc > 1 && !strstr(test.name, argv[1]))
+            continue;
+
+        const u32 failuresBefore = g_numFailures;
+        test.func();
+        numRunTests++;
+
+        const bool passed = g_numFailures == failuresBefore;
+        numFailedTests += passed ? 0 : 1;
+        std::cout << (passed ? "[  OK  ] " : "[FAILED] ") << test.name << std::endl;
+    }
+
+    std::cout << numRunTests - numFailedTests << "/" << numRunTests << " tests passed" << std::endl;
+    return numFailedTests == 0 ? 0 : 1;
+}
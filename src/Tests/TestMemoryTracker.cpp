@@ -0,0 +1,171 @@
+#include "Test.h"
+#include "timCore/MemoryTracker.h"
+
+#include <list>
+#include <memory>
+
+namespace tim
+{
+    namespace
+    {
+        constexpr MemoryTag g_testTag = MemoryTag::Other;
+
+        struct Usage
+        {
+            Usage() = default;
+            Usage(i64 _bytes, i64 _allocs) : bytes{ _bytes }, allocs{ _allocs } {}
+
+            i64 bytes = 0;
+            i64 allocs = 0;
+
+            Usage operator+(const Usage& _other) const { return Usage(bytes + _other.bytes, allocs + _other.allocs); }
+            Usage operator*(i64 _count) const { return Usage(bytes * _count, allocs * _count); }
+            bool operator==(const Usage& _other) const { return bytes == _other.bytes && allocs == _other.allocs; }
+        };
+
+        // Other tests and static data may hold memory under the tag, the checks are relative to the state at construction
+        struct TagDelta
+        {
+            TagDelta(MemoryTag _tag = g_testTag) : tag{ _tag }, start{ MemoryTracker::get().getStats(MemoryPool::Cpu, _tag) } {}
+
+            Usage get() const
+            {
+                const MemoryTagStats stats = MemoryTracker::get().getStats(MemoryPool::Cpu, tag);
+                return Usage(i64(stats.liveBytes) - i64(start.liveBytes), i64(stats.numAllocs) - i64(start.numAllocs));
+            }
+
+            MemoryTag tag;
+            MemoryTagStats start;
+        };
+
+        // Debug STLs allocate a proxy (and a list its sentinel) through the allocator of every container, even empty
+        template<typename Container>
+        Usage getEmptyUsage()
+        {
+            TagDelta delta;
+            Container container;
+            return delta.get();
+        }
+
+        struct TrackedObject : TaggedObject<g_testTag>
+        {
+            u64 data[5];
+        };
+
+        struct LargerTrackedObject : TrackedObject
+        {
+            u64 extra[11];
+        };
+    }
+
+    TIM_TEST(MemoryTracker_VectorAllocateAndFree)
+    {
+        using Vector = TaggedVector<u64, g_testTag>;
+        const Usage empty = getEmptyUsage<Vector>();
+
+        TagDelta delta;
+        TagDelta otherTag(MemoryTag::Shaders);
+        const u64 gpuBytes = MemoryTracker::get().getTotalLiveBytes(MemoryPool::Gpu);
+        {
+            Vector vec;
+            TIM_CHECK(delta.get() == empty);
+
+            vec.reserve(100);
+            TIM_CHECK(delta.get() == empty + Usage(100 * sizeof(u64), 1));
+
+            // A reallocation frees the old block once the new one is filled, only the new capacity stays
+            vec.resize(300);
+            TIM_CHECK(delta.get() == empty + Usage(i64(vec.capacity() * sizeof(u64)), 1));
+            TIM_CHECK(MemoryTracker::get().getStats(MemoryPool::Cpu, g_testTag).peakBytes >= delta.start.liveBytes + (100 + 300) * sizeof(u64));
+
+            vec.clear();
+            vec.shrink_to_fit();
+            TIM_CHECK(delta.get() == empty);
+
+            vec.assign(10, 1);
+        }
+        TIM_CHECK(delta.get() == Usage());
+
+        // Nothing is accounted on the other tags or on the GPU pool
+        TIM_CHECK(otherTag.get() == Usage());
+        TIM_CHECK(MemoryTracker::get().getTotalLiveBytes(MemoryPool::Gpu) == gpuBytes);
+    }
+
+    TIM_TEST(MemoryTracker_VectorCopyAndMove)
+    {
+        using Vector = TaggedVector<u32, g_testTag>;
+        const Usage empty = getEmptyUsage<Vector>();
+        const Usage block = { 64 * sizeof(u32), 1 };
+
+        TagDelta delta;
+        {
+            Vector source(64, 7);
+            TIM_CHECK(delta.get() == empty + block);
+
+            // Copies own their storage
+            Vector copy = source;
+            TIM_CHECK(delta.get() == (empty + block) * 2);
+
+            Vector assigned(16);
+            assigned = source;
+            TIM_CHECK(delta.get() == (empty + block) * 2 + empty + Usage(i64(assigned.capacity() * sizeof(u32)), 1));
+
+            // Moves hand the storage over, only the new containers count
+            const Usage beforeMoves = delta.get();
+            Vector moved = std::move(source);
+            TIM_CHECK(delta.get() == beforeMoves + empty);
+
+            Vector moveAssigned;
+            moveAssigned = std::move(copy);
+            TIM_CHECK(delta.get() == beforeMoves + empty * 2);
+
+            // Move assigning over a vector with storage frees it
+            const Usage assignedBlock = { i64(assigned.capacity() * sizeof(u32)), 1 };
+            moveAssigned = std::move(assigned);
+            TIM_CHECK(delta.get() == empty * 5 + block + assignedBlock);
+
+            moved.swap(moveAssigned);
+            TIM_CHECK(delta.get() == empty * 5 + block + assignedBlock);
+        }
+        TIM_CHECK(delta.get() == Usage());
+    }
+
+    TIM_TEST(MemoryTracker_RebindAndObjects)
+    {
+        using List = std::list<u64, TaggedAllocator<u64, g_testTag>>;
+        const Usage empty = getEmptyUsage<List>();
+
+        TagDelta delta;
+        {
+            // Node based containers allocate their nodes through the rebound allocator, under the same tag
+            List list;
+            for (u32 i = 0; i < 10; ++i)
+                list.push_back(i);
+            TIM_CHECK(delta.get().bytes >= empty.bytes + i64(10 * sizeof(u64)) && delta.get().allocs == empty.allocs + 10);
+
+            list.pop_front();
+            TIM_CHECK(delta.get().allocs == empty.allocs + 9);
+        }
+        TIM_CHECK(delta.get() == Usage());
+
+        {
+            std::unique_ptr<TrackedObject> object = std::make_unique<TrackedObject>();
+            TIM_CHECK(delta.get() == Usage(sizeof(TrackedObject), 1));
+
+            // The sized delete frees the size of the allocated type
+            std::unique_ptr<LargerTrackedObject> larger = std::make_unique<LargerTrackedObject>();
+            TIM_CHECK(delta.get() == Usage(sizeof(TrackedObject) + sizeof(LargerTrackedObject), 2));
+
+            std::unique_ptr<TrackedObject> movedObject = std::move(object);
+            TIM_CHECK(delta.get().allocs == 2);
+
+            larger.reset();
+            TIM_CHECK(delta.get() == Usage(sizeof(TrackedObject), 1));
+        }
+        TIM_CHECK(delta.get() == Usage());
+
+        // Untracked memory is left to its owner
+        TaggedVector<u64, MemoryTag::Untracked> untracked(32);
+        TIM_CHECK(MemoryTracker::get().getStats(MemoryPool::Cpu, MemoryTag::Untracked).liveBytes == 0);
+    }
+}
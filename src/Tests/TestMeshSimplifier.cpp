@@ -0,0 +1,137 @@
+#include "Test.h"
+#include "Renderer/MeshSimplifier.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace tim
+{
+    namespace
+    {
+        struct Grid
+        {
+            std::vector<vec3> positions;
+            std::vector<u32> indices;
+            std::vector<u32> groups;
+        };
+
+        Grid createGrid(u32 _size, float _bumpHeight, float _bumpFrequency = 0.4f)
+        {
+            Grid grid;
+            for (u32 y = 0; y <= _size; ++y)
+                for (u32 x = 0; x <= _size; ++x)
+                    grid.positions.push_back({ float(x), _bumpHeight * std::sin(x * _bumpFrequency) * std::cos(y * _bumpFrequency * 0.75f), float(y) });
+
+            for (u32 y = 0; y < _size; ++y)
+            {
+                for (u32 x = 0; x < _size; ++x)
+                {
+                    const u32 v = y * (_size + 1) + x;
+                    const u32 quad[6] = { v, v + _size + 1, v + 1, v + 1, v + _size + 1, v + _size + 2 };
+                    grid.indices.insert(grid.indices.end(), quad, quad + 6);
+                    grid.groups.push_back(0);
+                    grid.groups.push_back(0);
+                }
+            }
+            return grid;
+        }
+
+        float distanceToSegment(vec3 _p, vec3 _a, vec3 _b)
+        {
+            const float t = std::clamp(linalg::dot(_p - _a, _b - _a) / linalg::length2(_b - _a), 0.f, 1.f);
+            return linalg::length(_p - (_a + (_b - _a) * t));
+        }
+
+        // Reference distance : the projection on the plane when it is inside the triangle, the closest edge otherwise
+        float distanceToTriangle(vec3 _p, vec3 _a, vec3 _b, vec3 _c)
+        {
+            const vec3 n = linalg::normalize(linalg::cross(_b - _a, _c - _a));
+            const vec3 q = _p - n * linalg::dot(_p - _a, n);
+            const bool inside = linalg::dot(linalg::cross(_b - _a, q - _a), n) >= 0 &&
+                                linalg::dot(linalg::cross(_c - _b, q - _b), n) >= 0 &&
+                                linalg::dot(linalg::cross(_a - _c, q - _c), n) >= 0;
+            if (inside)
+                return std::abs(linalg::dot(_p - _a, n));
+
+            return std::min(distanceToSegment(_p, _a, _b), std::min(distanceToSegment(_p, _b, _c), distanceToSegment(_p, _c, _a)));
+        }
+
+        // Largest distance of the centroids and edge midpoints of _from to the closest triangle of _to
+        float maxDistanceBetween(const std::vector<vec3>& _positions, const std::vector<u32>& _from, const std::vector<u32>& _to)
+        {
+            float maxDistance = 0;
+            for (u32 t = 0; t < _from.size(); t += 3)
+            {
+                const vec3 a = _positions[_from[t]], b = _positions[_from[t + 1]], c = _positions[_from[t + 2]];
+                const vec3 samples[4] = { (a + b + c) / 3.f, (a + b) * 0.5f, (b + c) * 0.5f, (c + a) * 0.5f };
+                for (vec3 p : samples)
+                {
+                    float distance = FLT_MAX;
+                    for (u32 o = 0; o < _to.size(); o += 3)
+                        distance = std::min(distance, distanceToTriangle(p, _positions[_to[o]], _positions[_to[o + 1]], _positions[_to[o + 2]]));
+                    maxDistance = std::max(maxDistance, distance);
+                }
+            }
+            return maxDistance;
+        }
+    }
+
+    TIM_TEST(MeshSimplifier_FlatGridHasNoError)
+    {
+        const Grid grid = createGrid(16, 0.f);
+        const u32 numTriangle = u32(grid.groups.size());
+
+        SimplifiedMesh result;
+        simplifyMesh(grid.positions.data(), u32(grid.positions.size()), grid.indices.data(), grid.groups.data(), numTriangle, numTriangle / 4, FLT_MAX, result);
+
+        TIM_CHECK(result.groups.size() < numTriangle);
+        TIM_CHECK(result.error < 1e-5f);
+    }
+
+    TIM_TEST(MeshSimplifier_ErrorBoundsTheDistanceToTheResult)
+    {
+        const Grid grid = createGrid(16, 0.5f);
+        const u32 numTriangle = u32(grid.groups.size());
+
+        SimplifiedMesh result;
+        simplifyMesh(grid.positions.data(), u32(grid.positions.size()), grid.indices.data(), grid.groups.data(), numTriangle, numTriangle / 4, FLT_MAX, result);
+        TIM_CHECK(result.groups.size() <= numTriangle / 4);
+        TIM_CHECK(result.error > 0);
+
+        // One sided distance of the source vertices to the simplified surface
+        float maxDistance = 0;
+        for (vec3 p : grid.positions)
+        {
+            float distance = FLT_MAX;
+            for (u32 t = 0; t < result.groups.size(); ++t)
+            {
+                const u32* tri = &result.indices[t * 3];
+                distance = std::min(distance, distanceToTriangle(p, grid.positions[tri[0]], grid.positions[tri[1]], grid.positions[tri[2]]));
+            }
+            maxDistance = std::max(maxDistance, distance);
+        }
+
+        TIM_CHECK(maxDistance > 0);
+        TIM_CHECK(maxDistance <= result.error + 1e-4f);
+    }
+
+    TIM_TEST(MeshSimplifier_ErrorBoundsTheDistanceBetweenTheSurfaces)
+    {
+        const Grid grid = createGrid(24, 0.5f, 0.9f);
+        const u32 numTriangle = u32(grid.groups.size());
+
+        for (u32 target : { numTriangle / 4, numTriangle / 16 })
+        {
+            SimplifiedMesh result;
+            simplifyMesh(grid.positions.data(), u32(grid.positions.size()), grid.indices.data(), grid.groups.data(), numTriangle, target, FLT_MAX, result);
+            TIM_CHECK(result.groups.size() < numTriangle);
+
+            // Points inside the triangles, away from the vertices, in both directions
+            const float toSimplified = maxDistanceBetween(grid.positions, grid.indices, result.indices);
+            const float toSource = maxDistanceBetween(grid.positions, result.indices, grid.indices);
+            TIM_CHECK(toSimplified <= result.error + 1e-4f);
+            TIM_CHECK(toSource <= result.error + 1e-4f);
+        }
+    }
+}
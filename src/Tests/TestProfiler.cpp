@@ -0,0 +1,168 @@
+#include "Test.h"
+#include "MockRenderer.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace tim
+{
+    namespace
+    {
+        u32 countOccurrences(const std::string& _str, const std::string& _pattern)
+        {
+            u32 count = 0;
+            for (size_t pos = _str.find(_pattern); pos != std::string::npos; pos = _str.find(_pattern, pos + _pattern.size()))
+                count++;
+            return count;
+        }
+
+        // Brackets and braces outside of the strings close in order, escaped quotes stay in their string
+        bool isBalancedJson(const std::string& _json)
+        {
+            std::string stack;
+            bool inString = false;
+            for (size_t i = 0; i < _json.size(); ++i)
+            {
+                const char c = _json[i];
+                if (inString)
+                {
+                    if (c == '\\')
+                        ++i;
+                    else if (c == '"')
+                        inString = false;
+                }
+                else if (c == '"')
+                    inString = true;
+                else if (c == '{' || c == '[')
+                    stack.push_back(c == '{' ? '}' : ']');
+                else if (c == '}' || c == ']')
+                {
+                    if (stack.empty() || stack.back() != c)
+                        return false;
+                    stack.pop_back();
+                }
+            }
+            return stack.empty() && !inString;
+        }
+    }
+
+    TIM_TEST(Profiler_NestedScopes)
+    {
+        Profiler& profiler = Profiler::get();
+        profiler.clear();
+
+        MockRenderer renderer;
+        IRenderContext* context = renderer.CreateRenderContext(RenderContextType::Graphics, 0);
+        renderer.BeginFrame();
+        context->BeginRender();
+        context->BeginScope("Frame");
+        context->BeginScope("Pass");
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        context->EndScope();
+        context->EndScope();
+        context->EndRender();
+
+        // Without timestamps the scopes are sent as CPU events when they end, the outer one covers the inner one
+        const ProfileStats frame = profiler.getStats("Frame", ProfileTimeline::Cpu);
+        const ProfileStats pass = profiler.getStats("Pass", ProfileTimeline::Cpu);
+        TIM_CHECK(frame.numSamples == 1 && pass.numSamples == 1);
+        TIM_CHECK(pass.average >= 2000.0);
+        TIM_CHECK(frame.average >= pass.average);
+        TIM_CHECK(profiler.getStats("Frame", ProfileTimeline::Gpu).numSamples == 0);
+    }
+
+    TIM_TEST(Profiler_ScopesBalanceAcrossFramesInFlight)
+    {
+        Profiler& profiler = Profiler::get();
+        profiler.clear();
+
+        MockRenderer renderer;
+        MockRenderContext* context = static_cast<MockRenderContext*>(renderer.CreateRenderContext(RenderContextType::Graphics, 0));
+        const u32 numFrames = 3 * TIM_FRAME_LATENCY + 1;
+        for (u32 i = 0; i < numFrames; ++i)
+        {
+            renderer.BeginFrame();
+            context->BeginRender();
+            context->BeginScope("Frame");
+            for (u32 pass = 0; pass < 3; ++pass)
+            {
+                context->BeginScope("Pass");
+                context->EndScope();
+            }
+            context->EndScope();
+            context->EndRender();
+
+            TIM_CHECK(context->getNumOpenScopes() == 0);
+            TIM_CHECK(profiler.getStats("Frame", ProfileTimeline::Cpu).numSamples == i + 1);
+            TIM_CHECK(profiler.getStats("Pass", ProfileTimeline::Cpu).numSamples == 3 * (i + 1));
+        }
+
+        // With timestamps, the scopes of a frame reach the GPU timeline when its slot is recorded again
+        ContextScopeTracker tracker(true, 1);
+        u64 timestamps[ContextScopeTracker::MaxQueries];
+        for (u32 i = 0; i < ContextScopeTracker::MaxQueries; ++i)
+            timestamps[i] = i * 1000;
+
+        for (u32 i = 0; i < numFrames; ++i)
+        {
+            tracker.beginFrame(i % TIM_FRAME_LATENCY, timestamps, 0.001);
+            TIM_CHECK(tracker.beginScope("GpuFrame") == 0);
+            TIM_CHECK(tracker.beginScope("GpuPass") == 2);
+            TIM_CHECK(tracker.endScope() == 3);
+            TIM_CHECK(tracker.endScope() == 1);
+            tracker.endFrame();
+
+            TIM_CHECK(tracker.getNumOpenScopes() == 0);
+            TIM_CHECK(tracker.getNumQueries(i % TIM_FRAME_LATENCY) == 4);
+            const u32 numReadBack = i >= TIM_FRAME_LATENCY ? i - TIM_FRAME_LATENCY + 1 : 0;
+            TIM_CHECK(profiler.getStats("GpuFrame", ProfileTimeline::Gpu).numSamples == numReadBack);
+            TIM_CHECK(profiler.getStats("GpuPass", ProfileTimeline::Gpu).numSamples == numReadBack);
+        }
+
+        // Queries 0 to 1 and 2 to 3, one microsecond per 1000 ticks
+        TIM_CHECK(profiler.getStats("GpuFrame", ProfileTimeline::Gpu).average == 1.0);
+        TIM_CHECK(profiler.getStats("GpuPass", ProfileTimeline::Gpu).average == 1.0);
+        TIM_CHECK(profiler.getStats("GpuFrame", ProfileTimeline::Cpu).numSamples == 0);
+    }
+
+    TIM_TEST(Profiler_ChromeTraceOutput)
+    {
+        Profiler& profiler = Profiler::get();
+        profiler.clear();
+
+        MockRenderer renderer;
+        IRenderContext* context = renderer.CreateRenderContext(RenderContextType::Graphics, 0);
+        renderer.BeginFrame();
+        context->BeginRender();
+        context->BeginScope("Frame");
+        context->BeginScope("Pass \"quoted\"");
+        context->EndScope();
+        context->EndScope();
+        context->EndRender();
+        profiler.addEvent("Gpu\\Pass", ProfileTimeline::Gpu, 1, 10.0, 5.0);
+
+        const std::filesystem::path path = std::filesystem::temp_directory_path() / "tim_test_trace.json";
+        TIM_CHECK(profiler.exportChromeTrace(path.string()));
+
+        std::ifstream file(path);
+        std::stringstream stream;
+        stream << file.rdbuf();
+        const std::string json = stream.str();
+        file.close();
+        std::filesystem::remove(path);
+
+        TIM_CHECK(json.rfind("{\"traceEvents\":[", 0) == 0);
+        TIM_CHECK(isBalancedJson(json));
+
+        // Two process names, then one complete event per scope on the timeline of its process
+        TIM_CHECK(countOccurrences(json, "\"ph\":\"M\"") == 2);
+        TIM_CHECK(countOccurrences(json, "\"ph\":\"X\"") == 3);
+        TIM_CHECK(countOccurrences(json, "\"ph\":\"X\",\"pid\":0") == 2);
+        TIM_CHECK(json.find("{\"name\":\"Gpu\\\\Pass\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":10.000,\"dur\":5.000}") != std::string::npos);
+        TIM_CHECK(json.find("\"name\":\"Pass \\\"quoted\\\"\"") != std::string::npos);
+        TIM_CHECK(json.find("\"name\":\"Frame\"") != std::string::npos);
+    }
+}
@@ -0,0 +1,117 @@
+#include "Test.h"
+#include "MockRenderer.h"
+#include "Renderer/resourceAllocator.h"
+
+namespace tim
+{
+    TIM_TEST(ResourceAllocator_ReusesReleasedSizeClass)
+    {
+        MockRenderer renderer;
+        ResourceAllocator allocator(&renderer);
+
+        BufferHandle buffer = allocator.allocBuffer(1000, BufferUsage::Storage);
+        TIM_CHECK(allocator.getStats().misses == 1 && allocator.getStats().hits == 0);
+        TIM_CHECK(allocator.getStats().liveBytes == 1024 && allocator.getStats().requestedBytes == 1000);
+
+        allocator.releaseBuffer(buffer);
+        TIM_CHECK(allocator.getStats().liveBytes == 0 && allocator.getStats().requestedBytes == 0);
+        TIM_CHECK(allocator.getStats().cachedBytes == 1024);
+
+        // Same size class and usage, the released buffer is handed back
+        BufferHandle reused = allocator.allocBuffer(600, BufferUsage::Storage);
+        TIM_CHECK(reused.ptr == buffer.ptr);
+        TIM_CHECK(allocator.getStats().hits == 1);
+        TIM_CHECK(allocator.getStats().liveBytes == 1024 && allocator.getStats().requestedBytes == 600);
+
+        // Another usage is another pool
+        BufferHandle other = allocator.allocBuffer(600, BufferUsage::ConstantBuffer);
+        TIM_CHECK(other.ptr != buffer.ptr);
+        TIM_CHECK(allocator.getStats().misses == 2);
+
+        allocator.releaseBuffer(reused);
+        allocator.releaseBuffer(other);
+        allocator.clear();
+        TIM_CHECK(renderer.getNumLiveResources() == 0);
+        TIM_CHECK(renderer.getStats().numInvalidDestroys == 0);
+    }
+
+    TIM_TEST(ResourceAllocator_EvictsUnusedResources)
+    {
+        MockRenderer renderer;
+        const u32 maxUnusedFrames = 8;
+        ResourceAllocator allocator(&renderer, ResourceAllocator::DefaultMemoryBudget, maxUnusedFrames);
+
+        BufferHandle buffer = allocator.allocBuffer(4096, BufferUsage::Storage);
+        allocator.releaseBuffer(buffer);
+
+        for (u32 frame = 1; frame < maxUnusedFrames; ++frame)
+        {
+            allocator.nextFrame();
+            TIM_CHECK(renderer.isAlive(buffer.ptr));
+        }
+
+        allocator.nextFrame();
+        TIM_CHECK(!renderer.isAlive(buffer.ptr));
+        TIM_CHECK(allocator.getStats().evictions == 1 && allocator.getStats().cachedBytes == 0);
+        TIM_CHECK(renderer.getStats().numInvalidDestroys == 0);
+    }
+
+    TIM_TEST(ResourceAllocator_EvictsToBudget)
+    {
+        MockRenderer renderer;
+        const u64 budget = 16 * 1024;
+        ResourceAllocator allocator(&renderer, budget);
+
+        BufferHandle buffers[4];
+        for (BufferHandle& buffer : buffers)
+            buffer = allocator.allocBuffer(4096, BufferUsage::Storage);
+        for (BufferHandle& buffer : buffers)
+            allocator.releaseBuffer(buffer);
+
+        for (u32 frame = 0; frame <= TIM_FRAME_LATENCY; ++frame)
+            allocator.nextFrame();
+        TIM_CHECK(allocator.getStats().evictions == 0);
+
+        // Another size class, the cache gives back the room over the budget and no more
+        BufferHandle large = allocator.allocBuffer(8192, BufferUsage::Storage);
+        TIM_CHECK(allocator.getStats().evictions == 2);
+        TIM_CHECK(allocator.getStats().liveBytes + allocator.getStats().cachedBytes == budget);
+
+        u32 numAlive = 0;
+        for (const BufferHandle& buffer : buffers)
+            numAlive += renderer.isAlive(buffer.ptr) ? 1 : 0;
+        TIM_CHECK(numAlive == 2);
+
+        allocator.releaseBuffer(large);
+        allocator.clear();
+        TIM_CHECK(renderer.getNumLiveResources() == 0);
+        TIM_CHECK(renderer.getStats().numInvalidDestroys == 0);
+    }
+
+    TIM_TEST(ResourceAllocator_KeepsResourcesInFlight)
+    {
+        // Neither the unused frames limit nor the budget destroy a resource released during the last TIM_FRAME_LATENCY frames
+        MockRenderer renderer;
+        ResourceAllocator allocator(&renderer, 1024, 0);
+
+        for (u32 frame = 0; frame <= TIM_FRAME_LATENCY; ++frame)
+            allocator.nextFrame();
+
+        BufferHandle buffer = allocator.allocBuffer(1024, BufferUsage::Storage);
+        allocator.releaseBuffer(buffer);
+
+        for (u32 frame = 0; frame < TIM_FRAME_LATENCY; ++frame)
+        {
+            BufferHandle other = allocator.allocBuffer(512, BufferUsage::Storage);
+            TIM_CHECK(renderer.isAlive(buffer.ptr));
+            allocator.releaseBuffer(other);
+
+            allocator.nextFrame();
+            TIM_CHECK(renderer.isAlive(buffer.ptr));
+        }
+
+        allocator.nextFrame();
+        TIM_CHECK(!renderer.isAlive(buffer.ptr));
+        TIM_CHECK(renderer.getStats().numInvalidDestroys == 0);
+    }
+}
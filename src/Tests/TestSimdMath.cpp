@@ -0,0 +1,36 @@
+#include "Test.h"
+#include "timCore/SimdMath.h"
+
+namespace tim
+{
+    TIM_TEST(SimdMath_BoxLoadStoreKeepsNeighbours)
+    {
+        // The box sits between two guard values which must survive the store
+        float data[8] = { -1.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, -2.f };
+        const BoxA box = BoxA::load(reinterpret_cast<const vec3*>(&data[1]));
+        TIM_CHECK(box.minExtent.toVec3() == vec3(1.f, 2.f, 3.f) && box.maxExtent.toVec3() == vec3(4.f, 5.f, 6.f));
+
+        const BoxA moved = { box.minExtent - vec3(1.f), box.maxExtent + vec3(1.f) };
+        moved.store(reinterpret_cast<vec3*>(&data[1]));
+        TIM_CHECK(data[0] == -1.f && data[7] == -2.f);
+        TIM_CHECK(data[1] == 0.f && data[3] == 2.f && data[4] == 5.f && data[6] == 7.f);
+    }
+
+    TIM_TEST(SimdMath_BoxOperationsMatchLinalg)
+    {
+        const vec3 extents[4] = { { -1.f, 0.f, 2.f }, { 3.f, 4.f, 5.f }, { 0.5f, -2.f, 1.f }, { 6.f, 1.f, 2.5f } };
+        const BoxA a = BoxA::load(&extents[0]), b = BoxA::load(&extents[2]);
+
+        const BoxA merged = mergeBox(a, b);
+        TIM_CHECK(merged.minExtent.toVec3() == linalg::min_(extents[0], extents[2]));
+        TIM_CHECK(merged.maxExtent.toVec3() == linalg::max_(extents[1], extents[3]));
+
+        const BoxA intersection = intersectionBox(a, b);
+        const vec3 dim = linalg::min_(extents[1], extents[3]) - linalg::max_(extents[0], extents[2]);
+        TIM_CHECK(getBoxVolume(intersection) == dim.x * dim.y * dim.z);
+
+        TIM_CHECK(boxOverlap(a, b));
+        const BoxA far = { vec3(10.f), vec3(11.f) };
+        TIM_CHECK(!boxOverlap(a, far));
+    }
+}
@@ -0,0 +1,276 @@
+#include "Test.h"
+#include "Renderer/TextureCooker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace tim
+{
+    namespace
+    {
+        void unpack565(u16 _c, int _out[3])
+        {
+            const int r = (_c >> 11) & 31, g = (_c >> 5) & 63, b = _c & 31;
+            _out[0] = (r << 3) | (r >> 2);
+            _out[1] = (g << 2) | (g >> 4);
+            _out[2] = (b << 3) | (b >> 2);
+        }
+
+        // Reference decoders of the block formats, as specified for the GPU
+        void decodeBC1Block(const ubyte _block[8], ubyte _out[16][4])
+        {
+            u16 c0, c1;
+            u32 indices;
+            memcpy(&c0, _block, 2);
+            memcpy(&c1, _block + 2, 2);
+            memcpy(&indices, _block + 4, 4);
+
+            int palette[4][4];
+            unpack565(c0, palette[0]);
+            unpack565(c1, palette[1]);
+            for (u32 c = 0; c < 3; ++c)
+            {
+                palette[2][c] = c0 > c1 ? (2 * palette[0][c] + palette[1][c]) / 3 : (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = c0 > c1 ? (palette[0][c] + 2 * palette[1][c]) / 3 : 0;
+            }
+            for (u32 p = 0; p < 4; ++p)
+                palette[p][3] = c0 <= c1 && p == 3 ? 0 : 255;
+
+            for (u32 i = 0; i < 16; ++i)
+                for (u32 c = 0; c < 4; ++c)
+                    _out[i][c] = ubyte(palette[(indices >> (2 * i)) & 3][c]);
+        }
+
+        // Mode 6 only, the one the cooker writes
+        bool decodeBC7Block(const ubyte _block[16], ubyte _out[16][4])
+        {
+            u64 bits[2];
+            memcpy(bits, _block, 16);
+            u32 pos = 0;
+            auto read = [&](u32 _numBits)
+            {
+                u32 value = 0;
+                for (u32 i = 0; i < _numBits; ++i, ++pos)
+                    value |= u32((bits[pos / 64] >> (pos % 64)) & 1) << i;
+                return value;
+            };
+
+            if (read(7) != (1 << 6))
+                return false;
+
+            u32 e[2][4];
+            for (u32 c = 0; c < 4; ++c)
+            {
+                e[0][c] = read(7);
+                e[1][c] = read(7);
+            }
+            const u32 p0 = read(1), p1 = read(1);
+            for (u32 c = 0; c < 4; ++c)
+            {
+                e[0][c] = (e[0][c] << 1) | p0;
+                e[1][c] = (e[1][c] << 1) | p1;
+            }
+
+            const u32 weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+            for (u32 i = 0; i < 16; ++i)
+            {
+                const u32 w = weights[read(i == 0 ? 3 : 4)];
+                for (u32 c = 0; c < 4; ++c)
+                    _out[i][c] = ubyte(((64 - w) * e[0][c] + w * e[1][c] + 32) >> 6);
+            }
+            return true;
+        }
+
+        // Encode _rgba with the cooker and decode it back, returns the max and the RMS error per channel over the image
+        template<u32 BlockSize, typename Encode, typename Decode>
+        void roundTrip(const std::vector<ubyte>& _rgba, u32 _width, u32 _height, const Encode& _encode, const Decode& _decode, int& _maxError, float& _rmsError)
+        {
+            const u32 numBlocksX = (_width + 3) / 4, numBlocksY = (_height + 3) / 4;
+            std::vector<ubyte> encoded(size_t(numBlocksX) * numBlocksY * BlockSize);
+            _encode(_rgba.data(), _width, _height, encoded.data());
+
+            _maxError = 0;
+            double sum = 0;
+            for (u32 by = 0; by < numBlocksY; ++by)
+            {
+                for (u32 bx = 0; bx < numBlocksX; ++bx)
+                {
+                    ubyte decoded[16][4];
+                    _decode(&encoded[(size_t(by) * numBlocksX + bx) * BlockSize], decoded);
+
+                    for (u32 i = 0; i < 16; ++i)
+                    {
+                        const u32 x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                        if (x >= _width || y >= _height)
+                            continue;
+
+                        for (u32 c = 0; c < 4; ++c)
+                        {
+                            const int error = std::abs(int(decoded[i][c]) - int(_rgba[(size_t(y) * _width + x) * 4 + c]));
+                            _maxError = std::max(_maxError, error);
+                            sum += error * error;
+                        }
+                    }
+                }
+            }
+            _rmsError = float(std::sqrt(sum / (double(_width) * _height * 4)));
+        }
+
+        std::vector<ubyte> makeImage(u32 _width, u32 _height, ubyte(*_texel)(u32 _x, u32 _y, u32 _c))
+        {
+            std::vector<ubyte> rgba(size_t(_width) * _height * 4);
+            for (u32 y = 0; y < _height; ++y)
+                for (u32 x = 0; x < _width; ++x)
+                    for (u32 c = 0; c < 4; ++c)
+                        rgba[(size_t(y) * _width + x) * 4 + c] = _texel(x, y, c);
+            return rgba;
+        }
+
+        const ubyte g_solidColor[4] = { 37, 142, 201, 255 };
+        ubyte solidTexel(u32, u32, u32 _c) { return g_solidColor[_c]; }
+        // Colors on a line, the case both encoders are built for
+        ubyte gradientTexel(u32 _x, u32 _y, u32 _c) { return _c == 3 ? 255 : ubyte(std::min(255u, 40 + (_x + 4 * (_y % 4)) * (_c + 3))); }
+        ubyte translucentGradientTexel(u32 _x, u32 _y, u32 _c) { return _c == 3 ? ubyte(255 - 12 * ((_x + _y) % 16)) : gradientTexel(_x, _y, _c); }
+        ubyte noiseTexel(u32 _x, u32 _y, u32 _c) { return _c == 3 ? 255 : ubyte(((_x * 73856093u) ^ (_y * 19349663u) ^ (_c * 83492791u)) >> 7); }
+    }
+
+    TIM_TEST(TextureCooker_BC1RoundTrip)
+    {
+        int maxError;
+        float rmsError;
+
+        // A single color is only rounded to 565
+        roundTrip<8>(makeImage(4, 4, solidTexel), 4, 4, TextureCooker::encodeBC1, decodeBC1Block, maxError, rmsError);
+        TIM_CHECK(maxError <= 4);
+
+        // Colors on a line land on the 4 entries of the palette, the partial blocks of a 7x6 image included
+        roundTrip<8>(makeImage(7, 6, gradientTexel), 7, 6, TextureCooker::encodeBC1, decodeBC1Block, maxError, rmsError);
+        TIM_CHECK(maxError <= 24);
+        TIM_CHECK(rmsError <= 8.f);
+
+        roundTrip<8>(makeImage(16, 16, noiseTexel), 16, 16, TextureCooker::encodeBC1, decodeBC1Block, maxError, rmsError);
+        TIM_CHECK(rmsError <= 80.f);
+
+        // The cooker only writes opaque blocks
+        std::vector<ubyte> encoded(8);
+        TextureCooker::encodeBC1(makeImage(4, 4, gradientTexel).data(), 4, 4, encoded.data());
+        ubyte decoded[16][4];
+        decodeBC1Block(encoded.data(), decoded);
+        TIM_CHECK(std::all_of(decoded, decoded + 16, [](const ubyte* _texel) { return _texel[3] == 255; }));
+    }
+
+    TIM_TEST(TextureCooker_BC7RoundTrip)
+    {
+        int maxError;
+        float rmsError;
+
+        auto decode = [](const ubyte* _block, ubyte _out[16][4]) { TIM_CHECK(decodeBC7Block(_block, _out)); };
+
+        roundTrip<16>(makeImage(4, 4, solidTexel), 4, 4, TextureCooker::encodeBC7, decode, maxError, rmsError);
+        TIM_CHECK(maxError <= 2);
+
+        roundTrip<16>(makeImage(7, 6, gradientTexel), 7, 6, TextureCooker::encodeBC7, decode, maxError, rmsError);
+        TIM_CHECK(maxError <= 8);
+        TIM_CHECK(rmsError <= 3.f);
+
+        roundTrip<16>(makeImage(9, 9, translucentGradientTexel), 9, 9, TextureCooker::encodeBC7, decode, maxError, rmsError);
+        TIM_CHECK(maxError <= 24);
+        TIM_CHECK(rmsError <= 8.f);
+
+        roundTrip<16>(makeImage(16, 16, noiseTexel), 16, 16, TextureCooker::encodeBC7, decode, maxError, rmsError);
+        TIM_CHECK(rmsError <= 70.f);
+    }
+
+    TIM_TEST(TextureCooker_MipChainDimensions)
+    {
+        TIM_CHECK(TextureCooker::computeNumMips(1, 1) == 1);
+        TIM_CHECK(TextureCooker::computeNumMips(256, 256) == 9);
+        TIM_CHECK(TextureCooker::computeNumMips(300, 17) == 9);
+        TIM_CHECK(TextureCooker::computeNumMips(5, 3) == 3);
+        TIM_CHECK(TextureCooker::computeNumMips(1u << 20, 1) == CookedTextureHeader::MaxMips);
+
+        // Each level halves the previous one rounded down, never below one texel, down to 1x1
+        const uvec2 sizes[] = { { 256, 256 }, { 300, 17 }, { 5, 3 }, { 1, 7 } };
+        for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser })
+        {
+            for (uvec2 size : sizes)
+            {
+                const std::vector<ubyte> rgba = makeImage(size.x, size.y, solidTexel);
+                const std::vector<std::vector<ubyte>> mips = TextureCooker::generateMipChain(rgba.data(), size.x, size.y, filter);
+                TIM_CHECK(mips.size() == TextureCooker::computeNumMips(size.x, size.y));
+
+                u32 w = size.x, h = size.y;
+                for (const std::vector<ubyte>& mip : mips)
+                {
+                    TIM_CHECK(mip.size() == size_t(w) * h * 4);
+
+                    // The filters are normalized, a constant image stays constant
+                    for (size_t i = 0; i < mip.size(); ++i)
+                        TIM_CHECK(std::abs(int(mip[i]) - int(g_solidColor[i % 4])) <= 1);
+
+                    w = std::max(1u, w / 2);
+                    h = std::max(1u, h / 2);
+                }
+                TIM_CHECK(mips.back().size() == 4);
+            }
+        }
+
+        // The cooked levels of a non power of two texture are sized in whole blocks
+        const fs::path folder = fs::temp_directory_path() / "tim_test_cooker";
+        fs::remove_all(folder);
+        TextureCooker cooker(folder.string() + "/", TextureCompression::BC1, MipFilter::Box);
+        const std::vector<ubyte> rgba = makeImage(13, 6, gradientTexel);
+        CookedTexture cooked;
+        cooker.cook(rgba.data(), 13, 6, 13 * 4, false, 1, 1, cooked);
+
+        const CookedTextureHeader& header = cooked.getHeader();
+        const u32 blockCounts[] = { 4 * 2, 2 * 1, 1 * 1, 1 * 1 };
+        TIM_CHECK(header.numMips == 4);
+        for (u32 mip = 0; mip < header.numMips; ++mip)
+            TIM_CHECK(header.mipSizes[mip] == blockCounts[mip] * 8);
+        fs::remove_all(folder);
+    }
+
+    TIM_TEST(TextureCooker_ConcurrentCooksOfTheSameTexture)
+    {
+        const fs::path folder = fs::temp_directory_path() / "tim_test_cooker_concurrent";
+        fs::remove_all(folder);
+        const TextureCooker cooker(folder.string() + "/", TextureCompression::BC7, MipFilter::Box);
+        const std::vector<ubyte> rgba = makeImage(64, 64, translucentGradientTexel);
+
+        // Every writer has its own temporary file, the entry is always complete whichever rename lands last
+        std::vector<std::thread> threads;
+        std::vector<u32> numMips(8, 0);
+        for (u32 t = 0; t < numMips.size(); ++t)
+        {
+            threads.emplace_back([&, t]()
+            {
+                for (u32 i = 0; i < 4; ++i)
+                {
+                    CookedTexture cooked;
+                    cooker.cook(rgba.data(), 64, 64, 64 * 4, false, 42, 1, cooked);
+                    numMips[t] = cooked.getHeader().numMips;
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+
+        TIM_CHECK(std::all_of(numMips.begin(), numMips.end(), [](u32 _numMips) { return _numMips == 7; }));
+
+        u32 numEntries = 0, numTempFiles = 0;
+        for (const fs::directory_entry& entry : fs::directory_iterator(folder))
+            (entry.path().extension() == ".tmp" ? numTempFiles : numEntries)++;
+        TIM_CHECK(numEntries == 1 && numTempFiles == 0);
+
+        CookedTexture cached;
+        TIM_CHECK(cached.load(cooker.getCachePath(42, 1), 42, 1));
+        TIM_CHECK(cached.getHeader().numMips == 7);
+        fs::remove_all(folder);
+    }
+}
@@ -0,0 +1,124 @@
+#include "Test.h"
+#include "Renderer/VertexCompression.h"
+
+#include <cmath>
+
+namespace tim
+{
+    namespace
+    {
+        struct TestMesh
+        {
+            std::vector<vec3> positions;
+            std::vector<vec3> normals;
+            std::vector<vec2> texCoords;
+        };
+
+        // Uv sphere, a few blocks of vertices
+        TestMesh createSphere(vec3 _center, float _radius, u32 _numRings, u32 _numSegments)
+        {
+            TestMesh mesh;
+            for (u32 ring = 0; ring <= _numRings; ++ring)
+            {
+                for (u32 segment = 0; segment <= _numSegments; ++segment)
+                {
+                    const float theta = 3.14159265f * ring / _numRings;
+                    const float phi = 2 * 3.14159265f * segment / _numSegments;
+                    const vec3 normal = { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+                    mesh.positions.push_back(_center + normal * _radius);
+                    mesh.normals.push_back(normal);
+                    mesh.texCoords.push_back({ float(segment) / _numSegments, float(ring) / _numRings });
+                }
+            }
+            return mesh;
+        }
+
+        // Large terrain far from the origin made of 16x16 vertices patches, the texture tiles about once per quad
+        TestMesh createTerrain(vec3 _origin, float _quadSize, u32 _numPatches)
+        {
+            TestMesh mesh;
+            for (u32 patch = 0; patch < _numPatches * _numPatches; ++patch)
+            {
+                for (u32 i = 0; i < 256; ++i)
+                {
+                    const float x = float((patch % _numPatches) * 15 + i % 16);
+                    const float y = float((patch / _numPatches) * 15 + i / 16);
+                    const float height = std::sin(x * 0.3f) * std::cos(y * 0.2f) * _quadSize;
+                    mesh.positions.push_back(_origin + vec3(x * _quadSize, height, y * _quadSize));
+                    mesh.normals.push_back(linalg::normalize(vec3(-std::cos(x * 0.3f) * 0.3f, 1.f, std::sin(y * 0.2f) * 0.2f)));
+                    mesh.texCoords.push_back({ x * 1.37f + 0.1f, y * 1.37f + 0.1f });
+                }
+            }
+            return mesh;
+        }
+
+        void checkRoundTrip(const TestMesh& _mesh)
+        {
+            const u32 numVertex = u32(_mesh.positions.size());
+
+            CompressedVertexStreams streams;
+            compressVertexStreams(numVertex, _mesh.positions.data(), _mesh.normals.data(), _mesh.texCoords.data(), streams);
+            TIM_CHECK(streams.blocks.size() == (numVertex + VERTEX_BLOCK_SIZE - 1) / VERTEX_BLOCK_SIZE);
+
+            // Half a quantization step and the float rounding per axis, 16 bits octahedral normals, half precision of the uv range of a block
+            float maxCoord = 0, maxUvRange = 0;
+            for (u32 i = 0; i < numVertex; ++i)
+            {
+                maxCoord = std::max(maxCoord, linalg::maxelem(linalg::abs(_mesh.positions[i])));
+
+                const vec2 uv = _mesh.texCoords[i] - streams.blocks[i >> VERTEX_BLOCK_SHIFT].uvOffset.xy();
+                maxUvRange = std::max(maxUvRange, std::max(uv.x, uv.y));
+            }
+
+            const float positionBound = (streams.blocks[0].origin_scale.w * 0.5f + maxCoord * std::ldexp(1.f, -23)) * std::sqrt(3.f);
+            const float uvBound = std::max(maxUvRange, 1.f) * std::ldexp(1.f, -11) * std::sqrt(2.f);
+
+            const VertexCompressionError error = measureVertexCompressionError(streams, _mesh.positions.data(), _mesh.normals.data(), _mesh.texCoords.data());
+            TIM_CHECK(error.position <= positionBound);
+            TIM_CHECK(error.normal < 1e-4f);
+            TIM_CHECK(error.texCoord <= uvBound);
+
+            // The decoded streams are the ones measured
+            std::vector<vec3> positions(numVertex), normals(numVertex);
+            std::vector<vec2> texCoords(numVertex);
+            decompressVertexStreams(streams, positions.data(), normals.data(), texCoords.data());
+
+            u32 numErrors = 0;
+            for (u32 i = 0; i < numVertex; ++i)
+            {
+                numErrors += linalg::length(positions[i] - _mesh.positions[i]) > positionBound ? 1 : 0;
+                numErrors += linalg::length(texCoords[i] - _mesh.texCoords[i]) > uvBound ? 1 : 0;
+            }
+            TIM_CHECK(numErrors == 0);
+        }
+    }
+
+    TIM_TEST(VertexCompression_SphereRoundTrip)
+    {
+        checkRoundTrip(createSphere({ 0, 0, 0 }, 1.f, 32, 48));
+        checkRoundTrip(createSphere({ -250, 12, 3000 }, 0.05f, 8, 8));
+    }
+
+    TIM_TEST(VertexCompression_TiledTerrainRoundTrip)
+    {
+        // Uvs up to 120 : without the block offsets the half precision is 1/16 there
+        const TestMesh terrain = createTerrain({ 1000, -20, -500 }, 2.f, 6);
+        checkRoundTrip(terrain);
+
+        CompressedVertexStreams streams;
+        compressVertexStreams(u32(terrain.positions.size()), terrain.positions.data(), terrain.normals.data(), terrain.texCoords.data(), streams);
+        const VertexCompressionError error = measureVertexCompressionError(streams, terrain.positions.data(), terrain.normals.data(), terrain.texCoords.data());
+        TIM_CHECK(error.texCoord < 2e-2f);
+    }
+
+    TIM_TEST(VertexCompression_HalfConversion)
+    {
+        const float values[] = { 0.f, -0.f, 1.f, -2.5f, 0.333f, 65504.f, 6.1e-5f, 3e-7f };
+        for (float value : values)
+        {
+            const float decoded = halfToFloat(floatToHalf(value));
+            TIM_CHECK(std::abs(decoded - value) <= std::abs(value) * std::ldexp(1.f, -11) + std::ldexp(1.f, -25));
+        }
+        TIM_CHECK(std::isinf(halfToFloat(floatToHalf(1e6f))));
+    }
+}
@@ -0,0 +1,193 @@
+#include "Test.h"
+#include "MockRenderer.h"
+#include "Renderer/VirtualTexturePool.h"
+
+#include <cstring>
+#include <filesystem>
+
+namespace tim
+{
+    namespace
+    {
+        u32 readU32(const ubyte* _ptr)
+        {
+            u32 value;
+            memcpy(&value, _ptr, sizeof(u32));
+            return value;
+        }
+
+        std::unique_ptr<CookedTexture> cookTexture(const TextureCooker& _cooker, u32 _width, u32 _height, u64 _sourceHash)
+        {
+            std::vector<ubyte> rgba(size_t(_width) * _height * 4, 255);
+            for (size_t i = 0; i < rgba.size(); i += 4)
+                rgba[i] = ubyte(i / 4);
+
+            std::unique_ptr<CookedTexture> cooked = std::make_unique<CookedTexture>();
+            _cooker.cook(rgba.data(), _width, _height, _width * 4, false, _sourceHash, 1, *cooked);
+            return cooked;
+        }
+    }
+
+    TIM_TEST(VirtualTexture_PackPageWrapsBorders)
+    {
+        // Each texel stores its coordinates
+        const u32 width = 300, height = 200;
+        std::vector<u32> mip(width * height);
+        for (u32 y = 0; y < height; ++y)
+            for (u32 x = 0; x < width; ++x)
+                mip[y * width + x] = x | (y << 16);
+
+        std::vector<ubyte> page(VirtualTexturePool::getPackedPageSize(ImageFormat::RGBA8_SRGB));
+        TIM_CHECK(page.size() == VT_PAGE_SLOT_SIZE * VT_PAGE_SLOT_SIZE * 4);
+
+        const uvec2 pages[] = { { 0, 0 }, { 2, 1 } };
+        for (uvec2 p : pages)
+        {
+            VirtualTexturePool::packPage((const ubyte*)mip.data(), ImageFormat::RGBA8_SRGB, width, height, p.x, p.y, page.data());
+
+            u32 numErrors = 0;
+            for (u32 y = 0; y < VT_PAGE_SLOT_SIZE; ++y)
+            {
+                for (u32 x = 0; x < VT_PAGE_SLOT_SIZE; ++x)
+                {
+                    const u32 srcX = (p.x * VT_PAGE_SIZE + x + width - VT_PAGE_BORDER) % width;
+                    const u32 srcY = (p.y * VT_PAGE_SIZE + y + height - VT_PAGE_BORDER) % height;
+                    numErrors += readU32(&page[(y * VT_PAGE_SLOT_SIZE + x) * 4]) != (srcX | (srcY << 16)) ? 1 : 0;
+                }
+            }
+            TIM_CHECK(numErrors == 0);
+        }
+    }
+
+    TIM_TEST(VirtualTexture_PackPageCompressedBlocks)
+    {
+        // BC1 mip of 16x10 blocks, each block stores its block coordinates in its first bytes
+        const u32 width = 64, height = 40;
+        const u32 blocksX = width / 4, blocksY = height / 4;
+        std::vector<ubyte> mip(blocksX * blocksY * 8, 0);
+        for (u32 y = 0; y < blocksY; ++y)
+        {
+            for (u32 x = 0; x < blocksX; ++x)
+            {
+                mip[(y * blocksX + x) * 8 + 0] = ubyte(x);
+                mip[(y * blocksX + x) * 8 + 1] = ubyte(y);
+            }
+        }
+
+        const u32 slotBlocks = VT_PAGE_SLOT_SIZE / 4;
+        std::vector<ubyte> page(VirtualTexturePool::getPackedPageSize(ImageFormat::BC1_SRGB));
+        TIM_CHECK(page.size() == slotBlocks * slotBlocks * 8);
+
+        VirtualTexturePool::packPage(mip.data(), ImageFormat::BC1_SRGB, width, height, 0, 0, page.data());
+
+        // The mip is smaller than a page, it repeats with a one block border
+        u32 numErrors = 0;
+        for (u32 y = 0; y < slotBlocks; ++y)
+        {
+            for (u32 x = 0; x < slotBlocks; ++x)
+            {
+                const u32 srcX = (x + blocksX - VT_PAGE_BORDER / 4) % blocksX;
+                const u32 srcY = (y + blocksY - VT_PAGE_BORDER / 4) % blocksY;
+                const ubyte* block = &page[(y * slotBlocks + x) * 8];
+                numErrors += block[0] != srcX || block[1] != srcY ? 1 : 0;
+            }
+        }
+        TIM_CHECK(numErrors == 0);
+    }
+
+    TIM_TEST(VirtualTexture_BuildPageTableUsesFinestResidentMip)
+    {
+        // 4x2 pages at mip 0, 2x1 at mip 1, a single page for the coarser mips
+        VirtualTexturePool::TextureLayout layout;
+        layout.width = 512;
+        layout.height = 256;
+        layout.numMips = 10;
+        layout.atlas = VT_ATLAS_BC7;
+
+        std::vector<std::vector<u32>> residency(layout.numMips);
+        for (u32 mip = 0; mip < layout.numMips; ++mip)
+            residency[mip].assign(VirtualTexturePool::getNumPages(layout, mip), u32(-1));
+
+        TIM_CHECK(residency[0].size() == 8 && residency[1].size() == 2 && residency[2].size() == 1);
+
+        auto entry = [&](u32 _page, u32 _mip) { return _page | (layout.atlas << VT_ENTRY_ATLAS_SHIFT) | (_mip << VT_ENTRY_MIP_SHIFT); };
+
+        u32 pageTable[8];
+        VirtualTexturePool::buildPageTable(layout, residency, pageTable);
+        for (u32 i = 0; i < 8; ++i)
+            TIM_CHECK(pageTable[i] == VT_INVALID_ENTRY);
+
+        residency[9][0] = 5;
+        residency[1][1] = 7;  // right half
+        residency[0][4] = 11; // x = 0, y = 1
+        VirtualTexturePool::buildPageTable(layout, residency, pageTable);
+
+        for (u32 y = 0; y < 2; ++y)
+        {
+            for (u32 x = 0; x < 4; ++x)
+            {
+                u32 expected = entry(5, 9);
+                if (x == 0 && y == 1)
+                    expected = entry(11, 0);
+                else if (x >= 2)
+                    expected = entry(7, 1);
+
+                TIM_CHECK(pageTable[y * 4 + x] == expected);
+            }
+        }
+    }
+
+    TIM_TEST(VirtualTexture_EvictedSlotsAreNotReusedWhileInFlight)
+    {
+        const std::filesystem::path cacheFolder = std::filesystem::temp_directory_path() / "tim_tests_vt";
+        {
+            TextureCooker cooker(cacheFolder.string() + "/", TextureCompression::None, MipFilter::Box);
+            MockRenderer renderer;
+            VirtualTexturePool pool(&renderer, 4);
+
+            const u32 texA = pool.reserveTexture();
+            const u32 texB = pool.reserveTexture();
+            pool.setTextureData(texA, cookTexture(cooker, 512, 512, 1));
+            pool.setTextureData(texB, cookTexture(cooker, 512, 512, 2));
+
+            // Physical pages referenced by the page tables of the last frames, the GPU may still sample them
+            std::vector<std::vector<u32>> pageTableHistory;
+            u32 numEvictions = 0, numUploads = 0, numUnsafeUploads = 0;
+
+            for (u32 frame = 0; frame < 40; ++frame)
+            {
+                renderer.BeginFrame();
+                pool.requestTexture(frame < 20 ? texA : texB, 1e-4f, 1.f);
+                pool.update(4);
+
+                numEvictions += pool.getStats().numEvictedPages;
+                for (const MockRenderer::ImageUpload& upload : renderer.getImageUploads())
+                {
+                    const uvec2 slot = upload.offset / u32(VT_PAGE_SLOT_SIZE);
+                    const u32 physicalPage = slot.y * VT_ATLAS_PAGES_PER_SIDE + slot.x;
+                    TIM_CHECK(physicalPage < 4);
+
+                    const size_t firstFrame = pageTableHistory.size() > TIM_FRAME_LATENCY ? pageTableHistory.size() - TIM_FRAME_LATENCY : 0;
+                    for (size_t i = firstFrame; i < pageTableHistory.size(); ++i)
+                    {
+                        for (u32 entry : pageTableHistory[i])
+                            numUnsafeUploads += entry != VT_INVALID_ENTRY && (entry & VT_ENTRY_PAGE_MASK) == physicalPage ? 1 : 0;
+                    }
+                    numUploads++;
+                }
+
+                // The page table is the first dynamic buffer of the update
+                const std::vector<ubyte>& pageTableData = renderer.getDynamicBuffers().front();
+                std::vector<u32>& pageTable = pageTableHistory.emplace_back(pageTableData.size() / sizeof(u32));
+                memcpy(pageTable.data(), pageTableData.data(), pageTable.size() * sizeof(u32));
+            }
+
+            TIM_CHECK(numEvictions > 0);
+            TIM_CHECK(numUploads > 4);
+            TIM_CHECK(numUnsafeUploads == 0);
+        }
+
+        std::error_code ec;
+        std::filesystem::remove_all(cacheFolder, ec);
+    }
+}
@@ -4,11 +4,16 @@
 #include "Renderer/raytracingPass.h"
 #include "Renderer/lightProbFieldPass.h"
 #include "Renderer/postprocessPass.h"
+#include "Renderer/FrameGraph.h"
 #include "Renderer/SimpleCamera.h"
 #include "Renderer/shaderMacros.h"
 #include "Renderer/TextureManager.h"
 #include "Renderer/Scene.h"
 #include "Renderer/BVHData.h"
+#include "Renderer/SampleSequence.h"
+#include "Renderer/ObjParser.h"
+#include "timCore/Profiler.h"
+#include "timCore/SimdMath.h"
 
 #include <iostream>
 
@@ -24,6 +29,7 @@ bool g_windowMinimized = false;
 bool g_editSun = false;
 SunData g_sunData;
 uvec3 g_lpfResolution = { 0,0,0 };
+bool g_exportTrace = false;
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
@@ -36,6 +42,9 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if (key == GLFW_KEY_F10 && action == GLFW_PRESS)
         g_renderer->InvalidateShaders();
 
+    if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+        g_exportTrace = true;
+
     if (key == GLFW_KEY_L && action == GLFW_PRESS)
     { 
         float sunValue = 1;
@@ -157,6 +166,25 @@ void window_iconify_callback(GLFWwindow* window, int iconified)
 int main(int argc, char* argv[])
 {
     printf("%s\n",argv[0]);
+
+    if (argc > 1 && strcmp(argv[1], "-benchLpfSampling") == 0)
+    {
+        runSampleSequenceBenchmark(NUM_RAYS_PER_PROB, 256, 0.03f);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-benchObjParsing") == 0)
+    {
+        runObjParserBenchmark({ "./data/suzanne.obj", "./data/cornell.obj", "./data/sponza.obj", "./data/room/room.obj" }, 2 * 1024 * 1024);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "-benchSimdMath") == 0)
+    {
+        runSimdMathBenchmark(4096, 1000);
+        return 0;
+    }
+
 	GLFWwindow* window;
 
 	/* Initialize the library */
@@ -190,7 +218,7 @@ int main(int argc, char* argv[])
     {
         const u32 downScaleFactor = 8;
         TextureManager textureManager(g_renderer, downScaleFactor);
-        textureManager.loadTexture("./data/image/ibl_brdf_lut.png");
+        textureManager.loadTexture("./data/image/ibl_brdf_lut.png", false);
 
         Scene scene(g_renderer, textureManager);
         {
@@ -207,9 +235,10 @@ int main(int argc, char* argv[])
             scene.build(blasParams, tlasParams, false);
         }
         bool needClearLpf = true;
+        uvec2 reportedResolution = { 0, 0 };
 
         RayTracingPass rtPass(g_renderer, context, resourceAllocator, textureManager);
-        LightProbFieldPass lpfPass(g_renderer, context, resourceAllocator, textureManager);
+        LightProbFieldPass lpfPass(g_renderer, context, textureManager);
         PostprocessPass postprocessPass(g_renderer, context);
 
         double prevTime = glfwGetTime();
@@ -224,6 +253,7 @@ int main(int argc, char* argv[])
 
             if (!g_windowMinimized)
             {
+                TIM_PROFILE_SCOPE("Frame");
                 camera.update(float(frameTime));
 
                 if (g_rebuildBvh)
@@ -260,10 +290,17 @@ int main(int argc, char* argv[])
                     g_lpfResolution = {};
                 }
 
+                // Textures requested by the scene keep loading in background, a few of them are uploaded every frame
+                textureManager.processPendingUploads(4);
+
                 g_renderer->BeginFrame();
+
+                // Stream the virtual texture pages needed at the current camera position, uploads are recorded in the frame
+                textureManager.updateVirtualTextures(camera.getPos(), (70.f * 3.14f / 180) / frameResolution.y);
                 ImageHandle backbuffer = g_renderer->GetBackBuffer();
 
                 context->BeginRender();
+                context->BeginScope("Frame");
                 context->ClearImage(backbuffer, Color{ 0, 0, 0, 0 });
                 if (needClearLpf)
                 {
@@ -275,44 +312,101 @@ int main(int argc, char* argv[])
                 rtPass.setFrameBufferSize(frameResolution);
                 scene.setSunData(g_sunData);
 
-                LightProbFieldPass::PassResource lpfPassResources = lpfPass.fillPassResources(scene);
-                lpfPass.traceLightProbField(scene, lpfPassResources);
-                lpfPass.updateLightProbField(scene, lpfPassResources);
-                lpfPass.freePassResources(lpfPassResources);
+                const BufferUsage transientBufferUsage = BufferUsage::Storage | BufferUsage::Transfer;
+                FrameGraph frameGraph(resourceAllocator);
+                const FrameResource backbufferResource = frameGraph.importTexture("Backbuffer", backbuffer);
 
-                ImageCreateInfo imgInfo(ImageFormat::RGBA16F, frameResolution.x, frameResolution.y, 1, 1, ImageType::Image2D, MemoryType::Default);
-                ImageHandle outputColorBuffer = resourceAllocator.allocTexture(imgInfo);
+                FrameResource lpfIrradiance, lpfTracingResult;
+                frameGraph.addPass("LightProbField", [&](FrameGraph::PassBuilder& _builder)
+                {
+                    lpfIrradiance = _builder.createBuffer("LPF irradiance", lpfPass.getIrradianceBufferSize(scene), transientBufferUsage);
+                    lpfTracingResult = _builder.createBuffer("LPF tracing result", lpfPass.getTracingResultBufferSize(scene), transientBufferUsage);
+                    _builder.setSideEffect(); // updates the light prob field of the scene
+                }, 
+                [&](const FrameGraph& _graph)
+                {
+                    LightProbFieldPass::PassResource lpfPassResources = lpfPass.fillPassResources(scene, _graph.getBufferView(lpfIrradiance), _graph.getBufferView(lpfTracingResult));
+                    lpfPass.traceLightProbField(scene, lpfPassResources);
+                    lpfPass.updateLightProbField(scene, lpfPassResources);
+                });
 
-                RayTracingPass::PassResource rtPassResources = rtPass.fillPassResources(camera, scene);
-                rtPass.tracePass(outputColorBuffer, scene, rtPassResources);
-                rtPass.lightingPass(outputColorBuffer, scene, rtPassResources);
-                rtPass.freePassResources(rtPassResources);
+                FrameResource outputColorBuffer, tracingResult, reflexionRays, refractionRays;
+                frameGraph.addPass("RayTracing", [&](FrameGraph::PassBuilder& _builder)
+                {
+                    outputColorBuffer = _builder.createTexture("Output color", ImageCreateInfo(ImageFormat::RGBA16F, frameResolution.x, frameResolution.y, 1, 1, ImageType::Image2D, MemoryType::Default));
+                    tracingResult = _builder.createBuffer("Tracing result", rtPass.getTracingResultBufferSize(), transientBufferUsage);
+                    reflexionRays = _builder.createBuffer("Reflexion rays", rtPass.getRayStorageBufferSize(), transientBufferUsage);
+                    refractionRays = _builder.createBuffer("Refraction rays", rtPass.getRayStorageBufferSize(), transientBufferUsage);
+                },
+                [&](const FrameGraph& _graph)
+                {
+                    RayTracingPass::PassResource rtPassResources = rtPass.fillPassResources(camera, scene, _graph.getBufferView(tracingResult), _graph.getBuffer(reflexionRays), _graph.getBuffer(refractionRays));
+                    rtPass.tracePass(_graph.getTexture(outputColorBuffer), scene, rtPassResources);
+                    rtPass.lightingPass(_graph.getTexture(outputColorBuffer), scene, rtPassResources);
+                });
 
-                ImageCreateInfo imgInfo2(ImageFormat::RGBA8, frameResolution.x, frameResolution.y, 1, 1, ImageType::Image2D, MemoryType::Default, ImageUsage::Sampled | ImageUsage::Storage);
-                ImageHandle finalOutput = resourceAllocator.allocTexture(imgInfo2);
+                FrameResource finalOutput;
+                frameGraph.addPass("Tonemap", [&](FrameGraph::PassBuilder& _builder)
+                {
+                    _builder.read(outputColorBuffer);
+                    finalOutput = _builder.createTexture("Final output", ImageCreateInfo(ImageFormat::RGBA8, frameResolution.x, frameResolution.y, 1, 1, ImageType::Image2D, MemoryType::Default, ImageUsage::Sampled | ImageUsage::Storage));
+                },
+                [&](const FrameGraph& _graph)
+                {
+                    postprocessPass.tonemapPass(_graph.getTexture(outputColorBuffer), _graph.getTexture(finalOutput));
+                });
 
-                postprocessPass.tonemapPass(outputColorBuffer, finalOutput);
-                resourceAllocator.releaseTexture(outputColorBuffer);
+                frameGraph.addPass("CopyToBackbuffer", [&](FrameGraph::PassBuilder& _builder)
+                {
+                    _builder.read(finalOutput);
+                    _builder.write(backbufferResource);
+                },
+                [&](const FrameGraph& _graph)
+                {
+                    postprocessPass.copyImage(_graph.getTexture(finalOutput), _graph.getTexture(backbufferResource), backbufferResolution);
+                });
 
-                postprocessPass.copyImage(finalOutput, backbuffer, backbufferResolution);
-                resourceAllocator.releaseTexture(finalOutput);
+                frameGraph.compile();
+                if (reportedResolution != frameResolution)
+                {
+                    frameGraph.printMemoryReport();
+                    reportedResolution = frameResolution;
+                }
+                frameGraph.execute(context);
 
+                context->EndScope();
                 context->EndRender();
 
                 g_renderer->Execute(context);
 
                 g_renderer->EndFrame();
                 g_renderer->Present();
+                resourceAllocator.nextFrame();
 
                 frameCounter++;
                 double curTime = glfwGetTime();
                 if (curTime - prevTimeForFps > 1)
                 {
                     std::cout << "FPS : " << u32(0.5f + float(frameCounter) / float(curTime - prevTimeForFps)) << std::endl;
+
+                    const RenderContextStats& ctxStats = context->GetStats();
+                    std::cout << "Dispatch : " << u32(0.5 + 1000000.0 * ctxStats.dispatchCpuTime / std::max(ctxStats.numDispatches, 1u)) << "us CPU, "
+                              << ctxStats.numBindCalls / std::max(frameCounter, 1u) << " binds per frame, " << ctxStats.numSkippedTables << " skipped tables" << std::endl;
+                    if (ctxStats.numSkippedDispatches > 0)
+                        std::cout << ctxStats.numSkippedDispatches << " dispatches skipped, their shader failed to compile" << std::endl;
+                    context->ResetStats();
+                    Profiler::get().printSummary();
+
                     prevTimeForFps = curTime;
                     frameCounter = 0;
                 }
 
+                if (g_exportTrace)
+                {
+                    Profiler::get().exportChromeTrace("trace.json");
+                    g_exportTrace = false;
+                }
+
                 frameTime = curTime - prevTime;
                 prevTime = curTime;
             }
@@ -324,6 +418,7 @@ int main(int argc, char* argv[])
         }
 
         g_renderer->WaitForIdle();
+        Profiler::get().exportChromeTrace("trace.json");
     }
 
     resourceAllocator.clear();
@@ -4,7 +4,7 @@
 
 namespace tim
 {
-    Buffer::Buffer(u64 _size, MemoryType _memType, BufferUsage _usage)
+    Buffer::Buffer(u64 _size, MemoryType _memType, BufferUsage _usage, MemoryTag _tag) : m_size{ _size }, m_tag{ _tag }
     {
         VezBufferCreateInfo createInfo = {};
         createInfo.size = _size;
@@ -28,10 +28,12 @@ namespace tim
         }
 
         TIM_VK_VERIFY(vezCreateBuffer(VezRenderer::get().getVkDevice(), memFlags, &createInfo, &m_buffer));
+        MemoryTracker::get().onAlloc(MemoryPool::Gpu, m_tag, m_size);
     }
 
     Buffer::~Buffer()
     {
         vezDestroyBuffer(VezRenderer::get().getVkDevice(), m_buffer);
+        MemoryTracker::get().onFree(MemoryPool::Gpu, m_tag, m_size);
     }
 }
\ No newline at end of file
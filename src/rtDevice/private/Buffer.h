@@ -7,12 +7,14 @@ namespace tim
     class Buffer
     {
     public:
-        Buffer(u64 _size, MemoryType _memType, BufferUsage _usage);
+        Buffer(u64 _size, MemoryType _memType, BufferUsage _usage, MemoryTag _tag = MemoryTag::Other);
         ~Buffer();
 
         VkBuffer getVkBuffer() const { return m_buffer; }
 
     private:
         VkBuffer m_buffer = VK_NULL_HANDLE;
+        u64 m_size;
+        MemoryTag m_tag;
     };
 }
\ No newline at end of file
@@ -22,6 +22,12 @@ namespace tim
                 return VkFormat::VK_FORMAT_B8G8R8A8_UNORM;
             case ImageFormat::RGBA8_SRGB:
                 return _isStorage ? VkFormat::VK_FORMAT_R8G8B8A8_UNORM : VkFormat::VK_FORMAT_R8G8B8A8_SRGB;
+            case ImageFormat::BC1_SRGB:
+                TIM_ASSERT(!_isStorage);
+                return VkFormat::VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+            case ImageFormat::BC7_SRGB:
+                TIM_ASSERT(!_isStorage);
+                return VkFormat::VK_FORMAT_BC7_SRGB_BLOCK;
             default:
                 TIM_ASSERT(false);
                 return VkFormat::VK_FORMAT_R8G8B8A8_UNORM;
@@ -29,7 +35,7 @@ namespace tim
         }
     }
 
-    Image::Image(const ImageCreateInfo& _desc) : m_desc{ _desc }
+    Image::Image(const ImageCreateInfo& _desc, MemoryTag _tag) : m_desc{ _desc }, m_tag{ _tag }
     {
         VezImageCreateInfo info = {};
         VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -100,6 +106,7 @@ namespace tim
         info.format = toVkFormat(m_desc.format, isStorage);
 
         TIM_VK_VERIFY(vezCreateImage(VezRenderer::get().getVkDevice(), memFlags, &info, &m_image));
+        MemoryTracker::get().onAlloc(MemoryPool::Gpu, m_tag, computeImageSize(m_desc));
 
         VezImageViewCreateInfo viewCreateInfo = {};
         viewCreateInfo.image = m_image;
@@ -117,6 +124,8 @@ namespace tim
         }
         if (isSampled)
         {
+            // Sampled view sees the whole mip chain, storage view only the first mip
+            viewCreateInfo.subresourceRange.levelCount = info.mipLevels;
             viewCreateInfo.format = toVkFormat(m_desc.format, false);
             TIM_VK_VERIFY(vezCreateImageView(VezRenderer::get().getVkDevice(), &viewCreateInfo, &m_sampledView));
         }
@@ -128,5 +137,6 @@ namespace tim
         vezDestroyImageView(VezRenderer::get().getVkDevice(), m_sampledView);
         vezDestroyImageView(VezRenderer::get().getVkDevice(), m_storageView);
         vezDestroyImage(VezRenderer::get().getVkDevice(), m_image);
+        MemoryTracker::get().onFree(MemoryPool::Gpu, m_tag, computeImageSize(m_desc));
     }
 }
\ No newline at end of file
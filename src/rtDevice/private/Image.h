@@ -7,7 +7,7 @@ namespace tim
     class Image
     {
     public:
-        Image(const ImageCreateInfo&);
+        Image(const ImageCreateInfo&, MemoryTag _tag = MemoryTag::Other);
         ~Image();
 
         const ImageCreateInfo& getDesc() const { return m_desc; }
@@ -18,6 +18,7 @@ namespace tim
 
     private:
         ImageCreateInfo m_desc;
+        MemoryTag m_tag;
         VkImage m_image;
         VkImageView m_storageView = VK_NULL_HANDLE;
         VkImageView m_sampledView = VK_NULL_HANDLE;
@@ -1,17 +1,170 @@
 #include "PipelineStateCache.h"
 #include "ShaderCompiler/ShaderCompiler.h"
 #include "VezRenderer.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
 
 namespace tim
 {
+    namespace
+    {
+        constexpr u32 g_ManifestMaxUnusedRuns = 16;
+    }
+
+    PipelineStateCache::PipelineStateCache(ShaderCompiler& _shaderCompiler) : m_shaderCompiler{ _shaderCompiler }
+    {
+        m_manifestPath = m_shaderCompiler.getCacheFolder() + "variants.manifest";
+        for (const ShaderKey& key : loadManifest())
+            m_unusedKeys.insert(key);
+    }
+
+    void PipelineStateCache::prewarm()
+    {
+        std::vector<ShaderKey> keys(m_unusedKeys.begin(), m_unusedKeys.end());
+        if (keys.empty())
+            return;
+
+        m_shaderCompiler.precompile(keys);
+
+        u32 numPipelines = 0;
+        for (const ShaderKey& key : keys)
+        {
+            // Variants of removed or broken shaders are left to the first dispatch using them
+            if (m_shaderCompiler.hasShaderMicrocode(key.fx, key.flags) && m_cache.count(key) == 0)
+            {
+                createComputePipeline(key);
+                numPipelines++;
+            }
+        }
+
+        std::cout << "Prewarmed " << numPipelines << " pipelines from " << m_manifestPath << std::endl;
+    }
+
+    void PipelineStateCache::reloadChangedShaders(double _checkPeriod)
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - m_lastSourceCheck).count() >= _checkPeriod)
+        {
+            m_shaderCompiler.checkForChanges();
+            m_lastSourceCheck = now;
+        }
+
+        m_reloadedKeys.clear();
+        m_shaderCompiler.collectReloadedShaders(m_reloadedKeys);
+        for (const ShaderKey& key : m_reloadedKeys)
+        {
+            // Frames in flight may still use the previous pipeline, it is destroyed TIM_FRAME_LATENCY frames later
+            auto it = m_cache.find(key);
+            if (it != m_cache.end())
+            {
+                if (it->second != VK_NULL_HANDLE)
+                    m_dirtyPipeline.push_back({ it->second, m_frame });
+                m_cache.erase(it);
+            }
+            createComputePipeline(key);
+        }
+    }
+
+    void PipelineStateCache::nextFrame()
+    {
+        m_frame++;
+
+        for (u32 i = 0; i < m_dirtyPipeline.size();)
+        {
+            if (m_dirtyPipeline[i].frame + TIM_FRAME_LATENCY > m_frame)
+            {
+                ++i;
+                continue;
+            }
+
+            vezDestroyPipeline(VezRenderer::get().getVkDevice(), m_dirtyPipeline[i].pipeline);
+            m_dirtyPipeline[i] = m_dirtyPipeline.back();
+            m_dirtyPipeline.pop_back();
+        }
+    }
+
+    std::vector<ShaderKey> PipelineStateCache::loadManifest()
+    {
+        // A "run" line with the counter of the sessions, then one variant per line: fx hash, flags and the last run using it.
+        // A variant used again is appended with the new run, the highest one wins.
+        ska::flat_hash_map<ShaderKey, u32> lastRuns;
+        {
+            std::ifstream file(m_manifestPath);
+            std::string line;
+            while (std::getline(file, line))
+            {
+                std::istringstream stream(line);
+                if (line.rfind("run ", 0) == 0)
+                {
+                    stream.ignore(4) >> m_run;
+                    continue;
+                }
+
+                ShaderKey key;
+                u32 lastRun = 0;
+                if (stream >> key.fx >> std::hex >> key.flags.m_flags >> std::dec)
+                {
+                    stream >> lastRun;
+                    u32& stamp = lastRuns[key];
+                    stamp = std::max(stamp, lastRun);
+                }
+            }
+        }
+        m_run++;
+
+        // Compact the manifest, the variants of this run are appended by recordKey
+        std::vector<ShaderKey> keys;
+        std::ofstream file(m_manifestPath, std::ios::trunc);
+        file << "run " << m_run << "\n";
+        for (const auto& [key, lastRun] : lastRuns)
+        {
+            if (m_run - lastRun > g_ManifestMaxUnusedRuns)
+                continue;
+
+            file << key.fx << " " << std::hex << key.flags.m_flags << std::dec << " " << lastRun << "\n";
+            keys.push_back(key);
+        }
+
+        if (keys.size() < lastRuns.size())
+            std::cout << "Dropped " << lastRuns.size() - keys.size() << " unused variants from " << m_manifestPath << std::endl;
+        return keys;
+    }
+
+    void PipelineStateCache::recordKey(const ShaderKey& _key)
+    {
+        if (!m_recordedKeys.insert(_key).second)
+            return;
+
+        m_unusedKeys.erase(_key);
+        std::ofstream file(m_manifestPath, std::ios::app);
+        file << _key.fx << " " << std::hex << _key.flags.m_flags << std::dec << " " << m_run << "\n";
+    }
+
     VezPipeline PipelineStateCache::getComputePipeline(const ShaderKey& _key)
     {
         auto it = m_cache.find(_key);
         if (it != m_cache.end())
+        {
+            if (!m_unusedKeys.empty() && m_unusedKeys.count(_key) > 0)
+                recordKey(_key);
             return it->second;
+        }
+
+        recordKey(_key);
+        return createComputePipeline(_key);
+    }
+
+    VezPipeline PipelineStateCache::createComputePipeline(const ShaderKey& _key)
+    {
+        const Blob& blob = m_shaderCompiler.getShaderMicrocode(_key.fx, _key.flags);
+        if (blob.empty())
+        {
+            // Failed to compile, the dispatches using it are skipped until a reload succeeds
+            m_cache[_key] = VK_NULL_HANDLE;
+            return VK_NULL_HANDLE;
+        }
 
-        auto blob = m_shaderCompiler.getShaderMicrocode(_key.fx, _key.flags);
-        
         VezShaderModuleCreateInfo createInfo = {};
         createInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
         createInfo.codeSize = blob.size();
@@ -38,14 +191,17 @@ namespace tim
     PipelineStateCache::~PipelineStateCache()
     {
         clear();
-        for (VezPipeline pipeline : m_dirtyPipeline)
-            vezDestroyPipeline(VezRenderer::get().getVkDevice(), pipeline);
+        for (const DirtyPipeline& dirty : m_dirtyPipeline)
+            vezDestroyPipeline(VezRenderer::get().getVkDevice(), dirty.pipeline);
     }
 
     void PipelineStateCache::clear()
     {
         for (auto& [key, pso] : m_cache)
-            m_dirtyPipeline.push_back(pso);
+        {
+            if (pso != VK_NULL_HANDLE)
+                m_dirtyPipeline.push_back({ pso, m_frame });
+        }
         
         for (VkShaderModule module : m_allModules)
             vezDestroyShaderModule(VezRenderer::get().getVkDevice(), module);
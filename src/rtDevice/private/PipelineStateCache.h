@@ -3,6 +3,9 @@
 #include "timCore/type.h"
 #include "ShaderCompiler/ShaderFlags.h"
 #include <VEZ.h>
+#include <string>
+#include <chrono>
+#include <vector>
 
 namespace tim
 {
@@ -11,17 +14,43 @@ namespace tim
     class PipelineStateCache
     {
     public:
-        PipelineStateCache(ShaderCompiler& _shaderCompiler) : m_shaderCompiler{ _shaderCompiler } {}
+        PipelineStateCache(ShaderCompiler& _shaderCompiler);
         ~PipelineStateCache();
 
         void clear();
 
+        // Compile and create the pipelines of every variant recorded in the manifest by the previous sessions, the variants
+        // no session used for g_ManifestMaxUnusedRuns runs are dropped from it
+        void prewarm();
+
+        // Swap in the pipelines of the variants recompiled after a source change, sources are checked at most every _checkPeriod seconds
+        void reloadChangedShaders(double _checkPeriod);
+        // Destroy the pipelines replaced TIM_FRAME_LATENCY frames ago, called once the fence of the frame starting is waited
+        void nextFrame();
+
         VezPipeline getComputePipeline(const ShaderKey& _key);
 
+    private:
+        std::vector<ShaderKey> loadManifest();
+        void recordKey(const ShaderKey& _key);
+        VezPipeline createComputePipeline(const ShaderKey& _key);
+
     private:
         ShaderCompiler& m_shaderCompiler;
+        std::string m_manifestPath;
+        u32 m_run = 0;
+        ska::flat_hash_set<ShaderKey> m_recordedKeys; // stamped with this run in the manifest
+        ska::flat_hash_set<ShaderKey> m_unusedKeys; // loaded from the manifest, not used yet by this run
+        std::chrono::steady_clock::time_point m_lastSourceCheck;
+        std::vector<ShaderKey> m_reloadedKeys;
         ska::flat_hash_map<ShaderKey, VezPipeline> m_cache;
         std::vector<VkShaderModule> m_allModules;
-        std::vector<VezPipeline> m_dirtyPipeline;
+        struct DirtyPipeline
+        {
+            VezPipeline pipeline;
+            u64 frame; // replaced during this frame, frames in flight may still use it
+        };
+        std::vector<DirtyPipeline> m_dirtyPipeline;
+        u64 m_frame = 0;
     };
 }
@@ -3,33 +3,80 @@
 #include "VezRenderer.h"
 #include "Buffer.h"
 #include "Image.h"
+#include "timCore/Profiler.h"
+#include <chrono>
 
 namespace tim
 {
     RenderContext::RenderContext(RenderContextType _type, u32 _queueIndex) 
-        : m_contextType{ _type }, m_queueIndex{ _queueIndex } 
+        : m_contextType{ _type }, m_queueIndex{ _queueIndex },
+          m_scopes{ VezRenderer::get().m_physicalDeviceProperties.limits.timestampComputeAndGraphics == VK_TRUE, _queueIndex }
     {
         VezCommandBufferAllocateInfo allocInfo = {};
         allocInfo.queue = VezRenderer::get().m_graphicsQueue.m_queue;
         allocInfo.commandBufferCount = TIM_FRAME_LATENCY;
         TIM_VK_VERIFY(vezAllocateCommandBuffers(VezRenderer::get().getVkDevice(), &allocInfo, m_commandBuffer));
+
+        if (m_scopes.useTimestamps())
+        {
+            VezQueryPoolCreateInfo queryInfo = {};
+            queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+            queryInfo.queryCount = ContextScopeTracker::MaxQueries;
+            for (VkQueryPool& queryPool : m_queryPool)
+                TIM_VK_VERIFY(vezCreateQueryPool(VezRenderer::get().getVkDevice(), &queryInfo, &queryPool));
+        }
     }
 
     RenderContext::~RenderContext()
     {
+        for (VkQueryPool queryPool : m_queryPool)
+        {
+            if (queryPool != VK_NULL_HANDLE)
+                vezDestroyQueryPool(VezRenderer::get().getVkDevice(), queryPool);
+        }
         vezFreeCommandBuffers(VezRenderer::get().getVkDevice(), TIM_FRAME_LATENCY, m_commandBuffer);
     }
 
     void RenderContext::BeginRender()
     {
-        vezBeginCommandBuffer(m_commandBuffer[VezRenderer::get().m_frameIndex], 0);
+        const u32 frameIndex = VezRenderer::get().m_frameIndex;
+
+        // The frame fence was waited in BeginFrame, the results of the previous recording are available
+        u64 timestamps[ContextScopeTracker::MaxQueries];
+        const u32 numQueries = m_scopes.getNumQueries(frameIndex);
+        const bool hasTimestamps = numQueries > 0 &&
+            vezGetQueryPoolResults(VezRenderer::get().getVkDevice(), m_queryPool[frameIndex], 0, numQueries, sizeof(u64) * numQueries, timestamps, sizeof(u64),
+                                   VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS;
+        const double usPerTick = double(VezRenderer::get().m_physicalDeviceProperties.limits.timestampPeriod) / 1000.0;
+        m_scopes.beginFrame(frameIndex, hasTimestamps ? timestamps : nullptr, usPerTick);
+
+        vezBeginCommandBuffer(m_commandBuffer[frameIndex], 0);
+        m_boundTables.clear();
+
+        if (m_scopes.useTimestamps())
+            vezCmdResetQueryPool(m_queryPool[frameIndex], 0, ContextScopeTracker::MaxQueries);
     }
 
     void RenderContext::EndRender()
     {
+        m_scopes.endFrame();
         vezEndCommandBuffer();
     }
 
+    void RenderContext::BeginScope(const char* _name)
+    {
+        const u32 query = m_scopes.beginScope(_name);
+        if (query != u32(-1))
+            vezCmdWriteTimestamp(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_queryPool[VezRenderer::get().m_frameIndex], query);
+    }
+
+    void RenderContext::EndScope()
+    {
+        const u32 query = m_scopes.endScope();
+        if (query != u32(-1))
+            vezCmdWriteTimestamp(VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool[VezRenderer::get().m_frameIndex], query);
+    }
+
     namespace
     {
         Image * toImage(ImageHandle _img)
@@ -70,36 +117,77 @@ namespace tim
 
     void RenderContext::Dispatch(const DrawArguments& _drawArgs, u32 _sizeX, u32 _sizeY, u32 _sizeZ)
     {
+        const auto start = std::chrono::high_resolution_clock::now();
+
         VezPipeline pipeline = VezRenderer::get().m_psoCache->getComputePipeline(_drawArgs.m_key);
+        if (pipeline == VK_NULL_HANDLE)
+        {
+            // The shader failed to compile and has no previous version
+            m_stats.numSkippedDispatches++;
+            return;
+        }
         vezCmdBindPipeline(pipeline);
 
         if (_drawArgs.m_constantSize > 0)
             vezCmdPushConstants(0, _drawArgs.m_constantSize, _drawArgs.m_constants);
 
+        // Bindings persist across pipelines in the command buffer, a table still bound is skipped
+        for (u32 i = 0; i < _drawArgs.m_numBindingTables; ++i)
+            bindTable(*_drawArgs.m_bindingTables[i]);
+
         for (u32 i = 0; i < _drawArgs.m_numBufferBindings; ++i)
         {
-            const auto& binding =_drawArgs.m_bufferBindings[i];
-            const Buffer* buf = reinterpret_cast<const Buffer*>(binding.m_buffer.m_buffer.ptr);
-            vezCmdBindBuffer(buf->getVkBuffer(), binding.m_buffer.m_offset, binding.m_buffer.m_range, binding.m_binding.m_set, binding.m_binding.m_slot, binding.m_binding.m_arrayElement);
+            m_boundTables.invalidate(_drawArgs.m_bufferBindings[i].m_binding);
+            bindBuffer(_drawArgs.m_bufferBindings[i]);
         }
 
         for (u32 i = 0; i < _drawArgs.m_numImageBindings; ++i)
         {
-            const auto& binding = _drawArgs.m_imageBindings[i];
-            const Image* img = reinterpret_cast<const Image*>(binding.m_image.ptr);
-
-            if (binding.m_sampler != SamplerType::Count)
-            {
-                TIM_ASSERT(binding.m_viewType == ImageViewType::Sampled);
-                vezCmdBindCombinedImageSampler(img->getVkSampledView(), VezRenderer::get().m_samplers[to_integral(binding.m_sampler)], binding.m_binding.m_set, binding.m_binding.m_slot, binding.m_binding.m_arrayElement);
-            }
-            else
-            {
-                vezCmdBindImageView(binding.m_viewType == ImageViewType::Sampled ? img->getVkSampledView() : img->getVkStorageView(),
-                                    VK_NULL_HANDLE, binding.m_binding.m_set, binding.m_binding.m_slot, binding.m_binding.m_arrayElement);
-            }
+            m_boundTables.invalidate(_drawArgs.m_imageBindings[i].m_binding);
+            bindImage(_drawArgs.m_imageBindings[i]);
         }
 
         vezCmdDispatch(_sizeX, _sizeY, _sizeZ);
+
+        m_stats.numDispatches++;
+        m_stats.dispatchCpuTime += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void RenderContext::bindBuffer(const BufferBinding& _binding)
+    {
+        const Buffer* buf = reinterpret_cast<const Buffer*>(_binding.m_buffer.m_buffer.ptr);
+        vezCmdBindBuffer(buf->getVkBuffer(), _binding.m_buffer.m_offset, _binding.m_buffer.m_range, _binding.m_binding.m_set, _binding.m_binding.m_slot, _binding.m_binding.m_arrayElement);
+        m_stats.numBindCalls++;
+    }
+
+    void RenderContext::bindImage(const ImageBinding& _binding)
+    {
+        const Image* img = reinterpret_cast<const Image*>(_binding.m_image.ptr);
+
+        if (_binding.m_sampler != SamplerType::Count)
+        {
+            TIM_ASSERT(_binding.m_viewType == ImageViewType::Sampled);
+            vezCmdBindCombinedImageSampler(img->getVkSampledView(), VezRenderer::get().m_samplers[to_integral(_binding.m_sampler)], _binding.m_binding.m_set, _binding.m_binding.m_slot, _binding.m_binding.m_arrayElement);
+        }
+        else
+        {
+            vezCmdBindImageView(_binding.m_viewType == ImageViewType::Sampled ? img->getVkSampledView() : img->getVkStorageView(),
+                                VK_NULL_HANDLE, _binding.m_binding.m_set, _binding.m_binding.m_slot, _binding.m_binding.m_arrayElement);
+        }
+        m_stats.numBindCalls++;
+    }
+
+    void RenderContext::bindTable(const BindingTable& _table)
+    {
+        if (!m_boundTables.bind(_table))
+        {
+            m_stats.numSkippedTables++;
+            return;
+        }
+
+        for (const BufferBinding& binding : _table.getBufferBindings())
+            bindBuffer(binding);
+        for (const ImageBinding& binding : _table.getImageBindings())
+            bindImage(binding);
     }
 }
\ No newline at end of file
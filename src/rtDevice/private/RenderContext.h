@@ -1,6 +1,7 @@
 #pragma once
 #include "rtDevice/public/IRenderContext.h"
 #include "Common.h"
+#include "timCore/Profiler.h"
 #include <VEZ.h>
 
 namespace tim
@@ -20,10 +21,26 @@ namespace tim
 
         void Dispatch(const DrawArguments&, u32 _sizeX, u32 _sizeY, u32 _sizeZ = 1) override;
 
+        const RenderContextStats& GetStats() const override { return m_stats; }
+        void ResetStats() override { m_stats = {}; }
+
+        void BeginScope(const char* _name) override;
+        void EndScope() override;
+
+    private:
+        void bindBuffer(const BufferBinding& _binding);
+        void bindImage(const ImageBinding& _binding);
+        void bindTable(const BindingTable& _table);
+
     private:
         RenderContextType m_contextType;
         u32 m_queueIndex;
         VkCommandBuffer m_commandBuffer[TIM_FRAME_LATENCY] = { VK_NULL_HANDLE };
+        BoundBindingTables m_boundTables;
+        RenderContextStats m_stats;
+
+        ContextScopeTracker m_scopes;
+        VkQueryPool m_queryPool[TIM_FRAME_LATENCY] = { VK_NULL_HANDLE };
 
         friend class VezRenderer;
     };
@@ -11,6 +11,7 @@
 namespace tim
 {
     static const u64 g_scratchBufferSize = 4 * 1024 * 1024;
+    static const double g_shaderCheckPeriod = 0.5; // seconds between two checks of the shader sources
     VezRenderer* VezRenderer::s_Renderer = nullptr;
 
 	IRenderer* createRenderer()
@@ -177,7 +178,7 @@ namespace tim
         {
             for (u32 i = 0; i < TIM_FRAME_LATENCY; ++i)
             {
-                m_scratchBuffer[i] = new Buffer(g_scratchBufferSize, MemoryType::Staging, BufferUsage::ConstantBuffer | BufferUsage::Storage);
+                m_scratchBuffer[i] = new Buffer(g_scratchBufferSize, MemoryType::Staging, BufferUsage::ConstantBuffer | BufferUsage::Storage, MemoryTag::Transients);
                 void* ptr; 
                 vezMapBuffer(m_vkDevice, m_scratchBuffer[i]->getVkBuffer(), 0, VK_WHOLE_SIZE, &ptr);
                 TIM_ASSERT(ptr);
@@ -186,6 +187,7 @@ namespace tim
         }
 
         m_psoCache = std::make_unique<PipelineStateCache>(*m_shaderCompiler);
+        m_psoCache->prewarm();
 	}
 
     void VezRenderer::createSwapChain(u32 _x, u32 _y)
@@ -269,9 +271,7 @@ namespace tim
 
     void VezRenderer::InvalidateShaders()
     {
-        vezDeviceWaitIdle(m_vkDevice);
-        m_psoCache->clear();
-        m_shaderCompiler->clearCache();
+        m_psoCache->reloadChangedShaders(0);
     }
 
     void VezRenderer::WaitForIdle()
@@ -285,6 +285,9 @@ namespace tim
         {
             TIM_VK_VERIFY(vezWaitForFences(m_vkDevice, 1, &m_graphicsQueue.m_fences[m_frameIndex], true, u64(-1)));
         }
+
+        m_psoCache->nextFrame();
+        m_psoCache->reloadChangedShaders(g_shaderCheckPeriod);
     }
 
     void VezRenderer::EndFrame()
@@ -353,9 +356,9 @@ namespace tim
         return ImageHandle{ m_backBuffer[m_frameIndex] };
     }
 
-    BufferHandle VezRenderer::CreateBuffer(u32 _size, MemoryType _memType, BufferUsage _usage)
+    BufferHandle VezRenderer::CreateBuffer(u32 _size, MemoryType _memType, BufferUsage _usage, MemoryTag _tag)
     {
-        return BufferHandle{ reinterpret_cast<void *>(new Buffer(_size, _memType, _usage)) };
+        return BufferHandle{ reinterpret_cast<void *>(new Buffer(_size, _memType, _usage, _tag)) };
     }
 
     void VezRenderer::DestroyBuffer(BufferHandle& _buffer)
@@ -382,12 +385,23 @@ namespace tim
         Image* img = reinterpret_cast<Image*>(_handle.ptr);
         VezImageSubDataInfo info = {};
         info.dataRowLength = _pitch;
-        info.imageExtent = { img->getDesc().width, img->getDesc().height, 1 };
+        info.imageExtent = { std::max(1u, img->getDesc().width >> _mipIndex), std::max(1u, img->getDesc().height >> _mipIndex), 1 };
         info.imageOffset = { 0,0,0 };
         info.imageSubresource = { _mipIndex,0,1 };
         vezImageSubData(m_vkDevice, img->getVkHandle(), &info, _data);
     }
 
+    void VezRenderer::UploadImageRegion(ImageHandle _handle, void* _data, u32 _pitch, u32 _mipIndex, uvec2 _offset, uvec2 _extent)
+    {
+        Image* img = reinterpret_cast<Image*>(_handle.ptr);
+        VezImageSubDataInfo info = {};
+        info.dataRowLength = _pitch;
+        info.imageExtent = { _extent.x, _extent.y, 1 };
+        info.imageOffset = { i32(_offset.x), i32(_offset.y), 0 };
+        info.imageSubresource = { _mipIndex,0,1 };
+        vezImageSubData(m_vkDevice, img->getVkHandle(), &info, _data);
+    }
+
     ubyte * VezRenderer::GetDynamicBuffer(u32 _size, BufferView& _buffer)
     {
         const u32 minAlignement = std::max(m_physicalDeviceProperties.limits.minUniformBufferOffsetAlignment, m_physicalDeviceProperties.limits.minStorageBufferOffsetAlignment);
@@ -407,9 +421,9 @@ namespace tim
         return m_allRenderContext.back();
     }
 
-    ImageHandle VezRenderer::CreateImage(const ImageCreateInfo& _info)
+    ImageHandle VezRenderer::CreateImage(const ImageCreateInfo& _info, MemoryTag _tag)
     {
-        Image * image = new Image(_info);
+        Image * image = new Image(_info, _tag);
         return ImageHandle{ reinterpret_cast<Image*>(image) };
     }
 
@@ -423,6 +437,7 @@ namespace tim
     void VezRenderer::createSamplers()
     {
         VezSamplerCreateInfo info = {};
+        info.maxLod = VK_LOD_CLAMP_NONE;
 
         // Clamp_Nearest_MipNearest
         info.magFilter = VkFilter::VK_FILTER_NEAREST;
@@ -34,16 +34,17 @@ namespace tim
 
         ImageHandle GetBackBuffer() const override;
 
-        BufferHandle CreateBuffer(u32 _size, MemoryType _memType, BufferUsage _usage) override;
+        BufferHandle CreateBuffer(u32 _size, MemoryType _memType, BufferUsage _usage, MemoryTag _tag = MemoryTag::Other) override;
         void DestroyBuffer(BufferHandle& _buffer) override;
         void UploadBuffer(BufferHandle _handle, void* _data, u32 _dataSize) override;
         void UploadBuffer(BufferHandle _handle, u32 _destOffset, void* _data, u32 _dataSize) override;
 
         void UploadImage(ImageHandle _handle, void* _data, u32 _pitch, u32 _mipIndex) override;
+        void UploadImageRegion(ImageHandle _handle, void* _data, u32 _pitch, u32 _mipIndex, uvec2 _offset, uvec2 _extent) override;
 
         ubyte* GetDynamicBuffer(u32 _size, BufferView& _buffer) override;
 
-        ImageHandle CreateImage(const ImageCreateInfo& _info) override;
+        ImageHandle CreateImage(const ImageCreateInfo& _info, MemoryTag _tag = MemoryTag::Other) override;
         void DestroyImage(ImageHandle& _buffer) override;
 
         IRenderContext * CreateRenderContext(RenderContextType _type, u32 _queueIndex = 0);
@@ -1,8 +1,10 @@
 #pragma once
 #include "timCore/type.h"
+#include "timCore/hash.h"
 #include "shaderCompiler/ShaderFlags.h"
 #include "Resource.h"
 #include <vector>
+#include <algorithm>
 
 namespace tim
 {
@@ -46,9 +48,89 @@ namespace tim
         BindingPoint m_binding;
     };
 
+    // Immutable bindings of resources living as long as the scene (BVH, geometry, textures, light prob field).
+    // A context binds a table once and skips it in the next dispatches while no other binding overrides its slots
+    class BindingTable
+    {
+    public:
+        BindingTable() = default;
+        BindingTable(std::vector<BufferBinding> _buffers, std::vector<ImageBinding> _images) : m_buffers{ std::move(_buffers) }, m_images{ std::move(_images) }
+        {
+            m_hash = hash_64_fnv1a(m_buffers.data(), m_buffers.size() * sizeof(BufferBinding));
+            m_hash = hash_64_fnv1a(m_images.data(), m_images.size() * sizeof(ImageBinding), m_hash);
+
+            for (const BufferBinding& binding : m_buffers)
+                m_slots.push_back(getSlotKey(binding.m_binding));
+            for (const ImageBinding& binding : m_images)
+                m_slots.push_back(getSlotKey(binding.m_binding));
+            std::sort(m_slots.begin(), m_slots.end());
+            m_slots.erase(std::unique(m_slots.begin(), m_slots.end()), m_slots.end());
+        }
+
+        const std::vector<BufferBinding>& getBufferBindings() const { return m_buffers; }
+        const std::vector<ImageBinding>& getImageBindings() const { return m_images; }
+        u64 getHash() const { return m_hash; }
+
+        static u32 getSlotKey(BindingPoint _binding) { return (u32(_binding.m_set) << 16) | _binding.m_slot; }
+        bool covers(u32 _slotKey) const { return std::binary_search(m_slots.begin(), m_slots.end(), _slotKey); }
+        bool overlaps(const BindingTable& _other) const
+        {
+            return std::any_of(_other.m_slots.begin(), _other.m_slots.end(), [this](u32 _slot) { return covers(_slot); });
+        }
+
+    private:
+        std::vector<BufferBinding> m_buffers;
+        std::vector<ImageBinding> m_images;
+        std::vector<u32> m_slots; // sorted set and slot keys
+        u64 m_hash = 0;
+    };
+
+    // Tables bound in a command buffer, kept apart from the device calls so the skipping can run headless
+    class BoundBindingTables
+    {
+    public:
+        void clear() { m_tables.clear(); }
+
+        // False when _table is still bound and its bindings can be skipped. Otherwise the tables it overrides
+        // and the ones rebuilt since they were bound are forgotten, the caller binds _table
+        bool bind(const BindingTable& _table)
+        {
+            for (const BoundTable& bound : m_tables)
+            {
+                if (bound.table == &_table && bound.hash == _table.getHash())
+                    return false;
+            }
+
+            m_tables.erase(std::remove_if(m_tables.begin(), m_tables.end(), [&_table](const BoundTable& _bound)
+            {
+                return _bound.table == &_table || _bound.hash != _bound.table->getHash() || _bound.table->overlaps(_table);
+            }), m_tables.end());
+
+            m_tables.push_back({ &_table, _table.getHash() });
+            return true;
+        }
+
+        // Forget the tables owning a slot overridden by a dynamic binding
+        void invalidate(BindingPoint _binding)
+        {
+            const u32 slotKey = BindingTable::getSlotKey(_binding);
+            m_tables.erase(std::remove_if(m_tables.begin(), m_tables.end(), [slotKey](const BoundTable& _bound) { return _bound.table->covers(slotKey); }), m_tables.end());
+        }
+
+    private:
+        struct BoundTable
+        {
+            const BindingTable* table;
+            u64 hash;
+        };
+        std::vector<BoundTable> m_tables;
+    };
+
     struct DrawArguments
     {
         ShaderKey m_key;
+        const BindingTable * const * m_bindingTables = nullptr;
+        u32 m_numBindingTables = 0;
         BufferBinding * m_bufferBindings = nullptr;
         u32 m_numBufferBindings = 0;
         ImageBinding * m_imageBindings = nullptr;
@@ -57,6 +139,15 @@ namespace tim
         u32 m_constantSize = 0;
     };
 
+    struct RenderContextStats
+    {
+        u32 numDispatches = 0;
+        u32 numBindCalls = 0;
+        u32 numSkippedTables = 0;
+        u32 numSkippedDispatches = 0; // shader without bytecode
+        double dispatchCpuTime = 0; // seconds spent recording dispatches
+    };
+
 	class IRenderContext
 	{
 	public:
@@ -69,6 +160,14 @@ namespace tim
 
         virtual void Dispatch(const DrawArguments&, u32 _sizeX, u32 _sizeY, u32 _sizeZ = 1) = 0;
 
+        virtual const RenderContextStats& GetStats() const = 0;
+        virtual void ResetStats() = 0;
+
+        // Named nestable scopes sent to the Profiler, timed with GPU timestamps read back TIM_FRAME_LATENCY frames later,
+        // or with CPU timers of the recording when the device has no timestamp support. _name must be a string literal
+        virtual void BeginScope(const char* _name) = 0;
+        virtual void EndScope() = 0;
+
     protected:
         virtual ~IRenderContext() {}
     };
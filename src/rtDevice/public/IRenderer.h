@@ -17,6 +17,7 @@ namespace tim
 		virtual void Deinit() = 0;
         virtual void Resize(u32 _x, u32 _y) = 0;
 
+        // Check the shader sources now, only the variants depending on a changed file are recompiled in the background
         virtual void InvalidateShaders() = 0;
 
         virtual void WaitForIdle() = 0;
@@ -27,16 +28,18 @@ namespace tim
 
         virtual ImageHandle GetBackBuffer() const = 0;
 
-        virtual BufferHandle CreateBuffer(u32 _size, MemoryType _memType, BufferUsage _usage) = 0;
+        // Resources are accounted in the MemoryTracker under _tag
+        virtual BufferHandle CreateBuffer(u32 _size, MemoryType _memType, BufferUsage _usage, MemoryTag _tag = MemoryTag::Other) = 0;
         virtual void DestroyBuffer(BufferHandle& _buffer) = 0;
         virtual void UploadBuffer(BufferHandle _handle, void * _data, u32 _dataSize) = 0;
         virtual void UploadBuffer(BufferHandle _handle, u32 _destOffset, void* _data, u32 _dataSize) = 0;
 
         virtual void UploadImage(ImageHandle _handle, void * _data, u32 _pitch, u32 _mipIndex) = 0;
+        virtual void UploadImageRegion(ImageHandle _handle, void* _data, u32 _pitch, u32 _mipIndex, uvec2 _offset, uvec2 _extent) = 0;
 
         virtual ubyte * GetDynamicBuffer(u32 _size, BufferView& _buffer) = 0;
 
-        virtual ImageHandle CreateImage(const ImageCreateInfo& _info) = 0;
+        virtual ImageHandle CreateImage(const ImageCreateInfo& _info, MemoryTag _tag = MemoryTag::Other) = 0;
         virtual void DestroyImage(ImageHandle& _buffer) = 0;
 
         virtual IRenderContext * CreateRenderContext(RenderContextType, u32 _queueIndex = 0) = 0;
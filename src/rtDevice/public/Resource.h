@@ -1,6 +1,7 @@
 #pragma once
 #include "timCore/type.h"
 #include "timCore/Common.h"
+#include "timCore/MemoryTracker.h"
 
 namespace tim
 {
@@ -61,9 +62,28 @@ namespace tim
         BGRA8,
         RGBA8_SRGB,
         RGBA16F,
-        RG16F
+        RG16F,
+        BC1_SRGB,
+        BC7_SRGB,
     };
 
+    inline bool isBlockCompressed(ImageFormat _format)
+    {
+        return _format == ImageFormat::BC1_SRGB || _format == ImageFormat::BC7_SRGB;
+    }
+
+    // Size in bytes of a 4x4 block for compressed formats, of a texel otherwise
+    inline u32 getFormatBlockSize(ImageFormat _format)
+    {
+        switch (_format)
+        {
+        case ImageFormat::BC1_SRGB:     return 8;
+        case ImageFormat::BC7_SRGB:     return 16;
+        case ImageFormat::RGBA16F:      return 8;
+        default:                        return 4;
+        }
+    }
+
     struct ImageCreateInfo
     {
         ImageCreateInfo(ImageFormat _format, u32 _width, u32 _height, u32 _depth = 1, u32 _numMips = 1, ImageType _type = ImageType::Image2D, MemoryType _mem = MemoryType::Default, ImageUsage _usage = ImageUsage::Storage) :
@@ -85,6 +105,24 @@ namespace tim
         ImageUsage usage;
     };
 
+    // Memory of the texels of all the layers and mips
+    inline u64 computeImageSize(const ImageCreateInfo& _info)
+    {
+        const u32 numLayers = _info.type == ImageType::ImageCube ? 6 : (_info.type == ImageType::Image2D_Array ? _info.depth : 1);
+        const u32 blockDim = isBlockCompressed(_info.format) ? 4 : 1;
+
+        u64 size = 0;
+        for (u32 mip = 0; mip < _info.numMips; ++mip)
+        {
+            const u64 width = (std::max(_info.width >> mip, 1u) + blockDim - 1) / blockDim;
+            const u64 height = (std::max(_info.height >> mip, 1u) + blockDim - 1) / blockDim;
+            const u64 depth = _info.type == ImageType::Image3D ? std::max(_info.depth >> mip, 1u) : 1;
+            size += width * height * depth * getFormatBlockSize(_info.format);
+        }
+
+        return size * numLayers;
+    }
+
     struct ImageHandle
     {
         void* ptr = nullptr;
@@ -0,0 +1,93 @@
+#include "MappedFile.h"
+
+#include <windows.h>
+#include <utility>
+
+namespace tim
+{
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile::MappedFile(MappedFile&& _other) noexcept
+    {
+        *this = std::move(_other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& _other) noexcept
+    {
+        if (this != &_other)
+        {
+            close();
+            std::swap(m_file, _other.m_file);
+            std::swap(m_mapping, _other.m_mapping);
+            std::swap(m_data, _other.m_data);
+            std::swap(m_size, _other.m_size);
+        }
+        return *this;
+    }
+
+    bool MappedFile::open(const std::string& _path)
+    {
+        close();
+
+        HANDLE file = CreateFileA(_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize))
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        // Empty files cannot be mapped, they open as an empty view
+        if (fileSize.QuadPart == 0)
+        {
+            static const ubyte s_empty = 0;
+            m_file = file;
+            m_data = &s_empty;
+            m_size = 0;
+            return true;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+        {
+            CloseHandle(file);
+            return false;
+        }
+
+        const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!data)
+        {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+        m_data = static_cast<const ubyte*>(data);
+        m_size = u64(fileSize.QuadPart);
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        if (m_mapping)
+        {
+            UnmapViewOfFile(m_data);
+            CloseHandle(m_mapping);
+        }
+        if (m_file)
+            CloseHandle(m_file);
+
+        m_file = nullptr;
+        m_mapping = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "type.h"
+#include <string>
+
+namespace tim
+{
+    // Read only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& _other) noexcept;
+        MappedFile& operator=(MappedFile&& _other) noexcept;
+
+        bool open(const std::string& _path);
+        void close();
+
+        bool isOpen() const { return m_data != nullptr; }
+        const ubyte* data() const { return m_data; }
+        u64 size() const { return m_size; }
+
+    private:
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+        const ubyte* m_data = nullptr;
+        u64 m_size = 0;
+    };
+}
@@ -0,0 +1,101 @@
+#include "MemoryTracker.h"
+#include "Common.h"
+
+#include <iomanip>
+
+namespace tim
+{
+    const char* getMemoryTagName(MemoryTag _tag)
+    {
+        switch (_tag)
+        {
+        case MemoryTag::Geometry:       return "Geometry";
+        case MemoryTag::BvhNodes:       return "BVH nodes";
+        case MemoryTag::BvhLeafData:    return "BVH leaf data";
+        case MemoryTag::BvhPrimitives:  return "BVH primitives";
+        case MemoryTag::Textures:       return "Textures";
+        case MemoryTag::LightProbField: return "Light prob field";
+        case MemoryTag::Transients:     return "Transients";
+        case MemoryTag::Shaders:        return "Shaders";
+        case MemoryTag::Other:          return "Other";
+        default:                        return "Untracked";
+        }
+    }
+
+    MemoryTracker& MemoryTracker::get()
+    {
+        static MemoryTracker s_tracker;
+        return s_tracker;
+    }
+
+    void MemoryTracker::onAlloc(MemoryPool _pool, MemoryTag _tag, u64 _bytes)
+    {
+        if (_tag == MemoryTag::Untracked)
+            return;
+
+        Counter& counter = m_counters[u32(_pool)][u32(_tag)];
+        const u64 live = counter.liveBytes.fetch_add(_bytes) + _bytes;
+        counter.numAllocs++;
+
+        u64 peak = counter.peakBytes.load();
+        while (live > peak && !counter.peakBytes.compare_exchange_weak(peak, live));
+    }
+
+    void MemoryTracker::onFree(MemoryPool _pool, MemoryTag _tag, u64 _bytes)
+    {
+        if (_tag == MemoryTag::Untracked)
+            return;
+
+        Counter& counter = m_counters[u32(_pool)][u32(_tag)];
+        TIM_ASSERT(counter.liveBytes.load() >= _bytes);
+        counter.liveBytes -= _bytes;
+        counter.numAllocs--;
+    }
+
+    MemoryTagStats MemoryTracker::getStats(MemoryPool _pool, MemoryTag _tag) const
+    {
+        if (_tag == MemoryTag::Untracked)
+            return {};
+
+        const Counter& counter = m_counters[u32(_pool)][u32(_tag)];
+        return { counter.liveBytes.load(), counter.peakBytes.load(), counter.numAllocs.load() };
+    }
+
+    u64 MemoryTracker::getTotalLiveBytes(MemoryPool _pool) const
+    {
+        u64 total = 0;
+        for (const Counter& counter : m_counters[u32(_pool)])
+            total += counter.liveBytes.load();
+        return total;
+    }
+
+    void MemoryTracker::printReport(const char* _title) const
+    {
+        auto toMB = [](u64 _bytes) { return double(_bytes) / (1024 * 1024); };
+
+        std::cout << "Memory after " << _title << " (live / peak MB)" << std::endl;
+        std::cout << std::fixed << std::setprecision(2);
+        for (u32 i = 0; i < u32(MemoryTag::Count); ++i)
+        {
+            const MemoryTagStats cpu = getStats(MemoryPool::Cpu, MemoryTag(i));
+            const MemoryTagStats gpu = getStats(MemoryPool::Gpu, MemoryTag(i));
+            if (cpu.peakBytes == 0 && gpu.peakBytes == 0)
+                continue;
+
+            std::cout << "  " << std::left << std::setw(18) << getMemoryTagName(MemoryTag(i)) << std::right
+                      << " CPU " << std::setw(9) << toMB(cpu.liveBytes) << " / " << std::setw(9) << toMB(cpu.peakBytes)
+                      << "   GPU " << std::setw(9) << toMB(gpu.liveBytes) << " / " << std::setw(9) << toMB(gpu.peakBytes) << std::endl;
+        }
+        std::cout << "  Total CPU " << toMB(getTotalLiveBytes(MemoryPool::Cpu)) << " MB, GPU " << toMB(getTotalLiveBytes(MemoryPool::Gpu)) << " MB" << std::endl;
+        std::cout << std::defaultfloat;
+    }
+
+    void MemoryTracker::resetPeaks()
+    {
+        for (auto& pool : m_counters)
+        {
+            for (Counter& counter : pool)
+                counter.peakBytes = counter.liveBytes.load();
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "type.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace tim
+{
+    enum class MemoryTag : u32
+    {
+        Geometry,
+        BvhNodes,
+        BvhLeafData,
+        BvhPrimitives,  // triangles, materials, lights and blas headers
+        Textures,
+        LightProbField,
+        Transients,
+        Shaders,
+        Other,
+        Count,
+        Untracked = Count // accounted by the owner of the memory
+    };
+
+    enum class MemoryPool : u32 { Cpu, Gpu, Count };
+
+    const char* getMemoryTagName(MemoryTag _tag);
+
+    struct MemoryTagStats
+    {
+        u64 liveBytes = 0;
+        u64 peakBytes = 0;
+        u64 numAllocs = 0; // live
+    };
+
+    // Live and peak bytes per subsystem, fed by the tagged containers on the CPU and by the resource creation of the renderer on the GPU
+    class MemoryTracker
+    {
+    public:
+        static MemoryTracker& get();
+
+        void onAlloc(MemoryPool _pool, MemoryTag _tag, u64 _bytes);
+        void onFree(MemoryPool _pool, MemoryTag _tag, u64 _bytes);
+
+        MemoryTagStats getStats(MemoryPool _pool, MemoryTag _tag) const;
+        u64 getTotalLiveBytes(MemoryPool _pool) const;
+
+        void printReport(const char* _title) const;
+        void resetPeaks();
+
+    private:
+        MemoryTracker() = default;
+
+        struct Counter
+        {
+            std::atomic<u64> liveBytes = 0;
+            std::atomic<u64> peakBytes = 0;
+            std::atomic<u64> numAllocs = 0;
+        };
+        Counter m_counters[u32(MemoryPool::Count)][u32(MemoryTag::Count)];
+    };
+
+    // Standard allocator accounting its memory on the CPU pool under Tag
+    template<typename T, MemoryTag Tag>
+    class TaggedAllocator
+    {
+    public:
+        using value_type = T;
+        template<typename U> struct rebind { using other = TaggedAllocator<U, Tag>; };
+
+        TaggedAllocator() = default;
+        template<typename U> TaggedAllocator(const TaggedAllocator<U, Tag>&) {}
+
+        T* allocate(size_t _count)
+        {
+            MemoryTracker::get().onAlloc(MemoryPool::Cpu, Tag, _count * sizeof(T));
+            return std::allocator<T>().allocate(_count);
+        }
+
+        void deallocate(T* _ptr, size_t _count)
+        {
+            MemoryTracker::get().onFree(MemoryPool::Cpu, Tag, _count * sizeof(T));
+            std::allocator<T>().deallocate(_ptr, _count);
+        }
+
+        template<typename U> bool operator==(const TaggedAllocator<U, Tag>&) const { return true; }
+        template<typename U> bool operator!=(const TaggedAllocator<U, Tag>&) const { return false; }
+    };
+
+    template<typename T, MemoryTag Tag>
+    using TaggedVector = std::vector<T, TaggedAllocator<T, Tag>>;
+
+    // Base of the objects allocated one by one, accounts them on the CPU pool under Tag
+    template<MemoryTag Tag>
+    struct TaggedObject
+    {
+        static void* operator new(size_t _size)
+        {
+            MemoryTracker::get().onAlloc(MemoryPool::Cpu, Tag, _size);
+            return ::operator new(_size);
+        }
+
+        static void operator delete(void* _ptr, size_t _size)
+        {
+            MemoryTracker::get().onFree(MemoryPool::Cpu, Tag, _size);
+            ::operator delete(_ptr);
+        }
+    };
+}
@@ -0,0 +1,210 @@
+#include "Profiler.h"
+#include "Common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+namespace tim
+{
+    namespace
+    {
+        i64 getTicks()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        void writeJsonString(std::ostream& _stream, const char* _str)
+        {
+            _stream << '"';
+            for (const char* c = _str; *c; ++c)
+            {
+                if (*c == '"' || *c == '\\')
+                    _stream << '\\';
+                _stream << *c;
+            }
+            _stream << '"';
+        }
+    }
+
+    Profiler& Profiler::get()
+    {
+        static Profiler s_profiler;
+        return s_profiler;
+    }
+
+    Profiler::Profiler() : m_origin{ getTicks() }
+    {
+
+    }
+
+    double Profiler::now() const
+    {
+        return double(getTicks() - m_origin) / 1000.0;
+    }
+
+    u32 Profiler::getCurrentThreadId() const
+    {
+        // Small ids in order of first use, the main thread is usually 0
+        static std::atomic<u32> s_nextThreadId = 0;
+        thread_local u32 t_threadId = s_nextThreadId++;
+        return t_threadId;
+    }
+
+    void Profiler::addEvent(const char* _name, ProfileTimeline _timeline, u32 _threadId, double _start, double _duration)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_events.size() == MaxEvents)
+            m_events.pop_front();
+        m_events.push_back({ _name, _timeline, _threadId, _start, _duration });
+
+        StatsWindow& window = m_stats[{ _timeline, _name }];
+        window.samples[window.cursor] = _duration;
+        window.cursor = (window.cursor + 1) % StatsWindowSize;
+        window.numSamples = std::min(window.numSamples + 1, StatsWindowSize);
+    }
+
+    ProfileStats Profiler::StatsWindow::compute() const
+    {
+        ProfileStats stats;
+        if (numSamples == 0)
+            return stats;
+
+        stats.numSamples = numSamples;
+        stats.min = samples[0];
+        stats.max = samples[0];
+        for (u32 i = 0; i < numSamples; ++i)
+        {
+            stats.average += samples[i];
+            stats.min = std::min(stats.min, samples[i]);
+            stats.max = std::max(stats.max, samples[i]);
+        }
+        stats.average /= numSamples;
+        return stats;
+    }
+
+    ProfileStats Profiler::getStats(const char* _name, ProfileTimeline _timeline) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_stats.find({ _timeline, _name });
+        return it != m_stats.end() ? it->second.compute() : ProfileStats{};
+    }
+
+    void Profiler::printSummary() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::cout << std::fixed << std::setprecision(3);
+        for (const auto& [key, window] : m_stats)
+        {
+            const ProfileStats stats = window.compute();
+            std::cout << (key.first == ProfileTimeline::Gpu ? "[GPU] " : "[CPU] ") << key.second << " : " << stats.average / 1000 << "ms (min "
+                      << stats.min / 1000 << "ms, max " << stats.max / 1000 << "ms, " << stats.numSamples << " samples)" << std::endl;
+        }
+        std::cout << std::defaultfloat;
+    }
+
+    bool Profiler::exportChromeTrace(const std::string& _path) const
+    {
+        std::ofstream file(_path);
+        if (!file.is_open())
+        {
+            std::cout << "Failed to write trace " << _path << std::endl;
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // One process per timeline, threads are CPU threads or GPU queues
+        file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}";
+
+        for (const ProfileEvent& event : m_events)
+        {
+            file << ",\n{\"name\":";
+            writeJsonString(file, event.name);
+            file << ",\"ph\":\"X\",\"pid\":" << u32(event.timeline) << ",\"tid\":" << event.threadId << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+        }
+        file << "\n]}\n";
+
+        std::cout << "Trace of " << m_events.size() << " events written to " << _path << std::endl;
+        return true;
+    }
+
+    void Profiler::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events.clear();
+        m_stats.clear();
+    }
+
+    ProfileScope::~ProfileScope()
+    {
+        Profiler& profiler = Profiler::get();
+        profiler.addEvent(m_name, ProfileTimeline::Cpu, profiler.getCurrentThreadId(), m_start, profiler.now() - m_start);
+    }
+
+    void ContextScopeTracker::beginFrame(u32 _frameIndex, const u64* _timestamps, double _usPerTick)
+    {
+        TIM_ASSERT(_frameIndex < TIM_FRAME_LATENCY && m_openScopes.empty());
+        Frame& frame = m_frames[_frameIndex];
+
+        if (_timestamps && frame.numQueries > 0)
+        {
+            // GPU and CPU clocks are not calibrated, the frame starts on the GPU when it was recorded on the CPU
+            for (const Scope& scope : frame.scopes)
+            {
+                if (scope.beginQuery == u32(-1))
+                    continue;
+
+                const double start = frame.cpuStart + double(_timestamps[scope.beginQuery] - _timestamps[0]) * _usPerTick;
+                const double duration = double(_timestamps[scope.endQuery] - _timestamps[scope.beginQuery]) * _usPerTick;
+                Profiler::get().addEvent(scope.name, ProfileTimeline::Gpu, m_queueIndex, start, duration);
+            }
+        }
+
+        m_frameIndex = _frameIndex;
+        frame.scopes.clear();
+        frame.numQueries = 0;
+        frame.cpuStart = Profiler::get().now();
+    }
+
+    void ContextScopeTracker::endFrame()
+    {
+        TIM_ASSERT(m_openScopes.empty());
+    }
+
+    u32 ContextScopeTracker::beginScope(const char* _name)
+    {
+        Frame& frame = m_frames[m_frameIndex];
+        Scope scope = { _name, u32(-1), u32(-1), Profiler::get().now() };
+
+        // Scopes over the query budget are dropped from the GPU timeline
+        if (m_useTimestamps && frame.numQueries + 2 <= MaxQueries)
+        {
+            scope.beginQuery = frame.numQueries++;
+            scope.endQuery = frame.numQueries++;
+        }
+
+        m_openScopes.push_back(u32(frame.scopes.size()));
+        frame.scopes.push_back(scope);
+        return scope.beginQuery;
+    }
+
+    u32 ContextScopeTracker::endScope()
+    {
+        TIM_ASSERT(!m_openScopes.empty());
+        const Scope& scope = m_frames[m_frameIndex].scopes[m_openScopes.back()];
+        m_openScopes.pop_back();
+
+        if (!m_useTimestamps)
+        {
+            Profiler& profiler = Profiler::get();
+            profiler.addEvent(scope.name, ProfileTimeline::Cpu, profiler.getCurrentThreadId(), scope.cpuStart, profiler.now() - scope.cpuStart);
+        }
+        return scope.endQuery;
+    }
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include "type.h"
+#include "Common.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#define TIM_PROFILE_CONCAT_INNER(a, b) a##b
+#define TIM_PROFILE_CONCAT(a, b) TIM_PROFILE_CONCAT_INNER(a, b)
+
+// CPU timing of the enclosing block, scopes nest naturally on a thread. _name must be a string literal
+#define TIM_PROFILE_SCOPE(_name) tim::ProfileScope TIM_PROFILE_CONCAT(profileScope_, __LINE__)(_name)
+
+namespace tim
+{
+    enum class ProfileTimeline : u32 { Cpu, Gpu };
+
+    struct ProfileEvent
+    {
+        const char* name;
+        ProfileTimeline timeline;
+        u32 threadId;    // CPU thread or GPU queue
+        double start;    // microseconds since the profiler was created
+        double duration; // microseconds
+    };
+
+    struct ProfileStats
+    {
+        u32 numSamples = 0;
+        double average = 0; // microseconds, over the last samples
+        double min = 0;
+        double max = 0;
+    };
+
+    // Collects the CPU and GPU scopes of the whole run. Keeps a rolling window of durations per scope name
+    // and exports both timelines to the Chrome trace format (chrome://tracing or ui.perfetto.dev)
+    class Profiler
+    {
+    public:
+        static constexpr u32 StatsWindowSize = 128;
+        static constexpr size_t MaxEvents = 1024 * 1024; // oldest events are dropped beyond
+
+        static Profiler& get();
+
+        double now() const;
+        u32 getCurrentThreadId() const;
+
+        void addEvent(const char* _name, ProfileTimeline _timeline, u32 _threadId, double _start, double _duration);
+
+        ProfileStats getStats(const char* _name, ProfileTimeline _timeline) const;
+        void printSummary() const;
+        bool exportChromeTrace(const std::string& _path) const;
+        void clear();
+
+    private:
+        Profiler();
+
+        struct StatsWindow
+        {
+            double samples[StatsWindowSize];
+            u32 numSamples = 0;
+            u32 cursor = 0;
+
+            ProfileStats compute() const;
+        };
+
+        using StatsKey = std::pair<ProfileTimeline, std::string>;
+        mutable std::mutex m_mutex;
+        std::deque<ProfileEvent> m_events;
+        std::map<StatsKey, StatsWindow> m_stats; // sorted for the summary
+        i64 m_origin;
+    };
+
+    class ProfileScope
+    {
+    public:
+        ProfileScope(const char* _name) : m_name{ _name }, m_start{ Profiler::get().now() } {}
+        ~ProfileScope();
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+
+    private:
+        const char* m_name;
+        double m_start;
+    };
+
+    // Scopes of a render context over its TIM_FRAME_LATENCY frames in flight. With timestamps, each scope gets two queries of the frame
+    // and the GPU events are sent to the Profiler when the frame is recorded again. Without, the scopes are timed on the CPU at EndScope.
+    class ContextScopeTracker
+    {
+    public:
+        static constexpr u32 MaxQueries = 256; // per frame, 2 per scope
+
+        ContextScopeTracker(bool _useTimestamps, u32 _queueIndex) : m_useTimestamps{ _useTimestamps }, m_queueIndex{ _queueIndex } {}
+
+        bool useTimestamps() const { return m_useTimestamps; }
+        // Queries written by the last recording of _frameIndex
+        u32 getNumQueries(u32 _frameIndex) const { return m_frames[_frameIndex].numQueries; }
+        u32 getNumOpenScopes() const { return u32(m_openScopes.size()); }
+
+        // Record _frameIndex again. _timestamps holds the getNumQueries(_frameIndex) results of its previous recording, its scopes are dropped when null
+        void beginFrame(u32 _frameIndex, const u64* _timestamps, double _usPerTick);
+        void endFrame();
+
+        // Query to write at the top of the pipe, u32(-1) when the scope is CPU timed or over the query budget
+        u32 beginScope(const char* _name);
+        // Query to write at the bottom of the pipe, u32(-1) when none
+        u32 endScope();
+
+    private:
+        struct Scope
+        {
+            const char* name;
+            u32 beginQuery;
+            u32 endQuery;
+            double cpuStart;
+        };
+
+        struct Frame
+        {
+            std::vector<Scope> scopes;
+            u32 numQueries = 0;
+            double cpuStart = 0; // profiler time of beginFrame, the first timestamp is aligned on it
+        };
+
+        bool m_useTimestamps;
+        u32 m_queueIndex;
+        u32 m_frameIndex = 0;
+        Frame m_frames[TIM_FRAME_LATENCY];
+        std::vector<u32> m_openScopes;
+    };
+}
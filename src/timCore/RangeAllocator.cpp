@@ -0,0 +1,97 @@
+#include "RangeAllocator.h"
+#include "Common.h"
+
+#include <algorithm>
+
+namespace tim
+{
+    RangeAllocator::RangeAllocator(u32 _alignment) : m_alignment{ _alignment }
+    {
+        TIM_ASSERT(_alignment > 0);
+    }
+
+    u32 RangeAllocator::allocate(u32 _size)
+    {
+        TIM_ASSERT(_size > 0);
+        const u32 size = alignUp(_size, m_alignment);
+
+        auto it = std::find_if(m_freeRanges.begin(), m_freeRanges.end(), [size](const auto& _range) { return _range.second >= size; });
+
+        u32 offset;
+        if (it != m_freeRanges.end())
+        {
+            offset = it->first;
+            if (it->second > size)
+                m_freeRanges[offset + size] = it->second - size;
+            m_freeRanges.erase(it);
+        }
+        else
+        {
+            offset = m_size;
+            m_size += size;
+        }
+
+        m_allocations[offset] = size;
+        m_allocatedSize += size;
+        return offset;
+    }
+
+    void RangeAllocator::free(u32 _offset)
+    {
+        auto alloc = m_allocations.find(_offset);
+        TIM_ASSERT(alloc != m_allocations.end());
+
+        u32 offset = _offset;
+        u32 size = alloc->second;
+        m_allocatedSize -= size;
+        m_allocations.erase(alloc);
+
+        // Merge with the neighbours
+        auto next = m_freeRanges.lower_bound(offset);
+        if (next != m_freeRanges.begin())
+        {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset)
+            {
+                offset = prev->first;
+                size += prev->second;
+                m_freeRanges.erase(prev);
+            }
+        }
+        if (next != m_freeRanges.end() && offset + size == next->first)
+        {
+            size += next->second;
+            m_freeRanges.erase(next);
+        }
+
+        if (offset + size == m_size)
+            m_size = offset;
+        else
+            m_freeRanges[offset] = size;
+    }
+
+    void RangeAllocator::clear()
+    {
+        m_size = 0;
+        m_allocatedSize = 0;
+        m_freeRanges.clear();
+        m_allocations.clear();
+    }
+
+    u32 RangeAllocator::getAllocationSize(u32 _offset) const
+    {
+        auto it = m_allocations.find(_offset);
+        return it != m_allocations.end() ? it->second : 0;
+    }
+
+    RangeAllocator::Stats RangeAllocator::getStats() const
+    {
+        Stats stats;
+        stats.size = m_size;
+        stats.allocatedSize = m_allocatedSize;
+        stats.numFreeRanges = u32(m_freeRanges.size());
+        for (const auto& range : m_freeRanges)
+            stats.largestFreeRange = std::max(stats.largestFreeRange, range.second);
+        return stats;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "type.h"
+#include "flat_hash_map.h"
+
+#include <map>
+
+namespace tim
+{
+    // First fit allocator of [offset, offset + size) ranges in an address space growing at the end.
+    // Only offsets are handed out, the owner sizes its storage from getSize().
+    class RangeAllocator
+    {
+    public:
+        struct Stats
+        {
+            u32 size = 0;             // end of the last allocated range
+            u32 allocatedSize = 0;
+            u32 numFreeRanges = 0;
+            u32 largestFreeRange = 0;
+        };
+
+        RangeAllocator(u32 _alignment = 1);
+
+        u32 allocate(u32 _size);
+        void free(u32 _offset);
+        void clear();
+
+        u32 getSize() const { return m_size; }
+        u32 getAllocationSize(u32 _offset) const;
+        Stats getStats() const;
+
+    private:
+        u32 m_alignment;
+        u32 m_size = 0;
+        u32 m_allocatedSize = 0;
+        std::map<u32, u32> m_freeRanges; // offset -> size, never touching each other nor the end
+        ska::flat_hash_map<u32, u32> m_allocations;
+    };
+}
@@ -0,0 +1,435 @@
+#include "SimdMath.h"
+#include "Common.h"
+
+#include <bitset>
+#include <cfloat>
+#include <chrono>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+namespace tim
+{
+    namespace
+    {
+        void setLane(float4a& _a, u32 _lane, float _value)
+        {
+            float tmp[4];
+            simd::storeu(tmp, _a);
+            tmp[_lane] = _value;
+            _a = simd::loadu(tmp);
+        }
+    }
+
+    void Box4::setEmpty()
+    {
+        minX = minY = minZ = simd::splat(FLT_MAX);
+        maxX = maxY = maxZ = simd::splat(-FLT_MAX);
+    }
+
+    void Box4::set(u32 _lane, const vec3& _min, const vec3& _max)
+    {
+        TIM_ASSERT(_lane < 4);
+        setLane(minX, _lane, _min.x); setLane(minY, _lane, _min.y); setLane(minZ, _lane, _min.z);
+        setLane(maxX, _lane, _max.x); setLane(maxY, _lane, _max.y); setLane(maxZ, _lane, _max.z);
+    }
+
+    // The entry and exit planes are picked from the sign of the direction rather than with a min/max of both slabs, empty boxes (min > max) stay empty
+    u32 intersectRayBox4(const RaySlab& _ray, const Box4& _boxes, float _tMax, float4a* _tNear)
+    {
+        const float4a& nearX = _ray.invDir.x >= 0 ? _boxes.minX : _boxes.maxX;
+        const float4a& farX = _ray.invDir.x >= 0 ? _boxes.maxX : _boxes.minX;
+        const float4a& nearY = _ray.invDir.y >= 0 ? _boxes.minY : _boxes.maxY;
+        const float4a& farY = _ray.invDir.y >= 0 ? _boxes.maxY : _boxes.minY;
+        const float4a& nearZ = _ray.invDir.z >= 0 ? _boxes.minZ : _boxes.maxZ;
+        const float4a& farZ = _ray.invDir.z >= 0 ? _boxes.maxZ : _boxes.minZ;
+
+        const float4a ox = simd::splat(_ray.origin.x), oy = simd::splat(_ray.origin.y), oz = simd::splat(_ray.origin.z);
+        const float4a ix = simd::splat(_ray.invDir.x), iy = simd::splat(_ray.invDir.y), iz = simd::splat(_ray.invDir.z);
+
+        float4a tNear = simd::max(simd::max(simd::mul(simd::sub(nearX, ox), ix), simd::mul(simd::sub(nearY, oy), iy)),
+                                  simd::max(simd::mul(simd::sub(nearZ, oz), iz), simd::splat(0)));
+        float4a tFar = simd::min(simd::min(simd::mul(simd::sub(farX, ox), ix), simd::mul(simd::sub(farY, oy), iy)),
+                                 simd::min(simd::mul(simd::sub(farZ, oz), iz), simd::splat(_tMax)));
+
+        if (_tNear)
+            *_tNear = tNear;
+
+        return simd::lessEqualMask(tNear, tFar);
+    }
+
+#if TIM_SIMD >= 2
+    void Box8::setEmpty()
+    {
+        minX = minY = minZ = _mm256_set1_ps(FLT_MAX);
+        maxX = maxY = maxZ = _mm256_set1_ps(-FLT_MAX);
+    }
+
+    void Box8::set(u32 _lane, const vec3& _min, const vec3& _max)
+    {
+        TIM_ASSERT(_lane < 8);
+        auto setLane8 = [_lane](__m256& _a, float _value)
+        {
+            float tmp[8];
+            _mm256_storeu_ps(tmp, _a);
+            tmp[_lane] = _value;
+            _a = _mm256_loadu_ps(tmp);
+        };
+
+        setLane8(minX, _min.x); setLane8(minY, _min.y); setLane8(minZ, _min.z);
+        setLane8(maxX, _max.x); setLane8(maxY, _max.y); setLane8(maxZ, _max.z);
+    }
+
+    u32 intersectRayBox8(const RaySlab& _ray, const Box8& _boxes, float _tMax)
+    {
+        const __m256& nearX = _ray.invDir.x >= 0 ? _boxes.minX : _boxes.maxX;
+        const __m256& farX = _ray.invDir.x >= 0 ? _boxes.maxX : _boxes.minX;
+        const __m256& nearY = _ray.invDir.y >= 0 ? _boxes.minY : _boxes.maxY;
+        const __m256& farY = _ray.invDir.y >= 0 ? _boxes.maxY : _boxes.minY;
+        const __m256& nearZ = _ray.invDir.z >= 0 ? _boxes.minZ : _boxes.maxZ;
+        const __m256& farZ = _ray.invDir.z >= 0 ? _boxes.maxZ : _boxes.minZ;
+
+        const __m256 ox = _mm256_set1_ps(_ray.origin.x), oy = _mm256_set1_ps(_ray.origin.y), oz = _mm256_set1_ps(_ray.origin.z);
+        const __m256 ix = _mm256_set1_ps(_ray.invDir.x), iy = _mm256_set1_ps(_ray.invDir.y), iz = _mm256_set1_ps(_ray.invDir.z);
+
+        __m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(nearX, ox), ix), _mm256_mul_ps(_mm256_sub_ps(nearY, oy), iy)),
+                                     _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(nearZ, oz), iz), _mm256_setzero_ps()));
+        __m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(farX, ox), ix), _mm256_mul_ps(_mm256_sub_ps(farY, oy), iy)),
+                                    _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(farZ, oz), iz), _mm256_set1_ps(_tMax)));
+
+        return u32(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+    }
+#endif
+
+    namespace
+    {
+        // Same layout as the Box of the shaders
+        struct ScalarBox
+        {
+            vec3 minExtent;
+            vec3 maxExtent;
+        };
+
+        bool scalarRayBox(const RaySlab& _ray, const ScalarBox& _box, float _tMax)
+        {
+            auto slab = [&](u32 _axis, float& _near, float& _far)
+            {
+                const float inv = _ray.invDir[_axis];
+                const float lo = inv >= 0 ? _box.minExtent[_axis] : _box.maxExtent[_axis];
+                const float hi = inv >= 0 ? _box.maxExtent[_axis] : _box.minExtent[_axis];
+                _near = (lo - _ray.origin[_axis]) * inv;
+                _far = (hi - _ray.origin[_axis]) * inv;
+            };
+
+            float nx, fx, ny, fy, nz, fz;
+            slab(0, nx, fx); slab(1, ny, fy); slab(2, nz, fz);
+            const float tNear = std::max(std::max(nx, ny), std::max(nz, 0.f));
+            const float tFar = std::min(std::min(fx, fy), std::min(fz, _tMax));
+            return tNear <= tFar;
+        }
+
+        // The box helpers of BVHBuilder, on linalg and through BoxA loads and stores
+        ScalarBox scalarMerge(const ScalarBox& _b1, const ScalarBox& _b2) { return { linalg::min_(_b1.minExtent, _b2.minExtent), linalg::max_(_b1.maxExtent, _b2.maxExtent) }; }
+        ScalarBox scalarIntersection(const ScalarBox& _b1, const ScalarBox& _b2) { return { linalg::max_(_b1.minExtent, _b2.minExtent), linalg::min_(_b1.maxExtent, _b2.maxExtent) }; }
+        float scalarVolume(const ScalarBox& _box)
+        {
+            vec3 dim = _box.maxExtent - _box.minExtent;
+            return dim.x * dim.y * dim.z;
+        }
+
+        ScalarBox wrappedMerge(const ScalarBox& _b1, const ScalarBox& _b2)
+        {
+            ScalarBox box;
+            mergeBox(BoxA::load(&_b1.minExtent), BoxA::load(&_b2.minExtent)).store(&box.minExtent);
+            return box;
+        }
+
+        ScalarBox wrappedIntersection(const ScalarBox& _b1, const ScalarBox& _b2)
+        {
+            ScalarBox box;
+            intersectionBox(BoxA::load(&_b1.minExtent), BoxA::load(&_b2.minExtent)).store(&box.minExtent);
+            return box;
+        }
+
+        float wrappedVolume(const ScalarBox& _box) { return getBoxVolume(BoxA::load(&_box.minExtent)); }
+
+        template<typename F>
+        double measureNs(u32 _numOps, F _func)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            _func();
+            auto end = std::chrono::high_resolution_clock::now();
+            return std::chrono::duration<double, std::nano>(end - start).count() / _numOps;
+        }
+
+        void printRow(const char* _name, double _scalarNs, double _simdNs, bool _match)
+        {
+            std::cout << std::setw(24) << _name << std::fixed << std::setprecision(2) << std::setw(16) << _scalarNs << std::setw(16) << _simdNs
+                      << std::setw(9) << _scalarNs / _simdNs << "x" << std::setw(10) << (_match ? "yes" : "NO") << "\n";
+        }
+    }
+
+    void runSimdMathBenchmark(u32 _numBoxes, u32 _numIterations)
+    {
+        std::mt19937 rng(1234);
+        std::uniform_real_distribution<float> position(-100.f, 100.f);
+        std::uniform_real_distribution<float> size(0.f, 10.f);
+
+        std::vector<ScalarBox> boxes(_numBoxes);
+        std::vector<vec3> points(_numBoxes);
+        for (u32 i = 0; i < _numBoxes; ++i)
+        {
+            boxes[i].minExtent = { position(rng), position(rng), position(rng) };
+            boxes[i].maxExtent = boxes[i].minExtent + vec3{ size(rng), size(rng), size(rng) };
+            points[i] = { position(rng), position(rng), position(rng) };
+        }
+
+        const u32 numOps = _numBoxes * _numIterations;
+        const char* backend = TIM_SIMD == 2 ? "AVX" : (TIM_SIMD == 1 ? "SSE" : "scalar");
+        std::cout << "SIMD math benchmark, " << backend << " backend, " << _numBoxes << " boxes x " << _numIterations << " iterations\n";
+        std::cout << std::setw(24) << "operation" << std::setw(16) << "scalar ns/op" << std::setw(16) << "simd ns/op" << std::setw(10) << "speedup" << std::setw(10) << "match" << "\n";
+
+        // Merge, the reduction of BVHBuilder::searchBestSplit
+        {
+            ScalarBox refBox, box;
+            double refNs = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    refBox = boxes[0];
+                    for (u32 i = 1; i < _numBoxes; ++i)
+                    {
+                        refBox.minExtent = linalg::min_(refBox.minExtent, boxes[i].minExtent);
+                        refBox.maxExtent = linalg::max_(refBox.maxExtent, boxes[i].maxExtent);
+                    }
+                }
+            });
+
+            double ns = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    BoxA merged = BoxA::load(&boxes[0].minExtent);
+                    for (u32 i = 1; i < _numBoxes; ++i)
+                        merged = mergeBox(merged, BoxA::load(&boxes[i].minExtent));
+                    merged.store(&box.minExtent);
+                }
+            });
+
+            printRow("merge", refNs, ns, refBox.minExtent == box.minExtent && refBox.maxExtent == box.maxExtent);
+        }
+
+        // Intersection volume of neighbour boxes
+        {
+            double refSum = 0, sum = 0;
+            double refNs = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    refSum = 0;
+                    for (u32 i = 1; i < _numBoxes; ++i)
+                    {
+                        vec3 dim = linalg::min_(boxes[i - 1].maxExtent, boxes[i].maxExtent) - linalg::max_(boxes[i - 1].minExtent, boxes[i].minExtent);
+                        refSum += dim.x * dim.y * dim.z;
+                    }
+                }
+            });
+
+            double ns = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    sum = 0;
+                    for (u32 i = 1; i < _numBoxes; ++i)
+                        sum += getBoxVolume(intersectionBox(BoxA::load(&boxes[i - 1].minExtent), BoxA::load(&boxes[i].minExtent)));
+                }
+            });
+
+            printRow("intersection volume", refNs, ns, refSum == sum);
+        }
+
+        // Overlap of each box with the 8 next ones
+        {
+            const u32 window = 8;
+            u32 refCount = 0, count = 0;
+            double refNs = measureNs(numOps * window, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    refCount = 0;
+                    for (u32 i = 0; i < _numBoxes; ++i)
+                    {
+                        for (u32 j = 1; j <= window; ++j)
+                        {
+                            const ScalarBox& a = boxes[i];
+                            const ScalarBox& b = boxes[(i + j) % _numBoxes];
+                            refCount += linalg::all(linalg::lequal(a.minExtent, b.maxExtent)) && linalg::all(linalg::lequal(b.minExtent, a.maxExtent)) ? 1 : 0;
+                        }
+                    }
+                }
+            });
+
+            double ns = measureNs(numOps * window, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    count = 0;
+                    for (u32 i = 0; i < _numBoxes; ++i)
+                    {
+                        const BoxA a = BoxA::load(&boxes[i].minExtent);
+                        for (u32 j = 1; j <= window; ++j)
+                            count += boxOverlap(a, BoxA::load(&boxes[(i + j) % _numBoxes].minExtent)) ? 1 : 0;
+                    }
+                }
+            });
+
+            printRow("box overlap", refNs, ns, refCount == count);
+        }
+
+        // Per item work of BVHBuilder::fillSplitData: the child box grows by the item clipped to the split box,
+        // and the volume growth of both children is compared for the items straddling the split
+        {
+            const ScalarBox parent = { vec3(-100.f), vec3(110.f) };
+            const ScalarBox clip = { vec3(-100.f), vec3(0.f, 110.f, 110.f) };
+            const ScalarBox left = { vec3(-100.f), vec3(5.f, 110.f, 110.f) };
+            const ScalarBox right = { vec3(-5.f, -100.f, -100.f), vec3(110.f) };
+
+            auto splitUpdate = [&](auto _merge, auto _intersection, auto _volume, ScalarBox& _acc, float& _growth)
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    _acc = _intersection(boxes[0], clip);
+                    _growth = 0;
+                    for (u32 i = 1; i < _numBoxes; ++i)
+                    {
+                        _acc = _intersection(_merge(boxes[i], _acc), clip);
+                        _growth += _volume(_intersection(_merge(left, boxes[i]), parent)) - _volume(_intersection(_merge(right, boxes[i]), parent));
+                    }
+                }
+            };
+
+            ScalarBox refBox, box;
+            float refGrowth = 0, growth = 0;
+            // Lambdas rather than function pointers, so that both paths get their own inlined instantiation
+            double refNs = measureNs(numOps, [&]()
+            {
+                splitUpdate([](const ScalarBox& _b1, const ScalarBox& _b2) { return scalarMerge(_b1, _b2); },
+                            [](const ScalarBox& _b1, const ScalarBox& _b2) { return scalarIntersection(_b1, _b2); },
+                            [](const ScalarBox& _box) { return scalarVolume(_box); }, refBox, refGrowth);
+            });
+            double ns = measureNs(numOps, [&]()
+            {
+                splitUpdate([](const ScalarBox& _b1, const ScalarBox& _b2) { return wrappedMerge(_b1, _b2); },
+                            [](const ScalarBox& _b1, const ScalarBox& _b2) { return wrappedIntersection(_b1, _b2); },
+                            [](const ScalarBox& _box) { return wrappedVolume(_box); }, box, growth);
+            });
+            const bool match = refBox.minExtent == box.minExtent && refBox.maxExtent == box.maxExtent && refGrowth == growth;
+            printRow("split update, Box", refNs, ns, match);
+
+            // Same work with the child and split boxes kept in registers
+            ns = measureNs(numOps, [&]()
+            {
+                const BoxA parentA = BoxA::load(&parent.minExtent), clipA = BoxA::load(&clip.minExtent);
+                const BoxA leftA = BoxA::load(&left.minExtent), rightA = BoxA::load(&right.minExtent);
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    BoxA acc = intersectionBox(BoxA::load(&boxes[0].minExtent), clipA);
+                    growth = 0;
+                    for (u32 i = 1; i < _numBoxes; ++i)
+                    {
+                        const BoxA aabb = BoxA::load(&boxes[i].minExtent);
+                        acc = intersectionBox(mergeBox(aabb, acc), clipA);
+                        growth += getBoxVolume(intersectionBox(mergeBox(leftA, aabb), parentA)) - getBoxVolume(intersectionBox(mergeBox(rightA, aabb), parentA));
+                    }
+                    acc.store(&box.minExtent);
+                }
+            });
+            printRow("split update, BoxA", refNs, ns, refBox.minExtent == box.minExtent && refBox.maxExtent == box.maxExtent && refGrowth == growth);
+        }
+
+        // Slab test of a ray against every box, 4 and 8 boxes per test
+        {
+            std::vector<Box4> boxes4((_numBoxes + 3) / 4);
+            for (Box4& b : boxes4)
+                b.setEmpty();
+            for (u32 i = 0; i < _numBoxes; ++i)
+                boxes4[i / 4].set(i % 4, boxes[i].minExtent, boxes[i].maxExtent);
+
+            const RaySlab ray({ -150.f, 3.f, -2.f }, linalg::normalize(vec3{ 1.f, 0.02f, 0.01f }));
+            const float tMax = 1000.f;
+
+            u32 refHits = 0, hits = 0;
+            double refNs = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    refHits = 0;
+                    for (u32 i = 0; i < _numBoxes; ++i)
+                        refHits += scalarRayBox(ray, boxes[i], tMax) ? 1 : 0;
+                }
+            });
+
+            double ns = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    hits = 0;
+                    for (const Box4& b : boxes4)
+                        hits += u32(std::bitset<4>(intersectRayBox4(ray, b, tMax)).count());
+                }
+            });
+
+            printRow("ray box x4", refNs, ns, refHits == hits);
+
+#if TIM_SIMD >= 2
+            std::vector<Box8> boxes8((_numBoxes + 7) / 8);
+            for (Box8& b : boxes8)
+                b.setEmpty();
+            for (u32 i = 0; i < _numBoxes; ++i)
+                boxes8[i / 8].set(i % 8, boxes[i].minExtent, boxes[i].maxExtent);
+
+            ns = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    hits = 0;
+                    for (const Box8& b : boxes8)
+                        hits += u32(std::bitset<8>(intersectRayBox8(ray, b, tMax)).count());
+                }
+            });
+
+            printRow("ray box x8", refNs, ns, refHits == hits);
+#endif
+        }
+
+        // Point transform
+        {
+            const mat4 m = linalg::mul(linalg::translation_matrix(vec3{ 1.f, -2.f, 3.f }), linalg::rotation_matrix(linalg::rotation_quat(linalg::normalize(vec3{ 1.f, 1.f, 0.f }), 0.7f)));
+            const mat4a ma(m);
+
+            vec3 refSum = { 0, 0, 0 }, sum = { 0, 0, 0 };
+            double refNs = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    refSum = { 0, 0, 0 };
+                    for (u32 i = 0; i < _numBoxes; ++i)
+                        refSum += linalg::mul(m, vec4(points[i], 1.f)).xyz();
+                }
+            });
+
+            double ns = measureNs(numOps, [&]()
+            {
+                for (u32 it = 0; it < _numIterations; ++it)
+                {
+                    vec3a acc(vec3{ 0, 0, 0 });
+                    for (u32 i = 0; i < _numBoxes; ++i)
+                        acc = acc + transformPoint(ma, points[i]);
+                    sum = acc.toVec3();
+                }
+            });
+
+            printRow("transform point", refNs, ns, linalg::length(refSum - sum) <= 1e-4f * linalg::length(refSum));
+        }
+    }
+}
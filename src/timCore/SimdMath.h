@@ -0,0 +1,266 @@
+#pragma once
+#include "type.h"
+
+// Backend of the SIMD math layer: 0 scalar, 1 SSE, 2 AVX (8 wide box batches). Detected from the compiler flags unless defined by the build
+#ifndef TIM_SIMD
+    #if defined(__AVX__)
+        #define TIM_SIMD 2
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define TIM_SIMD 1
+    #else
+        #define TIM_SIMD 0
+    #endif
+#endif
+
+#if TIM_SIMD
+#include <immintrin.h>
+#endif
+
+namespace tim
+{
+    // 4 float lanes, the building block of the types below
+    struct alignas(16) float4a
+    {
+#if TIM_SIMD
+        __m128 m;
+#else
+        float m[4];
+#endif
+    };
+
+    namespace simd
+    {
+#if TIM_SIMD
+        inline float4a set(float _x, float _y, float _z, float _w) { return { _mm_set_ps(_w, _z, _y, _x) }; }
+        inline float4a splat(float _s) { return { _mm_set1_ps(_s) }; }
+        inline float4a loadu(const float* _ptr) { return { _mm_loadu_ps(_ptr) }; }
+        inline void storeu(float* _ptr, float4a _a) { _mm_storeu_ps(_ptr, _a.m); }
+
+        inline float4a add(float4a _a, float4a _b) { return { _mm_add_ps(_a.m, _b.m) }; }
+        inline float4a sub(float4a _a, float4a _b) { return { _mm_sub_ps(_a.m, _b.m) }; }
+        inline float4a mul(float4a _a, float4a _b) { return { _mm_mul_ps(_a.m, _b.m) }; }
+        inline float4a madd(float4a _a, float4a _b, float4a _c) { return { _mm_add_ps(_mm_mul_ps(_a.m, _b.m), _c.m) }; }
+        inline float4a min(float4a _a, float4a _b) { return { _mm_min_ps(_a.m, _b.m) }; }
+        inline float4a max(float4a _a, float4a _b) { return { _mm_max_ps(_a.m, _b.m) }; }
+
+        // One bit per lane
+        inline u32 lessEqualMask(float4a _a, float4a _b) { return u32(_mm_movemask_ps(_mm_cmple_ps(_a.m, _b.m))); }
+
+        template<u32 Lane> float4a splatLane(float4a _a) { return { _mm_shuffle_ps(_a.m, _a.m, _MM_SHUFFLE(Lane, Lane, Lane, Lane)) }; }
+        template<u32 Lane> float getLane(float4a _a) { return _mm_cvtss_f32(splatLane<Lane>(_a).m); }
+
+        // Two boxes stored as 6 contiguous floats (min then max), without reading past the last one
+        inline void loadBox(const float* _ptr, float4a& _min, float4a& _max)
+        {
+            _min.m = _mm_loadu_ps(_ptr);
+            __m128 tail = _mm_loadu_ps(_ptr + 2);
+            _max.m = _mm_shuffle_ps(tail, tail, _MM_SHUFFLE(3, 3, 2, 1));
+        }
+
+        inline void storeBox(float* _ptr, float4a _min, float4a _max)
+        {
+            __m128 zx = _mm_shuffle_ps(_min.m, _max.m, _MM_SHUFFLE(0, 0, 2, 2));
+            _mm_storeu_ps(_ptr, _mm_shuffle_ps(_min.m, zx, _MM_SHUFFLE(2, 0, 1, 0)));
+            _mm_storel_pi((__m64*)(_ptr + 4), _mm_shuffle_ps(_max.m, _max.m, _MM_SHUFFLE(3, 3, 2, 1)));
+        }
+#else
+        inline float4a set(float _x, float _y, float _z, float _w) { return { { _x, _y, _z, _w } }; }
+        inline float4a splat(float _s) { return { { _s, _s, _s, _s } }; }
+        inline float4a loadu(const float* _ptr) { return { { _ptr[0], _ptr[1], _ptr[2], _ptr[3] } }; }
+        inline void storeu(float* _ptr, float4a _a) { for (u32 i = 0; i < 4; ++i) _ptr[i] = _a.m[i]; }
+
+        template<typename Op> float4a apply(float4a _a, float4a _b, Op _op) { return { { _op(_a.m[0], _b.m[0]), _op(_a.m[1], _b.m[1]), _op(_a.m[2], _b.m[2]), _op(_a.m[3], _b.m[3]) } }; }
+        inline float4a add(float4a _a, float4a _b) { return apply(_a, _b, [](float x, float y) { return x + y; }); }
+        inline float4a sub(float4a _a, float4a _b) { return apply(_a, _b, [](float x, float y) { return x - y; }); }
+        inline float4a mul(float4a _a, float4a _b) { return apply(_a, _b, [](float x, float y) { return x * y; }); }
+        inline float4a madd(float4a _a, float4a _b, float4a _c) { return add(mul(_a, _b), _c); }
+        // Same operand order as minps/maxps so that NaN lanes resolve the same way on both backends
+        inline float4a min(float4a _a, float4a _b) { return apply(_a, _b, [](float x, float y) { return x < y ? x : y; }); }
+        inline float4a max(float4a _a, float4a _b) { return apply(_a, _b, [](float x, float y) { return x > y ? x : y; }); }
+
+        inline u32 lessEqualMask(float4a _a, float4a _b)
+        {
+            u32 mask = 0;
+            for (u32 i = 0; i < 4; ++i)
+                mask |= _a.m[i] <= _b.m[i] ? (1u << i) : 0;
+            return mask;
+        }
+
+        template<u32 Lane> float4a splatLane(float4a _a) { return splat(_a.m[Lane]); }
+        template<u32 Lane> float getLane(float4a _a) { return _a.m[Lane]; }
+
+        inline void loadBox(const float* _ptr, float4a& _min, float4a& _max)
+        {
+            _min = { { _ptr[0], _ptr[1], _ptr[2], _ptr[3] } };
+            _max = { { _ptr[3], _ptr[4], _ptr[5], _ptr[5] } };
+        }
+
+        inline void storeBox(float* _ptr, float4a _min, float4a _max)
+        {
+            for (u32 i = 0; i < 3; ++i)
+            {
+                _ptr[i] = _min.m[i];
+                _ptr[i + 3] = _max.m[i];
+            }
+        }
+#endif
+    }
+
+    // vec3 in a 16 bytes register, the w lane is undefined and ignored
+    struct vec3a
+    {
+        float4a v;
+
+        vec3a() = default;
+        explicit vec3a(float4a _v) : v{ _v } {}
+        vec3a(const vec3& _v) : v{ simd::set(_v.x, _v.y, _v.z, 0) } {}
+
+        float x() const { return simd::getLane<0>(v); }
+        float y() const { return simd::getLane<1>(v); }
+        float z() const { return simd::getLane<2>(v); }
+        vec3 toVec3() const { return { x(), y(), z() }; }
+    };
+
+    inline vec3a operator+(vec3a _a, vec3a _b) { return vec3a(simd::add(_a.v, _b.v)); }
+    inline vec3a operator-(vec3a _a, vec3a _b) { return vec3a(simd::sub(_a.v, _b.v)); }
+    inline vec3a operator*(vec3a _a, vec3a _b) { return vec3a(simd::mul(_a.v, _b.v)); }
+    inline vec3a min_(vec3a _a, vec3a _b) { return vec3a(simd::min(_a.v, _b.v)); }
+    inline vec3a max_(vec3a _a, vec3a _b) { return vec3a(simd::max(_a.v, _b.v)); }
+    inline bool allLessEqual(vec3a _a, vec3a _b) { return (simd::lessEqualMask(_a.v, _b.v) & 0x7) == 0x7; }
+
+    struct vec4a
+    {
+        float4a v;
+
+        vec4a() = default;
+        explicit vec4a(float4a _v) : v{ _v } {}
+        vec4a(const vec4& _v) : v{ simd::set(_v.x, _v.y, _v.z, _v.w) } {}
+
+        vec4 toVec4() const { float tmp[4]; simd::storeu(tmp, v); return { tmp[0], tmp[1], tmp[2], tmp[3] }; }
+    };
+
+    inline vec4a operator+(vec4a _a, vec4a _b) { return vec4a(simd::add(_a.v, _b.v)); }
+    inline vec4a operator-(vec4a _a, vec4a _b) { return vec4a(simd::sub(_a.v, _b.v)); }
+    inline vec4a operator*(vec4a _a, vec4a _b) { return vec4a(simd::mul(_a.v, _b.v)); }
+    inline vec4a min_(vec4a _a, vec4a _b) { return vec4a(simd::min(_a.v, _b.v)); }
+    inline vec4a max_(vec4a _a, vec4a _b) { return vec4a(simd::max(_a.v, _b.v)); }
+
+    // Column major like linalg
+    struct mat4a
+    {
+        float4a c[4];
+
+        mat4a() = default;
+        mat4a(const mat4& _m)
+        {
+            for (u32 i = 0; i < 4; ++i)
+                c[i] = simd::set(_m[i].x, _m[i].y, _m[i].z, _m[i].w);
+        }
+
+        mat4 toMat4() const
+        {
+            mat4 m;
+            for (u32 i = 0; i < 4; ++i)
+                m[i] = vec4a(c[i]).toVec4();
+            return m;
+        }
+    };
+
+    inline vec4a mul(const mat4a& _m, vec4a _v)
+    {
+        float4a r = simd::mul(_m.c[0], simd::splatLane<0>(_v.v));
+        r = simd::madd(_m.c[1], simd::splatLane<1>(_v.v), r);
+        r = simd::madd(_m.c[2], simd::splatLane<2>(_v.v), r);
+        r = simd::madd(_m.c[3], simd::splatLane<3>(_v.v), r);
+        return vec4a(r);
+    }
+
+    inline mat4a mul(const mat4a& _a, const mat4a& _b)
+    {
+        mat4a m;
+        for (u32 i = 0; i < 4; ++i)
+            m.c[i] = mul(_a, vec4a(_b.c[i])).v;
+        return m;
+    }
+
+    // Affine transform of a point, w = 1 and no perspective divide
+    inline vec3a transformPoint(const mat4a& _m, vec3a _p)
+    {
+        float4a r = simd::mul(_m.c[0], simd::splatLane<0>(_p.v));
+        r = simd::madd(_m.c[1], simd::splatLane<1>(_p.v), r);
+        r = simd::madd(_m.c[2], simd::splatLane<2>(_p.v), r);
+        return vec3a(simd::add(r, _m.c[3]));
+    }
+
+    // Register copy of a box stored as a min and a max vec3 next to each other (Box of the shaders)
+    struct BoxA
+    {
+        vec3a minExtent;
+        vec3a maxExtent;
+
+        BoxA() = default;
+        BoxA(vec3a _min, vec3a _max) : minExtent{ _min }, maxExtent{ _max } {}
+
+        static BoxA load(const vec3* _extents)
+        {
+            BoxA box;
+            simd::loadBox(&_extents[0].x, box.minExtent.v, box.maxExtent.v);
+            return box;
+        }
+
+        void store(vec3* _extents) const { simd::storeBox(&_extents[0].x, minExtent.v, maxExtent.v); }
+    };
+
+    inline BoxA mergeBox(const BoxA& _b1, const BoxA& _b2) { return { min_(_b1.minExtent, _b2.minExtent), max_(_b1.maxExtent, _b2.maxExtent) }; }
+    inline BoxA intersectionBox(const BoxA& _b1, const BoxA& _b2) { return { max_(_b1.minExtent, _b2.minExtent), min_(_b1.maxExtent, _b2.maxExtent) }; }
+
+    inline float getBoxVolume(const BoxA& _box)
+    {
+        vec3a dim = _box.maxExtent - _box.minExtent;
+        return dim.x() * dim.y() * dim.z();
+    }
+
+    // Touching boxes overlap
+    inline bool boxOverlap(const BoxA& _b1, const BoxA& _b2)
+    {
+        return allLessEqual(_b1.minExtent, _b2.maxExtent) && allLessEqual(_b2.minExtent, _b1.maxExtent);
+    }
+
+    // Ray prepared for the slab tests, the inverse direction may hold infinities
+    struct RaySlab
+    {
+        vec3 origin;
+        vec3 invDir;
+
+        RaySlab(const vec3& _origin, const vec3& _dir) : origin{ _origin }, invDir{ 1.f / _dir.x, 1.f / _dir.y, 1.f / _dir.z } {}
+    };
+
+    // 4 boxes in SoA layout for the batched slab test, unused lanes must be set empty so that they never hit
+    struct Box4
+    {
+        float4a minX, minY, minZ;
+        float4a maxX, maxY, maxZ;
+
+        void setEmpty();
+        void set(u32 _lane, const vec3& _min, const vec3& _max);
+    };
+
+    // Bit i set when the ray hits box i within [0, _tMax], _tNear receives the entry distances
+    u32 intersectRayBox4(const RaySlab& _ray, const Box4& _boxes, float _tMax, float4a* _tNear = nullptr);
+
+#if TIM_SIMD >= 2
+    struct Box8
+    {
+        __m256 minX, minY, minZ;
+        __m256 maxX, maxY, maxZ;
+
+        void setEmpty();
+        void set(u32 _lane, const vec3& _min, const vec3& _max);
+    };
+
+    u32 intersectRayBox8(const RaySlab& _ray, const Box8& _boxes, float _tMax);
+#endif
+
+    // Compare the scalar linalg path with this layer on the hot box and transform operations
+    void runSimdMathBenchmark(u32 _numBoxes, u32 _numIterations);
+}
@@ -0,0 +1,74 @@
+#include "ThreadPool.h"
+#include "Common.h"
+
+#include <algorithm>
+
+namespace tim
+{
+    ThreadPool::ThreadPool(u32 _numThreads)
+    {
+        if (_numThreads == 0)
+            _numThreads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+        m_workers.reserve(_numThreads);
+        for (u32 i = 0; i < _numThreads; ++i)
+            m_workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_exit = true;
+        }
+        m_jobAvailable.notify_all();
+
+        for (std::thread& worker : m_workers)
+            worker.join();
+    }
+
+    void ThreadPool::submit(Job _job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            TIM_ASSERT(!m_exit);
+            m_jobs.push_back(std::move(_job));
+        }
+        m_jobAvailable.notify_one();
+    }
+
+    void ThreadPool::waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this] { return m_jobs.empty() && m_numRunningJobs == 0; });
+    }
+
+    void ThreadPool::workerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobAvailable.wait(lock, [this] { return m_exit || !m_jobs.empty(); });
+
+                // pending jobs are still executed on exit
+                if (m_jobs.empty())
+                    return;
+
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+                m_numRunningJobs++;
+            }
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_numRunningJobs--;
+                if (m_jobs.empty() && m_numRunningJobs == 0)
+                    m_idle.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "type.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace tim
+{
+    // Fixed set of worker threads consuming a FIFO of jobs. Jobs must not wait on other jobs of the same pool.
+    class ThreadPool
+    {
+    public:
+        using Job = std::function<void()>;
+
+        // _numThreads == 0 uses std::thread::hardware_concurrency() - 1 (at least 1)
+        ThreadPool(u32 _numThreads = 0);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void submit(Job _job);
+        void waitIdle();
+
+        u32 getNumThreads() const { return u32(m_workers.size()); }
+
+    private:
+        void workerLoop();
+
+        std::vector<std::thread> m_workers;
+        std::deque<Job> m_jobs;
+        std::mutex m_mutex;
+        std::condition_variable m_jobAvailable;
+        std::condition_variable m_idle;
+        u32 m_numRunningJobs = 0;
+        bool m_exit = false;
+    };
+}
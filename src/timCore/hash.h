@@ -1,6 +1,7 @@
 #pragma once
 #include "type.h"
 #include <stdint.h>
+#include <string.h>
 #include <functional>
 
 namespace tim
@@ -33,6 +34,108 @@ namespace tim
         }
     }
 
+    // Runtime hash of a memory block, used to key on disk caches
+    inline uint64_t hash_64_fnv1a(const void* _data, size_t _size, uint64_t _value = detail::val_64_const) noexcept
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(_data);
+        for (size_t i = 0; i < _size; ++i)
+            _value = (_value ^ uint64_t(bytes[i])) * detail::prime_64_const;
+        return _value;
+    }
+
+    // Streaming MurmurHash3 x64 128 bits, the result only depends on the concatenation of the added blocks
+    class Hash128
+    {
+    public:
+        explicit Hash128(u64 _seed = 0) : m_h1{ _seed }, m_h2{ _seed } {}
+
+        void add(const void* _data, size_t _size)
+        {
+            const ubyte* bytes = static_cast<const ubyte*>(_data);
+            m_length += _size;
+
+            if (m_tailSize > 0)
+            {
+                const size_t count = _size < 16 - m_tailSize ? _size : 16 - m_tailSize;
+                memcpy(m_tail + m_tailSize, bytes, count);
+                m_tailSize += u32(count);
+                bytes += count;
+                _size -= count;
+
+                if (m_tailSize < 16)
+                    return;
+
+                mixBlock(m_tail);
+                m_tailSize = 0;
+            }
+
+            for (; _size >= 16; bytes += 16, _size -= 16)
+                mixBlock(bytes);
+
+            memcpy(m_tail, bytes, _size);
+            m_tailSize = u32(_size);
+        }
+
+        void get(u64 _hash[2]) const
+        {
+            u64 h1 = m_h1, h2 = m_h2;
+            u64 k1 = 0, k2 = 0;
+            for (u32 i = m_tailSize; i > 8; --i)
+                k2 |= u64(m_tail[i - 1]) << ((i - 9) * 8);
+            for (u32 i = m_tailSize < 8 ? m_tailSize : 8; i > 0; --i)
+                k1 |= u64(m_tail[i - 1]) << ((i - 1) * 8);
+
+            if (m_tailSize > 8)
+            {
+                k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+            }
+            if (m_tailSize > 0)
+            {
+                k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+            }
+
+            h1 ^= m_length; h2 ^= m_length;
+            h1 += h2; h2 += h1;
+            h1 = fmix(h1); h2 = fmix(h2);
+            h1 += h2; h2 += h1;
+
+            _hash[0] = h1;
+            _hash[1] = h2;
+        }
+
+    private:
+        static constexpr u64 c1 = 0x87c37b91114253d5ull;
+        static constexpr u64 c2 = 0x4cf5ad432745937full;
+
+        static u64 rotl(u64 _x, int _r) { return (_x << _r) | (_x >> (64 - _r)); }
+
+        static u64 fmix(u64 _k)
+        {
+            _k ^= _k >> 33; _k *= 0xff51afd7ed558ccdull;
+            _k ^= _k >> 33; _k *= 0xc4ceb9fe1a85ec53ull;
+            _k ^= _k >> 33;
+            return _k;
+        }
+
+        void mixBlock(const ubyte* _block)
+        {
+            u64 k1, k2;
+            memcpy(&k1, _block, 8);
+            memcpy(&k2, _block + 8, 8);
+
+            k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; m_h1 ^= k1;
+            m_h1 = rotl(m_h1, 27); m_h1 += m_h2; m_h1 = m_h1 * 5 + 0x52dce729;
+
+            k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; m_h2 ^= k2;
+            m_h2 = rotl(m_h2, 31); m_h2 += m_h1; m_h2 = m_h2 * 5 + 0x38495ab5;
+        }
+
+        u64 m_h1, m_h2;
+        u64 m_length = 0;
+        ubyte m_tail[16];
+        u32 m_tailSize = 0;
+    };
+
     #define TIM_HASH32(str) ::tim::detail::hash_32_fnv1a_const(#str)
     #define TIM_HASH32_STR(str) ::tim::detail::hash_32_fnv1a_const(str)
 